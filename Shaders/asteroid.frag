@@ -0,0 +1,18 @@
+#version 130
+precision mediump float;
+
+uniform sampler2D uTexture;
+uniform vec3      uSunPosition; //Camera-relative
+
+varying vec3  vary_normal;
+varying vec3  vary_position;
+varying vec2  UV;
+varying float vary_albedo;
+
+void main()
+{
+	vec3 toSun    = normalize(uSunPosition - vary_position);
+	float diffuse = max(dot(normalize(vary_normal), toSun), 0.0);
+	vec3 color    = texture2D(uTexture, UV).rgb * vary_albedo;
+	gl_FragColor  = vec4(color * (0.05 + 0.95*diffuse), 1.0);
+}
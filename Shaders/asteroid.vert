@@ -0,0 +1,39 @@
+#version 130
+precision mediump float;
+
+attribute vec3 vPosition;
+attribute vec3 vNormal;
+attribute vec2 Vuv;
+attribute vec4 iPositionSize; //Camera-relative center, diameter
+attribute vec4 iRotation;     //Axis, angle
+attribute vec4 iShape;        //Scale on each axis, albedo
+
+uniform mat4  uView;
+uniform mat4  uProjection;
+uniform float uLogDepthScale; //2 / log2(far + 1) in the logarithmic depth mode, 0 otherwise
+
+varying vec3  vary_normal;
+varying vec3  vary_position; //Camera-relative
+varying vec2  UV;
+varying float vary_albedo;
+
+//Rodrigues rotation around a unit axis
+vec3 rotate(vec3 v, vec3 axis, float angle)
+{
+	float c = cos(angle);
+	float s = sin(angle);
+	return v*c + cross(axis, v)*s + axis*dot(axis, v)*(1.0 - c);
+}
+
+void main()
+{
+	//The normals of a scaled mesh are scaled by the inverse
+	vary_normal   = rotate(normalize(vNormal / iShape.xyz), iRotation.xyz, iRotation.w);
+	vary_position = iPositionSize.xyz + rotate(vPosition * iShape.xyz, iRotation.xyz, iRotation.w) * iPositionSize.w;
+	vary_albedo   = iShape.w;
+	UV            = Vuv;
+
+	gl_Position = uProjection * uView * vec4(vary_position, 1.0);
+	if(uLogDepthScale > 0.0)
+		gl_Position.z = (log2(max(1e-6, 1.0 + gl_Position.w)) * uLogDepthScale - 1.0) * gl_Position.w;
+}
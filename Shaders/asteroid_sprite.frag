@@ -0,0 +1,16 @@
+#version 130
+precision mediump float;
+
+uniform sampler2D uTexture;
+
+varying float vary_intensity;
+
+void main()
+{
+	//Round points
+	vec2 d = gl_PointCoord * 2.0 - 1.0;
+	if(dot(d, d) > 1.0)
+		discard;
+	vec3 color   = texture2D(uTexture, gl_PointCoord).rgb;
+	gl_FragColor = vec4(color * vary_intensity, 1.0);
+}
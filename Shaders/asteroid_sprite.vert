@@ -0,0 +1,29 @@
+#version 130
+precision mediump float;
+
+attribute vec4 iPositionSize; //Camera-relative center, diameter
+
+uniform mat4  uView;
+uniform mat4  uProjection;
+uniform vec3  uSunPosition;   //Camera-relative
+uniform float uPointScale;    //Pixels covered by a diameter of 1 at a distance of 1
+uniform float uLogDepthScale; //2 / log2(far + 1) in the logarithmic depth mode, 0 otherwise
+
+varying float vary_intensity;
+
+void main()
+{
+	vec3 position = iPositionSize.xyz;
+	float dist    = max(length(position), 1e-6);
+	float pixels  = iPositionSize.w * uPointScale / dist;
+
+	//A point never goes below one pixel : dim it by the part of the pixel the rock really covers.
+	//The phase factor makes the rocks seen from the night side darker, like the lit fraction of a sphere
+	float phase    = 0.5 + 0.5*dot(normalize(uSunPosition - position), -position / dist);
+	vary_intensity = min(pixels*pixels, 1.0) * phase;
+	gl_PointSize   = max(pixels, 1.0);
+
+	gl_Position = uProjection * uView * vec4(position, 1.0);
+	if(uLogDepthScale > 0.0)
+		gl_Position.z = (log2(max(1e-6, 1.0 + gl_Position.w)) * uLogDepthScale - 1.0) * gl_Position.w;
+}
@@ -0,0 +1,162 @@
+#version 130
+precision mediump float;
+
+//Table sizes, see Atmosphere.h
+#define TRANSMITTANCE_WIDTH  256 //ATMOSPHERE_TRANSMITTANCE_WIDTH
+#define TRANSMITTANCE_HEIGHT 64  //ATMOSPHERE_TRANSMITTANCE_HEIGHT
+#define SCATTERING_NU        8   //ATMOSPHERE_SCATTERING_NU
+#define SCATTERING_MU_S      32  //ATMOSPHERE_SCATTERING_MU_S
+#define SCATTERING_MU        64  //ATMOSPHERE_SCATTERING_MU
+#define SCATTERING_R         16  //ATMOSPHERE_SCATTERING_R
+
+uniform vec4      uPlanet;             //Center and radius of the ground, world space
+uniform float     uTopRadius;          //The lengths below are in planet radii, the ground is at 1
+uniform float     uMuSMin;
+uniform vec3      uRayleighScattering;
+uniform vec3      uMieScattering;
+uniform float     uMieG;
+uniform vec3      uSunDirection;
+uniform float     uSunIntensity;
+uniform vec3      uCameraPosition;
+uniform mat4      uInvView;
+uniform sampler2D uTransmittance;
+uniform sampler3D uScattering;
+
+varying vec3 vary_view_position;
+
+const float PI = 3.14159265358979;
+
+float safeSqrt(float a)
+{
+	return sqrt(max(a, 0.0));
+}
+
+float distanceToTop(float r, float mu)
+{
+	return max(-r*mu + safeSqrt(r*r*(mu*mu - 1.0) + uTopRadius*uTopRadius), 0.0);
+}
+
+float distanceToBottom(float r, float mu)
+{
+	return max(-r*mu - safeSqrt(r*r*(mu*mu - 1.0) + 1.0), 0.0);
+}
+
+bool intersectsGround(float r, float mu)
+{
+	return mu < 0.0 && r*r*(mu*mu - 1.0) + 1.0 >= 0.0;
+}
+
+float coordFromUnitRange(float x, float size)
+{
+	return 0.5/size + x*(1.0 - 1.0/size);
+}
+
+vec3 transmittanceToTop(float r, float mu)
+{
+	float H    = safeSqrt(uTopRadius*uTopRadius - 1.0);
+	float rho  = safeSqrt(r*r - 1.0);
+	float d    = distanceToTop(r, mu);
+	float dMin = uTopRadius - r;
+	float dMax = rho + H;
+	vec2 uv    = vec2(coordFromUnitRange((d - dMin) / (dMax - dMin), float(TRANSMITTANCE_WIDTH)),
+	                  coordFromUnitRange(rho / H, float(TRANSMITTANCE_HEIGHT)));
+	return texture2D(uTransmittance, uv).rgb;
+}
+
+//Transmittance between the point at (r, mu) and the one at distance d along the ray
+vec3 transmittanceBetween(float r, float mu, float d, bool ground)
+{
+	float rd  = clamp(sqrt(d*d + 2.0*r*mu*d + r*r), 1.0, uTopRadius);
+	float mud = clamp((r*mu + d) / rd, -1.0, 1.0);
+	if(ground)
+		return min(transmittanceToTop(rd, -mud) / transmittanceToTop(r, -mu), vec3(1.0));
+	return min(transmittanceToTop(r, mu) / transmittanceToTop(rd, mud), vec3(1.0));
+}
+
+//Rayleigh in rgb, red channel of Mie in a. The two nu slices around nu are blended
+vec4 singleScattering(float r, float mu, float muS, float nu, bool ground)
+{
+	float H   = safeSqrt(uTopRadius*uTopRadius - 1.0);
+	float rho = safeSqrt(r*r - 1.0);
+	float uR  = coordFromUnitRange(rho / H, float(SCATTERING_R));
+
+	float rmu          = r * mu;
+	float discriminant = rmu*rmu - r*r + 1.0;
+	float uMu;
+	if(ground)
+	{
+		float d    = -rmu - safeSqrt(discriminant);
+		float dMin = r - 1.0;
+		float dMax = rho;
+		uMu = 0.5 - 0.5 * coordFromUnitRange(dMax == dMin ? 0.0 : (d - dMin) / (dMax - dMin), float(SCATTERING_MU / 2));
+	}
+	else
+	{
+		float d    = -rmu + safeSqrt(discriminant + H*H);
+		float dMin = uTopRadius - r;
+		float dMax = rho + H;
+		uMu = 0.5 + 0.5 * coordFromUnitRange((d - dMin) / (dMax - dMin), float(SCATTERING_MU / 2));
+	}
+
+	float d    = distanceToTop(1.0, muS);
+	float dMin = uTopRadius - 1.0;
+	float dMax = H;
+	float a    = (d - dMin) / (dMax - dMin);
+	float A    = (distanceToTop(1.0, uMuSMin) - dMin) / (dMax - dMin);
+	float uMuS = coordFromUnitRange(max(1.0 - a / A, 0.0) / (1.0 + a), float(SCATTERING_MU_S));
+
+	float x     = (nu + 1.0) * 0.5 * float(SCATTERING_NU - 1);
+	float slice = floor(x);
+	vec4 s0 = texture3D(uScattering, vec3((slice + uMuS) / float(SCATTERING_NU), uMu, uR));
+	vec4 s1 = texture3D(uScattering, vec3((min(slice + 1.0, float(SCATTERING_NU - 1)) + uMuS) / float(SCATTERING_NU), uMu, uR));
+	return mix(s0, s1, x - slice);
+}
+
+//Only the red channel of Mie is stored. The others follow the ratios of the Rayleigh channels and of the coefficients
+vec3 extrapolateMie(vec4 scattering)
+{
+	if(scattering.r <= 0.0)
+		return vec3(0.0);
+	return scattering.rgb * scattering.a / scattering.r * (uRayleighScattering.r / uMieScattering.r) * (uMieScattering / uRayleighScattering);
+}
+
+float rayleighPhase(float nu)
+{
+	return 3.0 / (16.0 * PI) * (1.0 + nu*nu);
+}
+
+float miePhase(float g, float nu)
+{
+	float k = 3.0 / (8.0 * PI) * (1.0 - g*g) / (2.0 + g*g);
+	return k * (1.0 + nu*nu) / pow(1.0 + g*g - 2.0*g*nu, 1.5);
+}
+
+void main()
+{
+	vec3 position = (uCameraPosition - uPlanet.xyz) / uPlanet.w;
+	vec3 view     = normalize(mat3(uInvView) * vary_view_position);
+
+	//Start at the camera, or where the view ray enters the atmosphere
+	float r   = max(length(position), 1.0);
+	float rmu = dot(position, view);
+	if(r > uTopRadius)
+	{
+		float discriminant = rmu*rmu - r*r + uTopRadius*uTopRadius;
+		if(discriminant < 0.0 || rmu > 0.0)
+			discard;
+		position += view * (-rmu - sqrt(discriminant));
+		r   = uTopRadius;
+		rmu = dot(position, view);
+	}
+	float mu  = clamp(rmu / r, -1.0, 1.0);
+	float muS = clamp(dot(position, uSunDirection) / r, -1.0, 1.0);
+	float nu  = clamp(dot(view, uSunDirection), -1.0, 1.0);
+	bool ground = intersectsGround(r, mu);
+
+	vec4 scattering = singleScattering(r, mu, muS, nu, ground);
+	vec3 color = uSunIntensity * (scattering.rgb * rayleighPhase(nu) + extrapolateMie(scattering) * miePhase(uMieG, nu));
+
+	//What is behind is seen through the whole atmosphere, or down to the ground
+	vec3 transmittance = ground ? transmittanceBetween(r, mu, distanceToBottom(r, mu), true) : transmittanceToTop(r, mu);
+	gl_FragColor = vec4(color, dot(transmittance, vec3(1.0 / 3.0)));
+}
@@ -0,0 +1,42 @@
+#version 130
+precision mediump float;
+
+uniform vec4  uPlanet;     //Center and radius of the ground, world space
+uniform float uTopRadius;  //Top of the atmosphere, in planet radii
+uniform mat4  uView;
+uniform mat4  uProjection;
+uniform mat4  uInvProjection;
+uniform float uNearDepth;     //NDC depth of the near plane : -1, or 1 in reversed-Z
+uniform float uLogDepthScale; //2 / log2(far + 1) in the logarithmic depth mode, 0 otherwise
+
+varying vec3 vary_view_position;
+
+void main()
+{
+	//Triangle strip corners from gl_VertexID, same order as the impostor quad
+	vec2 corner  = vec2(float(gl_VertexID & 1), float((gl_VertexID >> 1) & 1)) * 2.0 - 1.0;
+	vec3 center  = (uView * vec4(uPlanet.xyz, 1.0)).xyz;
+	float radius = uPlanet.w * uTopRadius;
+	float dist   = length(center);
+
+	//From inside the atmosphere every pixel looks through it : full-screen quad on the near plane
+	if(dist < radius * 1.01)
+	{
+		vec4 position = uInvProjection * vec4(corner, uNearDepth, 1.0);
+		vary_view_position = position.xyz / position.w;
+		gl_Position = vec4(corner, uNearDepth, 1.0);
+		return;
+	}
+
+	//Otherwise the quad of the impostors, pushed to the front of the atmosphere and just big enough to cover it
+	vec3 w      = center / dist;
+	vec3 up     = abs(w.y) > 0.99 ? vec3(1.0, 0.0, 0.0) : vec3(0.0, 1.0, 0.0);
+	vec3 u      = normalize(cross(w, up));
+	vec3 v      = cross(u, w);
+	float halfSize = (dist - radius) * radius / sqrt(max(dist*dist - radius*radius, 1e-8));
+
+	vary_view_position = center - w*radius + (u*corner.x + v*corner.y) * halfSize;
+	gl_Position = uProjection * vec4(vary_view_position, 1.0);
+	if(uLogDepthScale > 0.0)
+		gl_Position.z = (log2(max(1e-6, 1.0 + gl_Position.w)) * uLogDepthScale - 1.0) * gl_Position.w;
+}
@@ -1,4 +1,4 @@
-#version 120
+#version 130
 precision mediump float;
 
 attribute vec3 vPosition;
@@ -7,6 +7,9 @@ attribute vec2 Vuv;
 uniform mat4 uMVP;
 uniform mat4 uModel;
 uniform mat3 uInvModel3x3;
+#if DEPTH_MODE == 2
+uniform float uLogDepthScale; //2 / log2(far + 1)
+#endif
 
 varying vec3 vary_normal;
 varying vec4 vary_world_position;
@@ -15,9 +18,15 @@ varying vec2 UV;
 void main()
 {
 	gl_Position = uMVP*vec4(vPosition, 1.0);
+#if DEPTH_MODE == 2
+	//Logarithmic depth, premultiplied by w to survive the perspective division
+	gl_Position.z = (log2(max(1e-6, 1.0 + gl_Position.w)) * uLogDepthScale - 1.0) * gl_Position.w;
+#endif
+#if NUM_LIGHTS > 0 || CLUSTERED
 	vary_normal = transpose(uInvModel3x3) * vNormal;
 	
 	vary_world_position = uModel * vec4(vPosition, 1.0);
 	vary_world_position = vary_world_position / vary_world_position.w; //Normalization from w
+#endif
 	UV=Vuv;
 }
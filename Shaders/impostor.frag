@@ -0,0 +1,169 @@
+#version 130
+precision mediump float;
+
+uniform vec3 uMtlColor;
+uniform vec4 uMtlCts;
+#if NUM_LIGHTS > 0
+uniform vec3 uLightPos[NUM_LIGHTS];
+uniform vec3 uLightColor[NUM_LIGHTS];
+#endif
+#if CLUSTERED
+uniform usampler2D uClusterGrid;   //offset, count per cluster. x = tile, y = depth slice
+uniform usampler2D uLightIndices;  //light indices of the clusters
+uniform sampler2D  uLights;        //two texels per light : position and radius, color
+uniform vec4       uClusterParams; //tile width, tile height (pixels), depth slice scale, bias
+uniform ivec3      uClusterCount;
+#endif
+uniform vec3 uCameraPosition;
+uniform sampler2D uTexture;
+uniform mat4 uProjection;
+uniform mat4 uInvView;
+uniform mat3 uInvModel3x3;
+#if DEPTH_MODE == 2
+uniform float uLogDepthScale; //2 / log2(far + 1)
+#endif
+
+varying vec3 vary_view_position;
+varying vec3 vary_view_center;
+varying float vary_radius;
+
+const float PI = 3.14159265358979;
+
+#if ECLIPSES
+#define MAX_OCCLUDERS 4 //ECLIPSE_MAX_OCCLUDERS
+uniform int  uEclipseLight;       //The light the occluders hide, index in the clusters
+uniform vec4 uEclipseLightSphere; //Its center and radius
+uniform vec4 uOccluders[MAX_OCCLUDERS];
+uniform int  uNbOccluders;
+
+//Area of the intersection of two disks of radii r1, r2 whose centers are d apart
+float diskOverlap(float r1, float r2, float d)
+{
+	if(d >= r1 + r2)
+		return 0.0;
+	if(d <= abs(r1 - r2))
+		return PI * min(r1, r2) * min(r1, r2);
+	float a1 = r1*r1 * acos(clamp((d*d + r1*r1 - r2*r2) / (2.0*d*r1), -1.0, 1.0));
+	float a2 = r2*r2 * acos(clamp((d*d + r2*r2 - r1*r1) / (2.0*d*r2), -1.0, 1.0));
+	return a1 + a2 - 0.5 * sqrt(max((-d+r1+r2) * (d+r1-r2) * (d-r1+r2) * (d+r1+r2), 0.0));
+}
+
+//Fraction of the light disk seen from "position" that the occluders do not hide. Angular radii are treated as flat disks
+float eclipseVisibility(vec3 position)
+{
+	vec3  toLight      = uEclipseLightSphere.xyz - position;
+	float lightDist    = length(toLight);
+	float lightAngle   = asin(min(uEclipseLightSphere.w / lightDist, 1.0));
+	float visibility   = 1.0;
+	for(int i = 0; i < uNbOccluders; i++)
+	{
+		vec3  toOccluder    = uOccluders[i].xyz - position;
+		float occluderDist  = length(toOccluder);
+		if(occluderDist <= uOccluders[i].w)
+			continue;
+		float occluderAngle = asin(uOccluders[i].w / occluderDist);
+		float separation    = acos(clamp(dot(toLight, toOccluder) / (lightDist * occluderDist), -1.0, 1.0));
+		visibility -= diskOverlap(lightAngle, occluderAngle, separation) / (PI * lightAngle * lightAngle);
+	}
+	return max(visibility, 0.0);
+}
+#endif
+
+//Phong lighting of one light, scaled by its attenuation. "visibility" is the part of the light that is not eclipsed
+vec3 shadeLight(vec3 color, vec3 normal, vec3 V, vec3 position, vec3 lightPos, vec3 lightColor, float attenuation, float visibility)
+{
+	vec3 lightDir = normalize(lightPos - position);
+	vec3 R        = reflect(-lightDir, normal);
+	vec3 ambient  = uMtlCts.x * color * lightColor;
+	vec3 diffuse  = uMtlCts.y * max(0.0, dot(normal, lightDir)) * color * lightColor;
+	vec3 specular = uMtlCts.z * pow(max(0.0, dot(R, V)), uMtlCts.w) * lightColor;
+	return attenuation * (ambient + visibility * (diffuse + specular));
+}
+
+#if CLUSTERED
+//Lights of the cluster of the fragment. Each one fades out over the last tenth of its radius
+vec3 shadeClustered(vec3 color, vec3 normal, vec3 V, vec3 position, float viewDepth)
+{
+	int   slice   = clamp(int(log(viewDepth) * uClusterParams.z + uClusterParams.w), 0, uClusterCount.z-1);
+	ivec2 tile    = clamp(ivec2(gl_FragCoord.xy / uClusterParams.xy), ivec2(0), uClusterCount.xy-1);
+	uvec2 cluster = texelFetch(uClusterGrid, ivec2(tile.x + tile.y*uClusterCount.x, slice), 0).xy;
+	int   width   = textureSize(uLightIndices, 0).x;
+
+	vec3 result = vec3(0.0);
+	for(int i = 0; i < int(cluster.y); i++)
+	{
+		int index      = int(cluster.x) + i;
+		int light      = int(texelFetch(uLightIndices, ivec2(index % width, index / width), 0).r);
+		vec4 posRadius = texelFetch(uLights, ivec2(2*light, 0), 0);
+		vec3 lightColor = texelFetch(uLights, ivec2(2*light+1, 0), 0).rgb;
+		float attenuation = clamp((posRadius.w - length(posRadius.xyz - position)) / (0.1 * posRadius.w), 0.0, 1.0);
+#if ECLIPSES
+		float visibility = (light == uEclipseLight) ? eclipseVisibility(position) : 1.0;
+#else
+		float visibility = 1.0;
+#endif
+		result += shadeLight(color, normal, V, position, posRadius.xyz, lightColor, attenuation, visibility);
+	}
+	return result;
+}
+#endif
+
+void main()
+{
+	//Ray from the camera (origin of the view space) against the sphere
+	vec3 dir    = normalize(vary_view_position);
+	float b     = dot(dir, vary_view_center);
+	float disc  = b*b - dot(vary_view_center, vary_view_center) + vary_radius*vary_radius;
+	if(disc < 0.0)
+		discard;
+	vec3 viewPos = dir * (b - sqrt(disc));
+
+	vec4 clipPos = uProjection * vec4(viewPos, 1.0);
+#if DEPTH_MODE == 1
+	gl_FragDepth = clipPos.z / clipPos.w; //[0, 1] clip range
+#elif DEPTH_MODE == 2
+	gl_FragDepth = 0.5 * log2(max(1e-6, 1.0 + clipPos.w)) * uLogDepthScale;
+#else
+	gl_FragDepth = 0.5 * clipPos.z / clipPos.w + 0.5;
+#endif
+
+	vec3 worldPos    = (uInvView * vec4(viewPos, 1.0)).xyz;
+	vec3 worldCenter = (uInvView * vec4(vary_view_center, 1.0)).xyz;
+	vec3 normal      = normalize(worldPos - worldCenter);
+
+	//Same parametrization as the Sphere mesh : uv = (theta/2pi, phi/pi)
+	vec3 local = normalize(uInvModel3x3 * (worldPos - worldCenter));
+	float theta = atan(local.x, local.z);
+	if(theta < 0.0)
+		theta += 2.0*PI;
+	vec2 UV = vec2(theta / (2.0*PI), acos(clamp(local.y, -1.0, 1.0)) / PI);
+
+#if TEXTURED
+	vec3 color    = texture2D(uTexture, UV).rgb;
+#else
+	vec3 color    = uMtlColor;
+#endif
+
+#if UNLIT_SKY
+	gl_FragColor  = vec4(color, 1.0);
+#elif CLUSTERED
+	vec3 V        = normalize(uCameraPosition - worldPos);
+	gl_FragColor  = vec4(shadeClustered(color, normal, V, worldPos, -viewPos.z), 1.0);
+#elif EMISSIVE || NUM_LIGHTS == 0
+	gl_FragColor  = vec4(uMtlCts.x * color, 1.0);
+#else
+	vec3 V        = normalize(uCameraPosition - worldPos);
+	vec3 result   = vec3(0.0);
+	for(int i = 0; i < NUM_LIGHTS; i++)
+	{
+		//Without clusters the eclipsed light is the first one
+#if ECLIPSES
+		float visibility = (i == 0) ? eclipseVisibility(worldPos) : 1.0;
+#else
+		float visibility = 1.0;
+#endif
+		result += shadeLight(color, normal, V, worldPos, uLightPos[i], uLightColor[i], 1.0, visibility);
+	}
+	gl_FragColor  = vec4(result, 1.0);
+#endif
+}
@@ -0,0 +1,31 @@
+#version 130
+precision mediump float;
+
+attribute vec2 vCorner;
+uniform mat4 uModel;
+uniform mat4 uView;
+uniform mat4 uProjection;
+
+varying vec3 vary_view_position;
+varying vec3 vary_view_center;
+varying float vary_radius;
+
+void main()
+{
+	//The Sphere mesh has a radius of 0.5 before the model matrix
+	vec3 center   = (uView * uModel * vec4(0.0, 0.0, 0.0, 1.0)).xyz;
+	float radius  = 0.5 * max(length(uModel[0].xyz), max(length(uModel[1].xyz), length(uModel[2].xyz)));
+
+	//Quad facing the camera, pushed to the front of the sphere and just big enough to cover its silhouette
+	float dist  = length(center);
+	vec3 w      = center / dist;
+	vec3 up     = abs(w.y) > 0.99 ? vec3(1.0, 0.0, 0.0) : vec3(0.0, 1.0, 0.0);
+	vec3 u      = normalize(cross(w, up));
+	vec3 v      = cross(u, w);
+	float halfSize = (dist - radius) * radius / sqrt(max(dist*dist - radius*radius, 1e-8));
+
+	vary_view_position = center - w*radius + (u*vCorner.x + v*vCorner.y) * halfSize;
+	vary_view_center   = center;
+	vary_radius        = radius;
+	gl_Position = uProjection * vec4(vary_view_position, 1.0);
+}
@@ -0,0 +1,47 @@
+#version 130
+precision mediump float;
+
+//Attributeless version of the Sphere mesh : every vertex is rebuilt from gl_VertexID.
+//Same math as Sphere::getGridPoint, Sphere::getGridPosition and Sphere::getGridUV : keep them in sync.
+uniform int uNbLatitude;
+uniform int uNbLongitude;
+uniform mat4 uMVP;
+uniform mat4 uModel;
+uniform mat3 uInvModel3x3;
+#if DEPTH_MODE == 2
+uniform float uLogDepthScale; //2 / log2(far + 1)
+#endif
+
+varying vec3 vary_normal;
+varying vec4 vary_world_position;
+varying vec2 UV;
+
+const float PI = 3.14159265358979;
+const ivec2 QUAD_CORNERS[6] = ivec2[6](ivec2(0, 0), ivec2(1, 1), ivec2(1, 0),
+                                       ivec2(0, 0), ivec2(0, 1), ivec2(1, 1));
+
+void main()
+{
+	int quad   = gl_VertexID / 6;
+	int corner = gl_VertexID - 6*quad;
+	int i = (quad / (uNbLatitude-1) + QUAD_CORNERS[corner].x) % uNbLongitude;
+	int j = (quad % (uNbLatitude-1) + QUAD_CORNERS[corner].y) % uNbLatitude;
+
+	float theta = 2.0*PI/float(uNbLongitude-1) * float(i);
+	float phi   = PI/float(uNbLatitude-1) * float(j);
+	vec3 vPosition = 0.5 * vec3(sin(phi)*sin(theta), cos(phi), cos(theta)*sin(phi));
+	vec3 vNormal   = normalize(vPosition);
+
+	gl_Position = uMVP*vec4(vPosition, 1.0);
+#if DEPTH_MODE == 2
+	//Logarithmic depth, premultiplied by w to survive the perspective division
+	gl_Position.z = (log2(max(1e-6, 1.0 + gl_Position.w)) * uLogDepthScale - 1.0) * gl_Position.w;
+#endif
+#if NUM_LIGHTS > 0 || CLUSTERED
+	vary_normal = transpose(uInvModel3x3) * vNormal;
+
+	vary_world_position = uModel * vec4(vPosition, 1.0);
+	vary_world_position = vary_world_position / vary_world_position.w; //Normalization from w
+#endif
+	UV = vec2(float(i)/float(uNbLongitude), float(j)/float(uNbLatitude));
+}
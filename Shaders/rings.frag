@@ -0,0 +1,41 @@
+#version 130
+precision mediump float;
+
+uniform sampler2D uOpacity;     //Single channel, from the inner (u = 0) to the outer edge (u = 1)
+uniform vec4      uPlanet;
+uniform mat3      uOrientation;
+uniform vec2      uRadii;
+uniform vec3      uColor;
+uniform vec3      uSunPosition;  //Camera-relative
+uniform vec2      uParticleCenter; //Center of the disk of particles, (x, z) in the frame of the rings
+uniform vec2      uParticleFade; //Level of detail of the particles (0 without them), radius of the disk they fill
+
+varying vec3 vary_position;
+varying vec3 vary_local;
+
+void main()
+{
+	float radius = length(vary_local.xz);
+	if(radius < uRadii.x || radius > uRadii.y)
+		discard;
+	float alpha = texture2D(uOpacity, vec2((radius - uRadii.x) / (uRadii.y - uRadii.x), 0.5)).r;
+
+	//Thinner where the particles are drawn
+	float closeness = 1.0 - smoothstep(0.5 * uParticleFade.y, uParticleFade.y, distance(vary_local.xz, uParticleCenter));
+	alpha *= 1.0 - 0.8 * uParticleFade.x * closeness;
+
+	//The side facing the star is lit, the other one only gets the light going through
+	vec3 toSun     = normalize(uSunPosition - vary_position);
+	vec3 normal    = uOrientation[1];
+	float sunSide  = dot(normal, toSun);
+	float viewSide = dot(normal, -vary_position);
+	float light    = abs(sunSide) * (sunSide * viewSide >= 0.0 ? 1.0 : 0.3 * (1.0 - alpha));
+
+	//Shadow of the planet, with a soft edge
+	vec3 toCenter = uPlanet.xyz - vary_position;
+	float along   = dot(toCenter, toSun);
+	if(along > 0.0)
+		light *= smoothstep(0.95, 1.0, sqrt(max(dot(toCenter, toCenter) - along * along, 0.0)) / uPlanet.w);
+
+	gl_FragColor = vec4(uColor * (0.03 + light), alpha);
+}
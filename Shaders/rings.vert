@@ -0,0 +1,27 @@
+#version 130
+precision mediump float;
+
+uniform vec4  uPlanet;       //Camera-relative center, radius
+uniform mat3  uOrientation;  //Axes of the planet : the rings are in the (x, z) plane
+uniform vec2  uRadii;        //Inner and outer radii, in planet radii
+uniform int   uNbSegments;
+uniform mat4  uView;
+uniform mat4  uProjection;
+uniform float uLogDepthScale; //2 / log2(far + 1) in the logarithmic depth mode, 0 otherwise
+
+varying vec3 vary_position; //Camera-relative
+varying vec3 vary_local;    //In the frame of the rings, in planet radii
+
+void main()
+{
+	//Triangle strip from gl_VertexID : even vertices on the inner edge, odd ones on the outer edge.
+	//The outer polygon goes around the circle and the inner one inside it, the fragments cut the exact edges
+	float angle  = float(gl_VertexID >> 1) * 6.28318530718 / float(uNbSegments);
+	float radius = (gl_VertexID & 1) == 1 ? uRadii.y / cos(3.14159265359 / float(uNbSegments)) : uRadii.x;
+	vary_local    = vec3(cos(angle), 0.0, sin(angle)) * radius;
+	vary_position = uPlanet.xyz + uOrientation * vary_local * uPlanet.w;
+
+	gl_Position = uProjection * uView * vec4(vary_position, 1.0);
+	if(uLogDepthScale > 0.0)
+		gl_Position.z = (log2(max(1e-6, 1.0 + gl_Position.w)) * uLogDepthScale - 1.0) * gl_Position.w;
+}
@@ -0,0 +1,11 @@
+#version 130
+precision mediump float;
+
+uniform samplerCube uSkybox;
+
+varying vec3 vary_direction;
+
+void main()
+{
+	gl_FragColor = vec4(textureCube(uSkybox, vary_direction).rgb, 1.0);
+}
@@ -0,0 +1,16 @@
+#version 130
+precision mediump float;
+
+uniform mat4 uInvViewProjection; //Inverse of projection * view without the view translation
+uniform float uFarDepth;         //NDC depth of the far plane : 1, or 0 in reversed-Z
+
+varying vec3 vary_direction;
+
+void main()
+{
+	//Full-screen triangle from gl_VertexID, on the far plane
+	vec2 ndc = vec2(float((gl_VertexID & 1) << 2) - 1.0, float((gl_VertexID & 2) << 1) - 1.0);
+	vec4 world = uInvViewProjection * vec4(ndc, 1.0, 1.0);
+	vary_direction = world.xyz / world.w;
+	gl_Position = vec4(ndc, uFarDepth, 1.0);
+}
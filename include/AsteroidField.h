@@ -0,0 +1,126 @@
+#ifndef  ASTEROIDFIELD_INC
+#define  ASTEROIDFIELD_INC
+
+#include <stdint.h>
+#include <vector>
+#include <glm/glm.hpp>
+
+/* Buckets of the distance histogram that picks the asteroids drawn as meshes, over [0, meshDistance] */
+#define ASTEROID_DISTANCE_BUCKETS 256
+/* Asteroids per job of the update and of the selection */
+#define ASTEROID_BATCH_SIZE 16384
+
+/* \brief The distributions an asteroid field is generated from. Lengths are in scene units, angles in radians */
+struct AsteroidFieldParameters
+{
+    uint32_t count             = 1000000;
+    uint32_t seed              = 1;
+    float    innerRadius       = 4.4f;   /*!< Smallest semi-major axis, uniform up to outerRadius*/
+    float    outerRadius       = 4.7f;
+    float    eccentricitySigma = 0.03f;  /*!< The eccentricities and inclinations follow Rayleigh distributions*/
+    float    inclinationSigma  = 0.04f;
+    float    maxEccentricity   = 0.08f;  /*!< The orbits use the first order expansion in e : keep it small. Also keeps the belt between Mars and Jupiter*/
+    float    minSize           = 0.002f; /*!< Diameter of the smallest rocks. The sizes follow a power law, many more small ones*/
+    float    maxSize           = 0.02f;
+    float    sizeExponent      = 2.5f;   /*!< Slope of the cumulative size distribution N(> D) ~ D^-sizeExponent*/
+    double   gravity           = 58.0;   /*!< G * M of the star : the mean motion is sqrt(gravity / a^3)*/
+    float    meshDistance      = 1.0f;   /*!< Farther asteroids are always sprites*/
+    uint32_t meshBudget        = 20000;  /*!< Most asteroids drawn as meshes per frame, the closest ones*/
+};
+
+/* \brief An asteroid drawn as a mesh. The rotation and the shape come from a hash of its index, so they are not stored */
+struct AsteroidInstance
+{
+    glm::vec4 positionSize; /*!< Camera-relative position, diameter*/
+    glm::vec4 rotation;     /*!< Axis, angle*/
+    glm::vec4 shape;        /*!< Scale of the rock mesh on each axis, albedo*/
+};
+
+/* \brief A belt of many small bodies around a star, far more than one objet each can handle.
+ * The orbits are kept as structure of arrays and moved 4 at a time (Float4) on the job threads, with the epicycle approximation
+ * of nearly circular orbits (first order in the eccentricity) instead of the Kepler equation.
+ * Each frame, the visible asteroids are split in two : the closest ones up to the mesh budget, drawn as instanced rocks, and the others, drawn as point sprites. */
+class AsteroidField
+{
+    public:
+        /* \brief Constructor. Generate the asteroids
+         * \param params the distributions */
+        AsteroidField(const AsteroidFieldParameters& params = AsteroidFieldParameters());
+
+        /* \brief Get the number of asteroids
+         * \return the number of asteroids */
+        uint32_t getNbAsteroids() const {return m_params.count;}
+
+        /* \brief Change how many asteroids are drawn as meshes. Takes effect at the next cull
+         * \param budget the largest number of meshes */
+        void setMeshBudget(uint32_t budget) {m_params.meshBudget = budget;}
+
+        /* \brief Get the settings
+         * \return the parameters */
+        const AsteroidFieldParameters& getParameters() const {return m_params;}
+
+        /* \brief Move every asteroid to its position at a date
+         * \param t the date. The mean anomalies are reduced in double, so t can grow for a long time */
+        void update(double t);
+
+        /* \brief Build the instances of the frame from the positions of the last update : frustum culling, then the meshBudget closest asteroids become meshes
+         * \param camera the camera position, in the frame of the field (the star at the origin)
+         * \param view the camera rotation
+         * \param projection the camera projection matrix
+         * \param t the date, for the rotation of the rocks */
+        void cull(const glm::dvec3& camera, const glm::mat4& view, const glm::mat4& projection, double t);
+
+        /* \brief Get the position of an asteroid computed by the last update
+         * \param asteroidID its index
+         * \return the position, relative to the star */
+        glm::vec3 getPosition(uint32_t asteroidID) const {return glm::vec3(m_x[asteroidID], m_y[asteroidID], m_z[asteroidID]);}
+
+        /* \brief Get the asteroids to draw as meshes, found by the last cull
+         * \return the instances */
+        const std::vector<AsteroidInstance>& getMeshInstances() const {return m_meshInstances;}
+
+        /* \brief Get the asteroids to draw as sprites, found by the last cull
+         * \return the camera-relative positions and the diameters */
+        const std::vector<glm::vec4>& getSprites() const {return m_sprites;}
+
+        /* \brief Get the distance below which the last cull drew meshes. Below meshDistance when the budget is reached
+         * \return the distance */
+        float getLastMeshDistance() const {return m_lastMeshDistance;}
+
+        /* \brief Get the CPU time of the last update
+         * \return the time in milliseconds */
+        double getLastUpdateTime() const {return m_lastUpdateTime;}
+
+        /* \brief Get the CPU time of the last cull
+         * \return the time in milliseconds */
+        double getLastCullTime() const {return m_lastCullTime;}
+
+    private:
+        AsteroidFieldParameters m_params;
+
+        /* The orbits, padded to a multiple of 4 with asteroids of size 0 */
+        std::vector<float> m_semiMajorAxis;
+        std::vector<float> m_eccentricity;
+        std::vector<float> m_meanAnomaly;      /*!< At t = 0*/
+        std::vector<float> m_meanMotion;
+        std::vector<float> m_perihelion;       /*!< Longitude of the periapsis*/
+        std::vector<float> m_cosNode;
+        std::vector<float> m_sinNode;
+        std::vector<float> m_sinInclination;
+        std::vector<float> m_size;
+
+        std::vector<float> m_x;
+        std::vector<float> m_y;
+        std::vector<float> m_z;
+        std::vector<float> m_distance;         /*!< Distance to the camera of the last cull, negative when culled*/
+
+        std::vector<uint32_t>         m_histograms; /*!< ASTEROID_DISTANCE_BUCKETS per batch*/
+        std::vector<AsteroidInstance> m_meshInstances;
+        std::vector<glm::vec4>        m_sprites;
+
+        float  m_lastMeshDistance = 0.0f;
+        double m_lastUpdateTime = 0.0;
+        double m_lastCullTime = 0.0;
+};
+
+#endif
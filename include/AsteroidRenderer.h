@@ -0,0 +1,68 @@
+#ifndef  ASTEROIDRENDERER_INC
+#define  ASTEROIDRENDERER_INC
+
+#include <GL/glew.h>
+#include <GL/gl.h>
+#include <glm/glm.hpp>
+
+#include "AsteroidField.h"
+#include "Geometry.h"
+#include "Shader.h"
+#include "DepthBuffer.h"
+
+/* \brief Draws the instances of an AsteroidField : one instanced draw call for the rocks, one of points for the sprites.
+ * The instance data is streamed to the GPU every frame */
+class AsteroidRenderer
+{
+    public:
+        /* \brief Destructor. Destroy the buffers and the shaders */
+        ~AsteroidRenderer();
+
+        AsteroidRenderer(const AsteroidRenderer&) = delete;
+        AsteroidRenderer& operator=(const AsteroidRenderer&) = delete;
+
+        /* \brief Tell if the context can draw instances with per-instance attributes (OpenGL 3.3, or GL_ARB_instanced_arrays and GL_ARB_draw_instanced)
+         * \return true if the renderer can be created */
+        static bool isSupported();
+
+        /* \brief Create a renderer
+         * \param rock the mesh of the rocks, of radius 0.5 like Sphere
+         * \return the renderer or NULL if error */
+        static AsteroidRenderer* create(const Geometry& rock);
+
+        /* \brief Draw the instances of the last AsteroidField::cull. Call it with the opaque objects
+         * \param field the asteroids
+         * \param texture the texture of the rocks
+         * \param sunPosition the camera-relative position of the star lighting them
+         * \param view the camera rotation, as given to cull
+         * \param projection the camera projection matrix, as given to cull
+         * \param depthBuffer the depth mode of the frame. NULL for the standard one */
+        void draw(const AsteroidField& field, GLuint texture, const glm::vec3& sunPosition, const glm::mat4& view, const glm::mat4& projection,
+                  const DepthBuffer* depthBuffer = nullptr);
+
+        /* \brief Draw rocks and sprites built by the caller, the same way as the asteroids of a field
+         * \param instances the rocks drawn as meshes
+         * \param sprites the camera-relative positions and diameters of the rocks drawn as points
+         * \param texture the texture of the rocks
+         * \param sunPosition the camera-relative position of the star lighting them
+         * \param view the camera rotation
+         * \param projection the camera projection matrix
+         * \param depthBuffer the depth mode of the frame. NULL for the standard one */
+        void draw(const std::vector<AsteroidInstance>& instances, const std::vector<glm::vec4>& sprites, GLuint texture, const glm::vec3& sunPosition,
+                  const glm::mat4& view, const glm::mat4& projection, const DepthBuffer* depthBuffer = nullptr);
+    private:
+        AsteroidRenderer() {}
+
+        /* \brief Set the uniforms shared by the two shaders */
+        void bindCommon(const Shader* shader, GLuint texture, const glm::vec3& sunPosition, const glm::mat4& view, const glm::mat4& projection,
+                        const DepthBuffer* depthBuffer) const;
+
+        Shader*  m_rockShader   = nullptr;
+        Shader*  m_spriteShader = nullptr;
+        GLuint   m_rockID       = 0; /*!< Positions, normals then UVs of the rock, like the Sphere buffer*/
+        uint32_t m_nbRockVertices = 0;
+        GLuint   m_instancesID  = 0;
+        GLuint   m_spritesID    = 0;
+};
+
+#endif
@@ -0,0 +1,115 @@
+#ifndef  ATMOSPHERE_INC
+#define  ATMOSPHERE_INC
+
+#include <GL/glew.h>
+#include <GL/gl.h>
+#include <stdint.h>
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "Shader.h"
+#include "DepthBuffer.h"
+
+#define ATMOSPHERE_CACHE_DIRECTORY "AtmosphereCache"
+
+/* Size of the transmittance table : view zenith (mu) x altitude (r) */
+#define ATMOSPHERE_TRANSMITTANCE_WIDTH  256
+#define ATMOSPHERE_TRANSMITTANCE_HEIGHT 64
+
+/* Size of the single scattering table : (nu, sun zenith) packed in x, view zenith in y, altitude in z. Same layout as Bruneton 2017 */
+#define ATMOSPHERE_SCATTERING_NU   8
+#define ATMOSPHERE_SCATTERING_MU_S 32
+#define ATMOSPHERE_SCATTERING_MU   64
+#define ATMOSPHERE_SCATTERING_R    16
+
+/* Number of steps of the numerical integrations */
+#define ATMOSPHERE_TRANSMITTANCE_STEPS 64
+#define ATMOSPHERE_SCATTERING_STEPS    32
+
+/* \brief The physical description of an atmosphere. Lengths are in planet radii (the ground is at 1), so one table serves planets of any size.
+ * The coefficients are per planet radius. */
+struct AtmosphereParameters
+{
+    float     topRadius           = 1.06f;                        /*!< Radius of the top of the atmosphere*/
+    glm::vec3 rayleighScattering  = glm::vec3(6.15f, 14.4f, 35.1f);
+    float     rayleighScaleHeight = 0.0075f;                      /*!< Altitude where the Rayleigh density is divided by e*/
+    glm::vec3 mieScattering       = glm::vec3(4.24f);
+    glm::vec3 mieExtinction       = glm::vec3(4.71f);
+    float     mieScaleHeight      = 0.0011f;
+    float     mieG                = 0.8f;                         /*!< Asymmetry of the Cornette-Shanks phase function*/
+    float     muSMin              = -0.2f;                        /*!< Cosine of the lowest sun zenith angle stored in the tables*/
+
+    /* \brief Earth, with altitudes stretched six times so that the atmosphere is visible from the scene distances.
+     * The coefficients are scaled down by as much, which keeps the optical depths, hence the colors, of the real one */
+    static AtmosphereParameters earth();
+
+    /* \brief A thicker orange atmosphere full of dust, for the sci-fi planets */
+    static AtmosphereParameters haze();
+};
+
+/* \brief Precomputed atmospheric scattering (Bruneton 2017, single scattering only).
+ * The transmittance and in-scattering tables are built on the CPU by the job threads at load time and cached on disk.
+ * Drawing costs a ray-sphere intersection and a few texture fetches per pixel, whatever the atmosphere thickness. */
+class Atmosphere
+{
+    public:
+        /* \brief Destructor. Destroy the tables and the shader */
+        ~Atmosphere();
+
+        Atmosphere(const Atmosphere&) = delete;
+        Atmosphere& operator=(const Atmosphere&) = delete;
+
+        /* \brief Create an atmosphere. Its tables are read from ATMOSPHERE_CACHE_DIRECTORY, or computed and written there
+         * \param params the atmosphere description
+         * \param useCache false to always compute the tables (benchmark)
+         * \return the atmosphere created or NULL if error */
+        static Atmosphere* create(const AtmosphereParameters& params, bool useCache = true);
+
+        /* \brief Compute the tables on the job threads
+         * \param params the atmosphere description
+         * \param transmittance receives ATMOSPHERE_TRANSMITTANCE_WIDTH x HEIGHT RGB texels
+         * \param scattering receives the scattering texels, RGBA : Rayleigh in RGB, the red channel of Mie in A */
+        static void computeTables(const AtmosphereParameters& params, std::vector<float>& transmittance, std::vector<float>& scattering);
+
+        /* \brief Draw the atmosphere of a planet, blended over what is drawn. Call it after the opaque objects and the sky
+         * \param center the planet center
+         * \param planetRadius the planet radius
+         * \param sunPosition the position of the star lighting it
+         * \param sunIntensity the irradiance of the star
+         * \param cameraPosition the camera position
+         * \param view the camera view matrix
+         * \param projection the camera projection matrix
+         * \param depthBuffer the depth mode of the frame. NULL for the standard one */
+        void draw(const glm::vec3& center, float planetRadius, const glm::vec3& sunPosition, float sunIntensity,
+                  const glm::vec3& cameraPosition, const glm::mat4& view, const glm::mat4& projection, const DepthBuffer* depthBuffer = nullptr) const;
+
+        /* \brief Get the time spent to compute or load the tables
+         * \return the time in milliseconds */
+        double getBuildTime() const {return m_buildTime;}
+
+        /* \brief Tell if the tables were read from the disk cache
+         * \return true if they were loaded, false if computed */
+        bool isFromCache() const {return m_fromCache;}
+
+        /* \brief Get the atmosphere description
+         * \return the parameters */
+        const AtmosphereParameters& getParameters() const {return m_params;}
+    private:
+        Atmosphere() {}
+
+        /* \brief Read the tables of "key" from the cache
+         * \return true on success */
+        static bool loadTables(uint64_t key, std::vector<float>& transmittance, std::vector<float>& scattering);
+
+        /* \brief Write the tables of "key" in the cache */
+        static void storeTables(uint64_t key, const std::vector<float>& transmittance, const std::vector<float>& scattering);
+
+        AtmosphereParameters m_params;
+        GLuint  m_transmittanceID = 0;
+        GLuint  m_scatteringID    = 0;
+        Shader* m_shader          = nullptr;
+        double  m_buildTime       = 0.0;
+        bool    m_fromCache       = false;
+};
+
+#endif
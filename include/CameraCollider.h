@@ -0,0 +1,61 @@
+#ifndef  CAMERACOLLIDER_INC
+#define  CAMERACOLLIDER_INC
+
+#include <stdint.h>
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "SphereBVH.h"
+
+/* Contacts resolved per move. Each one removes the motion into a body and slides along it with what is left */
+#define CAMERA_COLLISION_ITERATIONS 4
+/* The camera stops this far from the surfaces, relative to its radius, so that a sliding camera does not start its next sweep in contact */
+#define CAMERA_COLLISION_SKIN 0.01f
+
+/* \brief Continuous collision of the camera, a sphere, with moving spherical bodies, inside a bounding sphere (the star background).
+ * Both the camera and the bodies move along a segment during a frame : the camera sphere is swept against every body in the relative
+ * motion, so that fast bodies or a fast camera cannot pass through each other between two frames. On a contact the motion into the
+ * body is removed and the camera slides along its surface, pushed by the body if it comes at it.
+ * The broadphase queries the SphereBVH the bodies are already indexed in for the culling, with a sphere bounding everything the camera
+ * can reach this frame : only the bodies it overlaps are tested. */
+class CameraCollider
+{
+    public:
+        /* \brief Constructor
+         * \param radius the radius of the camera. Larger than the near plane distance, so that the surfaces are never clipped */
+        CameraCollider(float radius) : m_radius(radius) {}
+
+        /* \brief Move the camera
+         * \param from the camera position at the previous frame
+         * \param to the position wanted for this frame
+         * \param bodies the index of the bodies at their positions of this frame, relative to "from"
+         * \param centers the body centers of this frame, with the indices of "bodies". Their positions at the previous move give their motion
+         * \param radii the body radii, 0 for the bodies the camera goes through
+         * \param boundCenter the center of the sphere the camera has to stay in
+         * \param boundRadius its radius, 0 for none
+         * \return the camera position of this frame */
+        glm::dvec3 move(const glm::dvec3& from, const glm::dvec3& to, const SphereBVH& bodies, const std::vector<glm::dvec3>& centers,
+                        const std::vector<float>& radii, const glm::dvec3& boundCenter, double boundRadius);
+
+        /* \brief Get the bodies that passed the broadphase at the last move
+         * \return the number of bodies */
+        uint32_t getNbCandidates() const {return m_nbCandidates;}
+
+        /* \brief Get the contacts of the last move
+         * \return the number of contacts */
+        uint32_t getNbContacts() const {return m_nbContacts;}
+
+        /* \brief Get the CPU time of the last move
+         * \return the time in milliseconds */
+        double getLastMoveTime() const {return m_lastMoveTime;}
+
+    private:
+        float                   m_radius;
+        std::vector<glm::dvec3> m_previous;   /*!< The body centers of the previous move*/
+        std::vector<uint32_t>   m_candidates;
+        uint32_t                m_nbCandidates = 0;
+        uint32_t                m_nbContacts = 0;
+        double                  m_lastMoveTime = 0.0;
+};
+
+#endif
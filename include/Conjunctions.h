@@ -0,0 +1,143 @@
+#ifndef  CONJUNCTIONS_INC
+#define  CONJUNCTIONS_INC
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "Orbits.h"
+
+/* Intervals per orbit of the fastest body when analyze picks the intervals itself. Shorter intervals give tighter boxes, fewer candidates to refine */
+#define CONJUNCTION_INTERVALS_PER_ORBIT 128
+/* Intervals swept by one job. The order of the boxes is kept from one interval to the next inside a job, so that it is almost sorted already */
+#define CONJUNCTION_INTERVALS_PER_JOB 4
+/* Samples of the separation in an interval before its minimum is refined, in case the relative motion is not monotonic in it */
+#define CONJUNCTION_SAMPLES 4
+/* Golden section steps of the refinement. Each one divides the bracket by 1.618 */
+#define CONJUNCTION_REFINE_ITERATIONS 40
+
+/* \brief A body of the analysis. Its position is its Keplerian orbit around its parent, plus the position of the parent */
+struct ConjunctionBody
+{
+    KeplerElements elements;
+    int32_t        parent = -1; /*!< Index of the parent body, added before this one. -1 for an orbit around the origin*/
+    float          radius = 0.0f;
+};
+
+/* \brief A close approach between two bodies */
+struct Conjunction
+{
+    uint32_t first;      /*!< The body of smaller index*/
+    uint32_t second;
+    double   time;       /*!< Date of the closest approach*/
+    double   separation; /*!< Distance between the surfaces at that date, negative if they overlap*/
+};
+
+/* \brief Find every pair of bodies coming closer than a threshold during a time window.
+ * The window is cut into intervals. In each one, the motion of a body is bounded by a box : the positions at both ends, grown by how far
+ * the body can stray from that chord at its top speed. Sweep and prune finds the overlapping boxes along X, keeping the order of the previous
+ * interval so that the sort is an insertion sort over an almost sorted list. The pairs whose boxes overlap are then refined in parallel :
+ * the minimum of their separation in the interval is searched by sampling, then by golden section. The intervals are swept in parallel too. */
+class Conjunctions
+{
+    public:
+        /* \brief Add a body
+         * \param body its orbit, parent and radius
+         * \return its index */
+        uint32_t add(const ConjunctionBody& body);
+
+        /* \brief Remove every body */
+        void clear() {m_bodies.clear(); m_maxSpeeds.clear(); m_axisP.clear(); m_axisQ.clear(); m_periapses.clear();}
+
+        /* \brief Get the number of bodies
+         * \return the number of bodies */
+        uint32_t getNbBodies() const {return (uint32_t)m_bodies.size();}
+
+        /* \brief Find the close approaches
+         * \param start the start of the window
+         * \param end the end of the window
+         * \param threshold the separation under which a pair is reported
+         * \param out receives the closest approach of each pair in each interval where it comes under the threshold, the approaches spanning
+         * consecutive intervals merged. Sorted by date
+         * \param nbIntervals the number of intervals. 0 picks CONJUNCTION_INTERVALS_PER_ORBIT intervals per orbit of the fastest body */
+        void analyze(double start, double end, double threshold, std::vector<Conjunction>& out, uint32_t nbIntervals = 0);
+
+        /* \brief Compute the position of a body
+         * \param bodyID its index
+         * \param t the date
+         * \return the position */
+        glm::dvec3 getPosition(uint32_t bodyID, double t) const;
+
+        /* \brief Get the radius of a body
+         * \param bodyID its index
+         * \return the radius */
+        float getRadius(uint32_t bodyID) const {return m_bodies[bodyID].radius;}
+
+        /* \brief Get the top speed of a body, the motion of its parents included
+         * \param bodyID its index
+         * \return the speed, in units per unit of time */
+        double getMaxSpeed(uint32_t bodyID) const {return m_maxSpeeds[bodyID];}
+
+        /* \brief Get the pairs found by the sweep and prune of the last analysis, all intervals together
+         * \return the number of pairs refined */
+        uint64_t getNbCandidates() const {return m_nbCandidates;}
+
+        /* \brief Get the number of intervals of the last analysis
+         * \return the number of intervals */
+        uint32_t getNbIntervals() const {return m_nbIntervals;}
+
+        /* \brief Get the CPU time of the sweep and prune of the last analysis
+         * \return the time in milliseconds */
+        double getLastBroadphaseTime() const {return m_lastBroadphaseTime;}
+
+        /* \brief Get the CPU time of the refinement of the last analysis
+         * \return the time in milliseconds */
+        double getLastRefineTime() const {return m_lastRefineTime;}
+
+        /* \brief Write a report as CSV : first,second,time,separation
+         * \param path the file
+         * \param conjunctions the close approaches
+         * \param names the body names, by index
+         * \return true on success */
+        static bool saveReport(const char* path, const std::vector<Conjunction>& conjunctions, const std::vector<std::string>& names);
+
+    private:
+        /* \brief A pair whose boxes overlap in an interval */
+        struct Candidate
+        {
+            uint32_t first;
+            uint32_t second;
+            uint32_t interval;
+        };
+
+        /* \brief The box of a body over an interval, in the sweep order */
+        struct SortedBox
+        {
+            glm::dvec3 bmin;
+            glm::dvec3 bmax;
+        };
+
+        /* \brief Compute the position of a body relative to its parent
+         * \param bodyID its index
+         * \param t the date
+         * \return the position */
+        glm::dvec3 solve(uint32_t bodyID, double t) const;
+
+        /* \brief Compute the position of every body at a date, parents first
+         * \param t the date
+         * \param positions receives the positions */
+        void computePositions(double t, std::vector<glm::dvec3>& positions) const;
+
+        std::vector<ConjunctionBody> m_bodies;
+        std::vector<double>          m_maxSpeeds; /*!< Top speed of each body, the speeds of its parents included*/
+        std::vector<glm::dvec3>      m_axisP;     /*!< Towards the periapsis, times the semi-major axis*/
+        std::vector<glm::dvec3>      m_axisQ;     /*!< 90 degrees ahead, times the semi-minor axis*/
+        std::vector<double>          m_periapses; /*!< Closest distance of each body to its parent. A moon never closer than the threshold is not paired with it*/
+        uint64_t                     m_nbCandidates = 0;
+        uint32_t                     m_nbIntervals = 0;
+        double                       m_lastBroadphaseTime = 0.0;
+        double                       m_lastRefineTime = 0.0;
+};
+
+#endif
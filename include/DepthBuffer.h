@@ -0,0 +1,98 @@
+#ifndef  DEPTHBUFFER_INC
+#define  DEPTHBUFFER_INC
+
+#include <GL/glew.h>
+#include <GL/gl.h>
+#include <stdint.h>
+#include <glm/glm.hpp>
+
+#include "Shader.h"
+
+/* \brief How the depth of the fragments is computed and stored. Also the value of the DEPTH_MODE shader feature*/
+enum DepthMode
+{
+    DEPTH_STANDARD,    /*!< OpenGL default : [-1, 1] clip range, fixed point depth buffer of the window*/
+    DEPTH_REVERSED_Z,  /*!< Near plane at 1, infinity at 0 : [0, 1] clip range (glClipControl), 32 bits float depth buffer*/
+    DEPTH_LOGARITHMIC, /*!< log2(1 + w) written by the vertex shaders in the depth buffer of the window. For drivers without glClipControl*/
+    DEPTH_MODE_COUNT
+};
+
+/* \brief The depth buffer and the projection of the frame, in one of the DepthMode.
+ * Reversed-Z renders to an offscreen framebuffer with a float depth buffer, blitted to the window at the end of the frame. */
+class DepthBuffer
+{
+    public:
+        /* \brief Constructor. Starts in DEPTH_STANDARD
+         * \param width the framebuffer width in pixels
+         * \param height the framebuffer height in pixels
+         * \param zNear the near plane distance
+         * \param zFar the far plane distance. Ignored by the reversed-Z projection, which goes to infinity */
+        DepthBuffer(uint32_t width, uint32_t height, float zNear, float zFar);
+
+        /* \brief Destructor. Destroy the offscreen framebuffer */
+        ~DepthBuffer();
+
+        DepthBuffer(const DepthBuffer&) = delete;
+        DepthBuffer& operator=(const DepthBuffer&) = delete;
+
+        /* \brief Tell if the context can do reversed-Z (OpenGL 4.5 or GL_ARB_clip_control)
+         * \return true if DEPTH_REVERSED_Z can be used */
+        static bool isReversedZSupported();
+
+        /* \brief Get the name of a mode, for the logs
+         * \param mode the mode
+         * \return its name */
+        static const char* getModeName(DepthMode mode);
+
+        /* \brief Change the mode. Takes effect at the next beginFrame
+         * \param mode the new mode
+         * \return false if the mode is not supported, the current one is then kept */
+        bool setMode(DepthMode mode);
+
+        /* \brief Get the current mode
+         * \return the mode */
+        DepthMode getMode() const {return m_mode;}
+
+        /* \brief Get the perspective projection matching the mode
+         * \param fovy the vertical field of view, as given to glm::perspective
+         * \param aspect the width / height ratio
+         * \return the projection matrix */
+        glm::mat4 getProjection(float fovy, float aspect) const;
+
+        /* \brief Bind the framebuffer of the mode, set the depth state and clear the color and depth*/
+        void beginFrame();
+
+        /* \brief Copy the offscreen image to the window if any, and restore the default depth state*/
+        void endFrame();
+
+        /* \brief Get the shader variant bits of the mode
+         * \return the DEPTH_MODE feature bits */
+        uint32_t getVariantBits() const {return shaderFeatureBits(SHADER_FEATURE_DEPTH_MODE, m_mode);}
+
+        /* \brief Set the depth uniforms of a shader : uLogDepthScale, uNearDepth and uFarDepth (the NDC depths of the near and far planes)
+         * \param shader the shader in use */
+        void bind(const Shader* shader) const;
+
+        /* \brief Get the depth function of the opaque geometry
+         * \return GL_LESS, or GL_GREATER in reversed-Z */
+        GLenum getDepthFunc() const {return m_mode == DEPTH_REVERSED_Z ? GL_GREATER : GL_LESS;}
+
+        /* \brief Get the depth function of what is drawn at the far plane (the sky)
+         * \return GL_LEQUAL, or GL_GEQUAL in reversed-Z */
+        GLenum getFarDepthFunc() const {return m_mode == DEPTH_REVERSED_Z ? GL_GEQUAL : GL_LEQUAL;}
+    private:
+        /* \brief Create the offscreen framebuffer of the reversed-Z mode
+         * \return true on success */
+        bool createFramebuffer();
+
+        uint32_t  m_width;
+        uint32_t  m_height;
+        float     m_near;
+        float     m_far;
+        DepthMode m_mode          = DEPTH_STANDARD;
+        GLuint    m_framebufferID = 0;
+        GLuint    m_colorID       = 0;
+        GLuint    m_depthID       = 0;
+};
+
+#endif
@@ -0,0 +1,69 @@
+#ifndef  ECLIPSES_INC
+#define  ECLIPSES_INC
+
+#include <stdint.h>
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "Shader.h"
+#include "SphereGrid.h"
+
+#define ECLIPSE_MAX_OCCLUDERS 4
+
+/* \brief A body seen by the eclipse system */
+struct EclipseBody
+{
+    glm::vec3 center;
+    float     radius;
+    int32_t   light    = -1;    /*!< The light whose eclipses are computed for this body, -1 if it receives none*/
+    bool      occluder = false; /*!< true if the body can hide a light*/
+};
+
+/* \brief A spherical light (a star) */
+struct EclipseLight
+{
+    glm::vec3 center;
+    float     radius;
+};
+
+/* \brief The occluders of one body, ready for the shaders */
+struct EclipseShadow
+{
+    int32_t   light       = -1;
+    uint32_t  nbOccluders = 0;
+    glm::vec4 occluders[ECLIPSE_MAX_OCCLUDERS]; /*!< center, radius. The largest ones seen from the body first*/
+};
+
+/* \brief Analytic eclipse shadows. Every body being a sphere, the shaders compute the part of the light disk hidden by a few occluder spheres.
+ * This class finds, for each receiver, the occluders lying in the cone between it and its light, through a spatial index over the occluders. */
+class Eclipses
+{
+    public:
+        /* \brief Find the occluders of every receiver
+         * \param bodies the bodies. Their indices are the ones of getShadow
+         * \param lights the lights referenced by the bodies */
+        void update(const std::vector<EclipseBody>& bodies, const std::vector<EclipseLight>& lights);
+
+        /* \brief Get the occluders of a body
+         * \param bodyID the body index given to update
+         * \return its shadow. nbOccluders is 0 if it is not eclipsed */
+        const EclipseShadow& getShadow(uint32_t bodyID) const {return m_shadows[bodyID];}
+
+        /* \brief Set the uniforms of an ECLIPSES shader variant. The shader must be in use
+         * \param shader the shader
+         * \param bodyID the body drawn */
+        void bind(const Shader* shader, uint32_t bodyID) const;
+
+        /* \brief Get the CPU time of the last update
+         * \return the time in milliseconds */
+        double getLastUpdateTime() const {return m_lastUpdateTime;}
+
+    private:
+        SphereGrid                 m_grid;
+        std::vector<uint32_t>      m_occluderIDs; /*!< Grid index to body index*/
+        std::vector<EclipseShadow> m_shadows;
+        std::vector<EclipseLight>  m_lights;
+        double                     m_lastUpdateTime = 0.0;
+};
+
+#endif
@@ -0,0 +1,312 @@
+#ifndef  ENTITIES_INC
+#define  ENTITIES_INC
+
+#include <stdint.h>
+#include <vector>
+#include <atomic>
+#include <type_traits>
+#include <glm/glm.hpp>
+
+#include "Material.h"
+#include "Orbits.h"
+#include "LightClusters.h"
+#include "JobSystem.h"
+#include "FrameArena.h"
+
+class Geometry;
+
+/* Bytes of a chunk. A chunk holds the component arrays of one archetype for as many entities as fit in it */
+#define ENTITY_CHUNK_SIZE (16 * 1024)
+/* Chunks per batch of the parallel systems */
+#define ENTITY_CHUNKS_PER_JOB 4
+
+/* \brief The kinds of components. An entity has any combination of them, its archetype */
+enum ComponentType
+{
+    COMPONENT_TRANSFORM,
+    COMPONENT_RENDERABLE,
+    COMPONENT_MATERIAL,
+    COMPONENT_ORBIT,
+    COMPONENT_LIGHT,
+    COMPONENT_COLLIDER,
+    COMPONENT_COUNT
+};
+
+/* \brief A set of component types, one bit per ComponentType */
+typedef uint32_t ComponentMask;
+
+/* \brief Get the bit of a component type
+ * \param type the component type
+ * \return the mask holding only this type */
+constexpr ComponentMask componentBit(ComponentType type) {return 1u << type;}
+
+/* \brief A handle to an entity. The generation tells a destroyed entity from the one reusing its index */
+struct Entity
+{
+    uint32_t index      = UINT32_MAX;
+    uint32_t generation = 0;
+};
+
+/* \brief Where a body is. The hierarchy only passes positions down, like the propagated matrices of objet */
+struct TransformComponent
+{
+    glm::dvec3 position = glm::dvec3(0.0); /*!< Relative to the parent*/
+    glm::dvec3 world    = glm::dvec3(0.0); /*!< Written by EntitySystems::updateTransforms*/
+    glm::mat3  basis    = glm::mat3(1.0f); /*!< Rotation and scale of the body*/
+    Entity     parent;                     /*!< Set by EntitySystems::setParent, no index for a root*/
+    Entity     firstChild;                 /*!< The children are linked by nextSibling, kept by EntitySystems::setParent*/
+    Entity     nextSibling;
+    uint32_t   depth    = 0;               /*!< Depth of the parent + 1, 0 for a root*/
+};
+
+/* \brief What draws the body */
+struct RenderableComponent
+{
+    Geometry* geometry = nullptr;
+    GLuint    vboID    = 0;
+    uint32_t  visible  = 1;  /*!< Written by EntitySystems::cull*/
+    int32_t   bodyID   = -1; /*!< Index of the body in the eclipse bodies of the frame, -1 if it has none*/
+};
+
+/* \brief How the body is shaded */
+struct MaterialComponent
+{
+    Material material = Material{glm::vec3(0.0f), 0.2f, 0.8f, 0.0f, 1.0f};
+    int32_t  lit      = 0; /*!< The number of the star lighting the body, the etoile of objet*/
+};
+
+/* \brief A Keplerian orbit around the parent, with the spin of the body */
+struct OrbitComponent
+{
+    uint32_t  orbitID = 0; /*!< Index in the Orbits*/
+    float     spin    = 0.0f;
+    float     tilt    = 0.0f;
+    glm::vec3 size    = glm::vec3(1.0f);
+};
+
+/* \brief The body gives light, at its center */
+struct LightComponent
+{
+    glm::vec3 color  = glm::vec3(1.0f);
+    float     radius = 0.0f; /*!< Distance beyond which the light has no effect, the one of PointLight*/
+    uint32_t  index  = 0;    /*!< Where EntitySystems::gatherLights puts it in the lights of the frame : the shaders number the stars*/
+};
+
+/* \brief The sphere the body is culled and collided with */
+struct ColliderComponent
+{
+    float radius = 0.5f;
+};
+
+/* \brief The ComponentType of each component structure */
+template<typename T> struct ComponentTraits;
+
+/* \brief Register a component structure. The chunks move the components with memcpy, so it has to be trivially copyable */
+#define ENTITY_COMPONENT(T, componentType)                                                                     \
+    template<> struct ComponentTraits<T>                                                                       \
+    {                                                                                                          \
+        static_assert(std::is_trivially_copyable<T>::value, #T " is copied as bytes between the chunks");      \
+        static const ComponentType type = componentType;                                                       \
+    }
+
+ENTITY_COMPONENT(TransformComponent,  COMPONENT_TRANSFORM);
+ENTITY_COMPONENT(RenderableComponent, COMPONENT_RENDERABLE);
+ENTITY_COMPONENT(MaterialComponent,   COMPONENT_MATERIAL);
+ENTITY_COMPONENT(OrbitComponent,      COMPONENT_ORBIT);
+ENTITY_COMPONENT(LightComponent,      COMPONENT_LIGHT);
+ENTITY_COMPONENT(ColliderComponent,   COMPONENT_COLLIDER);
+
+/* \brief A block of entities of the same archetype. Each of its components is a contiguous array, so a system only streams the arrays it reads */
+class EntityChunk
+{
+    public:
+        /* \brief Get the number of entities of the chunk
+         * \return the number of entities */
+        uint32_t getSize() const {return m_size;}
+
+        /* \brief Get the array of a component. The archetype of the chunk must have it
+         * \return the first of getSize() components */
+        template<typename T> T* get() {return (T*)(m_data.data() + m_offsets[ComponentTraits<T>::type]);}
+        template<typename T> const T* get() const {return (const T*)(m_data.data() + m_offsets[ComponentTraits<T>::type]);}
+
+        /* \brief Get the entities of the chunk, in the order of the component arrays
+         * \return the first of getSize() entities */
+        const Entity* getEntities() const {return (const Entity*)m_data.data();}
+
+    private:
+        friend class EntityWorld;
+
+        std::vector<uint8_t> m_data;                      /*!< The entities, then each component array*/
+        uint32_t             m_offsets[COMPONENT_COUNT];  /*!< Offset of each component array in m_data*/
+        uint32_t             m_size = 0;
+};
+
+/* \brief Archetype-based entity storage. The entities with the same set of components are packed together in chunks of ENTITY_CHUNK_SIZE bytes,
+ * each component in its own array. A query walks the chunks of the archetypes having the components it needs, and only touches their arrays.
+ * Adding or removing components moves the entity to the chunks of its new archetype. Destroying an entity moves the last one of its archetype
+ * into its place, so the chunks stay packed. The components are copied as bytes : they must be trivially copyable. */
+class EntityWorld
+{
+    public:
+        /* \brief Create an entity
+         * \param components its components, default constructed
+         * \return the entity */
+        Entity create(ComponentMask components);
+
+        /* \brief Destroy an entity. Its handle, and the component pointers of its archetype, are no longer valid
+         * \param entity the entity */
+        void destroy(Entity entity);
+
+        /* \brief Change the components of an entity. The ones it keeps keep their value, the new ones are default constructed
+         * \param entity the entity
+         * \param components its new components */
+        void setComponents(Entity entity, ComponentMask components);
+
+        /* \brief Tell if an entity exists
+         * \param entity the entity
+         * \return false if it was destroyed */
+        bool isAlive(Entity entity) const {return entity.index < m_records.size() && m_records[entity.index].generation == entity.generation && m_records[entity.index].archetype != UINT32_MAX;}
+
+        /* \brief Get the components of an entity
+         * \param entity the entity, alive
+         * \return its archetype */
+        ComponentMask getComponents(Entity entity) const {return m_archetypes[m_records[entity.index].archetype].mask;}
+
+        /* \brief Get a component of an entity. The pointer is valid until an entity of the archetype is created, moved or destroyed
+         * \param entity the entity, alive
+         * \return the component, NULL if the entity does not have it */
+        template<typename T> T* get(Entity entity)
+        {
+            const Record& record = m_records[entity.index];
+            Archetype&    archetype = m_archetypes[record.archetype];
+            if(!(archetype.mask & componentBit(ComponentTraits<T>::type)))
+                return nullptr;
+            return archetype.chunks[record.chunk].get<T>() + record.row;
+        }
+
+        /* \brief Call f(chunk) on every chunk whose archetype has all the components of a mask
+         * \param components the components needed */
+        template<typename F> void forEachChunk(ComponentMask components, F f)
+        {
+            for(Archetype& archetype : m_archetypes)
+                if((archetype.mask & components) == components)
+                    for(EntityChunk& chunk : archetype.chunks)
+                        f(chunk);
+        }
+
+        /* \brief Call f(chunk) on the job threads for every chunk whose archetype has all the components of a mask. The chunks must not
+         * be created, moved or destroyed meanwhile : f may only change the components
+         * \param components the components needed */
+        template<typename F> void parallelForEachChunk(ComponentMask components, F f)
+        {
+            m_jobChunks.clear();
+            forEachChunk(components, [this](EntityChunk& chunk) {m_jobChunks.push_back(&chunk);});
+            JobSystem::get().parallelFor((uint32_t)m_jobChunks.size(), ENTITY_CHUNKS_PER_JOB, [&](uint32_t first, uint32_t last)
+            {
+                for(uint32_t i = first; i < last; i++)
+                    f(*m_jobChunks[i]);
+            });
+        }
+
+        /* \brief Get the number of entities alive
+         * \return the number of entities */
+        uint32_t getNbEntities() const {return m_nbEntities;}
+
+        /* \brief Get the number of archetypes met so far
+         * \return the number of archetypes */
+        uint32_t getNbArchetypes() const {return (uint32_t)m_archetypes.size();}
+
+        /* \brief Get the number of chunks of all the archetypes
+         * \return the number of chunks */
+        uint32_t getNbChunks() const;
+
+    private:
+        /* \brief The chunks of a set of components */
+        struct Archetype
+        {
+            ComponentMask            mask;
+            uint32_t                 capacity;                 /*!< Entities per chunk*/
+            uint32_t                 offsets[COMPONENT_COUNT]; /*!< Layout of its chunks*/
+            uint32_t                 nbEntities = 0;
+            std::vector<EntityChunk> chunks;                   /*!< All full but the last one*/
+        };
+
+        /* \brief Where an entity is */
+        struct Record
+        {
+            uint32_t generation = 0;
+            uint32_t archetype  = UINT32_MAX; /*!< UINT32_MAX once destroyed*/
+            uint32_t chunk      = 0;
+            uint32_t row        = 0;
+        };
+
+        /* \brief Find the archetype of a set of components, create it the first time
+         * \return its index */
+        uint32_t findArchetype(ComponentMask components);
+
+        /* \brief Add a row at the end of an archetype, its components default constructed
+         * \return the record of the row, to fill the entity in */
+        Record addRow(uint32_t archetypeID, Entity entity);
+
+        /* \brief Remove a row of an archetype, moving its last entity in its place */
+        void removeRow(uint32_t archetypeID, uint32_t chunkID, uint32_t row);
+
+        std::vector<Archetype>    m_archetypes;
+        std::vector<Record>       m_records;
+        std::vector<uint32_t>     m_freeIndices;
+        std::vector<EntityChunk*> m_jobChunks;
+        uint32_t                  m_nbEntities = 0;
+};
+
+/* \brief The systems updating the components of an EntityWorld, each on the job threads and only over the arrays it needs */
+class EntitySystems
+{
+    public:
+        /* \brief Attach an entity to a parent, or detach it. Both have a TransformComponent. The depths of the whole subtree of the entity follow
+         * \param world the world
+         * \param entity the child
+         * \param parent the parent, an Entity() for none. Not in the subtree of the entity */
+        static void setParent(EntityWorld& world, Entity entity, Entity parent);
+
+        /* \brief Place the bodies with an orbit where the last Orbits::propagate left them, and spin them (Transform and Orbit)
+         * \param world the world
+         * \param orbits the propagated orbits
+         * \param t the date of the propagation */
+        static void updateOrbits(EntityWorld& world, const Orbits& orbits, double t);
+
+        /* \brief Compute the world positions, one depth of the hierarchy after the other (Transform)
+         * \param world the world */
+        static void updateTransforms(EntityWorld& world);
+
+        /* \brief Flag the bodies whose collider touches the frustum (Transform, Collider and Renderable)
+         * \param world the world
+         * \param camera the position of the camera. The planes are relative to it
+         * \param planes the side planes of the frustum, pointing inside
+         * \return the number of visible bodies */
+        static uint32_t cull(EntityWorld& world, const glm::dvec3& camera, const glm::vec4 planes[4]);
+
+        /* \brief A body to draw, with its camera-relative model matrix */
+        struct Draw
+        {
+            glm::mat4 model;
+            Geometry* geometry;
+            GLuint    vboID;
+            int32_t   lit;
+            int32_t   bodyID;
+            Material  material;
+        };
+
+        /* \brief List the visible bodies to draw (Transform, Renderable and Material)
+         * \param world the world
+         * \param camera the position of the camera
+         * \param draws receives the bodies */
+        static void gatherDraws(EntityWorld& world, const glm::dvec3& camera, std::vector<Draw>& draws);
+
+        /* \brief Put the lights of the bodies in a list, each at its LightComponent::index (Transform and Light)
+         * \param world the world
+         * \param camera the position of the camera. The lights are relative to it
+         * \param lights receives the lights. It grows to hold the largest index, the slots no light takes are left as they are */
+        static void gatherLights(EntityWorld& world, const glm::dvec3& camera, std::vector<PointLight>& lights);
+};
+
+#endif
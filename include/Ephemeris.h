@@ -0,0 +1,129 @@
+#ifndef  EPHEMERIS_INC
+#define  EPHEMERIS_INC
+
+#include <stdint.h>
+#include <map>
+#include <vector>
+#include <glm/glm.hpp>
+
+/* Size of the chunks read by the table parsers */
+#define EPHEMERIS_READ_BUFFER_SIZE (1 << 20)
+/* Shortest segment the fit tries, in units of time, before giving up on the tolerance */
+#define EPHEMERIS_MIN_SEGMENT_LENGTH 0.25
+
+/* \brief A tabulated position */
+struct EphemerisSample
+{
+    double     time;
+    glm::dvec3 position;
+};
+
+/* \brief The samples of every body of a table, sorted by time. The key is the body ID (the NAIF ID in the JPL files, 399 for the Earth) */
+typedef std::map<int32_t, std::vector<EphemerisSample>> EphemerisTable;
+
+/* \brief What the fit of one body achieved */
+struct EphemerisFitStats
+{
+    int32_t  bodyID;
+    uint32_t nbSegments;
+    double   segmentLength;
+    double   maxError; /*!< Largest distance between a sample and the polynomials*/
+    double   rmsError;
+};
+
+/* \brief The description of one body in an ephemeris file. Its segments follow each other at "offset" bytes from the start of the file,
+ * each one holding (degree + 1) coefficients of (x, y, z), from the order 0 up */
+struct EphemerisBodyHeader
+{
+    int32_t  bodyID;
+    uint32_t degree;
+    uint32_t nbSegments;
+    uint32_t padding;
+    double   startTime;
+    double   segmentLength;
+    uint64_t offset;
+};
+
+/* \brief Piecewise Chebyshev ephemeris, the way the JPL DE files store the planets.
+ * Each body has segments of fixed length, so finding the segment of a date is a division. In each of them the position is a
+ * polynomial of a fixed degree, evaluated by the Clenshaw recurrence. The file is mapped in memory as is : opening it costs nothing
+ * whatever its size, and only the segments used are read from the disk.
+ *
+ * Table files, to import :
+ * - CSV : one "body,time,x,y,z" line per sample. Lines that do not start with a number (headers, comments) are skipped
+ * - binary : the "GSET" header of saveTable, then the samples as (int32 body, uint32 0, double time, x, y, z) records */
+class Ephemeris
+{
+    public:
+        /* \brief Destructor. Unmap the file */
+        ~Ephemeris();
+
+        Ephemeris(const Ephemeris&) = delete;
+        Ephemeris& operator=(const Ephemeris&) = delete;
+
+        /* \brief Read a table of positions, CSV or binary (detected from the first bytes). The file is streamed in chunks
+         * \param path the file path
+         * \param table receives the samples, added to the ones already there
+         * \return the number of samples read, 0 if error */
+        static uint64_t loadTable(const char* path, EphemerisTable& table);
+
+        /* \brief Write a table in the binary format, much faster to read again
+         * \param path the file path
+         * \param table the samples
+         * \return true on success */
+        static bool saveTable(const char* path, const EphemerisTable& table);
+
+        /* \brief Fit the polynomials of every body and write them in an ephemeris file.
+         * The segments of a body are halved until every sample is within the tolerance
+         * \param path the file written
+         * \param table the samples
+         * \param degree the degree of the polynomials
+         * \param tolerance the largest error allowed, in the unit of the positions
+         * \param stats if not NULL, receives the result of each body
+         * \return true on success */
+        static bool fit(const char* path, const EphemerisTable& table, uint32_t degree, double tolerance, std::vector<EphemerisFitStats>* stats = nullptr);
+
+        /* \brief Map an ephemeris file written by fit
+         * \param path the file path
+         * \return the ephemeris or NULL if error */
+        static Ephemeris* open(const char* path);
+
+        /* \brief Find a body
+         * \param bodyID the body ID of the table
+         * \return its index for getPosition, -1 if the file does not have it */
+        int32_t findBody(int32_t bodyID) const;
+
+        /* \brief Get the number of bodies of the file
+         * \return the number of bodies */
+        uint32_t getNbBodies() const {return m_nbBodies;}
+
+        /* \brief Get the first date covered for a body
+         * \param index the index returned by findBody
+         * \return the date */
+        double getStartTime(uint32_t index) const;
+
+        /* \brief Get the last date covered for a body
+         * \param index the index returned by findBody
+         * \return the date */
+        double getEndTime(uint32_t index) const;
+
+        /* \brief Evaluate the position of a body. The dates outside of the covered span are clamped to it
+         * \param index the index returned by findBody
+         * \param time the date
+         * \return the position */
+        glm::dvec3 getPosition(uint32_t index, double time) const;
+
+    private:
+        Ephemeris() {}
+
+        void*                      m_mapping  = nullptr;
+        uint64_t                   m_size     = 0;
+        uint32_t                   m_nbBodies = 0;
+        const EphemerisBodyHeader* m_bodies   = nullptr;
+#ifdef _WIN32
+        void*                      m_fileHandle    = nullptr;
+        void*                      m_mappingHandle = nullptr;
+#endif
+};
+
+#endif
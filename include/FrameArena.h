@@ -0,0 +1,104 @@
+#ifndef  FRAMEARENA_INC
+#define  FRAMEARENA_INC
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+
+/* Size of the blocks a frame arena grows by */
+#define FRAME_ARENA_BLOCK_SIZE (256 * 1024)
+
+/* \brief Linear allocator for the temporaries of a frame. Allocating moves a pointer forward in a block, freeing does nothing but
+ * give back the last allocation, and everything is dropped at once at the start of the next frame (resetAll).
+ * Each thread has its own arena (local), so the job threads allocate without locking. When a frame needed more than one block,
+ * the arena becomes a single block as large as all of them at the next reset : once the frames stop growing, they take nothing from the heap.
+ * Built with FRAME_ARENA_COUNT_ALLOCATIONS, the global operator new counts its calls, so that --test-allocations can check it */
+class FrameArena
+{
+    public:
+        FrameArena() {}
+
+        /* \brief Destructor. Free the blocks */
+        ~FrameArena();
+
+        FrameArena(const FrameArena&) = delete;
+        FrameArena& operator=(const FrameArena&) = delete;
+
+        /* \brief Allocate memory valid until the next reset
+         * \param size the size in bytes
+         * \param alignment a power of two
+         * \return the memory */
+        void* allocate(size_t size, size_t alignment);
+
+        /* \brief Give memory back. Only the last allocation is reused before the reset, as when a container frees its buffer right after making it
+         * \param pointer what allocate returned
+         * \param size its size */
+        void deallocate(void* pointer, size_t size);
+
+        /* \brief Drop every allocation, and merge the blocks if the frame needed several */
+        void reset();
+
+        /* \brief Get the bytes allocated since the last reset, alignment included
+         * \return the bytes */
+        size_t getUsed() const {return m_used + m_offset;}
+
+        /* \brief Get the bytes of all the blocks
+         * \return the bytes */
+        size_t getCapacity() const;
+
+        /* \brief Get the arena of the calling thread, created on first use
+         * \return the arena */
+        static FrameArena& local();
+
+        /* \brief Reset the arenas of every thread. Between two frames : nothing allocated from them may be used anymore, and no job may be running */
+        static void resetAll();
+
+        /* \brief Tell whether the global operator new counts its calls (FRAME_ARENA_COUNT_ALLOCATIONS)
+         * \return true if getNbAllocations is valid */
+        static bool countsAllocations();
+
+        /* \brief Get the number of calls to the global operator new so far, from every thread
+         * \return the number of calls, 0 if they are not counted */
+        static uint64_t getNbAllocations();
+
+    private:
+        struct Block
+        {
+            uint8_t* data;
+            size_t   size;
+        };
+
+        std::vector<Block> m_blocks; /*!< The last one is allocated from*/
+        size_t             m_offset = 0; /*!< First free byte of the last block*/
+        size_t             m_used   = 0; /*!< Bytes taken in the blocks before the last one*/
+};
+
+/* \brief STL allocator taking its memory from a FrameArena, by default the one of the thread creating it.
+ * The containers using it live until the end of the frame, and are filled on the thread they were created on */
+template<typename T> class FrameAllocator
+{
+    public:
+        typedef T value_type;
+
+        FrameAllocator() : m_arena(&FrameArena::local()) {}
+        explicit FrameAllocator(FrameArena& arena) : m_arena(&arena) {}
+        template<typename U> FrameAllocator(const FrameAllocator<U>& other) : m_arena(other.getArena()) {}
+
+        T* allocate(size_t n) {return (T*)m_arena->allocate(n * sizeof(T), alignof(T));}
+        void deallocate(T* pointer, size_t n) {m_arena->deallocate(pointer, n * sizeof(T));}
+
+        /* \brief Get the arena allocated from
+         * \return the arena */
+        FrameArena* getArena() const {return m_arena;}
+
+        template<typename U> bool operator==(const FrameAllocator<U>& other) const {return m_arena == other.getArena();}
+        template<typename U> bool operator!=(const FrameAllocator<U>& other) const {return m_arena != other.getArena();}
+
+    private:
+        FrameArena* m_arena;
+};
+
+/* \brief A vector of the frame */
+template<typename T> using FrameVector = std::vector<T, FrameAllocator<T>>;
+
+#endif
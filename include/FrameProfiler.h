@@ -0,0 +1,72 @@
+#ifndef  FRAMEPROFILER_INC
+#define  FRAMEPROFILER_INC
+
+#include <stdint.h>
+#include <vector>
+#include <chrono>
+
+/* Frames averaged by each report of the profiler */
+#define FRAME_PROFILER_WINDOW 120
+
+/* \brief CPU timings of the stages of a frame. Each stage is timed between begin and end, and the stages timed by their own
+ * class (getLast...Time) are added with add. Every FRAME_PROFILER_WINDOW frames, the average and the worst time of each stage
+ * are logged while the profiler is enabled */
+class FrameProfiler
+{
+    public:
+        /* \brief Start a frame */
+        void beginFrame();
+
+        /* \brief End a frame, and log the stages at the end of a window
+         * \return true if the stages were logged */
+        bool endFrame();
+
+        /* \brief Start timing a stage. Stages can be nested
+         * \param name the stage name, a string literal : stages are told apart by address */
+        void begin(const char* name);
+
+        /* \brief Stop timing the last stage started */
+        void end();
+
+        /* \brief Add a time measured elsewhere to a stage of this frame
+         * \param name the stage name, a string literal
+         * \param milliseconds the time */
+        void add(const char* name, double milliseconds);
+
+        /* \brief Turn the reports on or off. The stages are timed anyway
+         * \param enabled true to log the reports */
+        void setEnabled(bool enabled) {m_enabled = enabled;}
+
+        /* \brief Tell whether the reports are logged
+         * \return true if they are */
+        bool isEnabled() const {return m_enabled;}
+
+    private:
+        typedef std::chrono::high_resolution_clock Clock;
+
+        /* \brief A stage and its times over the current window */
+        struct Stage
+        {
+            const char* name;
+            uint32_t    depth;     /*!< Nesting level, for the indentation of the report*/
+            double      frameTime; /*!< Time of the current frame*/
+            double      total;
+            double      worst;
+        };
+
+        /* \brief Find a stage, or add it
+         * \param name the stage name
+         * \return its index in m_stages */
+        uint32_t findStage(const char* name);
+
+        std::vector<Stage>             m_stages;
+        std::vector<uint32_t>          m_open;      /*!< Stages begun and not ended yet*/
+        std::vector<Clock::time_point> m_openTimes;
+        Clock::time_point              m_frameBegin;
+        double                         m_frameTotal = 0.0;
+        double                         m_frameWorst = 0.0;
+        uint32_t                       m_nbFrames = 0;
+        bool                           m_enabled = false;
+};
+
+#endif
@@ -3,15 +3,21 @@
 
 #include <stdlib.h>
 #include <stdint.h>
+#include <atomic>
 
-/* \brief Represent a geometry*/
+/* Alignment of the data of a geometry, enough for the widest SIMD loads */
+#define GEOMETRY_ALIGNMENT 64
+
+/* \brief Represent a geometry. The vertices, normals and UVs are stored one after the other in a single aligned buffer, in the layout of the
+ * vertex buffers, so that it is uploaded as is (getData). The buffer is reference counted and read-only once built : copying a geometry
+ * shares it, and the edit functions give the geometry its own copy first if it is shared (copy-on-write)*/
 class Geometry
 {
     public:
         /* \brief The constructor.*/
         Geometry();
 
-        /* \brief Copy constructor
+        /* \brief Copy constructor. Share the data of "copy"
          * \param copy the object to copy*/
         Geometry(const Geometry& copy);
 
@@ -19,14 +25,19 @@ class Geometry
          * \param mvt the object to move. Do not use it afterward*/
         Geometry(Geometry&& mvt) noexcept;
 
-        /* \brief Assign operator. Make a copy of "copy"
+        /* \brief Assign operator. Share the data of "copy"
          * \param copy the object to copy
          * \return a reference to "this"*/
         Geometry& operator=(const Geometry& copy);
 
-        /* \brief Destructor. Destroy the data */
+        /* \brief Move assign operator
+         * \param mvt the object to move. Do not use it afterward
+         * \return a reference to "this"*/
+        Geometry& operator=(Geometry&& mvt) noexcept;
+
+        /* \brief Destructor. Release the data, destroyed with its last geometry */
         virtual ~Geometry();
-        
+
         /* \brief Get the vertices data of the geometry
          * \return const array on the vertices data. Use getNbVertices to get how many vertices the array contains (size(array) == 3*nbVertices) */
         const float* getVertices() const {return m_vertices;}
@@ -38,19 +49,63 @@ class Geometry
         /* \brief Get the UV mapping data of the geometry
          * \return const array on the UV mapping data. Use getNbVertices to get how many vertices the array contains (size(array) == 2*nbVertices) */
         const float* getUVs() const {return m_uvs;}
-        
+
+        /* \brief Get the whole data : the vertices, then the normals, then the UVs, GEOMETRY_ALIGNMENT aligned
+         * \return const array of getDataSize() bytes */
+        const float* getData() const {return m_vertices;}
+
+        /* \brief Get the size of the whole data
+         * \return the size in bytes, 8 floats per vertex */
+        size_t getDataSize() const {return (size_t)m_nbVertices * 8 * sizeof(float);}
+
         /* \brief Get how many vertices this geometry contains
          * \return the number of vertices this geometry contains*/
         uint32_t getNbVertices() const {return m_nbVertices;}
 
-    protected: 
-        /* \brief Clear all the tables*/
+        /* \brief Tell whether another geometry shares the data
+         * \return true if the data is shared */
+        bool isShared() const {return m_buffer != NULL && m_buffer->references.load() > 1;}
+
+        /* \brief Get the vertices to change them. The data is copied first if it is shared
+         * \return the array of 3*nbVertices floats, valid until this geometry is assigned or copied from */
+        float* editVertices() {makeUnique(); return m_vertices;}
+
+        /* \brief Get the normals to change them. The data is copied first if it is shared
+         * \return the array of 3*nbVertices floats */
+        float* editNormals() {makeUnique(); return m_normals;}
+
+        /* \brief Get the UVs to change them. The data is copied first if it is shared
+         * \return the array of 2*nbVertices floats */
+        float* editUVs() {makeUnique(); return m_uvs;}
+
+    protected:
+        /* \brief Replace the data by a new one, not shared, for a number of vertices. Its content is undefined : the subclasses fill it with the edit functions
+         * \param nbVertices the number of vertices */
+        void allocate(uint32_t nbVertices);
+
+        /* \brief Release the data*/
         void clear();
 
         uint32_t m_nbVertices = 0;
+
+    private:
+        /* \brief The header of the shared data, followed by the floats at GEOMETRY_ALIGNMENT bytes */
+        struct Buffer
+        {
+            std::atomic<uint32_t> references;
+        };
+
+        /* \brief Copy the data if another geometry shares it */
+        void makeUnique();
+
+        /* \brief Point the arrays in a buffer
+         * \param buffer the buffer, or NULL */
+        void setBuffer(Buffer* buffer);
+
         float*   m_vertices   = NULL;
         float*   m_normals    = NULL;
         float*   m_uvs        = NULL;
+        Buffer*  m_buffer     = NULL;
 };
 
 #endif
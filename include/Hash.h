@@ -0,0 +1,20 @@
+#ifndef  HASH_INC
+#define  HASH_INC
+
+#include <stdint.h>
+
+/* \brief Integer hash with a good avalanche (lowbias32, C. Wellons). The procedural generators draw their random numbers from it,
+ * so that any item can be generated alone, in any order, on any thread
+ * \param x the value to hash
+ * \return the hash */
+inline uint32_t hashInteger(uint32_t x)
+{
+    x ^= x >> 16;
+    x *= 0x7feb352d;
+    x ^= x >> 15;
+    x *= 0x846ca68b;
+    x ^= x >> 16;
+    return x;
+}
+
+#endif
@@ -0,0 +1,45 @@
+#ifndef  IMAGE_INC
+#define  IMAGE_INC
+
+#include <stdlib.h>
+#include <stdint.h>
+
+/* \brief An RGBA8 image stored in CPU memory (rows from top to bottom, as SDL_image loads them) */
+class Image
+{
+    public:
+        /* \brief Constructor. Allocate an image. The content is left undefined
+         * \param width the width in pixels
+         * \param height the height in pixels */
+        Image(uint32_t width, uint32_t height);
+
+        /* \brief Move constructor
+         * \param mvt the object to move. Do not use it afterward*/
+        Image(Image&& mvt) noexcept;
+
+        Image(const Image& copy) = delete;
+        Image& operator=(const Image& copy) = delete;
+
+        /* \brief Destructor. Destroy the pixels */
+        ~Image();
+
+        /* \brief Load an image file (any format SDL_image supports) and convert it to RGBA8
+         * \param path the file path
+         * \return the image loaded or NULL if error */
+        static Image* loadFromFile(const char* path);
+
+        /* \brief Get the pixels of the image
+         * \return width*height*4 bytes, RGBA */
+        const uint8_t* getPixels() const {return m_pixels;}
+        uint8_t* getPixels() {return m_pixels;}
+
+        uint32_t getWidth()  const {return m_width;}
+        uint32_t getHeight() const {return m_height;}
+
+    private:
+        uint32_t m_width  = 0;
+        uint32_t m_height = 0;
+        uint8_t* m_pixels = NULL;
+};
+
+#endif
@@ -0,0 +1,43 @@
+#ifndef  IMAGEPROCESSING_INC
+#define  IMAGEPROCESSING_INC
+
+#include <stdint.h>
+#include <vector>
+
+#include "Image.h"
+
+/* \brief The windowed-sinc filters available to downsample the mip levels */
+enum MipFilter
+{
+    MIP_FILTER_LANCZOS3, /*!< Lanczos, 3 lobes*/
+    MIP_FILTER_KAISER    /*!< Kaiser windowed sinc, 3 lobes, beta = 4*/
+};
+
+/* \brief CPU image processing kernels (SSE2 through Float4, AVX2 when compiled with ENABLE_AVX2).
+ * Every function splits its work over the job threads. RGB is treated as sRGB and filtered in linear space, alpha is linear. */
+class ImageProcessing
+{
+    public:
+        /* \brief Convert an equirectangular image to one face of a cubemap (OpenGL face order and orientation).
+         * The mapping is the one of the Sphere mesh : uv = (theta/2pi, phi/pi), theta = atan2(x, z), phi = acos(y)
+         * \param equirectangular the source image
+         * \param face the face index, 0 = GL_TEXTURE_CUBE_MAP_POSITIVE_X ... 5 = GL_TEXTURE_CUBE_MAP_NEGATIVE_Z
+         * \param faceImage receives the face. Must be square */
+        static void equirectangularToCubeFace(const Image& equirectangular, uint32_t face, Image& faceImage);
+
+        /* \brief Downsample an image by two in each dimension (at least one pixel)
+         * \param src the source image
+         * \param filter the filter to use
+         * \param wrapX true to wrap horizontally (equirectangular maps), false to clamp
+         * \return the downsampled image */
+        static Image* downsample(const Image& src, MipFilter filter, bool wrapX);
+
+        /* \brief Build every mip level below "src", down to 1x1
+         * \param src the level 0
+         * \param filter the filter to use
+         * \param wrapX true to wrap horizontally (equirectangular maps), false to clamp
+         * \return the levels 1 to n. The caller owns them */
+        static std::vector<Image*> buildMipChain(const Image& src, MipFilter filter, bool wrapX);
+};
+
+#endif
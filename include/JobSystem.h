@@ -0,0 +1,77 @@
+#ifndef  JOBSYSTEM_INC
+#define  JOBSYSTEM_INC
+
+#include <stdint.h>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <atomic>
+
+/* \brief A small pool of worker threads used to spread CPU work (rendering, image processing, simulation) over all the cores */
+class JobSystem
+{
+    public:
+        /* \brief Function called on a range [begin, end) of items */
+        typedef std::function<void(uint32_t begin, uint32_t end)> RangeFunction;
+
+        /* \brief Constructor. Create the worker threads
+         * \param nbThreads how many threads work on the jobs, including the calling thread. 0 = one per hardware thread */
+        JobSystem(uint32_t nbThreads = 0);
+
+        /* \brief Destructor. Stop and join the worker threads */
+        ~JobSystem();
+
+        JobSystem(const JobSystem&) = delete;
+        JobSystem& operator=(const JobSystem&) = delete;
+
+        /* \brief Run func over [0, count) split in batches of "grain" items, and wait until every batch is done.
+         * The calling thread takes part in the work. Batches are handed out dynamically so uneven work is balanced.
+         * func is called where it is, through a pointer : unlike a RangeFunction made from a lambda, nothing is allocated
+         * \param count the number of items
+         * \param grain the number of items per batch (at least 1)
+         * \param func the function called for each batch, func(begin, end) */
+        template<typename F> void parallelFor(uint32_t count, uint32_t grain, const F& func)
+        {
+            run(count, grain, &func, [](const void* context, uint32_t begin, uint32_t end) {(*(const F*)context)(begin, end);});
+        }
+
+        /* \brief Get how many threads take part in parallelFor (workers + calling thread)
+         * \return the number of threads*/
+        uint32_t getNbThreads() const {return (uint32_t)m_workers.size()+1;}
+
+        /* \brief Get the job system shared by the whole application
+         * \return the shared job system, created on first use */
+        static JobSystem& get();
+
+    private:
+        /* \brief Function calling the func of a parallelFor, given as context */
+        typedef void (*RangeCall)(const void* context, uint32_t begin, uint32_t end);
+
+        /* \brief The body of parallelFor */
+        void run(uint32_t count, uint32_t grain, const void* context, RangeCall call);
+
+        /* \brief Take batches of the current job until there is none left */
+        void runBatches();
+
+        /* \brief Main function of the worker threads */
+        void workerLoop();
+
+        std::vector<std::thread> m_workers;
+        std::mutex               m_mutex;
+        std::condition_variable  m_wakeUp;
+        std::condition_variable  m_done;
+        std::mutex               m_submitMutex;  /*!< Only one parallelFor runs at a time*/
+
+        const void*           m_context   = nullptr;
+        RangeCall             m_call      = nullptr;
+        uint32_t              m_count     = 0;
+        uint32_t              m_grain     = 1;
+        std::atomic<uint32_t> m_next{0};
+        uint32_t              m_nbBusy    = 0;
+        uint64_t              m_jobID     = 0;
+        bool                  m_quit      = false;
+};
+
+#endif
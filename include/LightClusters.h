@@ -0,0 +1,99 @@
+#ifndef  LIGHTCLUSTERS_INC
+#define  LIGHTCLUSTERS_INC
+
+#include <GL/glew.h>
+#include <GL/gl.h>
+#include <glm/glm.hpp>
+#include <stdint.h>
+#include <vector>
+
+#include "Shader.h"
+
+#define LIGHT_CLUSTERS_X              16
+#define LIGHT_CLUSTERS_Y              9
+#define LIGHT_CLUSTERS_Z              24
+#define LIGHT_CLUSTERS_MAX_LIGHTS     4096
+#define LIGHT_INDICES_TEXTURE_WIDTH   4096
+#define LIGHT_CLUSTERS_TEXTURE_UNIT   1 /*!< The cluster textures use the units 1, 2 and 3. Unit 0 is the material texture*/
+
+/* \brief A point light with a finite influence radius. Its contribution fades out over the last tenth of the radius*/
+struct PointLight
+{
+    glm::vec3 position; /*!< World space position*/
+    float     radius;   /*!< Distance beyond which the light has no effect*/
+    glm::vec3 color;
+};
+
+/* \brief Clustered forward lighting. The view frustum is split into LIGHT_CLUSTERS_X * LIGHT_CLUSTERS_Y tiles on screen
+ * and LIGHT_CLUSTERS_Z exponential depth slices. Every frame the lights are assigned to the clusters they touch (SIMD, one job per slice),
+ * and the result is uploaded to integer textures so that a fragment only loops over the lights of its cluster. */
+class LightClusters
+{
+    public:
+        /* \brief Constructor. Create the textures
+         * \param screenWidth the viewport width in pixels
+         * \param screenHeight the viewport height in pixels */
+        LightClusters(uint32_t screenWidth, uint32_t screenHeight);
+
+        /* \brief Destructor. Destroy the textures */
+        ~LightClusters();
+
+        LightClusters(const LightClusters&) = delete;
+        LightClusters& operator=(const LightClusters&) = delete;
+
+        /* \brief Assign the lights to the clusters and upload the result
+         * \param lights the lights. Only the first LIGHT_CLUSTERS_MAX_LIGHTS are used
+         * \param view the camera view matrix
+         * \param projection the camera projection matrix (glm::perspective)
+         * \param zNear the near plane distance of the projection
+         * \param zFar the far plane distance of the projection */
+        void update(const std::vector<PointLight>& lights, const glm::mat4& view, const glm::mat4& projection, float zNear, float zFar);
+
+        /* \brief Bind the textures and set the uniforms of a CLUSTERED shader variant. The shader must be in use
+         * \param shader the shader */
+        void bind(const Shader* shader) const;
+
+        /* \brief Get how many lights were assigned by the last update
+         * \return the number of lights */
+        uint32_t getNbLights() const {return m_nbLights;}
+
+        /* \brief Get how many (cluster, light) pairs the last update found
+         * \return the number of light indices */
+        uint32_t getNbIndices() const {return m_nbIndices;}
+
+        /* \brief Get the CPU time of the last assignment, upload excluded
+         * \return the time in milliseconds */
+        double getLastAssignTime() const {return m_lastAssignTime;}
+
+    private:
+        /* \brief Compute the view space bounding box of every cluster */
+        void buildClusterBounds(const glm::mat4& projection, float zNear, float zFar);
+
+        uint32_t m_screenWidth;
+        uint32_t m_screenHeight;
+        uint32_t m_nbLights       = 0;
+        uint32_t m_nbIndices      = 0;
+        double   m_lastAssignTime = 0.0;
+
+        /* Cluster bounds, in view space, for the projection they were built for*/
+        glm::mat4          m_boundsProjection = glm::mat4(0.0f);
+        float              m_boundsNear       = 0.0f;
+        float              m_boundsFar        = 0.0f;
+        std::vector<float> m_clusterMin; /*!< x, y, z per cluster*/
+        std::vector<float> m_clusterMax; /*!< x, y, z per cluster*/
+
+        std::vector<uint32_t>              m_grid;          /*!< offset, count per cluster*/
+        std::vector<uint32_t>              m_indices;       /*!< The light indices of every cluster, one after the other*/
+        std::vector<std::vector<uint32_t>> m_sliceIndices;  /*!< The indices found by each slice job*/
+        std::vector<float>                 m_lightData;     /*!< Two RGBA texels per light : position and radius, color*/
+
+        GLuint   m_gridTexture    = 0; /*!< RG32UI, (X*Y) x Z*/
+        GLuint   m_indexTexture   = 0; /*!< R32UI, LIGHT_INDICES_TEXTURE_WIDTH x n*/
+        GLuint   m_lightTexture   = 0; /*!< RGBA32F, 2*lights x 1*/
+        uint32_t m_indexTextureHeight = 0;
+        uint32_t m_lightTextureWidth  = 0;
+        float    m_sliceScale = 0.0f;
+        float    m_sliceBias  = 0.0f;
+};
+
+#endif
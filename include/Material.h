@@ -0,0 +1,55 @@
+#ifndef  MATERIAL_INC
+#define  MATERIAL_INC
+
+#include <GL/glew.h>
+#include <GL/gl.h>
+#include <glm/glm.hpp>
+#include <stdint.h>
+
+#include "Shader.h"
+#include "logger.h"
+
+/* \brief The Phong material of a body*/
+struct Material
+{
+    glm::vec3 color;         /*!< The albedo when there is no texture*/
+    float     ka;            /*!< Ambient coefficient. The emission scale of the emissive materials*/
+    float     kd;            /*!< Diffuse coefficient*/
+    float     ks;            /*!< Specular coefficient*/
+    float     alpha;         /*!< Specular exponent*/
+    GLuint    texture = 0;   /*!< The albedo texture, 0 for none*/
+    bool      sky     = false; /*!< The background, seen from inside*/
+
+    /* \brief Tell if the material does not reflect light (the stars and the sky)*/
+    bool isEmissive() const {return kd == 0.0f && ks == 0.0f;}
+
+    /* \brief Get the cheapest shader variant that renders this material correctly
+     * \param nbLights the number of lights lighting the body. The variants have at most 3, the lights after are left out
+     * \param clustered true if the lights come from the LightClusters instead
+     * \param eclipsed true if some occluders hide part of the light of the body
+     * \return the variant key */
+    uint32_t getVariantKey(uint32_t nbLights, bool clustered = false, bool eclipsed = false) const
+    {
+        uint32_t key = shaderFeatureBits(SHADER_FEATURE_TEXTURED, texture != 0);
+        if(sky && isEmissive() && ka == 1.0f)
+            return key | shaderFeatureBits(SHADER_FEATURE_UNLIT_SKY, 1);
+        if(!isEmissive() && eclipsed)
+            key |= shaderFeatureBits(SHADER_FEATURE_ECLIPSES, 1);
+        if(clustered && !isEmissive())
+            return key | shaderFeatureBits(SHADER_FEATURE_CLUSTERED, 1);
+        if(isEmissive() || nbLights == 0)
+            return key | shaderFeatureBits(SHADER_FEATURE_EMISSIVE, 1);
+        const uint32_t maxLights = (1u << SHADER_FEATURE_TABLE[SHADER_FEATURE_NUM_LIGHTS].nbBits) - 1;
+        if(nbLights > maxLights)
+        {
+            static bool warned = false;
+            if(!warned)
+                WARNING("The shader variants have at most %u lights, %u asked\n", maxLights, nbLights);
+            warned = true;
+            nbLights = maxLights;
+        }
+        return key | shaderFeatureBits(SHADER_FEATURE_NUM_LIGHTS, nbLights);
+    }
+};
+
+#endif
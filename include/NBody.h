@@ -0,0 +1,129 @@
+#ifndef  NBODY_INC
+#define  NBODY_INC
+
+#include <stdint.h>
+#include <vector>
+#include <utility>
+#include <glm/glm.hpp>
+
+/* Most bodies a leaf of the octree holds before it is split */
+#define NBODY_LEAF_SIZE 8
+/* Depth of the octree : the Morton codes have 21 bits per axis */
+#define NBODY_MAX_DEPTH 21
+
+/* \brief The settings of a simulation */
+struct NBodyParameters
+{
+    double gravity      = 1.0;  /*!< Gravitational constant*/
+    double timeStep     = 0.01; /*!< Fixed step of the integrator*/
+    double softening    = 1e-3; /*!< Plummer softening length, avoids infinite forces at close encounters*/
+    double openingAngle = 0.5;  /*!< Barnes-Hut theta : a cell seen under a smaller angle (size / distance) is one body. 0 = exact sum, at most 1*/
+};
+
+/* \brief A node of the octree, in depth first order : the first child of an internal node is the next node */
+struct NBodyNode
+{
+    glm::dvec3 centerOfMass;
+    double     mass;
+    double     openRadius2; /*!< Squared distance below which the node must be opened*/
+    uint32_t   next;        /*!< The node after this subtree*/
+    uint32_t   first;       /*!< First body of a leaf in the sorted arrays*/
+    uint32_t   count;       /*!< Number of bodies of a leaf, 0 for the internal nodes*/
+};
+
+/* \brief Gravity between many bodies. The forces come from a Barnes-Hut octree rebuilt every step over the Morton order of the bodies,
+ * and walked by the job threads. The integrator is a kick-drift-kick leapfrog on a fixed step : symplectic, its energy error stays bounded with exact forces,
+ * what drifts comes from the tree approximation and the close encounters. */
+class NBody
+{
+    public:
+        /* \brief Constructor
+         * \param params the simulation settings */
+        NBody(const NBodyParameters& params = NBodyParameters());
+
+        /* \brief Add a body
+         * \param position its position
+         * \param velocity its velocity
+         * \param mass its mass
+         * \return its index */
+        uint32_t add(const glm::dvec3& position, const glm::dvec3& velocity, double mass);
+
+        /* \brief Remove every body */
+        void clear();
+
+        /* \brief Change the Barnes-Hut opening angle
+         * \param theta the new angle, clamped to [0, 1] */
+        void setOpeningAngle(double theta);
+
+        /* \brief Get the settings
+         * \return the parameters */
+        const NBodyParameters& getParameters() const {return m_params;}
+
+        /* \brief Move the simulation forward by whole fixed steps. The remainder is kept for the next call
+         * \param dt the time elapsed
+         * \return the number of steps done */
+        uint32_t advance(double dt);
+
+        /* \brief Do one leapfrog step of timeStep */
+        void step();
+
+        /* \brief Get the total energy, kinetic + potential. The potential is the Barnes-Hut one of the last force computation
+         * \return the energy */
+        double getEnergy();
+
+        /* \brief Get the number of bodies
+         * \return the number of bodies added */
+        uint32_t getNbBodies() const {return (uint32_t)m_mass.size();}
+
+        /* \brief Get the position of a body
+         * \param bodyID the index returned by add
+         * \return its position */
+        glm::dvec3 getPosition(uint32_t bodyID) const {return m_position[bodyID];}
+
+        /* \brief Get the velocity of a body
+         * \param bodyID the index returned by add
+         * \return its velocity */
+        glm::dvec3 getVelocity(uint32_t bodyID) const {return m_velocity[bodyID];}
+
+        /* \brief Get the CPU time of the last force computation, octree build included
+         * \return the time in milliseconds */
+        double getLastForceTime() const {return m_lastForceTime;}
+
+        /* \brief Get the number of body-body and body-node interactions of the last force computation
+         * \return the number of interactions */
+        uint64_t getLastNbInteractions() const {return m_lastNbInteractions;}
+
+    private:
+        /* \brief Sort the bodies along the Morton curve and build the octree over them */
+        void buildTree();
+
+        /* \brief Build the subtree of the sorted bodies [first, last), all in the same cell of "level"
+         * \return its node index */
+        uint32_t buildNode(uint32_t first, uint32_t last, uint32_t level, const glm::dvec3& cellMin, double cellSize);
+
+        /* \brief Compute the accelerations and potentials of every body */
+        void computeForces();
+
+        NBodyParameters m_params;
+        double m_remainingTime = 0.0;
+        bool   m_forcesValid   = false; /*!< The accelerations match the positions*/
+
+        std::vector<glm::dvec3> m_position;
+        std::vector<glm::dvec3> m_velocity;
+        std::vector<glm::dvec3> m_acceleration;
+        std::vector<double>     m_potential;
+        std::vector<double>     m_mass;
+
+        /* Bodies sorted along the Morton curve, so that the leaves are ranges and close bodies walk the tree one after another */
+        std::vector<uint64_t>   m_codes; /*!< Morton codes, 3 x 21 bits*/
+        std::vector<uint32_t>   m_order; /*!< Body index of each sorted entry*/
+        std::vector<std::pair<uint64_t, uint32_t>> m_sortKeys; /*!< The codes with their body index while they are sorted, kept between the steps*/
+        std::vector<glm::dvec3> m_sortedPosition;
+        std::vector<double>     m_sortedMass;
+        std::vector<NBodyNode>  m_nodes;
+
+        double   m_lastForceTime      = 0.0;
+        uint64_t m_lastNbInteractions = 0;
+};
+
+#endif
@@ -0,0 +1,88 @@
+#ifndef  ORBITS_INC
+#define  ORBITS_INC
+
+#include <stdint.h>
+#include <vector>
+#include <glm/glm.hpp>
+
+/* Halley iterations of the Kepler equation solver. The convergence is cubic : once a step is below the tolerance, the error is below the float precision */
+#define KEPLER_MAX_ITERATIONS 8
+#define KEPLER_TOLERANCE      1e-4f
+/* Above, Halley needs more than KEPLER_MAX_ITERATIONS iterations near the periapsis in float. The elements are clamped to it */
+#define KEPLER_MAX_ECCENTRICITY 0.99f
+
+/* \brief The Keplerian elements of an elliptic orbit around the parent body.
+ * The reference plane is the XZ plane of the scene, the node longitude is measured from +X and the bodies go counterclockwise seen from +Y,
+ * like glm::rotate around +Y. Angles are in radians */
+struct KeplerElements
+{
+    float semiMajorAxis       = 1.0f;
+    float eccentricity        = 0.0f;
+    float inclination         = 0.0f;
+    float longitudeOfNode     = 0.0f; /*!< Longitude of the ascending node*/
+    float argumentOfPeriapsis = 0.0f;
+    float meanAnomaly         = 0.0f; /*!< Mean anomaly at t = 0*/
+    float meanMotion          = 1.0f; /*!< Mean anomaly gained per unit of time*/
+};
+
+/* \brief Keplerian orbits stored as structure of arrays and propagated 4 at a time (Float4) on the job threads.
+ * The orientation of each orbit is precomputed, so a frame only solves the Kepler equation and rotates the result. */
+class Orbits
+{
+    public:
+        /* \brief Add an orbit
+         * \param elements its elements. The eccentricity is clamped to [0, KEPLER_MAX_ECCENTRICITY]
+         * \return its index, for getPosition */
+        uint32_t add(const KeplerElements& elements);
+
+        /* \brief Remove every orbit */
+        void clear();
+
+        /* \brief Get the number of orbits
+         * \return the number of orbits added */
+        uint32_t getNbOrbits() const {return m_nbOrbits;}
+
+        /* \brief Compute the position of every body at a date
+         * \param t the date. The mean anomalies are reduced in double, so t can grow for a long time */
+        void propagate(double t);
+
+        /* \brief Get the position of a body computed by the last propagate, relative to its parent
+         * \param orbitID the index returned by add
+         * \return the position */
+        glm::vec3 getPosition(uint32_t orbitID) const {return glm::vec3(m_x[orbitID], m_y[orbitID], m_z[orbitID]);}
+
+        /* \brief Get the CPU time of the last propagate
+         * \return the time in milliseconds */
+        double getLastUpdateTime() const {return m_lastUpdateTime;}
+
+        /* \brief Compute one position in double precision, the slow way. Reference for the benchmark
+         * \param elements the orbit
+         * \param t the date
+         * \return the position relative to the parent */
+        static glm::dvec3 solve(const KeplerElements& elements, double t);
+
+        /* \brief Get the axes of the plane of an orbit, in the scene frame
+         * \param elements the orbit
+         * \param p receives the unit vector towards the periapsis
+         * \param q receives the unit vector 90 degrees ahead of it in the orbit plane */
+        static void getAxes(const KeplerElements& elements, glm::dvec3& p, glm::dvec3& q);
+
+    private:
+        uint32_t m_nbOrbits = 0;
+
+        /* One entry per orbit, padded with null orbits to a multiple of 4 */
+        std::vector<float> m_meanAnomaly;
+        std::vector<float> m_meanMotion;
+        std::vector<float> m_eccentricity;
+        std::vector<float> m_semiMajorAxis;
+        std::vector<float> m_semiMinorAxis;
+        std::vector<float> m_axisP[3]; /*!< Unit vector towards the periapsis*/
+        std::vector<float> m_axisQ[3]; /*!< Unit vector 90 degrees ahead of it in the orbit plane*/
+
+        std::vector<float> m_x;
+        std::vector<float> m_y;
+        std::vector<float> m_z;
+        double m_lastUpdateTime = 0.0;
+};
+
+#endif
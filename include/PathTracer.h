@@ -0,0 +1,136 @@
+#ifndef  PATHTRACER_INC
+#define  PATHTRACER_INC
+
+#include <stdint.h>
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "Image.h"
+#include "Simd.h"
+
+/* \brief A sphere of the scene as seen by the path tracer*/
+struct PTSphere
+{
+    glm::vec3    center       = glm::vec3(0.0f);
+    float        radius       = 0.5f;
+    glm::mat3    worldToLocal = glm::mat3(1.0f); /*!< Maps (point - center) to the sphere local frame. Used for the texture mapping*/
+    glm::vec3    albedo       = glm::vec3(0.8f); /*!< Diffuse reflectance, multiplied by the texture color*/
+    glm::vec3    emission     = glm::vec3(0.0f); /*!< Radiance scale of the area lights (the stars), multiplied by the texture color*/
+    const Image* texture      = nullptr;         /*!< Equirectangular texture (sRGB), same mapping as the Sphere mesh. Can be NULL*/
+};
+
+/* \brief CPU path tracer used for offline high-quality renders of the scene.
+ * Spheres are intersected analytically through a BVH traversed by packets of 4 rays (SIMD).
+ * The image is split into tiles rendered by the job threads, and each pass adds one sample per pixel to the accumulation buffer*/
+class PathTracer
+{
+    public:
+        /* \brief Constructor
+         * \param width the image width in pixels
+         * \param height the image height in pixels */
+        PathTracer(uint32_t width, uint32_t height);
+
+        /* \brief Set the scene to render and build the BVH over it. Resets the accumulation.
+         * \param spheres the bodies. Those with a non zero emission are the area lights
+         * \param environment the equirectangular background seen by rays escaping the scene. Can be NULL
+         * \param environmentScale the radiance scale of the background */
+        void setScene(const std::vector<PTSphere>& spheres, const Image* environment, float environmentScale);
+
+        /* \brief Set the camera. Resets the accumulation.
+         * \param invViewProjection the inverse of projection*view used by the rasterizer
+         * \param position the camera position in world space */
+        void setCamera(const glm::mat4& invViewProjection, const glm::vec3& position);
+
+        /* \brief Set how many bounces a path can do
+         * \param maxDepth the maximum number of bounces */
+        void setMaxDepth(uint32_t maxDepth) {m_maxDepth = maxDepth;}
+
+        /* \brief Clear the accumulation buffer*/
+        void reset();
+
+        /* \brief Render one more sample per pixel and add it to the accumulation buffer*/
+        void renderPass();
+
+        /* \brief Write the current estimate (tone mapped, sRGB) to a binary PPM file
+         * \param path the file path
+         * \return true on success, false otherwise */
+        bool saveToPPM(const char* path) const;
+
+        /* \brief Get how many passes were accumulated since the last reset
+         * \return the number of samples per pixel */
+        uint32_t getNbPasses() const {return m_nbPasses;}
+
+        /* \brief Get how many rays (camera, bounce and shadow rays) the last pass traced
+         * \return the number of rays */
+        uint64_t getLastNbRays() const {return m_lastNbRays;}
+
+        /* \brief Get the throughput of the last pass
+         * \return rays per second */
+        double getLastRaysPerSecond() const {return m_lastRaysPerSecond;}
+
+    private:
+        /* \brief A node of the BVH. Leaves have count > 0 and reference [first, first+count) in m_spheres*/
+        struct BVHNode
+        {
+            float    bmin[3];
+            float    bmax[3];
+            uint32_t leftOrFirst; /*!< Left child for inner nodes (right = left+1), first sphere for leaves*/
+            uint16_t count;
+            uint16_t axis;
+        };
+
+        /* \brief 4 rays stored in SoA*/
+        struct RayPacket
+        {
+            Float4 ox, oy, oz;
+            Float4 dx, dy, dz;
+            Float4 tMax;
+            Float4 active;
+        };
+
+        /* \brief Build the BVH recursively
+         * \param nodeID the node to fill, covering [first, first+count)
+         * \param depth the depth of the node, 0 for the root. m_bvhDepth keeps the largest one */
+        void buildNode(uint32_t nodeID, uint32_t first, uint32_t count, uint32_t depth);
+
+        /* \brief Find the closest hit of every active ray
+         * \param packet the rays. tMax is shortened to the hits
+         * \param hitID receives the hit sphere index per lane, or -1 */
+        void intersect(RayPacket& packet, int hitID[4]) const;
+
+        /* \brief Tell which active rays hit something before their tMax
+         * \param packet the rays
+         * \return a mask of the occluded lanes */
+        Float4 occluded(const RayPacket& packet) const;
+
+        /* \brief Render one tile
+         * \param tileID the tile index
+         * \return the number of rays traced */
+        uint64_t renderTile(uint32_t tileID);
+
+        /* \brief Sample a sphere texture at the direction "localDir" (linear RGB)*/
+        glm::vec3 sampleTexture(const Image* texture, const glm::vec3& localDir) const;
+
+        uint32_t m_width;
+        uint32_t m_height;
+        uint32_t m_maxDepth = 5;
+        uint32_t m_nbPasses = 0;
+        uint64_t m_lastNbRays = 0;
+        double   m_lastRaysPerSecond = 0.0;
+
+        std::vector<PTSphere>  m_spheres;
+        std::vector<uint32_t>  m_lights;  /*!< Indices of the emissive spheres*/
+        std::vector<BVHNode>   m_nodes;
+        uint32_t               m_bvhDepth = 0; /*!< Depth of the deepest leaf, the traversals need a stack of m_bvhDepth+1 entries*/
+        std::vector<float>     m_sphereData; /*!< x, y, z, radius² per sphere, in BVH order*/
+        const Image*           m_environment = nullptr;
+        float                  m_environmentScale = 1.0f;
+
+        glm::mat4 m_invViewProjection = glm::mat4(1.0f);
+        glm::vec3 m_cameraPosition    = glm::vec3(0.0f);
+
+        std::vector<glm::vec3> m_accumulation;
+        float                  m_srgbToLinear[256];
+};
+
+#endif
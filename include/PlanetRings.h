@@ -0,0 +1,112 @@
+#ifndef  PLANETRINGS_INC
+#define  PLANETRINGS_INC
+
+#include <GL/glew.h>
+#include <GL/gl.h>
+#include <stdint.h>
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "AsteroidField.h"
+#include "AsteroidRenderer.h"
+#include "Image.h"
+#include "Shader.h"
+#include "DepthBuffer.h"
+
+/* Particles tried per cell of the ring plane. A particle is kept if a random number is below the opacity of the ring at its radius times the level of detail */
+#define RINGS_PARTICLES_PER_CELL 24
+
+/* \brief The description of a ring system. Lengths are in planet radii, like AtmosphereParameters, so the rings follow the size of their planet */
+struct RingParameters
+{
+    float     innerRadius      = 1.24f;   /*!< The left column of the opacity image is at innerRadius, the right one at outerRadius*/
+    float     outerRadius      = 2.27f;
+    glm::vec3 color            = glm::vec3(0.85f, 0.76f, 0.64f);
+    uint32_t  nbSegments       = 128;     /*!< Sides of the annulus mesh. Its edges are cut per pixel, so it can stay coarse*/
+    float     angularSpeed     = 1.2f;    /*!< Angular speed of the particles at 1 planet radius, in radians per unit of time. Kepler's law gives the others*/
+    float     particleDistance = 0.6f;    /*!< The particles appear below this distance to the rings, and grow in number down to 0*/
+    float     particleRange    = 0.2f;    /*!< The particles fill a disk of this radius in the rings, around the point closest to the camera*/
+    float     cellSize         = 0.01f;   /*!< Size of the cells the particles are generated in*/
+    float     thickness        = 0.004f;  /*!< Vertical spread of the particles*/
+    float     minParticleSize  = 0.0015f; /*!< Diameter of the smallest particles. Power law like the asteroids*/
+    float     maxParticleSize  = 0.008f;
+    uint32_t  maxParticles     = 30000;
+    uint32_t  seed             = 7;
+};
+
+/* \brief Planetary rings with two levels of detail.
+ * From afar, one annulus blended over the scene, its opacity read from a single channel texture with mips along the radius.
+ * Being a single flat layer, it never covers itself and needs no sorting : the opaque planet hides it or is seen through it by the depth test alone.
+ * Close to the plane of the rings, opaque instanced particles are added around the camera, drawn with the AsteroidRenderer. Their number
+ * grows as the camera comes closer, and the annulus thins out around the camera so that they take over. They are generated from a hash
+ * of their cell, each radial band of cells turning at its own Keplerian speed : nothing is stored between frames. */
+class PlanetRings
+{
+    public:
+        /* \brief Destructor. Destroy the texture and the shader */
+        ~PlanetRings();
+
+        PlanetRings(const PlanetRings&) = delete;
+        PlanetRings& operator=(const PlanetRings&) = delete;
+
+        /* \brief Create rings
+         * \param params the ring description
+         * \param opacity the opacity of the rings, from innerRadius (left) to outerRadius (right) in the alpha channel. The rows are averaged
+         * \return the rings or NULL if error */
+        static PlanetRings* create(const RingParameters& params, const Image& opacity);
+
+        /* \brief Set how the particles are drawn. Without a renderer, only the annulus is drawn
+         * \param renderer the renderer of the particles, not owned
+         * \param texture the texture of the particles */
+        void setParticles(AsteroidRenderer* renderer, GLuint texture) {m_particleRenderer = renderer; m_particleTexture = texture;}
+
+        /* \brief Draw the rings of a planet, blended over what is drawn. Call it after the opaque objects, camera-relative like them
+         * \param center the planet center
+         * \param planetRadius the planet radius
+         * \param orientation the axes of the planet : the rings are in its (x, z) plane
+         * \param sunPosition the position of the star lighting them
+         * \param t the date, for the motion of the particles
+         * \param view the camera rotation
+         * \param projection the camera projection matrix
+         * \param depthBuffer the depth mode of the frame. NULL for the standard one */
+        void draw(const glm::vec3& center, float planetRadius, const glm::mat3& orientation, const glm::vec3& sunPosition, double t,
+                  const glm::mat4& view, const glm::mat4& projection, const DepthBuffer* depthBuffer = nullptr);
+
+        /* \brief Get the number of particles of the last draw
+         * \return the number of particles */
+        uint32_t getNbParticles() const {return (uint32_t)m_particles.size();}
+
+        /* \brief Get the CPU time spent to generate the particles of the last draw
+         * \return the time in milliseconds */
+        double getLastParticleTime() const {return m_lastParticleTime;}
+
+        /* \brief Get the ring description
+         * \return the parameters */
+        const RingParameters& getParameters() const {return m_params;}
+    private:
+        PlanetRings() {}
+
+        /* \brief Generate the particles in reach of the camera
+         * \param center the center of the disk of particles, the point of the rings closest to the camera : (x, z) in the frame of the rings, in planet radii
+         * \param lod the level of detail, in (0, 1]
+         * \param t the date */
+        void generateParticles(const glm::vec2& center, float lod, double t);
+
+        /* \brief Get the opacity of the rings
+         * \param radius the distance to the planet center, in planet radii
+         * \return the opacity, 0 outside of the rings */
+        float getOpacity(float radius) const;
+
+        RingParameters                m_params;
+        std::vector<float>            m_opacity;  /*!< The opacity profile, for the density of the particles*/
+        std::vector<AsteroidInstance> m_particles; /*!< In the frame of the rings, in planet radii*/
+        std::vector<AsteroidInstance> m_instances; /*!< The particles of the frame, camera-relative*/
+        std::vector<std::vector<AsteroidInstance>> m_groups; /*!< The particles of each job, kept for their capacity*/
+        GLuint                        m_opacityID = 0;
+        Shader*                       m_shader = nullptr;
+        AsteroidRenderer*             m_particleRenderer = nullptr;
+        GLuint                        m_particleTexture = 0;
+        double                        m_lastParticleTime = 0.0;
+};
+
+#endif
@@ -0,0 +1,18 @@
+#ifndef  ROCK_INC
+#define  ROCK_INC
+
+#include "Geometry.h"
+#include <glm/glm.hpp>
+
+/* \brief A low-poly rock : an icosphere of radius 0.5 (like Sphere) dented by random bumps, with flat normals.
+ * The UV mapping is the spherical one of Sphere, so the planet textures can be used on it */
+class Rock : public Geometry
+{
+    public:
+        /* \brief Constructor
+         * \param seed the seed of the bumps
+         * \param nbSubdivisions how many times the 20 faces of the icosahedron are split in 4 */
+        Rock(uint32_t seed, uint32_t nbSubdivisions);
+};
+
+#endif
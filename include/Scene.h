@@ -0,0 +1,146 @@
+#ifndef  SCENE_INC
+#define  SCENE_INC
+
+#include <stdint.h>
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "Orbits.h"
+
+/* Size of the chunks read by the text parser */
+#define SCENE_READ_BUFFER_SIZE (1 << 20)
+
+/* \brief The atmospheres a body can have */
+enum SceneAtmosphere
+{
+    SCENE_ATMOSPHERE_NONE,
+    SCENE_ATMOSPHERE_EARTH, /*!< AtmosphereParameters::earth*/
+    SCENE_ATMOSPHERE_HAZE   /*!< AtmosphereParameters::haze*/
+};
+
+/* \brief A texture of the scene. The strings are offsets in the string table of the scene */
+struct SceneTexture
+{
+    uint32_t name;
+    uint32_t path;
+};
+
+/* \brief A body of the scene, as stored in the binary files. Its parent comes before it, so the bodies can be created in order */
+struct SceneBody
+{
+    uint32_t       name;           /*!< Offset of the name in the string table*/
+    int32_t        parent;         /*!< Index of the parent body, -1 for the root*/
+    int32_t        texture;        /*!< Index of the albedo texture, -1 for none*/
+    glm::vec3      color;          /*!< The Material of the body*/
+    float          ka;
+    float          kd;
+    float          ks;
+    float          alpha;
+    uint32_t       sky;            /*!< 1 for the background, seen from inside*/
+    int32_t        light;          /*!< The number of the star this body is, 0 if it is not one*/
+    int32_t        lit;            /*!< The number of the star lighting the body, 0 for none*/
+    uint32_t       hasOrbit;       /*!< 0 : the body stays at the center of its parent, it only spins*/
+    KeplerElements orbit;
+    float          spin;           /*!< Rotation on itself around +Y, in radians per unit of time*/
+    float          tilt;           /*!< Lean of the spin axis around +X, in radians*/
+    glm::vec3      size;           /*!< Scale of the unit sphere*/
+    int32_t        atmosphere;     /*!< A SceneAtmosphere*/
+    uint32_t       rings;          /*!< Offset of the path of the ring image in the string table, 0 for none*/
+    int32_t        ephemerisID;    /*!< Body of the ephemeris replacing the orbit when one is given, -1 for none*/
+};
+
+/* \brief A scene description : the textures, and the bodies with their hierarchy, material and orbit.
+ * Two forms are read, told apart by their first bytes :
+ * - text, to edit. One statement per line, # starts a comment :
+ *     texture <name> <path>
+ *     body <name> <parent> key=value ...
+ *   The parent is the name of a body declared before, - for the root. The first body is the root, every other one has a parent.
+ *   The keys : texture=<name>, color=r,g,b, ka=, kd=, ks=, alpha= (the material, a lit matte one by default), sky, light=<star number>,
+ *   lit=<star number>, orbit=a,e,i,node,periapsis,meanAnomaly,meanMotion (the KeplerElements), spin=, tilt=, size=s or size=x,y,z,
+ *   atmosphere=earth|haze, rings=<image path>, ephemeris=<body ID>.
+ *   The text is streamed by chunks, with no copy of the lines.
+ * - binary, written by save : a header, the SceneTexture and SceneBody arrays, then the string table. It is mapped in memory as is,
+ *   loading it is a check of its indices. */
+class Scene
+{
+    public:
+        /* \brief Destructor. Unmap the file */
+        ~Scene();
+
+        Scene(const Scene&) = delete;
+        Scene& operator=(const Scene&) = delete;
+
+        /* \brief Load a scene, text or binary
+         * \param path the file path
+         * \return the scene or NULL if error */
+        static Scene* load(const char* path);
+
+        /* \brief Write the binary form of the scene
+         * \param path the file path
+         * \return true on success */
+        bool save(const char* path) const;
+
+        /* \brief Get the number of bodies
+         * \return the number of bodies */
+        uint32_t getNbBodies() const {return m_nbBodies;}
+
+        /* \brief Get a body, its parents have a smaller index
+         * \param index its index
+         * \return the body */
+        const SceneBody& getBody(uint32_t index) const {return m_bodies[index];}
+
+        /* \brief Get the number of textures
+         * \return the number of textures */
+        uint32_t getNbTextures() const {return m_nbTextures;}
+
+        /* \brief Get a texture
+         * \param index its index
+         * \return the texture */
+        const SceneTexture& getTexture(uint32_t index) const {return m_textures[index];}
+
+        /* \brief Find a texture
+         * \param name its name
+         * \return its index, -1 if the scene does not have it */
+        int32_t findTexture(const char* name) const;
+
+        /* \brief Get a string of the string table
+         * \param offset a name, path or rings offset
+         * \return the string, valid as long as the scene */
+        const char* getString(uint32_t offset) const {return m_strings + offset;}
+
+        /* \brief Get the CPU time of the load
+         * \return the time in milliseconds */
+        double getLoadTime() const {return m_loadTime;}
+
+    private:
+        Scene() {}
+
+        /* \brief Parse a text scene into the owned arrays
+         * \return true on success */
+        bool parse(const char* path);
+
+        /* \brief Map a binary scene and check it
+         * \return true on success */
+        bool map(const char* path);
+
+        std::vector<SceneTexture> m_ownedTextures;  /*!< The arrays of a text scene. The pointers below point to them or in the mapping*/
+        std::vector<SceneBody>    m_ownedBodies;
+        std::vector<char>         m_ownedStrings;
+
+        const SceneTexture*       m_textures    = nullptr;
+        const SceneBody*          m_bodies      = nullptr;
+        const char*               m_strings     = nullptr;
+        uint32_t                  m_nbTextures  = 0;
+        uint32_t                  m_nbBodies    = 0;
+        uint32_t                  m_stringsSize = 0;
+        double                    m_loadTime    = 0.0;
+
+        void*                     m_mapping  = nullptr;
+        uint64_t                  m_size     = 0;
+#ifdef _WIN32
+        void*                     m_fileHandle    = nullptr;
+        void*                     m_mappingHandle = nullptr;
+#endif
+};
+
+#endif
@@ -7,8 +7,99 @@
 #include <GL/gl.h>
 #include <iostream>
 #include <cstdlib>
+#include <stdint.h>
+#include <string>
+#include <chrono>
 #include "logger.h"
 
+/* \brief The features a shader variant is compiled with. Each one becomes a "#define NAME value" injected after the #version line*/
+enum ShaderFeature
+{
+    SHADER_FEATURE_TEXTURED,   /*!< The albedo comes from uTexture instead of uMtlColor*/
+    SHADER_FEATURE_EMISSIVE,   /*!< No lighting : the color is uMtlCts.x * albedo*/
+    SHADER_FEATURE_UNLIT_SKY,  /*!< Background seen from inside : the albedo as is, no lighting varyings*/
+    SHADER_FEATURE_NUM_LIGHTS, /*!< Number of point lights (uLightPos[], uLightColor[]), 0 to 3*/
+    SHADER_FEATURE_CLUSTERED,  /*!< The lights come from the LightClusters textures. GLSL 130*/
+    SHADER_FEATURE_ECLIPSES,   /*!< Soft shadows of the Eclipses occluder spheres on one light*/
+    SHADER_FEATURE_DEPTH_MODE, /*!< The DepthMode : 1 = reversed-Z, 2 = logarithmic depth (uLogDepthScale)*/
+    SHADER_FEATURE_COUNT
+};
+
+/* \brief Where a feature is stored in a variant key*/
+struct ShaderFeatureInfo
+{
+    const char* define; /*!< The macro name*/
+    uint32_t    shift;  /*!< The first bit of the value*/
+    uint32_t    nbBits; /*!< The number of bits of the value*/
+};
+
+/* \brief The feature table. The variant keys are built from it at compile time*/
+constexpr ShaderFeatureInfo SHADER_FEATURE_TABLE[SHADER_FEATURE_COUNT] =
+{
+    {"TEXTURED",   0, 1},
+    {"EMISSIVE",   1, 1},
+    {"UNLIT_SKY",  2, 1},
+    {"NUM_LIGHTS", 3, 2},
+    {"CLUSTERED",  5, 1},
+    {"ECLIPSES",   6, 1},
+    {"DEPTH_MODE", 7, 2}
+};
+
+/* \brief Get the number of bits used by the variant keys*/
+constexpr uint32_t shaderVariantKeyBits()
+{
+    uint32_t bits = 0;
+    for(uint32_t i = 0; i < SHADER_FEATURE_COUNT; i++)
+        if(SHADER_FEATURE_TABLE[i].shift + SHADER_FEATURE_TABLE[i].nbBits > bits)
+            bits = SHADER_FEATURE_TABLE[i].shift + SHADER_FEATURE_TABLE[i].nbBits;
+    return bits;
+}
+
+/* \brief Tell if no two features of the table share a bit*/
+constexpr bool shaderFeatureTableIsValid()
+{
+    uint32_t used = 0;
+    for(uint32_t i = 0; i < SHADER_FEATURE_COUNT; i++)
+    {
+        uint32_t mask = ((1u << SHADER_FEATURE_TABLE[i].nbBits) - 1) << SHADER_FEATURE_TABLE[i].shift;
+        if(used & mask)
+            return false;
+        used |= mask;
+    }
+    return true;
+}
+
+static_assert(shaderFeatureTableIsValid(), "Two shader features share a bit of the variant key");
+
+/* \brief The number of shader variants*/
+constexpr uint32_t SHADER_VARIANT_COUNT = 1u << shaderVariantKeyBits();
+
+/* \brief Encode a feature value in a variant key. Combine features with |
+ * \param feature the feature
+ * \param value its value (1 to enable a flag)
+ * \return the key bits */
+constexpr uint32_t shaderFeatureBits(ShaderFeature feature, uint32_t value)
+{
+    return (value & ((1u << SHADER_FEATURE_TABLE[feature].nbBits) - 1)) << SHADER_FEATURE_TABLE[feature].shift;
+}
+
+/* \brief Decode a feature value from a variant key
+ * \param variantKey the key
+ * \param feature the feature
+ * \return its value */
+constexpr uint32_t shaderFeatureValue(uint32_t variantKey, ShaderFeature feature)
+{
+    return (variantKey >> SHADER_FEATURE_TABLE[feature].shift) & ((1u << SHADER_FEATURE_TABLE[feature].nbBits) - 1);
+}
+
+/* \brief Where the build of a Shader is*/
+enum ShaderStatus
+{
+    SHADER_COMPILING, /*!< Submitted to the driver, the link status has not been checked yet*/
+    SHADER_LINKED,    /*!< Ready to be used*/
+    SHADER_FAILED     /*!< Did not compile or link*/
+};
+
 /** \brief A graphic program.*/
 class Shader
 {
@@ -31,6 +122,23 @@ class Shader
          * \return the fragment ID */
         int getFragID() const;
 
+        /** \brief get where the build of this shader is.
+         * \return the status */
+        ShaderStatus getStatus() const;
+
+        /** \brief tell if the driver is done building this shader, without blocking.
+         * Always true without GL_KHR_parallel_shader_compile : finish() then blocks until the build is done.
+         * \return true if finish() will not wait */
+        bool isReady() const;
+
+        /** \brief wait for the build, check it and store the program in the ShaderCache.
+         * \return true if the shader can be used */
+        bool finish();
+
+        /** \brief let the driver compile shaders on its own threads (GL_KHR_parallel_shader_compile), when available.
+         * Call it once after the context creation.*/
+        static void enableParallelCompile();
+
         /** \brief create a shader from a vertex and a fragment file.
          * \param vertexFile the vertex file.
          * \param fragmentFile the fragment file.
@@ -45,10 +153,43 @@ class Shader
          * \return the Shader constructed or NULL if error
          * */
         static Shader* loadFromStrings(const std::string& vertexString, const std::string& fragString);
+
+        /** \brief start building a shader from a vertex and a fragment string, without waiting for the driver.
+         * Poll isReady() then call finish() before using it.
+         * \param vertexString the vertex string.
+         * \param fragmentString the fragment string.
+         *
+         * \return the Shader being built. Never NULL*/
+        static Shader* beginLoadFromStrings(const std::string& vertexString, const std::string& fragString);
+
+        /** \brief create a shader variant from a vertex and a fragment string.
+         * \param vertexString the vertex string.
+         * \param fragmentString the fragment string.
+         * \param variantKey the features to define, built with shaderFeatureBits.
+         *
+         * \return the Shader constructed or NULL if error
+         * */
+        static Shader* loadVariantFromStrings(const std::string& vertexString, const std::string& fragString, uint32_t variantKey);
+
+        /** \brief insert the #define of every feature of a variant after the #version line of a shader code.
+         * \param code the shader code.
+         * \param variantKey the features to define.
+         *
+         * \return the code of the variant*/
+        static std::string injectDefines(const std::string& code, uint32_t variantKey);
+
+        /** \brief read a whole shader file.
+         * \param file the file.
+         *
+         * \return the file content*/
+        static std::string readFile(FILE* file);
     private:
         GLuint m_programID; /*!< The shader   program ID*/
         GLuint m_vertexID;  /*!< The vertex   shader  ID*/
         GLuint m_fragID;    /*!< The fragment shader  ID*/
+        ShaderStatus m_status; /*!< Where the build is*/
+        uint64_t m_cacheKey;   /*!< The key of the program in the ShaderCache*/
+        std::chrono::high_resolution_clock::time_point m_compileBegin; /*!< When the build was submitted*/
 
         /* \brief Bind the attributes to known locations (vPosition to 0, vColor to 1 for example)*/
         virtual void bindAttributes();
@@ -57,6 +198,11 @@ class Shader
          * \param code the attribute name
          * \param type the type of this attribute (vertex, fragment, etc.)*/
         static int loadShader(const std::string& code, int type);
+
+        /** \brief Print the compile errors of a shader component
+         * \param shader the shader component
+         * \param type the type of this component (vertex, fragment, etc.)*/
+        static void checkCompileStatus(GLuint shader, int type);
 };
 
 #endif
@@ -0,0 +1,52 @@
+#ifndef  SHADERCACHE_INC
+#define  SHADERCACHE_INC
+
+#include <GL/glew.h>
+#include <GL/gl.h>
+#include <stdint.h>
+#include <string>
+
+#define SHADER_CACHE_DIRECTORY "ShaderCache"
+
+/* \brief On-disk cache of linked program binaries (GL_ARB_get_program_binary).
+ * Programs are keyed by a hash of their sources (which include the injected defines) and of the driver strings,
+ * so that a driver update or another graphic card never reuses a stale binary. */
+class ShaderCache
+{
+    public:
+        /* \brief Compute the cache key of a program
+         * \param vertexString the vertex shader source
+         * \param fragString the fragment shader source
+         * \return the key */
+        static uint64_t computeKey(const std::string& vertexString, const std::string& fragString);
+
+        /* \brief Tell if program binaries can be used with the current context
+         * \return true if the driver supports at least one program binary format */
+        static bool isSupported();
+
+        /* \brief Try to load a program from the cache. A binary rejected by the driver is removed from the cache.
+         * \param key the program key
+         * \param programID the program receiving the binary
+         * \return true if programID is now linked, false if it must be compiled from source */
+        static bool loadProgram(uint64_t key, GLuint programID);
+
+        /* \brief Store a linked program in the cache. Mark the program with GL_PROGRAM_BINARY_RETRIEVABLE_HINT before linking it
+         * \param key the program key
+         * \param programID the linked program */
+        static void storeProgram(uint64_t key, GLuint programID);
+
+        /* \brief Count a program compiled from source
+         * \param milliseconds the compile and link time */
+        static void addCompileTime(double milliseconds);
+
+        /* \brief Log the hit / miss counts and the compile time spent so far */
+        static void logStats();
+
+    private:
+        static uint32_t s_nbHits;
+        static uint32_t s_nbMisses;
+        static double   s_compileTime;
+        static double   s_loadTime;
+};
+
+#endif
@@ -0,0 +1,57 @@
+#ifndef  SHADERVARIANTS_INC
+#define  SHADERVARIANTS_INC
+
+#include <stdint.h>
+#include <string>
+#include <chrono>
+
+#include "Shader.h"
+
+/* \brief Every variant of one vertex / fragment shader pair. A variant is compiled the first time it is asked for. */
+class ShaderVariants
+{
+    public:
+        /* \brief Constructor
+         * \param vertexString the vertex shader code, using the SHADER_FEATURE_TABLE macros
+         * \param fragString the fragment shader code, using the SHADER_FEATURE_TABLE macros */
+        ShaderVariants(const std::string& vertexString, const std::string& fragString);
+
+        /* \brief Destructor. Destroy the variants compiled */
+        ~ShaderVariants();
+
+        ShaderVariants(const ShaderVariants&) = delete;
+        ShaderVariants& operator=(const ShaderVariants&) = delete;
+
+        /* \brief Create the variants of a vertex and a fragment file. Nothing is compiled yet
+         * \param vertexFile the vertex file
+         * \param fragFile the fragment file
+         * \return the variants or NULL if a file is missing */
+        static ShaderVariants* loadFromFiles(FILE* vertexFile, FILE* fragFile);
+
+        /* \brief Get a variant, compiling it on first use. Blocks until the variant is built
+         * \param variantKey the features of the variant, built with shaderFeatureBits
+         * \return the variant or NULL if it does not compile */
+        Shader* get(uint32_t variantKey);
+
+        /* \brief Get a variant without blocking. The first call submits its build to the driver
+         * \param variantKey the features of the variant, built with shaderFeatureBits
+         * \return the variant, or NULL while it is being built or if it does not compile */
+        Shader* tryGet(uint32_t variantKey);
+
+    private:
+        /* \brief Submit the build of a variant if it was never asked for
+         * \return false if the variant failed to build */
+        bool submit(uint32_t variantKey);
+
+        /* \brief Check a variant whose build is done. A failed variant is destroyed
+         * \return the variant or NULL if it does not compile */
+        Shader* finish(uint32_t variantKey);
+
+        std::string m_vertexString;
+        std::string m_fragString;
+        Shader*     m_variants[SHADER_VARIANT_COUNT];
+        bool        m_failed[SHADER_VARIANT_COUNT]; /*!< The variants that did not compile, so that they are not retried every frame*/
+        std::chrono::high_resolution_clock::time_point m_submitTime[SHADER_VARIANT_COUNT]; /*!< When each variant was submitted*/
+};
+
+#endif
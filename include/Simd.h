@@ -0,0 +1,166 @@
+#ifndef  SIMD_INC
+#define  SIMD_INC
+
+#include <cmath>
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SIMD_SSE2 1
+#include <emmintrin.h>
+#endif
+
+/* \brief Four floats processed at once. Uses SSE2 when the compiler targets it, plain scalar code otherwise.
+ * Comparisons return a Float4 whose lanes are all ones (true) or all zeros (false), like SSE does. */
+struct Float4
+{
+#ifdef SIMD_SSE2
+    __m128 v;
+
+    Float4() : v(_mm_setzero_ps()) {}
+    Float4(__m128 x) : v(x) {}
+    Float4(float x) : v(_mm_set1_ps(x)) {}
+    Float4(float a, float b, float c, float d) : v(_mm_setr_ps(a, b, c, d)) {}
+
+    static Float4 load(const float* p) {return Float4(_mm_loadu_ps(p));}
+    void store(float* p) const {_mm_storeu_ps(p, v);}
+
+    friend Float4 operator+(Float4 a, Float4 b) {return _mm_add_ps(a.v, b.v);}
+    friend Float4 operator-(Float4 a, Float4 b) {return _mm_sub_ps(a.v, b.v);}
+    friend Float4 operator*(Float4 a, Float4 b) {return _mm_mul_ps(a.v, b.v);}
+    friend Float4 operator/(Float4 a, Float4 b) {return _mm_div_ps(a.v, b.v);}
+    friend Float4 operator&(Float4 a, Float4 b) {return _mm_and_ps(a.v, b.v);}
+    friend Float4 operator|(Float4 a, Float4 b) {return _mm_or_ps(a.v, b.v);}
+    friend Float4 operator<(Float4 a, Float4 b) {return _mm_cmplt_ps(a.v, b.v);}
+    friend Float4 operator>(Float4 a, Float4 b) {return _mm_cmpgt_ps(a.v, b.v);}
+    friend Float4 operator<=(Float4 a, Float4 b) {return _mm_cmple_ps(a.v, b.v);}
+    friend Float4 operator>=(Float4 a, Float4 b) {return _mm_cmpge_ps(a.v, b.v);}
+
+    friend Float4 min(Float4 a, Float4 b) {return _mm_min_ps(a.v, b.v);}
+    friend Float4 max(Float4 a, Float4 b) {return _mm_max_ps(a.v, b.v);}
+    friend Float4 sqrt(Float4 a) {return _mm_sqrt_ps(a.v);}
+    friend Float4 abs(Float4 a) {return _mm_andnot_ps(_mm_set1_ps(-0.0f), a.v);}
+    friend Float4 andNot(Float4 mask, Float4 a) {return _mm_andnot_ps(mask.v, a.v);}
+    friend Float4 floor(Float4 a)
+    {
+        __m128 t = _mm_cvtepi32_ps(_mm_cvttps_epi32(a.v));
+        return _mm_sub_ps(t, _mm_and_ps(_mm_cmpgt_ps(t, a.v), _mm_set1_ps(1.0f)));
+    }
+
+    /* \brief Convert to integers (truncation) and store them
+     * \param p receives the 4 integers */
+    void storeInt(int32_t* p) const {_mm_storeu_si128((__m128i*)p, _mm_cvttps_epi32(v));}
+
+    /* \brief Per lane "mask ? a : b" */
+    friend Float4 select(Float4 mask, Float4 a, Float4 b) {return _mm_or_ps(_mm_and_ps(mask.v, a.v), _mm_andnot_ps(mask.v, b.v));}
+
+    /* \brief Get one bit per lane telling which lanes of a comparison result are true */
+    friend int movemask(Float4 mask) {return _mm_movemask_ps(mask.v);}
+
+    float operator[](int i) const {float tmp[4]; store(tmp); return tmp[i];}
+#else
+    float v[4];
+
+    Float4() : v{0.0f, 0.0f, 0.0f, 0.0f} {}
+    Float4(float x) : v{x, x, x, x} {}
+    Float4(float a, float b, float c, float d) : v{a, b, c, d} {}
+
+    static Float4 load(const float* p) {return Float4(p[0], p[1], p[2], p[3]);}
+    void store(float* p) const {for(int i = 0; i < 4; i++) p[i] = v[i];}
+
+#define SIMD_LANEWISE(expr) Float4 r; for(int i = 0; i < 4; i++) r.v[i] = (expr); return r;
+    static float maskOf(bool b) {uint32_t bits = b ? 0xffffffffu : 0u; float f; memcpy(&f, &bits, 4); return f;}
+    static uint32_t bitsOf(float f) {uint32_t bits; memcpy(&bits, &f, 4); return bits;}
+    static float fromBits(uint32_t bits) {float f; memcpy(&f, &bits, 4); return f;}
+
+    friend Float4 operator+(Float4 a, Float4 b) {SIMD_LANEWISE(a.v[i] + b.v[i])}
+    friend Float4 operator-(Float4 a, Float4 b) {SIMD_LANEWISE(a.v[i] - b.v[i])}
+    friend Float4 operator*(Float4 a, Float4 b) {SIMD_LANEWISE(a.v[i] * b.v[i])}
+    friend Float4 operator/(Float4 a, Float4 b) {SIMD_LANEWISE(a.v[i] / b.v[i])}
+    friend Float4 operator&(Float4 a, Float4 b) {SIMD_LANEWISE(fromBits(bitsOf(a.v[i]) & bitsOf(b.v[i])))}
+    friend Float4 operator|(Float4 a, Float4 b) {SIMD_LANEWISE(fromBits(bitsOf(a.v[i]) | bitsOf(b.v[i])))}
+    friend Float4 operator<(Float4 a, Float4 b) {SIMD_LANEWISE(maskOf(a.v[i] < b.v[i]))}
+    friend Float4 operator>(Float4 a, Float4 b) {SIMD_LANEWISE(maskOf(a.v[i] > b.v[i]))}
+    friend Float4 operator<=(Float4 a, Float4 b) {SIMD_LANEWISE(maskOf(a.v[i] <= b.v[i]))}
+    friend Float4 operator>=(Float4 a, Float4 b) {SIMD_LANEWISE(maskOf(a.v[i] >= b.v[i]))}
+
+    friend Float4 min(Float4 a, Float4 b) {SIMD_LANEWISE(b.v[i] < a.v[i] ? b.v[i] : a.v[i])}
+    friend Float4 max(Float4 a, Float4 b) {SIMD_LANEWISE(b.v[i] > a.v[i] ? b.v[i] : a.v[i])}
+    friend Float4 sqrt(Float4 a) {SIMD_LANEWISE(std::sqrt(a.v[i]))}
+    friend Float4 abs(Float4 a) {SIMD_LANEWISE(std::fabs(a.v[i]))}
+    friend Float4 andNot(Float4 mask, Float4 a) {SIMD_LANEWISE(fromBits(~bitsOf(mask.v[i]) & bitsOf(a.v[i])))}
+    friend Float4 floor(Float4 a) {SIMD_LANEWISE(std::floor(a.v[i]))}
+    void storeInt(int32_t* p) const {for(int i = 0; i < 4; i++) p[i] = (int32_t)v[i];}
+
+    friend Float4 select(Float4 mask, Float4 a, Float4 b) {SIMD_LANEWISE(bitsOf(mask.v[i]) ? a.v[i] : b.v[i])}
+    friend int movemask(Float4 mask) {int r = 0; for(int i = 0; i < 4; i++) r |= (bitsOf(mask.v[i]) >> 31) << i; return r;}
+#undef SIMD_LANEWISE
+
+    float operator[](int i) const {return v[i];}
+#endif
+};
+
+/* \brief Two doubles processed at once, for the computations that need the double precision. SSE2 or scalar, like Float4 */
+struct Double2
+{
+#ifdef SIMD_SSE2
+    __m128d v;
+
+    Double2() : v(_mm_setzero_pd()) {}
+    Double2(__m128d x) : v(x) {}
+    Double2(double x) : v(_mm_set1_pd(x)) {}
+    Double2(double a, double b) : v(_mm_setr_pd(a, b)) {}
+
+    static Double2 load(const double* p) {return Double2(_mm_loadu_pd(p));}
+    void store(double* p) const {_mm_storeu_pd(p, v);}
+
+    friend Double2 operator+(Double2 a, Double2 b) {return _mm_add_pd(a.v, b.v);}
+    friend Double2 operator-(Double2 a, Double2 b) {return _mm_sub_pd(a.v, b.v);}
+    friend Double2 operator*(Double2 a, Double2 b) {return _mm_mul_pd(a.v, b.v);}
+
+    double operator[](int i) const {double tmp[2]; store(tmp); return tmp[i];}
+#else
+    double v[2];
+
+    Double2() : v{0.0, 0.0} {}
+    Double2(double x) : v{x, x} {}
+    Double2(double a, double b) : v{a, b} {}
+
+    static Double2 load(const double* p) {return Double2(p[0], p[1]);}
+    void store(double* p) const {p[0] = v[0]; p[1] = v[1];}
+
+    friend Double2 operator+(Double2 a, Double2 b) {return Double2(a.v[0] + b.v[0], a.v[1] + b.v[1]);}
+    friend Double2 operator-(Double2 a, Double2 b) {return Double2(a.v[0] - b.v[0], a.v[1] - b.v[1]);}
+    friend Double2 operator*(Double2 a, Double2 b) {return Double2(a.v[0] * b.v[0], a.v[1] * b.v[1]);}
+
+    double operator[](int i) const {return v[i];}
+#endif
+};
+
+/* \brief Sine and cosine of 4 angles at once. Absolute error below 3e-7 for |x| < 1e4
+ * \param x the angles in radians
+ * \param s receives the sines
+ * \param c receives the cosines */
+inline void sinCos(Float4 x, Float4& s, Float4& c)
+{
+    const float PI = 3.14159265358979f;
+    /* Reduction to [-pi, pi]. 2 pi is split in three floats (Cody-Waite), the first one short enough for k * 6.28125 to be exact */
+    Float4 k = floor(x * Float4(0.5f / PI) + Float4(0.5f));
+    x = ((x - k * Float4(6.28125f)) - k * Float4(1.93530717e-3f)) - k * Float4(1.02531317e-11f);
+
+    /* Then to [-pi/2, pi/2] : sin(pi - x) = sin(x), cos(pi - x) = -cos(x) */
+    Float4 halfPi(0.5f * PI);
+    Float4 outside = abs(x) > halfPi;
+    Float4 mirror  = select(x < Float4(0.0f), Float4(-PI), Float4(PI)) - x;
+    x = select(outside, mirror, x);
+    Float4 x2 = x * x;
+
+    /* Taylor series up to x^11 and x^12 */
+    s = x * (Float4(1.0f) + x2 * (Float4(-1.0f / 6.0f) + x2 * (Float4(1.0f / 120.0f) + x2 * (Float4(-1.0f / 5040.0f)
+          + x2 * (Float4(1.0f / 362880.0f) + x2 * Float4(-1.0f / 39916800.0f))))));
+    c = Float4(1.0f) + x2 * (Float4(-0.5f) + x2 * (Float4(1.0f / 24.0f) + x2 * (Float4(-1.0f / 720.0f)
+          + x2 * (Float4(1.0f / 40320.0f) + x2 * (Float4(-1.0f / 3628800.0f) + x2 * Float4(1.0f / 479001600.0f))))));
+    c = select(outside, Float4(0.0f) - c, c);
+}
+
+#endif
@@ -0,0 +1,46 @@
+#ifndef  SKYBOX_INC
+#define  SKYBOX_INC
+
+#include <GL/glew.h>
+#include <GL/gl.h>
+#include <glm/glm.hpp>
+
+#include "Image.h"
+#include "Shader.h"
+#include "DepthBuffer.h"
+
+/* \brief The star background, drawn as a cubemap on a single full-screen triangle at the far plane.
+ * It is drawn after the bodies with GL_LEQUAL so that only the pixels they do not cover are shaded. */
+class Skybox
+{
+    public:
+        /* \brief Destructor. Destroy the cubemap and the shader */
+        ~Skybox();
+
+        Skybox(const Skybox&) = delete;
+        Skybox& operator=(const Skybox&) = delete;
+
+        /* \brief Create a skybox from an equirectangular image. The image is converted once to a cubemap, with its mip chain, by ImageProcessing.
+         * The mapping is the one of the Sphere mesh seen from its center, so the sky looks like the old background sphere.
+         * \param equirectangular the source image
+         * \param faceSize the size in pixels of the cubemap faces
+         * \return the skybox created or NULL if error */
+        static Skybox* loadFromEquirectangular(const Image& equirectangular, uint32_t faceSize);
+
+        /* \brief Draw the skybox. Call it after the opaque objects
+         * \param view the camera view matrix
+         * \param projection the camera projection matrix
+         * \param depthBuffer the depth mode of the frame. NULL for the standard one */
+        void draw(const glm::mat4& view, const glm::mat4& projection, const DepthBuffer* depthBuffer = nullptr) const;
+
+        /* \brief Get the cubemap texture ID
+         * \return the cubemap texture ID */
+        GLuint getCubemapID() const {return m_cubemapID;}
+    private:
+        Skybox() {}
+
+        GLuint  m_cubemapID = 0;
+        Shader* m_shader    = nullptr;
+};
+
+#endif
@@ -12,6 +12,37 @@ class Sphere : public Geometry
          * \param nbLatitude the number of lattitude for this sphere
          * \param nbLongitude the number of longitude for this sphere */
         Sphere(uint32_t nbLatitude, uint32_t nbLongitude);
+
+        /* \brief Get how many vertices a sphere with this tessellation has (6 per quad, no index buffer)
+         * \param nbLatitude the number of lattitude
+         * \param nbLongitude the number of longitude
+         * \return the number of vertices */
+        static uint32_t countVertices(uint32_t nbLatitude, uint32_t nbLongitude) {return nbLongitude*(nbLatitude-1)*6;}
+
+        /* \brief Get the grid point (i = longitude, j = latitude) used by a vertex.
+         * Shaders/procedural_sphere.vert does the same computation from gl_VertexID : keep them in sync.
+         * \param vertexID the vertex index, in [0, countVertices(nbLatitude, nbLongitude))
+         * \param nbLatitude the number of lattitude
+         * \param nbLongitude the number of longitude
+         * \param i receives the longitude index
+         * \param j receives the latitude index */
+        static void getGridPoint(uint32_t vertexID, uint32_t nbLatitude, uint32_t nbLongitude, uint32_t& i, uint32_t& j);
+
+        /* \brief Get the position of a grid point (radius 0.5). The normal is this position normalized.
+         * \param i the longitude index
+         * \param j the latitude index
+         * \param nbLatitude the number of lattitude
+         * \param nbLongitude the number of longitude
+         * \return the position of the grid point */
+        static glm::vec3 getGridPosition(uint32_t i, uint32_t j, uint32_t nbLatitude, uint32_t nbLongitude);
+
+        /* \brief Get the UV mapping of a grid point
+         * \param i the longitude index
+         * \param j the latitude index
+         * \param nbLatitude the number of lattitude
+         * \param nbLongitude the number of longitude
+         * \return the UV of the grid point */
+        static glm::vec2 getGridUV(uint32_t i, uint32_t j, uint32_t nbLatitude, uint32_t nbLongitude);
 };
 
 #endif
@@ -0,0 +1,108 @@
+#ifndef  SPHEREBVH_INC
+#define  SPHEREBVH_INC
+
+#include <stdint.h>
+#include <vector>
+#include <glm/glm.hpp>
+
+/* Most spheres per leaf */
+#define SPHERE_BVH_LEAF_SIZE 4
+/* Bins of the surface area heuristic along the split axis */
+#define SPHERE_BVH_BINS 12
+/* Deepest node. The build makes a leaf there whatever its size, so that the traversal stacks cannot overflow */
+#define SPHERE_BVH_MAX_DEPTH 48
+
+/* \brief A node of a SphereBVH. The two children of an inner node follow each other */
+struct SphereBVHNode
+{
+    glm::vec3 bmin;
+    uint32_t  first; /*!< First sphere of a leaf (index in the sorted spheres), first child of an inner node*/
+    glm::vec3 bmax;
+    uint32_t  count; /*!< Number of spheres of a leaf, 0 for an inner node*/
+};
+
+/* \brief Bounding volume hierarchy over a set of spheres that move every frame.
+ * It is built once (binned surface area heuristic), then refit : the tree is kept and only its boxes are recomputed from the new positions,
+ * which costs a fraction of a build. The boxes of a refit tree overlap more as the spheres drift away from where they were at the build :
+ * getRefitCost tells when a new build pays off.
+ * Same indices as the vectors given to build : the queries report the position of a sphere in them. */
+class SphereBVH
+{
+    public:
+        /* \brief Build the tree
+         * \param centers the sphere centers
+         * \param radii the sphere radii */
+        void build(const std::vector<glm::vec3>& centers, const std::vector<float>& radii);
+
+        /* \brief Recompute the boxes of the tree for new positions of the same spheres
+         * \param centers the sphere centers, as many as at the build
+         * \param radii the sphere radii */
+        void refit(const std::vector<glm::vec3>& centers, const std::vector<float>& radii);
+
+        /* \brief Find the spheres in a convex volume, like a camera frustum
+         * \param planes the planes of the volume, (normal, d) with dot(normal, p) + d >= 0 inside. The normals do not need to be normalized
+         * \param nbPlanes the number of planes, at most 32
+         * \param out receives the sphere indices. Not cleared */
+        void queryPlanes(const glm::vec4* planes, uint32_t nbPlanes, std::vector<uint32_t>& out) const;
+
+        /* \brief Find the spheres overlapping a sphere
+         * \param center the query center
+         * \param radius the query radius
+         * \param out receives the sphere indices. Not cleared */
+        void queryRadius(const glm::vec3& center, float radius, std::vector<uint32_t>& out) const;
+
+        /* \brief Find the first sphere hit by a ray
+         * \param origin the ray origin
+         * \param direction the ray direction, normalized
+         * \param maxDistance the ray length
+         * \param distance if not NULL, receives the distance to the hit
+         * \return the sphere index, -1 if the ray hits nothing */
+        int32_t raycast(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, float* distance = nullptr) const;
+
+        /* \brief Find the sphere whose surface is the closest to a point
+         * \param point the point
+         * \param distance if not NULL, receives the distance to the surface, negative inside the sphere
+         * \return the sphere index, -1 if the tree is empty */
+        int32_t nearest(const glm::vec3& point, float* distance = nullptr) const;
+
+        /* \brief Get the number of spheres indexed
+         * \return the number of spheres */
+        uint32_t getNbSpheres() const {return (uint32_t)m_items.size();}
+
+        /* \brief Get the number of nodes
+         * \return the number of nodes */
+        uint32_t getNbNodes() const {return (uint32_t)m_nodes.size();}
+
+        /* \brief Get how much the refits degraded the tree : its surface area heuristic cost, relative to the one of the last build
+         * \return 1 just after a build, more as the boxes of the refit tree grow */
+        float getRefitCost() const {return m_buildCost > 0.0f ? m_cost / m_buildCost : 1.0f;}
+
+        /* \brief Get the CPU time of the last build
+         * \return the time in milliseconds */
+        double getLastBuildTime() const {return m_lastBuildTime;}
+
+        /* \brief Get the CPU time of the last refit
+         * \return the time in milliseconds */
+        double getLastRefitTime() const {return m_lastRefitTime;}
+
+    private:
+        /* \brief Split the spheres [first, first + count) of a node, then its children
+         * \param nodes the nodes of the tree being built
+         * \param nodeID the node, whose first and count are set
+         * \param depth its depth
+         * \param subtrees if not NULL, the large nodes at SPHERE_BVH_PARALLEL_DEPTH are added there instead of being split */
+        void split(std::vector<SphereBVHNode>& nodes, uint32_t nodeID, uint32_t depth, std::vector<uint32_t>* subtrees);
+
+        /* \brief Compute the surface area heuristic cost of the tree, from its boxes */
+        float computeCost() const;
+
+        std::vector<SphereBVHNode> m_nodes;
+        std::vector<uint32_t>      m_items;   /*!< Sphere indices in the order of the leaves*/
+        std::vector<glm::vec4>     m_spheres; /*!< Center and radius of m_items, in the same order, for the locality of the queries*/
+        float                      m_buildCost = 0.0f;
+        float                      m_cost = 0.0f;
+        double                     m_lastBuildTime = 0.0;
+        double                     m_lastRefitTime = 0.0;
+};
+
+#endif
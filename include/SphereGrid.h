@@ -0,0 +1,57 @@
+#ifndef  SPHEREGRID_INC
+#define  SPHEREGRID_INC
+
+#include <stdint.h>
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "FrameArena.h"
+
+#define SPHERE_GRID_MAX_CELLS (1u << 20)
+
+/* \brief Uniform grid over a set of spheres, rebuilt from scratch when they move.
+ * Each sphere is stored in the cell of its center and the queries are grown by the largest radius.
+ * Cells are stored compactly (counting sort), no hashing */
+class SphereGrid
+{
+    public:
+        /* \brief Build the grid
+         * \param centers the sphere centers
+         * \param radii the sphere radii
+         * \param count the number of spheres
+         * \param minCellSize the smallest cell size allowed. The cells are sized for about one sphere each, and at most SPHERE_GRID_MAX_CELLS cells */
+        void build(const glm::vec3* centers, const float* radii, uint32_t count, float minCellSize);
+
+        /* \brief Find the spheres whose bounding box may overlap a box
+         * \param bmin the box minimum corner
+         * \param bmax the box maximum corner
+         * \param out receives the sphere indices. Not cleared */
+        void query(const glm::vec3& bmin, const glm::vec3& bmax, FrameVector<uint32_t>& out) const;
+
+        /* \brief Find the spheres whose bounding box may overlap a cone, walking the cells along its axis.
+         * Much tighter than a box query for long thin cones, like the ones joining a body to its star
+         * \param a the center of the first cap
+         * \param b the center of the second cap
+         * \param radiusA the radius at a
+         * \param radiusB the radius at b
+         * \param out receives the sphere indices, each one at most once. Cleared */
+        void queryCone(const glm::vec3& a, const glm::vec3& b, float radiusA, float radiusB, FrameVector<uint32_t>& out) const;
+
+        /* \brief Get the number of spheres indexed
+         * \return the number of spheres */
+        uint32_t getNbSpheres() const {return m_nbSpheres;}
+
+    private:
+        /* \brief Get the cell coordinates of a point, clamped to the grid */
+        glm::ivec3 cellOf(const glm::vec3& p) const;
+
+        uint32_t              m_nbSpheres = 0;
+        glm::vec3             m_origin    = glm::vec3(0.0f);
+        float                 m_invCellSize = 1.0f;
+        float                 m_maxRadius = 0.0f;
+        glm::ivec3            m_dims      = glm::ivec3(0);
+        std::vector<uint32_t> m_cellStart; /*!< First item of each cell, plus one past the end*/
+        std::vector<uint32_t> m_items;     /*!< Sphere indices sorted by cell*/
+};
+
+#endif
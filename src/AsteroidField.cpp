@@ -0,0 +1,238 @@
+#include "AsteroidField.h"
+#include "JobSystem.h"
+#include "Simd.h"
+#include "Hash.h"
+#include "FrameArena.h"
+
+#include <chrono>
+#include <cmath>
+#include <algorithm>
+
+/* 1.5 * 2^52 : adding then subtracting it rounds a double to an integer */
+static const double ROUNDING_MAGIC = 6755399441055744.0;
+
+/* Draws of the random generator per asteroid : [0, 8) for the orbit, [8, 16) for the rock drawn as a mesh */
+#define ASTEROID_RANDOM_ORBIT 0
+#define ASTEROID_RANDOM_ROCK  8
+
+/* \brief Random number of an asteroid. A hash rather than a sequence : any asteroid can be drawn alone, in any order, on any thread
+ * \param seed the field seed
+ * \param asteroidID the asteroid
+ * \param draw which number of this asteroid, below 16
+ * \return a number in [0, 1) */
+static float random01(uint32_t seed, uint32_t asteroidID, uint32_t draw)
+{
+    return (hashInteger(hashInteger(seed) ^ (asteroidID * 16 + draw)) >> 8) * (1.0f / 16777216.0f);
+}
+
+/* \brief Draw from a Rayleigh distribution, the one of the eccentricities and inclinations of a relaxed belt */
+static float rayleigh(float sigma, float u)
+{
+    return sigma * std::sqrt(-2.0f * std::log(1.0f - u));
+}
+
+AsteroidField::AsteroidField(const AsteroidFieldParameters& params) : m_params(params)
+{
+    uint32_t size = (params.count + 3) / 4 * 4;
+    m_semiMajorAxis.resize(size, 0.0f);
+    m_eccentricity.resize(size, 0.0f);
+    m_meanAnomaly.resize(size, 0.0f);
+    m_meanMotion.resize(size, 0.0f);
+    m_perihelion.resize(size, 0.0f);
+    m_cosNode.resize(size, 1.0f);
+    m_sinNode.resize(size, 0.0f);
+    m_sinInclination.resize(size, 0.0f);
+    m_size.resize(size, 0.0f);
+    m_x.resize(size, 0.0f);
+    m_y.resize(size, 0.0f);
+    m_z.resize(size, 0.0f);
+    m_distance.resize(size, -1.0f);
+
+    float sizeRatio = std::pow(params.minSize / params.maxSize, params.sizeExponent);
+    JobSystem::get().parallelFor(params.count, ASTEROID_BATCH_SIZE, [&](uint32_t first, uint32_t last)
+    {
+        for(uint32_t i = first; i < last; i++)
+        {
+            float u[8];
+            for(uint32_t k = 0; k < 8; k++)
+                u[k] = random01(params.seed, i, ASTEROID_RANDOM_ORBIT + k);
+            float a = params.innerRadius + u[0] * (params.outerRadius - params.innerRadius);
+            float node = u[4] * 2.0f * (float)M_PI;
+            m_semiMajorAxis[i]  = a;
+            m_eccentricity[i]   = std::min(rayleigh(params.eccentricitySigma, u[1]), params.maxEccentricity);
+            m_sinInclination[i] = std::sin(rayleigh(params.inclinationSigma, u[2]));
+            m_perihelion[i]     = u[3] * 2.0f * (float)M_PI;
+            m_cosNode[i]        = std::cos(node);
+            m_sinNode[i]        = std::sin(node);
+            m_meanAnomaly[i]    = u[5] * 2.0f * (float)M_PI;
+            m_meanMotion[i]     = (float)std::sqrt(params.gravity / ((double)a * a * a));
+            /* Inverse of the truncated power law */
+            m_size[i] = params.minSize * std::pow(1.0f - u[6] * (1.0f - sizeRatio), -1.0f / params.sizeExponent);
+        }
+    });
+}
+
+void AsteroidField::update(double t)
+{
+    auto begin = std::chrono::high_resolution_clock::now();
+
+    uint32_t nbGroups = (uint32_t)m_x.size() / 4;
+    JobSystem::get().parallelFor(nbGroups, ASTEROID_BATCH_SIZE / 4, [&](uint32_t first, uint32_t last)
+    {
+        for(uint32_t group = first; group < last; group++)
+        {
+            uint32_t i = 4 * group;
+
+            /* Mean anomalies in [-pi, pi], reduced in double like Orbits */
+            float meanAnomaly[4];
+            for(uint32_t lane = 0; lane < 4; lane++)
+            {
+                double m = m_meanAnomaly[i + lane] + m_meanMotion[i + lane] * t;
+                double turns = (m * (0.5 / M_PI) + ROUNDING_MAGIC) - ROUNDING_MAGIC;
+                meanAnomaly[lane] = (float)(m - turns * (2.0 * M_PI));
+            }
+            Float4 m = Float4::load(meanAnomaly);
+            Float4 e = Float4::load(&m_eccentricity[i]);
+            Float4 sinM, cosM;
+            sinCos(m, sinM, cosM);
+
+            /* Epicycle : r = a (1 - e cos M), true longitude = periapsis + M + 2 e sin M. Exact to the first order in e */
+            Float4 r = Float4::load(&m_semiMajorAxis[i]) * (Float4(1.0f) - e * cosM);
+            Float4 longitude = Float4::load(&m_perihelion[i]) + m + Float4(2.0f) * e * sinM;
+            Float4 sinL, cosL;
+            sinCos(longitude, sinL, cosL);
+
+            /* Height above the reference plane : r sin(i) sin(longitude - node). The tilt shortens the orbits by cos(i), neglected */
+            Float4 sinFromNode = sinL * Float4::load(&m_cosNode[i]) - cosL * Float4::load(&m_sinNode[i]);
+            (r * cosL).store(&m_x[i]);
+            (r * Float4::load(&m_sinInclination[i]) * sinFromNode).store(&m_y[i]);
+            (Float4(0.0f) - r * sinL).store(&m_z[i]);
+        }
+    });
+
+    m_lastUpdateTime = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - begin).count();
+}
+
+void AsteroidField::cull(const glm::dvec3& camera, const glm::mat4& view, const glm::mat4& projection, double t)
+{
+    auto begin = std::chrono::high_resolution_clock::now();
+
+    /* Batches of a fixed size, one per job, so that each one can keep its own histogram and then write at its own offsets */
+    uint32_t count     = m_params.count;
+    uint32_t nbBatches = (count + ASTEROID_BATCH_SIZE - 1) / ASTEROID_BATCH_SIZE;
+    uint32_t stride    = ASTEROID_DISTANCE_BUCKETS + 1; /* The last entry counts the visible asteroids of the batch */
+    m_histograms.assign((size_t)nbBatches * stride, 0);
+
+    glm::vec3 eye(camera);
+    glm::mat3 rotation(view);
+    float tanX = 1.0f / projection[0][0];
+    float tanY = 1.0f / projection[1][1];
+    float bucketScale = ASTEROID_DISTANCE_BUCKETS / m_params.meshDistance;
+
+    /* Frustum culling 4 asteroids at a time, with the diameter as a generous margin, and the histogram of the distances of the close ones */
+    JobSystem::get().parallelFor(nbBatches, 1, [&](uint32_t firstBatch, uint32_t lastBatch)
+    {
+        for(uint32_t batch = firstBatch; batch < lastBatch; batch++)
+        {
+            uint32_t* histogram = &m_histograms[(size_t)batch * stride];
+            uint32_t last = std::min((uint32_t)m_x.size(), (batch + 1) * ASTEROID_BATCH_SIZE);
+            for(uint32_t i = batch * ASTEROID_BATCH_SIZE; i < last; i += 4)
+            {
+                Float4 dx = Float4::load(&m_x[i]) - Float4(eye.x);
+                Float4 dy = Float4::load(&m_y[i]) - Float4(eye.y);
+                Float4 dz = Float4::load(&m_z[i]) - Float4(eye.z);
+                Float4 vx = Float4(rotation[0][0]) * dx + Float4(rotation[1][0]) * dy + Float4(rotation[2][0]) * dz;
+                Float4 vy = Float4(rotation[0][1]) * dx + Float4(rotation[1][1]) * dy + Float4(rotation[2][1]) * dz;
+                Float4 depth = Float4(0.0f) - (Float4(rotation[0][2]) * dx + Float4(rotation[1][2]) * dy + Float4(rotation[2][2]) * dz);
+                Float4 margin = Float4::load(&m_size[i]);
+                Float4 culled = (depth < Float4(0.0f) - margin) | (abs(vx) > depth * Float4(tanX) + margin) | (abs(vy) > depth * Float4(tanY) + margin);
+                Float4 distance = select(culled, Float4(-1.0f), sqrt(dx * dx + dy * dy + dz * dz));
+                distance.store(&m_distance[i]);
+                /* Most groups are all culled or all far : only the close lanes are looked at one by one. The padding lanes are not counted */
+                int visible = ~movemask(culled) & (i + 4 <= count ? 0xf : (1 << (count - i)) - 1);
+                histogram[ASTEROID_DISTANCE_BUCKETS] += (visible & 1) + (visible >> 1 & 1) + (visible >> 2 & 1) + (visible >> 3 & 1);
+                int close = visible & movemask(distance < Float4(m_params.meshDistance));
+                for(uint32_t lane = 0; close != 0; lane++, close >>= 1)
+                {
+                    if(close & 1)
+                        histogram[std::min((uint32_t)(m_distance[i + lane] * bucketScale), (uint32_t)ASTEROID_DISTANCE_BUCKETS - 1)]++;
+                }
+            }
+        }
+    });
+
+    /* The mesh buckets are the closest ones that fit in the budget together */
+    uint32_t cutoff = 0;
+    uint32_t nbMeshes = 0;
+    for(; cutoff < ASTEROID_DISTANCE_BUCKETS; cutoff++)
+    {
+        uint32_t bucketCount = 0;
+        for(uint32_t batch = 0; batch < nbBatches; batch++)
+            bucketCount += m_histograms[(size_t)batch * stride + cutoff];
+        if(nbMeshes + bucketCount > m_params.meshBudget)
+            break;
+        nbMeshes += bucketCount;
+    }
+    m_lastMeshDistance = cutoff / bucketScale;
+
+    /* Offsets of each batch in the two outputs */
+    FrameVector<uint32_t> meshOffsets(nbBatches);
+    FrameVector<uint32_t> spriteOffsets(nbBatches);
+    uint32_t nbSprites = 0;
+    nbMeshes = 0;
+    for(uint32_t batch = 0; batch < nbBatches; batch++)
+    {
+        const uint32_t* histogram = &m_histograms[(size_t)batch * stride];
+        uint32_t batchMeshes = 0;
+        for(uint32_t bucket = 0; bucket < cutoff; bucket++)
+            batchMeshes += histogram[bucket];
+        meshOffsets[batch]   = nbMeshes;
+        spriteOffsets[batch] = nbSprites;
+        nbMeshes  += batchMeshes;
+        nbSprites += histogram[ASTEROID_DISTANCE_BUCKETS] - batchMeshes;
+    }
+    m_meshInstances.resize(nbMeshes);
+    m_sprites.resize(nbSprites);
+
+    JobSystem::get().parallelFor(nbBatches, 1, [&](uint32_t firstBatch, uint32_t lastBatch)
+    {
+        for(uint32_t batch = firstBatch; batch < lastBatch; batch++)
+        {
+            uint32_t meshIndex   = meshOffsets[batch];
+            uint32_t spriteIndex = spriteOffsets[batch];
+            uint32_t spriteEnd   = batch + 1 < nbBatches ? spriteOffsets[batch + 1] : nbSprites;
+            uint32_t last = std::min(count, (batch + 1) * ASTEROID_BATCH_SIZE);
+            for(uint32_t i = batch * ASTEROID_BATCH_SIZE; i < last; i++)
+            {
+                /* Without branches on the visibility, random from an asteroid to the next : every asteroid is written at the next sprite slot,
+                 * which only moves on for the visible sprites. Same mesh test as the histogram, on the bucket index, so that the counts match */
+                float distance = m_distance[i];
+                uint32_t bucket = std::min((uint32_t)(std::max(distance, 0.0f) * bucketScale), (uint32_t)ASTEROID_DISTANCE_BUCKETS - 1);
+                bool visible = distance >= 0.0f;
+                bool mesh = visible & (distance < m_params.meshDistance) & (bucket < cutoff);
+                glm::vec4 positionSize(m_x[i] - eye.x, m_y[i] - eye.y, m_z[i] - eye.z, m_size[i]);
+                if(spriteIndex < spriteEnd)
+                    m_sprites[spriteIndex] = positionSize;
+                spriteIndex += visible & !mesh;
+                if(!mesh)
+                    continue;
+
+                float u[8];
+                for(uint32_t k = 0; k < 8; k++)
+                    u[k] = random01(m_params.seed, i, ASTEROID_RANDOM_ROCK + k);
+                float z = 2.0f * u[0] - 1.0f;
+                float phi = 2.0f * (float)M_PI * u[1];
+                float radius = std::sqrt(1.0f - z * z);
+                double spin = (u[2] - 0.5) * 4.0;
+                double angle = std::fmod(2.0 * M_PI * u[3] + spin * t, 2.0 * M_PI);
+
+                AsteroidInstance& instance = m_meshInstances[meshIndex++];
+                instance.positionSize = positionSize;
+                instance.rotation = glm::vec4(radius * std::cos(phi), z, radius * std::sin(phi), (float)angle);
+                instance.shape = glm::vec4(1.0f + 0.6f * u[4], 0.7f + 0.3f * u[5], 0.5f + 0.5f * u[6], 0.6f + 0.4f * u[7]);
+            }
+        }
+    });
+
+    m_lastCullTime = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - begin).count();
+}
@@ -0,0 +1,183 @@
+#include "AsteroidRenderer.h"
+#include "logger.h"
+
+#include <glm/gtc/type_ptr.hpp>
+
+/* \brief Load a shader from a vertex / fragment file pair
+ * \return the shader or NULL if error */
+static Shader* loadShader(const char* vertPath, const char* fragPath)
+{
+    FILE* vert = fopen(vertPath, "r");
+    FILE* frag = fopen(fragPath, "r");
+    if(vert == NULL || frag == NULL)
+    {
+        ERROR("Could not open the asteroid shaders %s and %s\n", vertPath, fragPath);
+        if(vert) fclose(vert);
+        if(frag) fclose(frag);
+        return NULL;
+    }
+    Shader* shader = Shader::loadFromFiles(vert, frag);
+    fclose(vert);
+    fclose(frag);
+    return shader;
+}
+
+/* The entry points are core since OpenGL 3.1 and 3.3, the ARB ones for the older contexts */
+static void vertexAttribDivisor(GLuint index, GLuint divisor)
+{
+    if(glVertexAttribDivisor != NULL)
+        glVertexAttribDivisor(index, divisor);
+    else
+        glVertexAttribDivisorARB(index, divisor);
+}
+
+static void drawArraysInstanced(GLenum mode, GLint first, GLsizei count, GLsizei nbInstances)
+{
+    if(glDrawArraysInstanced != NULL)
+        glDrawArraysInstanced(mode, first, count, nbInstances);
+    else
+        glDrawArraysInstancedARB(mode, first, count, nbInstances);
+}
+
+/* \brief Upload a whole buffer, orphaning the previous storage so that the driver does not wait for the last frame to be drawn */
+static void streamBuffer(GLuint bufferID, const void* data, size_t size)
+{
+    glBindBuffer(GL_ARRAY_BUFFER, bufferID);
+    glBufferData(GL_ARRAY_BUFFER, size, NULL, GL_STREAM_DRAW);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, size, data);
+}
+
+AsteroidRenderer::~AsteroidRenderer()
+{
+    glDeleteBuffers(1, &m_rockID);
+    glDeleteBuffers(1, &m_instancesID);
+    glDeleteBuffers(1, &m_spritesID);
+    delete m_rockShader;
+    delete m_spriteShader;
+}
+
+bool AsteroidRenderer::isSupported()
+{
+    return (GLEW_VERSION_3_3 || GLEW_ARB_instanced_arrays) && (GLEW_VERSION_3_1 || GLEW_ARB_draw_instanced);
+}
+
+AsteroidRenderer* AsteroidRenderer::create(const Geometry& rock)
+{
+    if(!isSupported())
+    {
+        ERROR("The asteroids need OpenGL 3.3 or GL_ARB_instanced_arrays and GL_ARB_draw_instanced\n");
+        return NULL;
+    }
+    Shader* rockShader = loadShader("Shaders/asteroid.vert", "Shaders/asteroid.frag");
+    Shader* spriteShader = loadShader("Shaders/asteroid_sprite.vert", "Shaders/asteroid_sprite.frag");
+    if(rockShader == NULL || spriteShader == NULL)
+    {
+        delete rockShader;
+        delete spriteShader;
+        return NULL;
+    }
+
+    AsteroidRenderer* renderer = new AsteroidRenderer();
+    renderer->m_rockShader     = rockShader;
+    renderer->m_spriteShader   = spriteShader;
+    renderer->m_nbRockVertices = rock.getNbVertices();
+
+    glGenBuffers(1, &renderer->m_rockID);
+    glBindBuffer(GL_ARRAY_BUFFER, renderer->m_rockID);
+    glBufferData(GL_ARRAY_BUFFER, rock.getDataSize(), rock.getData(), GL_STATIC_DRAW);
+    glGenBuffers(1, &renderer->m_instancesID);
+    glGenBuffers(1, &renderer->m_spritesID);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    return renderer;
+}
+
+void AsteroidRenderer::bindCommon(const Shader* shader, GLuint texture, const glm::vec3& sunPosition, const glm::mat4& view, const glm::mat4& projection,
+                                  const DepthBuffer* depthBuffer) const
+{
+    GLuint programID = shader->getProgramID();
+    glUseProgram(programID);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glUniform1i(glGetUniformLocation(programID, "uTexture"), 0);
+    glUniform3fv(glGetUniformLocation(programID, "uSunPosition"), 1, glm::value_ptr(sunPosition));
+    glUniformMatrix4fv(glGetUniformLocation(programID, "uView"), 1, GL_FALSE, glm::value_ptr(view));
+    glUniformMatrix4fv(glGetUniformLocation(programID, "uProjection"), 1, GL_FALSE, glm::value_ptr(projection));
+    glUniform1f(glGetUniformLocation(programID, "uLogDepthScale"), 0.0f);
+    if(depthBuffer != nullptr)
+        depthBuffer->bind(shader);
+}
+
+void AsteroidRenderer::draw(const AsteroidField& field, GLuint texture, const glm::vec3& sunPosition, const glm::mat4& view, const glm::mat4& projection,
+                            const DepthBuffer* depthBuffer)
+{
+    draw(field.getMeshInstances(), field.getSprites(), texture, sunPosition, view, projection, depthBuffer);
+}
+
+void AsteroidRenderer::draw(const std::vector<AsteroidInstance>& instances, const std::vector<glm::vec4>& sprites, GLuint texture, const glm::vec3& sunPosition,
+                            const glm::mat4& view, const glm::mat4& projection, const DepthBuffer* depthBuffer)
+{
+    if(!instances.empty())
+    {
+        bindCommon(m_rockShader, texture, sunPosition, view, projection, depthBuffer);
+        GLuint programID = m_rockShader->getProgramID();
+
+        glBindBuffer(GL_ARRAY_BUFFER, m_rockID);
+        GLint vPosition = glGetAttribLocation(programID, "vPosition");
+        GLint vNormal = glGetAttribLocation(programID, "vNormal");
+        GLint vUV = glGetAttribLocation(programID, "Vuv");
+        glVertexAttribPointer(vPosition, 3, GL_FLOAT, GL_FALSE, 0, 0);
+        glVertexAttribPointer(vNormal, 3, GL_FLOAT, GL_FALSE, 0, (void*)(m_nbRockVertices * 3 * sizeof(float)));
+        glVertexAttribPointer(vUV, 2, GL_FLOAT, GL_FALSE, 0, (void*)(m_nbRockVertices * 6 * sizeof(float)));
+        glEnableVertexAttribArray(vPosition);
+        glEnableVertexAttribArray(vNormal);
+        glEnableVertexAttribArray(vUV);
+
+        /* One AsteroidInstance per rock */
+        streamBuffer(m_instancesID, instances.data(), instances.size() * sizeof(AsteroidInstance));
+        const char* names[] = {"iPositionSize", "iRotation", "iShape"};
+        GLint attributes[3];
+        for(uint32_t i = 0; i < 3; i++)
+        {
+            attributes[i] = glGetAttribLocation(programID, names[i]);
+            glVertexAttribPointer(attributes[i], 4, GL_FLOAT, GL_FALSE, sizeof(AsteroidInstance), (void*)(i * sizeof(glm::vec4)));
+            glEnableVertexAttribArray(attributes[i]);
+            vertexAttribDivisor(attributes[i], 1);
+        }
+
+        drawArraysInstanced(GL_TRIANGLES, 0, m_nbRockVertices, (GLsizei)instances.size());
+
+        /* The divisors are state of the attribute indices, shared with every other draw */
+        for(uint32_t i = 0; i < 3; i++)
+        {
+            vertexAttribDivisor(attributes[i], 0);
+            glDisableVertexAttribArray(attributes[i]);
+        }
+        glDisableVertexAttribArray(vUV);
+        glDisableVertexAttribArray(vNormal);
+        glDisableVertexAttribArray(vPosition);
+    }
+
+    if(!sprites.empty())
+    {
+        bindCommon(m_spriteShader, texture, sunPosition, view, projection, depthBuffer);
+        GLuint programID = m_spriteShader->getProgramID();
+        /* Pixels per unit of diameter at a distance of 1 */
+        GLint viewport[4];
+        glGetIntegerv(GL_VIEWPORT, viewport);
+        glUniform1f(glGetUniformLocation(programID, "uPointScale"), 0.5f * viewport[3] * projection[1][1]);
+
+        streamBuffer(m_spritesID, sprites.data(), sprites.size() * sizeof(glm::vec4));
+        GLint iPositionSize = glGetAttribLocation(programID, "iPositionSize");
+        glVertexAttribPointer(iPositionSize, 4, GL_FLOAT, GL_FALSE, 0, 0);
+        glEnableVertexAttribArray(iPositionSize);
+        glEnable(GL_PROGRAM_POINT_SIZE);
+        glEnable(GL_POINT_SPRITE);
+        glDrawArrays(GL_POINTS, 0, (GLsizei)sprites.size());
+        glDisable(GL_POINT_SPRITE);
+        glDisable(GL_PROGRAM_POINT_SIZE);
+        glDisableVertexAttribArray(iPositionSize);
+    }
+
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glUseProgram(0);
+}
@@ -0,0 +1,474 @@
+#include "Atmosphere.h"
+#include "JobSystem.h"
+#include "logger.h"
+
+#include <stdio.h>
+#include <string>
+#include <chrono>
+#include <cmath>
+#include <algorithm>
+#include <glm/gtc/type_ptr.hpp>
+
+#ifdef _WIN32
+#include <direct.h>
+#define MAKE_DIRECTORY(path) _mkdir(path)
+#else
+#include <sys/stat.h>
+#define MAKE_DIRECTORY(path) mkdir(path, 0755)
+#endif
+
+#define ATMOSPHERE_CACHE_MAGIC   0x54415347 /* "GSAT" */
+#define ATMOSPHERE_CACHE_VERSION 1
+
+#define TRANSMITTANCE_SIZE (ATMOSPHERE_TRANSMITTANCE_WIDTH * ATMOSPHERE_TRANSMITTANCE_HEIGHT * 3)
+#define SCATTERING_SIZE    (ATMOSPHERE_SCATTERING_NU * ATMOSPHERE_SCATTERING_MU_S * ATMOSPHERE_SCATTERING_MU * ATMOSPHERE_SCATTERING_R * 4)
+
+/* Angular radius of the sun used to soften the terminator, in radians */
+static const float SUN_ANGULAR_RADIUS = 0.05f;
+
+/* \brief Header written before the tables */
+struct AtmosphereCacheHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint64_t key;
+    uint32_t transmittanceSize; /*!< Number of floats*/
+    uint32_t scatteringSize;    /*!< Number of floats*/
+};
+
+AtmosphereParameters AtmosphereParameters::earth()
+{
+    return AtmosphereParameters();
+}
+
+AtmosphereParameters AtmosphereParameters::haze()
+{
+    AtmosphereParameters params;
+    params.topRadius           = 1.1f;
+    params.rayleighScattering  = glm::vec3(9.0f, 6.0f, 3.5f);
+    params.rayleighScaleHeight = 0.015f;
+    params.mieScattering       = glm::vec3(10.0f);
+    params.mieExtinction       = glm::vec3(14.0f);
+    params.mieScaleHeight      = 0.004f;
+    params.mieG                = 0.7f;
+    return params;
+}
+
+/*----------------------------------------------------------------------------*/
+/* Geometry of the rays, the ground being at r = 1 (Bruneton 2017, section 2) */
+/*----------------------------------------------------------------------------*/
+
+static float safeSqrt(float a)
+{
+    return std::sqrt(std::max(a, 0.0f));
+}
+
+static float clampCosine(float mu)
+{
+    return glm::clamp(mu, -1.0f, 1.0f);
+}
+
+static float distanceToTop(const AtmosphereParameters& params, float r, float mu)
+{
+    return std::max(-r * mu + safeSqrt(r * r * (mu * mu - 1.0f) + params.topRadius * params.topRadius), 0.0f);
+}
+
+static float distanceToBottom(float r, float mu)
+{
+    return std::max(-r * mu - safeSqrt(r * r * (mu * mu - 1.0f) + 1.0f), 0.0f);
+}
+
+/* Texel centers map to the bounds of the unit range, so that both ends are sampled exactly */
+static float coordFromUnitRange(float x, uint32_t size)
+{
+    return 0.5f / size + x * (1.0f - 1.0f / size);
+}
+
+static float unitRangeFromCoord(float u, uint32_t size)
+{
+    return (u - 0.5f / size) / (1.0f - 1.0f / size);
+}
+
+/*----------------------------------------------------------------------------*/
+/* Transmittance */
+/*----------------------------------------------------------------------------*/
+
+static void transmittanceRMuFromUv(const AtmosphereParameters& params, float u, float v, float& r, float& mu)
+{
+    float H   = safeSqrt(params.topRadius * params.topRadius - 1.0f);
+    float rho = H * unitRangeFromCoord(v, ATMOSPHERE_TRANSMITTANCE_HEIGHT);
+    r = std::sqrt(rho * rho + 1.0f);
+
+    float dMin = params.topRadius - r;
+    float dMax = rho + H;
+    float d    = dMin + unitRangeFromCoord(u, ATMOSPHERE_TRANSMITTANCE_WIDTH) * (dMax - dMin);
+    mu = d == 0.0f ? 1.0f : clampCosine((H * H - rho * rho - d * d) / (2.0f * r * d));
+}
+
+static glm::vec3 computeTransmittanceToTop(const AtmosphereParameters& params, float r, float mu)
+{
+    float dx = distanceToTop(params, r, mu) / ATMOSPHERE_TRANSMITTANCE_STEPS;
+    float rayleighDepth = 0.0f;
+    float mieDepth      = 0.0f;
+    for(uint32_t i = 0; i <= ATMOSPHERE_TRANSMITTANCE_STEPS; i++)
+    {
+        float d        = i * dx;
+        float altitude = std::sqrt(d * d + 2.0f * r * mu * d + r * r) - 1.0f;
+        float weight   = (i == 0 || i == ATMOSPHERE_TRANSMITTANCE_STEPS) ? 0.5f : 1.0f;
+        rayleighDepth += weight * std::exp(-altitude / params.rayleighScaleHeight);
+        mieDepth      += weight * std::exp(-altitude / params.mieScaleHeight);
+    }
+    glm::vec3 opticalDepth = (params.rayleighScattering * rayleighDepth + params.mieExtinction * mieDepth) * dx;
+    return glm::exp(-opticalDepth);
+}
+
+/* Bilinear lookup in the transmittance table */
+static glm::vec3 transmittanceToTop(const AtmosphereParameters& params, const float* table, float r, float mu)
+{
+    float H    = safeSqrt(params.topRadius * params.topRadius - 1.0f);
+    float rho  = safeSqrt(r * r - 1.0f);
+    float d    = distanceToTop(params, r, mu);
+    float dMin = params.topRadius - r;
+    float dMax = rho + H;
+    float u    = coordFromUnitRange((d - dMin) / (dMax - dMin), ATMOSPHERE_TRANSMITTANCE_WIDTH);
+    float v    = coordFromUnitRange(rho / H, ATMOSPHERE_TRANSMITTANCE_HEIGHT);
+
+    float x  = glm::clamp(u * ATMOSPHERE_TRANSMITTANCE_WIDTH - 0.5f, 0.0f, ATMOSPHERE_TRANSMITTANCE_WIDTH - 1.0f);
+    float y  = glm::clamp(v * ATMOSPHERE_TRANSMITTANCE_HEIGHT - 0.5f, 0.0f, ATMOSPHERE_TRANSMITTANCE_HEIGHT - 1.0f);
+    uint32_t x0 = (uint32_t)x;
+    uint32_t y0 = (uint32_t)y;
+    uint32_t x1 = std::min(x0 + 1, (uint32_t)ATMOSPHERE_TRANSMITTANCE_WIDTH - 1);
+    uint32_t y1 = std::min(y0 + 1, (uint32_t)ATMOSPHERE_TRANSMITTANCE_HEIGHT - 1);
+    float fx = x - x0;
+    float fy = y - y0;
+
+    const glm::vec3* texels = (const glm::vec3*)table;
+    glm::vec3 top    = glm::mix(texels[y0 * ATMOSPHERE_TRANSMITTANCE_WIDTH + x0], texels[y0 * ATMOSPHERE_TRANSMITTANCE_WIDTH + x1], fx);
+    glm::vec3 bottom = glm::mix(texels[y1 * ATMOSPHERE_TRANSMITTANCE_WIDTH + x0], texels[y1 * ATMOSPHERE_TRANSMITTANCE_WIDTH + x1], fx);
+    return glm::mix(top, bottom, fy);
+}
+
+/* Transmittance between the point at (r, mu) and the one at distance d along the ray */
+static glm::vec3 transmittanceBetween(const AtmosphereParameters& params, const float* table, float r, float mu, float d, bool ground)
+{
+    float rd  = glm::clamp(std::sqrt(d * d + 2.0f * r * mu * d + r * r), 1.0f, params.topRadius);
+    float mud = clampCosine((r * mu + d) / rd);
+    if(ground)
+        return glm::min(transmittanceToTop(params, table, rd, -mud) / transmittanceToTop(params, table, r, -mu), glm::vec3(1.0f));
+    return glm::min(transmittanceToTop(params, table, r, mu) / transmittanceToTop(params, table, rd, mud), glm::vec3(1.0f));
+}
+
+static glm::vec3 transmittanceToSun(const AtmosphereParameters& params, const float* table, float r, float muS)
+{
+    float sinHorizon = 1.0f / r;
+    float cosHorizon = -safeSqrt(1.0f - sinHorizon * sinHorizon);
+    float edge       = sinHorizon * SUN_ANGULAR_RADIUS;
+    return transmittanceToTop(params, table, r, muS) * glm::smoothstep(-edge, edge, muS - cosHorizon);
+}
+
+/*----------------------------------------------------------------------------*/
+/* Single scattering */
+/*----------------------------------------------------------------------------*/
+
+static void scatteringRMuMuSNuFromUvwz(const AtmosphereParameters& params, const glm::vec4& uvwz, float& r, float& mu, float& muS, float& nu, bool& ground)
+{
+    float H   = safeSqrt(params.topRadius * params.topRadius - 1.0f);
+    float rho = H * unitRangeFromCoord(uvwz.w, ATMOSPHERE_SCATTERING_R);
+    r = std::sqrt(rho * rho + 1.0f);
+
+    /* The lower half of the mu range holds the rays hitting the ground, the upper half the others */
+    if(uvwz.z < 0.5f)
+    {
+        float dMin = r - 1.0f;
+        float dMax = rho;
+        float d    = dMin + (dMax - dMin) * unitRangeFromCoord(1.0f - 2.0f * uvwz.z, ATMOSPHERE_SCATTERING_MU / 2);
+        mu     = d == 0.0f ? -1.0f : clampCosine(-(rho * rho + d * d) / (2.0f * r * d));
+        ground = true;
+    }
+    else
+    {
+        float dMin = params.topRadius - r;
+        float dMax = rho + H;
+        float d    = dMin + (dMax - dMin) * unitRangeFromCoord(2.0f * uvwz.z - 1.0f, ATMOSPHERE_SCATTERING_MU / 2);
+        mu     = d == 0.0f ? 1.0f : clampCosine((H * H - rho * rho - d * d) / (2.0f * r * d));
+        ground = false;
+    }
+
+    float xMuS = unitRangeFromCoord(uvwz.y, ATMOSPHERE_SCATTERING_MU_S);
+    float dMin = params.topRadius - 1.0f;
+    float dMax = H;
+    float D    = distanceToTop(params, 1.0f, params.muSMin);
+    float A    = (D - dMin) / (dMax - dMin);
+    float a    = (A - xMuS * A) / (1.0f + xMuS * A);
+    float d    = dMin + std::min(a, A) * (dMax - dMin);
+    muS = d == 0.0f ? 1.0f : clampCosine((H * H - d * d) / (2.0f * d));
+
+    nu = clampCosine(uvwz.x * 2.0f - 1.0f);
+}
+
+static glm::vec4 computeSingleScattering(const AtmosphereParameters& params, const float* transmittance, float r, float mu, float muS, float nu, bool ground)
+{
+    float dx = (ground ? distanceToBottom(r, mu) : distanceToTop(params, r, mu)) / ATMOSPHERE_SCATTERING_STEPS;
+    glm::vec3 rayleigh(0.0f);
+    glm::vec3 mie(0.0f);
+    for(uint32_t i = 0; i <= ATMOSPHERE_SCATTERING_STEPS; i++)
+    {
+        float d     = i * dx;
+        float rd    = glm::clamp(std::sqrt(d * d + 2.0f * r * mu * d + r * r), 1.0f, params.topRadius);
+        float muSd  = clampCosine((r * muS + d * nu) / rd);
+        glm::vec3 t = transmittanceBetween(params, transmittance, r, mu, d, ground) * transmittanceToSun(params, transmittance, rd, muSd);
+        float weight = (i == 0 || i == ATMOSPHERE_SCATTERING_STEPS) ? 0.5f : 1.0f;
+        rayleigh += weight * t * std::exp(-(rd - 1.0f) / params.rayleighScaleHeight);
+        mie      += weight * t * std::exp(-(rd - 1.0f) / params.mieScaleHeight);
+    }
+    rayleigh *= dx * params.rayleighScattering;
+    mie      *= dx * params.mieScattering;
+    return glm::vec4(rayleigh, mie.r);
+}
+
+void Atmosphere::computeTables(const AtmosphereParameters& params, std::vector<float>& transmittance, std::vector<float>& scattering)
+{
+    transmittance.resize(TRANSMITTANCE_SIZE);
+    scattering.resize(SCATTERING_SIZE);
+
+    JobSystem::get().parallelFor(ATMOSPHERE_TRANSMITTANCE_HEIGHT, 1, [&](uint32_t first, uint32_t last)
+    {
+        for(uint32_t y = first; y < last; y++)
+            for(uint32_t x = 0; x < ATMOSPHERE_TRANSMITTANCE_WIDTH; x++)
+            {
+                float r, mu;
+                transmittanceRMuFromUv(params, (x + 0.5f) / ATMOSPHERE_TRANSMITTANCE_WIDTH, (y + 0.5f) / ATMOSPHERE_TRANSMITTANCE_HEIGHT, r, mu);
+                glm::vec3 t = computeTransmittanceToTop(params, r, mu);
+                float* texel = &transmittance[(y * ATMOSPHERE_TRANSMITTANCE_WIDTH + x) * 3];
+                texel[0] = t.x;
+                texel[1] = t.y;
+                texel[2] = t.z;
+            }
+    });
+
+    /* One batch per row of the 3D table (a (mu, r) pair) */
+    const uint32_t width = ATMOSPHERE_SCATTERING_NU * ATMOSPHERE_SCATTERING_MU_S;
+    JobSystem::get().parallelFor(ATMOSPHERE_SCATTERING_MU * ATMOSPHERE_SCATTERING_R, 1, [&](uint32_t first, uint32_t last)
+    {
+        for(uint32_t row = first; row < last; row++)
+        {
+            uint32_t y = row % ATMOSPHERE_SCATTERING_MU;
+            uint32_t z = row / ATMOSPHERE_SCATTERING_MU;
+            for(uint32_t x = 0; x < width; x++)
+            {
+                float fragNu  = (float)(x / ATMOSPHERE_SCATTERING_MU_S);
+                float fragMuS = (x % ATMOSPHERE_SCATTERING_MU_S) + 0.5f;
+                glm::vec4 uvwz(fragNu / (ATMOSPHERE_SCATTERING_NU - 1), fragMuS / ATMOSPHERE_SCATTERING_MU_S,
+                               (y + 0.5f) / ATMOSPHERE_SCATTERING_MU, (z + 0.5f) / ATMOSPHERE_SCATTERING_R);
+                float r, mu, muS, nu;
+                bool ground;
+                scatteringRMuMuSNuFromUvwz(params, uvwz, r, mu, muS, nu, ground);
+
+                /* Not every nu is possible for a given (mu, muS) */
+                float spread = std::sqrt((1.0f - mu * mu) * (1.0f - muS * muS));
+                nu = glm::clamp(nu, mu * muS - spread, mu * muS + spread);
+
+                glm::vec4 s = computeSingleScattering(params, transmittance.data(), r, mu, muS, nu, ground);
+                float* texel = &scattering[(row * width + x) * 4];
+                texel[0] = s.x;
+                texel[1] = s.y;
+                texel[2] = s.z;
+                texel[3] = s.w;
+            }
+        }
+    });
+}
+
+/*----------------------------------------------------------------------------*/
+/* Disk cache */
+/*----------------------------------------------------------------------------*/
+
+/* \brief FNV-1a, 64 bits, over the parameters and the table layout */
+static uint64_t computeKey(const AtmosphereParameters& params)
+{
+    const float values[] =
+    {
+        params.topRadius, params.rayleighScattering.x, params.rayleighScattering.y, params.rayleighScattering.z, params.rayleighScaleHeight,
+        params.mieScattering.x, params.mieScattering.y, params.mieScattering.z, params.mieExtinction.x, params.mieExtinction.y, params.mieExtinction.z,
+        params.mieScaleHeight, params.mieG, params.muSMin, SUN_ANGULAR_RADIUS,
+        (float)ATMOSPHERE_TRANSMITTANCE_WIDTH, (float)ATMOSPHERE_TRANSMITTANCE_HEIGHT, (float)ATMOSPHERE_TRANSMITTANCE_STEPS,
+        (float)ATMOSPHERE_SCATTERING_NU, (float)ATMOSPHERE_SCATTERING_MU_S, (float)ATMOSPHERE_SCATTERING_MU, (float)ATMOSPHERE_SCATTERING_R, (float)ATMOSPHERE_SCATTERING_STEPS
+    };
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    const uint8_t* bytes = (const uint8_t*)values;
+    for(size_t i = 0; i < sizeof(values); i++)
+    {
+        hash ^= bytes[i];
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+static std::string cachePath(uint64_t key)
+{
+    char name[64];
+    snprintf(name, sizeof(name), ATMOSPHERE_CACHE_DIRECTORY "/%016llx.bin", (unsigned long long)key);
+    return name;
+}
+
+bool Atmosphere::loadTables(uint64_t key, std::vector<float>& transmittance, std::vector<float>& scattering)
+{
+    std::string path = cachePath(key);
+    FILE* file = fopen(path.c_str(), "rb");
+    if(file == NULL)
+        return false;
+
+    AtmosphereCacheHeader header;
+    bool valid = fread(&header, sizeof(header), 1, file) == 1 &&
+                 header.magic == ATMOSPHERE_CACHE_MAGIC && header.version == ATMOSPHERE_CACHE_VERSION && header.key == key &&
+                 header.transmittanceSize == TRANSMITTANCE_SIZE && header.scatteringSize == SCATTERING_SIZE;
+    if(valid)
+    {
+        transmittance.resize(TRANSMITTANCE_SIZE);
+        scattering.resize(SCATTERING_SIZE);
+        valid = fread(transmittance.data(), sizeof(float), TRANSMITTANCE_SIZE, file) == TRANSMITTANCE_SIZE &&
+                fread(scattering.data(), sizeof(float), SCATTERING_SIZE, file) == SCATTERING_SIZE;
+    }
+    fclose(file);
+
+    if(!valid)
+    {
+        WARNING("The atmosphere tables %s are invalid, computing them again\n", path.c_str());
+        remove(path.c_str());
+    }
+    return valid;
+}
+
+void Atmosphere::storeTables(uint64_t key, const std::vector<float>& transmittance, const std::vector<float>& scattering)
+{
+    AtmosphereCacheHeader header;
+    header.magic             = ATMOSPHERE_CACHE_MAGIC;
+    header.version           = ATMOSPHERE_CACHE_VERSION;
+    header.key               = key;
+    header.transmittanceSize = TRANSMITTANCE_SIZE;
+    header.scatteringSize    = SCATTERING_SIZE;
+
+    MAKE_DIRECTORY(ATMOSPHERE_CACHE_DIRECTORY);
+    std::string path = cachePath(key);
+    FILE* file = fopen(path.c_str(), "wb");
+    if(file == NULL)
+    {
+        WARNING("Could not write the atmosphere tables %s\n", path.c_str());
+        return;
+    }
+    fwrite(&header, sizeof(header), 1, file);
+    fwrite(transmittance.data(), sizeof(float), transmittance.size(), file);
+    fwrite(scattering.data(), sizeof(float), scattering.size(), file);
+    fclose(file);
+}
+
+/*----------------------------------------------------------------------------*/
+/* Rendering */
+/*----------------------------------------------------------------------------*/
+
+Atmosphere::~Atmosphere()
+{
+    glDeleteTextures(1, &m_transmittanceID);
+    glDeleteTextures(1, &m_scatteringID);
+    delete m_shader;
+}
+
+Atmosphere* Atmosphere::create(const AtmosphereParameters& params, bool useCache)
+{
+    FILE* vert = fopen("Shaders/atmosphere.vert", "r");
+    FILE* frag = fopen("Shaders/atmosphere.frag", "r");
+    if(vert == NULL || frag == NULL)
+    {
+        ERROR("Could not open the atmosphere shaders\n");
+        if(vert) fclose(vert);
+        if(frag) fclose(frag);
+        return NULL;
+    }
+    Shader* shader = Shader::loadFromFiles(vert, frag);
+    fclose(vert);
+    fclose(frag);
+    if(shader == NULL)
+        return NULL;
+
+    Atmosphere* atmosphere = new Atmosphere();
+    atmosphere->m_shader = shader;
+    atmosphere->m_params = params;
+
+    auto begin = std::chrono::high_resolution_clock::now();
+    uint64_t key = computeKey(params);
+    std::vector<float> transmittance;
+    std::vector<float> scattering;
+    atmosphere->m_fromCache = useCache && loadTables(key, transmittance, scattering);
+    if(!atmosphere->m_fromCache)
+    {
+        computeTables(params, transmittance, scattering);
+        if(useCache)
+            storeTables(key, transmittance, scattering);
+    }
+    atmosphere->m_buildTime = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - begin).count();
+    INFO("Atmosphere tables %016llx %s in %.1f ms\n", (unsigned long long)key, atmosphere->m_fromCache ? "loaded" : "computed", atmosphere->m_buildTime);
+
+    glGenTextures(1, &atmosphere->m_transmittanceID);
+    glBindTexture(GL_TEXTURE_2D, atmosphere->m_transmittanceID);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB16F, ATMOSPHERE_TRANSMITTANCE_WIDTH, ATMOSPHERE_TRANSMITTANCE_HEIGHT, 0, GL_RGB, GL_FLOAT, transmittance.data());
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    glGenTextures(1, &atmosphere->m_scatteringID);
+    glBindTexture(GL_TEXTURE_3D, atmosphere->m_scatteringID);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+    glTexImage3D(GL_TEXTURE_3D, 0, GL_RGBA16F, ATMOSPHERE_SCATTERING_NU * ATMOSPHERE_SCATTERING_MU_S, ATMOSPHERE_SCATTERING_MU, ATMOSPHERE_SCATTERING_R,
+                 0, GL_RGBA, GL_FLOAT, scattering.data());
+    glBindTexture(GL_TEXTURE_3D, 0);
+
+    return atmosphere;
+}
+
+void Atmosphere::draw(const glm::vec3& center, float planetRadius, const glm::vec3& sunPosition, float sunIntensity,
+                      const glm::vec3& cameraPosition, const glm::mat4& view, const glm::mat4& projection, const DepthBuffer* depthBuffer) const
+{
+    GLuint programID = m_shader->getProgramID();
+    glUseProgram(programID);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, m_transmittanceID);
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_3D, m_scatteringID);
+    glActiveTexture(GL_TEXTURE0);
+
+    glm::vec3 sunDirection = glm::normalize(sunPosition - center);
+    glUniform1i(glGetUniformLocation(programID, "uTransmittance"), 0);
+    glUniform1i(glGetUniformLocation(programID, "uScattering"), 1);
+    glUniform4f(glGetUniformLocation(programID, "uPlanet"), center.x, center.y, center.z, planetRadius);
+    glUniform1f(glGetUniformLocation(programID, "uTopRadius"), m_params.topRadius);
+    glUniform1f(glGetUniformLocation(programID, "uMuSMin"), m_params.muSMin);
+    glUniform3fv(glGetUniformLocation(programID, "uRayleighScattering"), 1, glm::value_ptr(m_params.rayleighScattering));
+    glUniform3fv(glGetUniformLocation(programID, "uMieScattering"), 1, glm::value_ptr(m_params.mieScattering));
+    glUniform1f(glGetUniformLocation(programID, "uMieG"), m_params.mieG);
+    glUniform3fv(glGetUniformLocation(programID, "uSunDirection"), 1, glm::value_ptr(sunDirection));
+    glUniform1f(glGetUniformLocation(programID, "uSunIntensity"), sunIntensity);
+    glUniform3fv(glGetUniformLocation(programID, "uCameraPosition"), 1, glm::value_ptr(cameraPosition));
+    glUniformMatrix4fv(glGetUniformLocation(programID, "uView"), 1, GL_FALSE, glm::value_ptr(view));
+    glUniformMatrix4fv(glGetUniformLocation(programID, "uInvView"), 1, GL_FALSE, glm::value_ptr(glm::inverse(view)));
+    glUniformMatrix4fv(glGetUniformLocation(programID, "uProjection"), 1, GL_FALSE, glm::value_ptr(projection));
+    glUniformMatrix4fv(glGetUniformLocation(programID, "uInvProjection"), 1, GL_FALSE, glm::value_ptr(glm::inverse(projection)));
+    glUniform1f(glGetUniformLocation(programID, "uNearDepth"), -1.0f);
+    glUniform1f(glGetUniformLocation(programID, "uLogDepthScale"), 0.0f);
+    if(depthBuffer != nullptr)
+        depthBuffer->bind(m_shader);
+
+    /* In-scattering is added, what is behind is multiplied by the transmittance in alpha. The depth is tested, not written */
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_ONE, GL_SRC_ALPHA);
+    glDepthMask(GL_FALSE);
+    glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+    glDepthMask(GL_TRUE);
+    glDisable(GL_BLEND);
+    glUseProgram(0);
+}
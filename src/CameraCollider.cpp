@@ -0,0 +1,120 @@
+#include "CameraCollider.h"
+
+#include <chrono>
+#include <algorithm>
+#include <cmath>
+
+glm::dvec3 CameraCollider::move(const glm::dvec3& from, const glm::dvec3& to, const SphereBVH& bodies, const std::vector<glm::dvec3>& centers,
+                                const std::vector<float>& radii, const glm::dvec3& boundCenter, double boundRadius)
+{
+    auto begin = std::chrono::high_resolution_clock::now();
+    uint32_t nbBodies = (uint32_t)centers.size();
+    if(m_previous.size() != nbBodies)
+        m_previous = centers; //New bodies : their motion is unknown, they are taken as still for this move
+
+    /* Everything relative to the camera of the previous frame, so that floats keep their precision around it */
+    float maxBodyMotion = 0.0f;
+    for(uint32_t i = 0; i < nbBodies; i++)
+        maxBodyMotion = glm::max(maxBodyMotion, (float)glm::length(centers[i] - m_previous[i]));
+
+    /* Broadphase. Each slide moves the camera by its motion relative to a body plus the motion of that body :
+     * over the frame, it cannot go farther than its own motion plus twice the fastest body. A body it meets was at most
+     * the fastest motion away from where the index has it */
+    glm::vec3 motion = glm::vec3(to - from);
+    m_candidates.clear();
+    bodies.queryRadius(glm::vec3(0.0f), glm::length(motion) + 3.0f * maxBodyMotion + m_radius, m_candidates);
+    m_candidates.erase(std::remove_if(m_candidates.begin(), m_candidates.end(), [&radii](uint32_t id){return radii[id] <= 0.0f;}), m_candidates.end());
+    m_nbCandidates = (uint32_t)m_candidates.size();
+    m_nbContacts   = 0;
+
+    /* Narrowphase : the camera at time s in [0, 1] is position + (s - u) * rate, a body is a0 + s * v.
+     * The first time the distance between them reaches the sum of the radii ends the sweep, then the camera slides with the rest */
+    glm::vec3 position(0.0f);
+    glm::vec3 rate = motion;
+    float     u    = 0.0f;
+    float     skin = CAMERA_COLLISION_SKIN * m_radius;
+    for(uint32_t iteration = 0; iteration < CAMERA_COLLISION_ITERATIONS && u < 1.0f; iteration++)
+    {
+        float   hitTime = 1.0f - u;
+        int32_t hitID   = -1;
+        for(uint32_t id : m_candidates)
+        {
+            glm::vec3 a0 = glm::vec3(m_previous[id] - from);
+            glm::vec3 v  = glm::vec3(centers[id] - from) - a0;
+            glm::vec3 q  = position - (a0 + u * v); //From the body to the camera
+            glm::vec3 w  = rate - v;                //Motion of the camera relative to the body
+            float     r  = radii[id] + m_radius;
+            float     b  = glm::dot(q, w);
+            if(b >= 0.0f)
+                continue; //Moving apart
+            float c = glm::dot(q, q) - r * r;
+            if(c < 0.0f)
+            {
+                //Already in contact and coming closer : no time left for this motion
+                hitTime = 0.0f;
+                hitID   = (int32_t)id;
+                break;
+            }
+            float a    = glm::dot(w, w);
+            float disc = b * b - a * c;
+            if(disc < 0.0f)
+                continue;
+            float tau = (-b - sqrtf(disc)) / a;
+            if(tau < hitTime)
+            {
+                hitTime = tau;
+                hitID   = (int32_t)id;
+            }
+        }
+
+        position += hitTime * rate;
+        u        += hitTime;
+        if(hitID < 0)
+            break;
+
+        //Put the camera just out of the body, then remove the motion into it : what is left slides along the surface
+        glm::vec3 a0     = glm::vec3(m_previous[hitID] - from);
+        glm::vec3 v      = glm::vec3(centers[hitID] - from) - a0;
+        glm::vec3 center = a0 + u * v;
+        glm::vec3 q      = position - center;
+        float     length = glm::length(q);
+        glm::vec3 normal = length > 0.0f ? q / length : glm::vec3(0.0f, 1.0f, 0.0f);
+        position = center + normal * (radii[hitID] + m_radius + skin);
+        glm::vec3 w = rate - v;
+        w   -= normal * glm::min(glm::dot(w, normal), 0.0f);
+        rate = w + v;
+        m_nbContacts++;
+    }
+
+    //Out of iterations, or a body came in faster than the camera could slide : push the camera out of what it ends in
+    for(uint32_t id : m_candidates)
+    {
+        glm::vec3 center = glm::vec3(centers[id] - from);
+        glm::vec3 q      = position - center;
+        float     r      = radii[id] + m_radius;
+        float     length = glm::length(q);
+        if(length >= r)
+            continue;
+        glm::vec3 normal = length > 0.0f ? q / length : glm::vec3(0.0f, 1.0f, 0.0f);
+        position = center + normal * (r + skin);
+        m_nbContacts++;
+    }
+
+    //The bounding sphere : the camera is brought back on it, which slides it along its inside
+    glm::dvec3 result = from + glm::dvec3(position);
+    if(boundRadius > 0.0)
+    {
+        glm::dvec3 offset = result - boundCenter;
+        double     limit  = boundRadius - m_radius;
+        double     length = glm::length(offset);
+        if(length > limit && length > 0.0)
+        {
+            result = boundCenter + offset * (limit / length);
+            m_nbContacts++;
+        }
+    }
+
+    m_previous     = centers;
+    m_lastMoveTime = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - begin).count();
+    return result;
+}
@@ -6,10 +6,10 @@
 Cone::Cone(uint32_t nbLattitude, float topRadius) : Geometry()
 {
     float radius = 0.5;
-    m_nbVertices = nbLattitude * 6;
-    m_vertices   = (float*)malloc(sizeof(float)*3*6*nbLattitude);
-    m_normals    = (float*)malloc(sizeof(float)*3*6*nbLattitude);
-    m_uvs        = (float*)malloc(sizeof(float)*2*6*nbLattitude);
+    allocate(nbLattitude * 6);
+    float* vertices = editVertices();
+    float* normals  = editNormals();
+    float* uvs      = editUVs();
 
 	for(uint32_t i=0; i < nbLattitude; i++)
 	{
@@ -33,10 +33,10 @@ Cone::Cone(uint32_t nbLattitude, float topRadius) : Geometry()
 					     };
 
 		for(uint32_t j=0; j < 18; j++)
-			m_vertices[18*i+j] = pos[j];
+			vertices[18*i+j] = pos[j];
 
         for(uint32_t j = 0; j < 12; j++)
-            m_uvs[12*i+j] = uvPos[j];
+            uvs[12*i+j] = uvPos[j];
 
         float angle        = atan2(1.0-topRadius, 1.0);
         glm::vec3 normalI  = glm::rotate(glm::mat4(1.0f), (float)(i*2*M_PI/nbLattitude), glm::vec3(0.0, 0.0, 1.0))           * glm::vec4(cos(angle), 0.0, sin(angle), 1.0f);
@@ -44,12 +44,12 @@ Cone::Cone(uint32_t nbLattitude, float topRadius) : Geometry()
 
         for(uint32_t j = 0; j < 3; j++)
         {
-            m_normals[18*i+0+j]  = normalI[j];
-            m_normals[18*i+3+j]  = normalI2[j];
-            m_normals[18*i+6+j]  = normalI2[j];
-            m_normals[18*i+9+j]  = normalI[j];
-            m_normals[18*i+12+j] = normalI2[j];
-            m_normals[18*i+15+j] = normalI[j];
+            normals[18*i+0+j]  = normalI[j];
+            normals[18*i+3+j]  = normalI2[j];
+            normals[18*i+6+j]  = normalI2[j];
+            normals[18*i+9+j]  = normalI[j];
+            normals[18*i+12+j] = normalI2[j];
+            normals[18*i+15+j] = normalI[j];
         }
 	}
 }
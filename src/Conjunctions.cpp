@@ -0,0 +1,311 @@
+#include "Conjunctions.h"
+#include "JobSystem.h"
+#include "logger.h"
+
+#include <chrono>
+#include <cmath>
+#include <algorithm>
+
+/* Golden ratio conjugate, the part of the bracket kept at each refinement step */
+#define CONJUNCTION_GOLDEN 0.6180339887498949
+
+uint32_t Conjunctions::add(const ConjunctionBody& body)
+{
+    ConjunctionBody added = body;
+    if(added.parent >= (int32_t)m_bodies.size())
+    {
+        WARNING("The parent %d of a body is not added yet, the body orbits the origin\n", added.parent);
+        added.parent = -1;
+    }
+    added.elements.eccentricity = glm::clamp(added.elements.eccentricity, 0.0f, KEPLER_MAX_ECCENTRICITY);
+
+    /* Top speed at the periapsis : n a sqrt((1 + e) / (1 - e)) */
+    double e     = added.elements.eccentricity;
+    double speed = std::abs((double)added.elements.meanMotion) * added.elements.semiMajorAxis * std::sqrt((1.0 + e) / (1.0 - e));
+    if(added.parent >= 0)
+        speed += m_maxSpeeds[added.parent];
+
+    //The orientation is computed once : the analysis solves each orbit hundreds of times
+    glm::dvec3 p, q;
+    Orbits::getAxes(added.elements, p, q);
+    m_axisP.push_back(p * (double)added.elements.semiMajorAxis);
+    m_axisQ.push_back(q * (added.elements.semiMajorAxis * std::sqrt(1.0 - e * e)));
+    m_bodies.push_back(added);
+    m_maxSpeeds.push_back(speed);
+    m_periapses.push_back(added.elements.semiMajorAxis * (1.0 - e));
+    return (uint32_t)m_bodies.size() - 1;
+}
+
+glm::dvec3 Conjunctions::solve(uint32_t bodyID, double t) const
+{
+    const KeplerElements& elements = m_bodies[bodyID].elements;
+    double e = elements.eccentricity;
+    double m = std::fmod(elements.meanAnomaly + elements.meanMotion * t, 2.0 * M_PI);
+
+    /* Newton from M + e sin(M), which is close already for the usual eccentricities. The convergence is quadratic :
+     * once a step is below 1e-8, the error left is around 1e-16 and one more iteration would change nothing */
+    double eccentricAnomaly = e > 0.8 ? M_PI : m + e * std::sin(m);
+    for(uint32_t iteration = 0; iteration < 50; iteration++)
+    {
+        double step = (eccentricAnomaly - e * std::sin(eccentricAnomaly) - m) / (1.0 - e * std::cos(eccentricAnomaly));
+        eccentricAnomaly -= step;
+        if(std::abs(step) < 1e-8)
+            break;
+    }
+    return (std::cos(eccentricAnomaly) - e) * m_axisP[bodyID] + std::sin(eccentricAnomaly) * m_axisQ[bodyID];
+}
+
+glm::dvec3 Conjunctions::getPosition(uint32_t bodyID, double t) const
+{
+    glm::dvec3 position(0.0);
+    for(int32_t i = (int32_t)bodyID; i >= 0; i = m_bodies[i].parent)
+        position += solve(i, t);
+    return position;
+}
+
+void Conjunctions::computePositions(double t, std::vector<glm::dvec3>& positions) const
+{
+    positions.resize(m_bodies.size());
+    for(uint32_t i = 0; i < m_bodies.size(); i++)
+    {
+        positions[i] = solve(i, t);
+        if(m_bodies[i].parent >= 0)
+            positions[i] += positions[m_bodies[i].parent];
+    }
+}
+
+void Conjunctions::analyze(double start, double end, double threshold, std::vector<Conjunction>& out, uint32_t nbIntervals)
+{
+    auto begin = std::chrono::high_resolution_clock::now();
+    out.clear();
+    m_nbCandidates = 0;
+    uint32_t nbBodies = (uint32_t)m_bodies.size();
+    if(nbBodies < 2 || end <= start)
+    {
+        m_nbIntervals = 0;
+        m_lastBroadphaseTime = m_lastRefineTime = 0.0;
+        return;
+    }
+
+    if(nbIntervals == 0)
+    {
+        float maxMotion = 0.0f;
+        for(const ConjunctionBody& body : m_bodies)
+            maxMotion = std::max(maxMotion, std::abs(body.elements.meanMotion));
+        double orbits = maxMotion * (end - start) / (2.0 * M_PI);
+        nbIntervals = (uint32_t)std::max(1.0, std::ceil(orbits * CONJUNCTION_INTERVALS_PER_ORBIT));
+    }
+    m_nbIntervals = nbIntervals;
+    double step = (end - start) / nbIntervals;
+
+    /* Sweep and prune, a group of consecutive intervals per job. The boxes hold the radius and half of the threshold,
+     * so that two of them overlap when the bodies may come closer than the threshold */
+    uint32_t nbGroups = (nbIntervals + CONJUNCTION_INTERVALS_PER_JOB - 1) / CONJUNCTION_INTERVALS_PER_JOB;
+    std::vector<std::vector<Candidate>> groups(nbGroups);
+    JobSystem::get().parallelFor(nbGroups, 1, [&](uint32_t firstGroup, uint32_t lastGroup)
+    {
+        std::vector<glm::dvec3> previous;
+        std::vector<glm::dvec3> next;
+        std::vector<glm::dvec3> boxMin(nbBodies);
+        std::vector<glm::dvec3> boxMax(nbBodies);
+        std::vector<uint32_t>   order(nbBodies);
+        std::vector<double>     keys(nbBodies);
+        std::vector<SortedBox>  sorted(nbBodies);
+        for(uint32_t group = firstGroup; group < lastGroup; group++)
+        {
+            std::vector<Candidate>& candidates = groups[group];
+            uint32_t firstInterval = group * CONJUNCTION_INTERVALS_PER_JOB;
+            uint32_t lastInterval  = std::min(firstInterval + CONJUNCTION_INTERVALS_PER_JOB, nbIntervals);
+            computePositions(start + firstInterval * step, previous);
+            for(uint32_t interval = firstInterval; interval < lastInterval; interval++)
+            {
+                computePositions(start + (interval + 1) * step, next);
+                for(uint32_t i = 0; i < nbBodies; i++)
+                {
+                    /* The body travels at most L = speed * step, so it stays in the ellipsoid whose foci are both ends of the chord and whose
+                     * major axis is L : within its semi-minor axis sqrt((L / 2)^2 - c^2) of the chord, c being half of the chord */
+                    double halfPath  = 0.5 * m_maxSpeeds[i] * step;
+                    double halfChord = 0.5 * glm::length(next[i] - previous[i]);
+                    double margin    = std::sqrt(std::max(0.0, halfPath * halfPath - halfChord * halfChord)) + m_bodies[i].radius + 0.5 * threshold;
+                    boxMin[i] = glm::min(previous[i], next[i]) - margin;
+                    boxMax[i] = glm::max(previous[i], next[i]) + margin;
+                }
+
+                if(interval == firstInterval)
+                {
+                    for(uint32_t i = 0; i < nbBodies; i++)
+                        order[i] = i;
+                    std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {return boxMin[a].x < boxMin[b].x;});
+                    for(uint32_t i = 0; i < nbBodies; i++)
+                        keys[i] = boxMin[order[i]].x;
+                }
+                else
+                {
+                    //The bodies moved a little since the previous interval : insertion sort from the previous order
+                    for(uint32_t i = 0; i < nbBodies; i++)
+                        keys[i] = boxMin[order[i]].x;
+                    for(uint32_t i = 1; i < nbBodies; i++)
+                    {
+                        uint32_t body = order[i];
+                        double   x    = keys[i];
+                        uint32_t j    = i;
+                        for(; j > 0 && keys[j - 1] > x; j--)
+                        {
+                            keys[j]  = keys[j - 1];
+                            order[j] = order[j - 1];
+                        }
+                        keys[j]  = x;
+                        order[j] = body;
+                    }
+                }
+
+                //The boxes copied in their order along X, so that the sweep reads memory in sequence.
+                //A box can only overlap the following ones that start before it ends
+                for(uint32_t i = 0; i < nbBodies; i++)
+                    sorted[i] = SortedBox{boxMin[order[i]], boxMax[order[i]]};
+                for(uint32_t i = 0; i < nbBodies; i++)
+                {
+                    const SortedBox& box = sorted[i];
+                    for(uint32_t j = i + 1; j < nbBodies && sorted[j].bmin.x <= box.bmax.x; j++)
+                    {
+                        const SortedBox& other = sorted[j];
+                        if(other.bmax.y < box.bmin.y || other.bmin.y > box.bmax.y || other.bmax.z < box.bmin.z || other.bmin.z > box.bmax.z)
+                            continue;
+                        uint32_t first  = std::min(order[i], order[j]);
+                        uint32_t second = std::max(order[i], order[j]);
+                        if(m_bodies[second].parent != (int32_t)first || m_periapses[second] - m_bodies[first].radius - m_bodies[second].radius < threshold)
+                            candidates.push_back(Candidate{first, second, interval});
+                    }
+                }
+                previous.swap(next);
+            }
+        }
+    });
+
+    std::vector<Candidate> candidates;
+    for(const std::vector<Candidate>& group : groups)
+        candidates.insert(candidates.end(), group.begin(), group.end());
+    m_nbCandidates = candidates.size();
+    auto broadphaseEnd = std::chrono::high_resolution_clock::now();
+    m_lastBroadphaseTime = std::chrono::duration<double, std::milli>(broadphaseEnd - begin).count();
+
+    /* Refinement : the separation is sampled over the interval, then its minimum is bracketed around the best sample and found by golden section */
+    std::vector<Conjunction> approaches(candidates.size());
+    JobSystem::get().parallelFor((uint32_t)candidates.size(), 64, [&](uint32_t first, uint32_t last)
+    {
+        for(uint32_t c = first; c < last; c++)
+        {
+            const Candidate& candidate = candidates[c];
+            auto distance = [&](double t) {return glm::length(getPosition(candidate.first, t) - getPosition(candidate.second, t));};
+            double t0 = start + candidate.interval * step;
+
+            double bestTime     = t0;
+            double bestDistance = distance(t0);
+            for(uint32_t s = 1; s <= CONJUNCTION_SAMPLES; s++)
+            {
+                double t = t0 + s * step / CONJUNCTION_SAMPLES;
+                double d = distance(t);
+                if(d < bestDistance)
+                {
+                    bestDistance = d;
+                    bestTime     = t;
+                }
+            }
+
+            double low  = std::max(t0, bestTime - step / CONJUNCTION_SAMPLES);
+            double high = std::min(t0 + step, bestTime + step / CONJUNCTION_SAMPLES);
+            double a    = high - CONJUNCTION_GOLDEN * (high - low);
+            double b    = low + CONJUNCTION_GOLDEN * (high - low);
+            double da   = distance(a);
+            double db   = distance(b);
+            for(uint32_t iteration = 0; iteration < CONJUNCTION_REFINE_ITERATIONS; iteration++)
+            {
+                if(da < db)
+                {
+                    high = b;
+                    b    = a;
+                    db   = da;
+                    a    = high - CONJUNCTION_GOLDEN * (high - low);
+                    da   = distance(a);
+                }
+                else
+                {
+                    low = a;
+                    a   = b;
+                    da  = db;
+                    b   = low + CONJUNCTION_GOLDEN * (high - low);
+                    db  = distance(b);
+                }
+            }
+            if(std::min(da, db) < bestDistance)
+            {
+                bestDistance = std::min(da, db);
+                bestTime     = da < db ? a : b;
+            }
+
+            Conjunction& approach = approaches[c];
+            approach.first      = candidate.first;
+            approach.second     = candidate.second;
+            approach.time       = bestTime;
+            approach.separation = bestDistance - m_bodies[candidate.first].radius - m_bodies[candidate.second].radius;
+        }
+    });
+
+    /* Each interval gives the minimum of the separation in it. Inside the interval, it is a local minimum of the separation : an approach.
+     * At an end shared with the next interval, it is one only if the next interval finds its own minimum at that same date : the approach
+     * is then reported once. The ends of the window always count */
+    std::vector<uint32_t> kept;
+    for(uint32_t c = 0; c < candidates.size(); c++)
+        if(approaches[c].separation < threshold)
+            kept.push_back(c);
+    std::sort(kept.begin(), kept.end(), [&](uint32_t a, uint32_t b)
+    {
+        if(candidates[a].first != candidates[b].first)
+            return candidates[a].first < candidates[b].first;
+        if(candidates[a].second != candidates[b].second)
+            return candidates[a].second < candidates[b].second;
+        return candidates[a].interval < candidates[b].interval;
+    });
+    double epsilon = step * 1e-4; //The date of a minimum is only known to about sqrt(1e-16) of the interval : the separation is flat around it
+    auto atStart = [&](uint32_t c) {return approaches[c].time - (start + candidates[c].interval * step) < epsilon;};
+    auto atEnd   = [&](uint32_t c) {return start + (candidates[c].interval + 1) * step - approaches[c].time < epsilon;};
+    for(uint32_t k = 0; k < kept.size(); k++)
+    {
+        uint32_t         c         = kept[k];
+        const Candidate& candidate = candidates[c];
+        if(atStart(c) && candidate.interval > 0)
+            continue; //Either the end of the previous interval, reported with it, or not a minimum
+        if(atEnd(c) && candidate.interval + 1 < nbIntervals)
+        {
+            bool sameApproach = false;
+            if(k + 1 < kept.size())
+            {
+                const Candidate& next = candidates[kept[k + 1]];
+                sameApproach = next.first == candidate.first && next.second == candidate.second && next.interval == candidate.interval + 1 && atStart(kept[k + 1]);
+            }
+            if(!sameApproach)
+                continue;
+        }
+        out.push_back(approaches[c]);
+    }
+    std::sort(out.begin(), out.end(), [](const Conjunction& a, const Conjunction& b) {return a.time < b.time;});
+    m_lastRefineTime = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - broadphaseEnd).count();
+}
+
+bool Conjunctions::saveReport(const char* path, const std::vector<Conjunction>& conjunctions, const std::vector<std::string>& names)
+{
+    FILE* file = fopen(path, "w");
+    if(file == nullptr)
+    {
+        ERROR("Could not write the report %s\n", path);
+        return false;
+    }
+    fprintf(file, "first,second,time,separation\n");
+    for(const Conjunction& conjunction : conjunctions)
+    {
+        fprintf(file, "%s,%s,%.9g,%.9g\n", conjunction.first < names.size() ? names[conjunction.first].c_str() : "?",
+                conjunction.second < names.size() ? names[conjunction.second].c_str() : "?", conjunction.time, conjunction.separation);
+    }
+    fclose(file);
+    return true;
+}
@@ -1,10 +1,9 @@
 #include "Cube.h"
+#include <cstring>
 
 Cube::Cube() : Geometry()
 {
-    m_vertices = (float*)malloc(sizeof(float)*3*36);
-    m_normals  = (float*)malloc(sizeof(float)*3*36);
-    m_uvs      = (float*)malloc(sizeof(float)*2*36);
+    allocate(36);
 
     float vertices[3*36] = {
                             //Front
@@ -152,12 +151,7 @@ Cube::Cube() : Geometry()
                             0.0, -1.0, 0.0,
                             0.0, -1.0, 0.0};
 
-    for(uint32_t i = 0; i < 3*36; i++)
-    {
-        m_vertices[i] = vertices[i];
-        m_normals[i] = normals[i];
-    }
-    for(uint32_t i = 0; i < 2*36; i++)
-        m_uvs[i] = uvs[i];
-    m_nbVertices = 36;
+    memcpy(editVertices(), vertices, sizeof(vertices));
+    memcpy(editNormals(),  normals,  sizeof(normals));
+    memcpy(editUVs(),      uvs,      sizeof(uvs));
 }
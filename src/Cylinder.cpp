@@ -4,11 +4,10 @@
 Cylinder::Cylinder(uint32_t nbLattitude) : Geometry()
 {
     float radius = 0.5;
-    m_nbVertices = nbLattitude * 6;
-    m_vertices   = (float*)malloc(sizeof(float)*3*6*nbLattitude);
-    m_normals    = (float*)malloc(sizeof(float)*3*6*nbLattitude);
-
-    m_uvs        = (float*)malloc(sizeof(float)*2*6*nbLattitude);
+    allocate(nbLattitude * 6);
+    float* vertices = editVertices();
+    float* normals  = editNormals();
+    float* uvs      = editUVs();
 
 	for(uint32_t i=0; i < nbLattitude; i++)
 	{
@@ -32,16 +31,16 @@ Cylinder::Cylinder(uint32_t nbLattitude) : Geometry()
 					     };
 
 		for(uint32_t j=0; j < 18; j++)
-			m_vertices[18*i+j] = (float)pos[j];
+			vertices[18*i+j] = (float)pos[j];
 
         for(uint32_t j = 0; j < 12; j++)
-            m_uvs[12*i+j] = (float)uvPos[j];
+            uvs[12*i+j] = (float)uvPos[j];
 
         for(uint32_t j = 0; j < 6; j++)
         {
             for(uint32_t k = 0; k < 2; k++)
-                m_normals[18*i+3*j+k]  = (float)pos[3*j+k];
-            m_normals[18*i+3*j+2] = 0.0f;
+                normals[18*i+3*j+k]  = (float)pos[3*j+k];
+            normals[18*i+3*j+2] = 0.0f;
         }
 	}
 }
@@ -0,0 +1,124 @@
+#include "DepthBuffer.h"
+#include "logger.h"
+
+#include <cmath>
+#include <glm/gtc/matrix_transform.hpp>
+
+DepthBuffer::DepthBuffer(uint32_t width, uint32_t height, float zNear, float zFar) : m_width(width), m_height(height), m_near(zNear), m_far(zFar)
+{}
+
+DepthBuffer::~DepthBuffer()
+{
+    glDeleteFramebuffers(1, &m_framebufferID);
+    glDeleteRenderbuffers(1, &m_colorID);
+    glDeleteRenderbuffers(1, &m_depthID);
+}
+
+bool DepthBuffer::isReversedZSupported()
+{
+    return GLEW_VERSION_4_5 || GLEW_ARB_clip_control;
+}
+
+const char* DepthBuffer::getModeName(DepthMode mode)
+{
+    switch(mode)
+    {
+        case DEPTH_STANDARD:    return "standard";
+        case DEPTH_REVERSED_Z:  return "reversed-Z";
+        case DEPTH_LOGARITHMIC: return "logarithmic";
+        default:                return "unknown";
+    }
+}
+
+bool DepthBuffer::setMode(DepthMode mode)
+{
+    if(mode == DEPTH_REVERSED_Z && (!isReversedZSupported() || !createFramebuffer()))
+        return false;
+    m_mode = mode;
+    return true;
+}
+
+bool DepthBuffer::createFramebuffer()
+{
+    if(m_framebufferID != 0)
+        return true;
+
+    glGenRenderbuffers(1, &m_colorID);
+    glBindRenderbuffer(GL_RENDERBUFFER, m_colorID);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, m_width, m_height);
+    glGenRenderbuffers(1, &m_depthID);
+    glBindRenderbuffer(GL_RENDERBUFFER, m_depthID);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT32F, m_width, m_height);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+    glGenFramebuffers(1, &m_framebufferID);
+    glBindFramebuffer(GL_FRAMEBUFFER, m_framebufferID);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, m_colorID);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, m_depthID);
+    GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    if(status != GL_FRAMEBUFFER_COMPLETE)
+    {
+        ERROR("The float depth framebuffer is incomplete (0x%x)\n", status);
+        glDeleteFramebuffers(1, &m_framebufferID);
+        glDeleteRenderbuffers(1, &m_colorID);
+        glDeleteRenderbuffers(1, &m_depthID);
+        m_framebufferID = m_colorID = m_depthID = 0;
+        return false;
+    }
+    return true;
+}
+
+glm::mat4 DepthBuffer::getProjection(float fovy, float aspect) const
+{
+    if(m_mode != DEPTH_REVERSED_Z)
+        return glm::perspective(fovy, aspect, m_near, m_far);
+
+    /* Infinite far plane, depth = near / -z : 1 at the near plane, 0 at infinity. The float exponent keeps the relative precision constant */
+    float f = 1.0f / tanf(fovy * 0.5f);
+    glm::mat4 projection(0.0f);
+    projection[0][0] = f / aspect;
+    projection[1][1] = f;
+    projection[2][3] = -1.0f;
+    projection[3][2] = m_near;
+    return projection;
+}
+
+void DepthBuffer::beginFrame()
+{
+    if(m_mode == DEPTH_REVERSED_Z)
+    {
+        glBindFramebuffer(GL_FRAMEBUFFER, m_framebufferID);
+        glClipControl(GL_LOWER_LEFT, GL_ZERO_TO_ONE);
+        glClearDepth(0.0);
+    }
+    else
+        glClearDepth(1.0);
+    glDepthFunc(getDepthFunc());
+    glClear(GL_DEPTH_BUFFER_BIT | GL_COLOR_BUFFER_BIT);
+}
+
+void DepthBuffer::endFrame()
+{
+    if(m_mode == DEPTH_REVERSED_Z)
+    {
+        glClipControl(GL_LOWER_LEFT, GL_NEGATIVE_ONE_TO_ONE);
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, m_framebufferID);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+        glBlitFramebuffer(0, 0, m_width, m_height, 0, 0, m_width, m_height, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    }
+    glClearDepth(1.0);
+    glDepthFunc(GL_LESS);
+}
+
+void DepthBuffer::bind(const Shader* shader) const
+{
+    GLint uLogDepthScale = glGetUniformLocation(shader->getProgramID(), "uLogDepthScale");
+    GLint uNearDepth     = glGetUniformLocation(shader->getProgramID(), "uNearDepth");
+    GLint uFarDepth      = glGetUniformLocation(shader->getProgramID(), "uFarDepth");
+    glUniform1f(uLogDepthScale, m_mode == DEPTH_LOGARITHMIC ? 2.0f / log2f(m_far + 1.0f) : 0.0f);
+    glUniform1f(uNearDepth, m_mode == DEPTH_REVERSED_Z ? 1.0f : -1.0f);
+    glUniform1f(uFarDepth, m_mode == DEPTH_REVERSED_Z ? 0.0f : 1.0f);
+}
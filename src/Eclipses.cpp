@@ -0,0 +1,107 @@
+#include "Eclipses.h"
+#include "JobSystem.h"
+
+#include <chrono>
+#include <algorithm>
+#include <glm/gtc/type_ptr.hpp>
+
+void Eclipses::update(const std::vector<EclipseBody>& bodies, const std::vector<EclipseLight>& lights)
+{
+    auto begin = std::chrono::high_resolution_clock::now();
+    m_lights = lights;
+
+    /* Index the occluders. Cells smaller than a few bodies would only make the cones cross more empty cells */
+    FrameVector<glm::vec3> centers;
+    FrameVector<float>     radii;
+    m_occluderIDs.clear();
+    float averageRadius = 0.0f;
+    for(uint32_t i = 0; i < bodies.size(); i++)
+    {
+        if(!bodies[i].occluder)
+            continue;
+        m_occluderIDs.push_back(i);
+        centers.push_back(bodies[i].center);
+        radii.push_back(bodies[i].radius);
+        averageRadius += bodies[i].radius;
+    }
+    if(!centers.empty())
+        averageRadius /= centers.size();
+    m_grid.build(centers.data(), radii.data(), (uint32_t)centers.size(), 4.0f * averageRadius);
+
+    m_shadows.assign(bodies.size(), EclipseShadow());
+    JobSystem::get().parallelFor((uint32_t)bodies.size(), 64, [&](uint32_t first, uint32_t last)
+    {
+        FrameVector<uint32_t> candidates;
+        for(uint32_t i = first; i < last; i++)
+        {
+            const EclipseBody& body = bodies[i];
+            if(body.light < 0 || body.light >= (int32_t)lights.size())
+                continue;
+            EclipseShadow& shadow = m_shadows[i];
+            shadow.light = body.light;
+
+            /* The occluders must cross the cone joining the body to the light disk */
+            const EclipseLight& light = lights[body.light];
+            glm::vec3 axis   = light.center - body.center;
+            float axisLength = glm::length(axis);
+            if(axisLength <= body.radius + light.radius)
+                continue;
+            m_grid.queryCone(body.center, light.center, body.radius, light.radius, candidates);
+
+            /* Keep the occluders that look the largest from the body, sorted by decreasing angular size */
+            float    bestSize[ECLIPSE_MAX_OCCLUDERS];
+            uint32_t bestID[ECLIPSE_MAX_OCCLUDERS];
+            uint32_t nbBest = 0;
+            for(uint32_t c : candidates)
+            {
+                uint32_t occluderID = m_occluderIDs[c];
+                if(occluderID == i)
+                    continue;
+                glm::vec3 toOccluder = centers[c] - body.center;
+                float t = glm::dot(toOccluder, axis) / (axisLength * axisLength);
+                if(t <= 0.0f || t >= 1.0f)
+                    continue;
+                float coneRadius = body.radius * (1.0f - t) + light.radius * t;
+                float distance   = glm::length(toOccluder - t * axis);
+                if(distance >= coneRadius + radii[c])
+                    continue;
+                float size = radii[c] / glm::length(toOccluder);
+                if(nbBest == ECLIPSE_MAX_OCCLUDERS && size <= bestSize[nbBest-1])
+                    continue;
+                uint32_t slot = std::min(nbBest, (uint32_t)ECLIPSE_MAX_OCCLUDERS - 1);
+                while(slot > 0 && bestSize[slot-1] < size)
+                {
+                    bestSize[slot] = bestSize[slot-1];
+                    bestID[slot]   = bestID[slot-1];
+                    slot--;
+                }
+                bestSize[slot] = size;
+                bestID[slot]   = c;
+                nbBest = std::min(nbBest + 1, (uint32_t)ECLIPSE_MAX_OCCLUDERS);
+            }
+
+            shadow.nbOccluders = nbBest;
+            for(uint32_t h = 0; h < nbBest; h++)
+                shadow.occluders[h] = glm::vec4(centers[bestID[h]], radii[bestID[h]]);
+        }
+    });
+
+    m_lastUpdateTime = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - begin).count();
+}
+
+void Eclipses::bind(const Shader* shader, uint32_t bodyID) const
+{
+    const EclipseShadow& shadow = m_shadows[bodyID];
+    glm::vec4 lightSphere(0.0f);
+    if(shadow.light >= 0)
+        lightSphere = glm::vec4(m_lights[shadow.light].center, m_lights[shadow.light].radius);
+
+    GLint uEclipseLight       = glGetUniformLocation(shader->getProgramID(), "uEclipseLight");
+    GLint uEclipseLightSphere = glGetUniformLocation(shader->getProgramID(), "uEclipseLightSphere");
+    GLint uOccluders          = glGetUniformLocation(shader->getProgramID(), "uOccluders");
+    GLint uNbOccluders        = glGetUniformLocation(shader->getProgramID(), "uNbOccluders");
+    glUniform1i(uEclipseLight, shadow.light);
+    glUniform4fv(uEclipseLightSphere, 1, glm::value_ptr(lightSphere));
+    glUniform4fv(uOccluders, ECLIPSE_MAX_OCCLUDERS, glm::value_ptr(shadow.occluders[0]));
+    glUniform1i(uNbOccluders, shadow.nbOccluders);
+}
@@ -0,0 +1,349 @@
+#include "Entities.h"
+
+#include <string.h>
+#include <cmath>
+#include <new>
+#include <glm/gtc/matrix_transform.hpp>
+
+static const uint32_t COMPONENT_SIZES[COMPONENT_COUNT] =
+{
+    sizeof(TransformComponent), sizeof(RenderableComponent), sizeof(MaterialComponent),
+    sizeof(OrbitComponent), sizeof(LightComponent), sizeof(ColliderComponent)
+};
+
+/* \brief Default construct a component in place */
+static void constructComponent(ComponentType type, void* component)
+{
+    switch(type)
+    {
+        case COMPONENT_TRANSFORM:  new(component) TransformComponent();  break;
+        case COMPONENT_RENDERABLE: new(component) RenderableComponent(); break;
+        case COMPONENT_MATERIAL:   new(component) MaterialComponent();   break;
+        case COMPONENT_ORBIT:      new(component) OrbitComponent();      break;
+        case COMPONENT_LIGHT:      new(component) LightComponent();      break;
+        case COMPONENT_COLLIDER:   new(component) ColliderComponent();   break;
+        default: break;
+    }
+}
+
+/* \brief Lay the arrays of an archetype out in a chunk : the entities, then each component, 16 bytes aligned
+ * \return the bytes used */
+static uint32_t layoutChunk(ComponentMask mask, uint32_t capacity, uint32_t offsets[COMPONENT_COUNT])
+{
+    uint32_t offset = capacity * sizeof(Entity);
+    for(uint32_t type = 0; type < COMPONENT_COUNT; type++)
+    {
+        offsets[type] = 0;
+        if(!(mask & componentBit((ComponentType)type)))
+            continue;
+        offset        = (offset + 15) & ~15u;
+        offsets[type] = offset;
+        offset       += capacity * COMPONENT_SIZES[type];
+    }
+    return offset;
+}
+
+uint32_t EntityWorld::findArchetype(ComponentMask components)
+{
+    for(uint32_t i = 0; i < m_archetypes.size(); i++)
+        if(m_archetypes[i].mask == components)
+            return i;
+
+    Archetype archetype;
+    archetype.mask = components;
+    uint32_t rowSize = sizeof(Entity);
+    for(uint32_t type = 0; type < COMPONENT_COUNT; type++)
+        if(components & componentBit((ComponentType)type))
+            rowSize += COMPONENT_SIZES[type];
+    archetype.capacity = glm::max(ENTITY_CHUNK_SIZE / rowSize, 1u);
+    while(archetype.capacity > 1 && layoutChunk(components, archetype.capacity, archetype.offsets) > ENTITY_CHUNK_SIZE)
+        archetype.capacity--;
+    layoutChunk(components, archetype.capacity, archetype.offsets);
+    m_archetypes.push_back(std::move(archetype));
+    return (uint32_t)m_archetypes.size() - 1;
+}
+
+EntityWorld::Record EntityWorld::addRow(uint32_t archetypeID, Entity entity)
+{
+    Archetype& archetype = m_archetypes[archetypeID];
+    if(archetype.chunks.empty() || archetype.chunks.back().m_size == archetype.capacity)
+    {
+        archetype.chunks.emplace_back();
+        EntityChunk& chunk = archetype.chunks.back();
+        chunk.m_data.resize(layoutChunk(archetype.mask, archetype.capacity, chunk.m_offsets));
+    }
+
+    EntityChunk& chunk = archetype.chunks.back();
+    Record record;
+    record.generation = entity.generation;
+    record.archetype  = archetypeID;
+    record.chunk      = (uint32_t)archetype.chunks.size() - 1;
+    record.row        = chunk.m_size++;
+    ((Entity*)chunk.m_data.data())[record.row] = entity;
+    for(uint32_t type = 0; type < COMPONENT_COUNT; type++)
+        if(archetype.mask & componentBit((ComponentType)type))
+            constructComponent((ComponentType)type, chunk.m_data.data() + chunk.m_offsets[type] + record.row * COMPONENT_SIZES[type]);
+    archetype.nbEntities++;
+    return record;
+}
+
+void EntityWorld::removeRow(uint32_t archetypeID, uint32_t chunkID, uint32_t row)
+{
+    Archetype&   archetype = m_archetypes[archetypeID];
+    EntityChunk& chunk     = archetype.chunks[chunkID];
+    EntityChunk& last      = archetype.chunks.back();
+    uint32_t     lastRow   = last.m_size - 1;
+    if(&chunk != &last || row != lastRow)
+    {
+        Entity moved = ((Entity*)last.m_data.data())[lastRow];
+        ((Entity*)chunk.m_data.data())[row] = moved;
+        for(uint32_t type = 0; type < COMPONENT_COUNT; type++)
+        {
+            if(!(archetype.mask & componentBit((ComponentType)type)))
+                continue;
+            uint32_t size = COMPONENT_SIZES[type];
+            memcpy(chunk.m_data.data() + chunk.m_offsets[type] + row * size, last.m_data.data() + last.m_offsets[type] + lastRow * size, size);
+        }
+        m_records[moved.index].chunk = chunkID;
+        m_records[moved.index].row   = row;
+    }
+    if(--last.m_size == 0)
+        archetype.chunks.pop_back();
+    archetype.nbEntities--;
+}
+
+Entity EntityWorld::create(ComponentMask components)
+{
+    Entity entity;
+    if(!m_freeIndices.empty())
+    {
+        entity.index = m_freeIndices.back();
+        m_freeIndices.pop_back();
+        entity.generation = m_records[entity.index].generation;
+    }
+    else
+    {
+        entity.index = (uint32_t)m_records.size();
+        m_records.emplace_back();
+    }
+    m_records[entity.index] = addRow(findArchetype(components), entity);
+    m_nbEntities++;
+    return entity;
+}
+
+void EntityWorld::destroy(Entity entity)
+{
+    if(!isAlive(entity))
+        return;
+    Record& record = m_records[entity.index];
+    removeRow(record.archetype, record.chunk, record.row);
+    record.archetype = UINT32_MAX;
+    record.generation++;
+    m_freeIndices.push_back(entity.index);
+    m_nbEntities--;
+}
+
+void EntityWorld::setComponents(Entity entity, ComponentMask components)
+{
+    if(!isAlive(entity) || getComponents(entity) == components)
+        return;
+
+    Record   from        = m_records[entity.index];
+    uint32_t archetypeID = findArchetype(components);
+    Record   to          = addRow(archetypeID, entity);
+    const Archetype& source      = m_archetypes[from.archetype];
+    const Archetype& destination = m_archetypes[archetypeID];
+    const EntityChunk& sourceChunk      = source.chunks[from.chunk];
+    EntityChunk&       destinationChunk = m_archetypes[archetypeID].chunks[to.chunk];
+    for(uint32_t type = 0; type < COMPONENT_COUNT; type++)
+    {
+        ComponentMask bit = componentBit((ComponentType)type);
+        if(!(source.mask & bit) || !(destination.mask & bit))
+            continue;
+        uint32_t size = COMPONENT_SIZES[type];
+        memcpy(destinationChunk.m_data.data() + destinationChunk.m_offsets[type] + to.row * size,
+               sourceChunk.m_data.data() + sourceChunk.m_offsets[type] + from.row * size, size);
+    }
+    removeRow(from.archetype, from.chunk, from.row);
+    m_records[entity.index] = to;
+}
+
+uint32_t EntityWorld::getNbChunks() const
+{
+    uint32_t nbChunks = 0;
+    for(const Archetype& archetype : m_archetypes)
+        nbChunks += (uint32_t)archetype.chunks.size();
+    return nbChunks;
+}
+
+void EntitySystems::setParent(EntityWorld& world, Entity entity, Entity parent)
+{
+    /* Out of the children of the previous parent, then first of the new one. The components do not move meanwhile, so the pointers stay valid */
+    TransformComponent* transform = world.get<TransformComponent>(entity);
+    if(world.isAlive(transform->parent))
+    {
+        Entity* link = &world.get<TransformComponent>(transform->parent)->firstChild;
+        while(world.isAlive(*link) && link->index != entity.index)
+            link = &world.get<TransformComponent>(*link)->nextSibling;
+        if(world.isAlive(*link))
+            *link = transform->nextSibling;
+    }
+    transform->parent      = parent;
+    transform->nextSibling = Entity();
+    transform->depth       = 0;
+    if(world.isAlive(parent))
+    {
+        TransformComponent* parentTransform = world.get<TransformComponent>(parent);
+        transform->nextSibling     = parentTransform->firstChild;
+        transform->depth           = parentTransform->depth + 1;
+        parentTransform->firstChild = entity;
+    }
+
+    /* The descendants were placed from their previous depth, and updateTransforms computes one depth after the other. Depth-first, without a stack */
+    Entity node = transform->firstChild;
+    while(world.isAlive(node))
+    {
+        TransformComponent* nodeTransform = world.get<TransformComponent>(node);
+        nodeTransform->depth = world.get<TransformComponent>(nodeTransform->parent)->depth + 1;
+        if(world.isAlive(nodeTransform->firstChild))
+        {
+            node = nodeTransform->firstChild;
+            continue;
+        }
+        /* The next sibling of the node, or of its closest ancestor having one, below the entity */
+        while(node.index != entity.index && !world.isAlive(world.get<TransformComponent>(node)->nextSibling))
+            node = world.get<TransformComponent>(node)->parent;
+        node = node.index != entity.index ? world.get<TransformComponent>(node)->nextSibling : Entity();
+    }
+}
+
+void EntitySystems::updateOrbits(EntityWorld& world, const Orbits& orbits, double t)
+{
+    world.parallelForEachChunk(componentBit(COMPONENT_TRANSFORM) | componentBit(COMPONENT_ORBIT), [&](EntityChunk& chunk)
+    {
+        TransformComponent*   transforms = chunk.get<TransformComponent>();
+        const OrbitComponent* bodies     = chunk.get<OrbitComponent>();
+        for(uint32_t i = 0; i < chunk.getSize(); i++)
+        {
+            const OrbitComponent& body = bodies[i];
+            float angle = (float)fmod(body.spin * t, 2.0 * M_PI);
+            float c = cosf(angle), s = sinf(angle);
+            float ct = cosf(body.tilt), st = sinf(body.tilt);
+            //The tilt around +X times the spin around +Y, times the size : the rotation part of the localMatrix of applyOrbits
+            transforms[i].position = glm::dvec3(orbits.getPosition(body.orbitID));
+            transforms[i].basis    = glm::mat3(glm::vec3(c, st * s, -ct * s) * body.size.x,
+                                               glm::vec3(0.0f, ct, st) * body.size.y,
+                                               glm::vec3(s, -st * c, ct * c) * body.size.z);
+        }
+    });
+}
+
+void EntitySystems::updateTransforms(EntityWorld& world)
+{
+    /* Each pass sets one depth, the previous pass wrote the parents */
+    std::atomic<uint32_t> nbDeeper(1);
+    for(uint32_t depth = 0; nbDeeper > 0; depth++)
+    {
+        nbDeeper = 0;
+        world.parallelForEachChunk(componentBit(COMPONENT_TRANSFORM), [&](EntityChunk& chunk)
+        {
+            TransformComponent* transforms = chunk.get<TransformComponent>();
+            uint32_t deeper = 0;
+            for(uint32_t i = 0; i < chunk.getSize(); i++)
+            {
+                TransformComponent& transform = transforms[i];
+                if(transform.depth == depth)
+                    transform.world = depth == 0 ? transform.position : world.get<TransformComponent>(transform.parent)->world + transform.position;
+                else if(transform.depth > depth)
+                    deeper++;
+            }
+            if(deeper > 0)
+                nbDeeper += deeper;
+        });
+    }
+}
+
+uint32_t EntitySystems::cull(EntityWorld& world, const glm::dvec3& camera, const glm::vec4 planes[4])
+{
+    float lengths[4];
+    for(uint32_t p = 0; p < 4; p++)
+        lengths[p] = glm::length(glm::vec3(planes[p]));
+
+    std::atomic<uint32_t> nbVisible(0);
+    world.parallelForEachChunk(componentBit(COMPONENT_TRANSFORM) | componentBit(COMPONENT_COLLIDER) | componentBit(COMPONENT_RENDERABLE), [&](EntityChunk& chunk)
+    {
+        const TransformComponent* transforms  = chunk.get<TransformComponent>();
+        const ColliderComponent*  colliders   = chunk.get<ColliderComponent>();
+        RenderableComponent*      renderables = chunk.get<RenderableComponent>();
+        uint32_t visible = 0;
+        for(uint32_t i = 0; i < chunk.getSize(); i++)
+        {
+            glm::vec3 center = glm::vec3(transforms[i].world - camera);
+            bool inside = true;
+            for(uint32_t p = 0; p < 4; p++)
+                inside = inside && glm::dot(glm::vec3(planes[p]), center) + planes[p].w >= -colliders[i].radius * lengths[p];
+            renderables[i].visible = inside;
+            visible += inside;
+        }
+        nbVisible += visible;
+    });
+    return nbVisible;
+}
+
+void EntitySystems::gatherDraws(EntityWorld& world, const glm::dvec3& camera, std::vector<Draw>& draws)
+{
+    /* Count the visible bodies of each chunk, then fill each range on the job threads */
+    FrameVector<EntityChunk*> chunks;
+    FrameVector<uint32_t>     offsets;
+    uint32_t nbDraws = 0;
+    world.forEachChunk(componentBit(COMPONENT_TRANSFORM) | componentBit(COMPONENT_RENDERABLE) | componentBit(COMPONENT_MATERIAL), [&](EntityChunk& chunk)
+    {
+        const RenderableComponent* renderables = chunk.get<RenderableComponent>();
+        chunks.push_back(&chunk);
+        offsets.push_back(nbDraws);
+        for(uint32_t i = 0; i < chunk.getSize(); i++)
+            nbDraws += renderables[i].visible;
+    });
+    draws.resize(nbDraws);
+
+    JobSystem::get().parallelFor((uint32_t)chunks.size(), ENTITY_CHUNKS_PER_JOB, [&](uint32_t first, uint32_t last)
+    {
+        for(uint32_t c = first; c < last; c++)
+        {
+            const EntityChunk&         chunk       = *chunks[c];
+            const TransformComponent*  transforms  = chunk.get<TransformComponent>();
+            const RenderableComponent* renderables = chunk.get<RenderableComponent>();
+            const MaterialComponent*   materials   = chunk.get<MaterialComponent>();
+            Draw* draw = draws.data() + offsets[c];
+            for(uint32_t i = 0; i < chunk.getSize(); i++)
+            {
+                if(!renderables[i].visible)
+                    continue;
+                glm::mat4 model(transforms[i].basis);
+                model[3]       = glm::vec4(glm::vec3(transforms[i].world - camera), 1.0f);
+                draw->model    = model;
+                draw->geometry = renderables[i].geometry;
+                draw->vboID    = renderables[i].vboID;
+                draw->lit      = materials[i].lit;
+                draw->bodyID   = renderables[i].bodyID;
+                draw->material = materials[i].material;
+                draw++;
+            }
+        }
+    });
+}
+
+void EntitySystems::gatherLights(EntityWorld& world, const glm::dvec3& camera, std::vector<PointLight>& lights)
+{
+    world.forEachChunk(componentBit(COMPONENT_TRANSFORM) | componentBit(COMPONENT_LIGHT), [&](EntityChunk& chunk)
+    {
+        const TransformComponent* transforms = chunk.get<TransformComponent>();
+        const LightComponent*     sources    = chunk.get<LightComponent>();
+        for(uint32_t i = 0; i < chunk.getSize(); i++)
+        {
+            if(sources[i].index >= lights.size())
+                lights.resize(sources[i].index + 1);
+            lights[sources[i].index] = {glm::vec3(transforms[i].world - camera), sources[i].radius, sources[i].color};
+        }
+    });
+}
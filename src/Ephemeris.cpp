@@ -0,0 +1,599 @@
+#include "Ephemeris.h"
+#include "Simd.h"
+#include "logger.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <cmath>
+#include <algorithm>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#define EPHEMERIS_TABLE_MAGIC   0x54455347 /* "GSET" */
+#define EPHEMERIS_FILE_MAGIC    0x50455347 /* "GSEP" */
+#define EPHEMERIS_FILE_VERSION  1
+/* Samples of the neighbor segments added to the fit of each one : without them the polynomial extrapolates
+ * between the edge of the segment and its first sample */
+#define EPHEMERIS_FIT_OVERLAP   2
+
+/* \brief Header of the binary tables */
+struct EphemerisTableHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint64_t nbSamples;
+};
+
+/* \brief One sample of the binary tables */
+struct EphemerisTableRecord
+{
+    int32_t  bodyID;
+    uint32_t padding;
+    double   time;
+    double   position[3];
+};
+
+/* \brief Header of the ephemeris files, followed by the EphemerisBodyHeader of every body */
+struct EphemerisFileHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t nbBodies;
+    uint32_t padding;
+};
+
+/*----------------------------------------------------------------------------*/
+/* Table import */
+/*----------------------------------------------------------------------------*/
+
+static const double POWERS_OF_TEN[] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12, 1e13, 1e14, 1e15,
+                                       1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+
+/* \brief Parse a decimal number ([-+]digits[.digits][e[-+]digits]) without the locale and the copies of strtod.
+ * The digits are gathered in an integer, then scaled once : exact for the 15 or so digits of the tables
+ * \return the character after the number, NULL if there is none */
+static const char* parseNumber(const char* p, const char* end, double& value)
+{
+    bool negative = false;
+    if(p < end && (*p == '-' || *p == '+'))
+        negative = *p++ == '-';
+
+    uint64_t mantissa = 0;
+    int32_t  exponent = 0;
+    uint32_t nbDigits = 0;
+    for(; p < end && *p >= '0' && *p <= '9'; p++, nbDigits++)
+    {
+        if(mantissa < 100000000000000000ull)
+            mantissa = mantissa * 10 + (*p - '0');
+        else
+            exponent++;
+    }
+    if(p < end && *p == '.')
+    {
+        for(p++; p < end && *p >= '0' && *p <= '9'; p++, nbDigits++)
+        {
+            if(mantissa < 100000000000000000ull)
+            {
+                mantissa = mantissa * 10 + (*p - '0');
+                exponent--;
+            }
+        }
+    }
+    if(nbDigits == 0)
+        return nullptr;
+    if(p < end && (*p == 'e' || *p == 'E'))
+    {
+        const char* q = p + 1;
+        bool negativeExponent = false;
+        if(q < end && (*q == '-' || *q == '+'))
+            negativeExponent = *q++ == '-';
+        int32_t e = 0;
+        const char* digits = q;
+        for(; q < end && *q >= '0' && *q <= '9'; q++)
+            e = std::min(e * 10 + (*q - '0'), 10000);
+        if(q > digits)
+        {
+            exponent += negativeExponent ? -e : e;
+            p = q;
+        }
+    }
+
+    double result = (double)mantissa;
+    if(exponent < 0)
+        result = -exponent <= 22 ? result / POWERS_OF_TEN[-exponent] : result * std::pow(10.0, exponent);
+    else if(exponent > 0)
+        result = exponent <= 22 ? result * POWERS_OF_TEN[exponent] : result * std::pow(10.0, exponent);
+    value = negative ? -result : result;
+    return p;
+}
+
+/* \brief Parse one "body,time,x,y,z" line
+ * \return true if it is a sample, false for the other lines */
+static bool parseLine(const char* p, const char* end, int32_t& bodyID, EphemerisSample& sample)
+{
+    double values[5];
+    for(uint32_t i = 0; i < 5; i++)
+    {
+        while(p < end && (*p == ' ' || *p == '\t'))
+            p++;
+        p = parseNumber(p, end, values[i]);
+        if(p == nullptr)
+            return false;
+        while(p < end && (*p == ' ' || *p == '\t'))
+            p++;
+        if(i < 4)
+        {
+            if(p == end || *p != ',')
+                return false;
+            p++;
+        }
+    }
+    bodyID          = (int32_t)values[0];
+    sample.time     = values[1];
+    sample.position = glm::dvec3(values[2], values[3], values[4]);
+    return true;
+}
+
+/* \brief Stream a CSV table : the lines cut by the end of a chunk are moved to the start of the buffer and completed by the next read */
+static uint64_t loadCSV(FILE* file, EphemerisTable& table)
+{
+    std::vector<char> buffer(EPHEMERIS_READ_BUFFER_SIZE);
+    size_t   kept      = 0;
+    uint64_t nbSamples = 0;
+    int32_t  lastBodyID = 0;
+    std::vector<EphemerisSample>* samples = nullptr;
+    while(true)
+    {
+        size_t nbRead = fread(buffer.data() + kept, 1, buffer.size() - kept, file);
+        size_t size   = kept + nbRead;
+        bool   last   = nbRead == 0;
+        if(size == 0)
+            break;
+
+        const char* begin = buffer.data();
+        const char* end   = begin + size;
+        while(begin < end)
+        {
+            const char* lineEnd = (const char*)memchr(begin, '\n', end - begin);
+            if(lineEnd == nullptr)
+            {
+                if(!last)
+                    break;
+                lineEnd = end;
+            }
+            int32_t bodyID;
+            EphemerisSample sample;
+            if(parseLine(begin, lineEnd, bodyID, sample))
+            {
+                if(samples == nullptr || bodyID != lastBodyID)
+                {
+                    samples    = &table[bodyID];
+                    lastBodyID = bodyID;
+                }
+                samples->push_back(sample);
+                nbSamples++;
+            }
+            begin = lineEnd + 1;
+        }
+        if(last)
+            break;
+
+        kept = end > begin ? end - begin : 0;
+        if(kept == buffer.size())
+        {
+            ERROR("A line of the table is longer than %d bytes\n", EPHEMERIS_READ_BUFFER_SIZE);
+            return 0;
+        }
+        memmove(buffer.data(), begin, kept);
+    }
+    return nbSamples;
+}
+
+static uint64_t loadBinary(FILE* file, EphemerisTable& table)
+{
+    EphemerisTableHeader header;
+    if(fread(&header, sizeof(header), 1, file) != 1 || header.version != 1)
+    {
+        ERROR("Unsupported binary ephemeris table\n");
+        return 0;
+    }
+
+    std::vector<EphemerisTableRecord> records(EPHEMERIS_READ_BUFFER_SIZE / sizeof(EphemerisTableRecord));
+    uint64_t nbSamples = 0;
+    while(nbSamples < header.nbSamples)
+    {
+        size_t nbWanted = (size_t)std::min<uint64_t>(records.size(), header.nbSamples - nbSamples);
+        size_t nbRead   = fread(records.data(), sizeof(EphemerisTableRecord), nbWanted, file);
+        for(size_t i = 0; i < nbRead; i++)
+        {
+            EphemerisSample sample;
+            sample.time     = records[i].time;
+            sample.position = glm::dvec3(records[i].position[0], records[i].position[1], records[i].position[2]);
+            table[records[i].bodyID].push_back(sample);
+        }
+        nbSamples += nbRead;
+        if(nbRead < nbWanted)
+        {
+            ERROR("The binary ephemeris table is truncated : %llu samples out of %llu\n", (unsigned long long)nbSamples, (unsigned long long)header.nbSamples);
+            return 0;
+        }
+    }
+    return nbSamples;
+}
+
+uint64_t Ephemeris::loadTable(const char* path, EphemerisTable& table)
+{
+    FILE* file = fopen(path, "rb");
+    if(file == nullptr)
+    {
+        ERROR("Could not open the ephemeris table %s\n", path);
+        return 0;
+    }
+
+    uint32_t magic = 0;
+    bool binary = fread(&magic, sizeof(magic), 1, file) == 1 && magic == EPHEMERIS_TABLE_MAGIC;
+    fseek(file, 0, SEEK_SET);
+    uint64_t nbSamples = binary ? loadBinary(file, table) : loadCSV(file, table);
+    fclose(file);
+
+    for(auto& body : table)
+    {
+        std::vector<EphemerisSample>& samples = body.second;
+        auto earlier = [](const EphemerisSample& a, const EphemerisSample& b) {return a.time < b.time;};
+        if(!std::is_sorted(samples.begin(), samples.end(), earlier))
+            std::stable_sort(samples.begin(), samples.end(), earlier);
+    }
+    if(nbSamples == 0)
+        ERROR("No sample in the ephemeris table %s\n", path);
+    return nbSamples;
+}
+
+bool Ephemeris::saveTable(const char* path, const EphemerisTable& table)
+{
+    FILE* file = fopen(path, "wb");
+    if(file == nullptr)
+    {
+        ERROR("Could not create the ephemeris table %s\n", path);
+        return false;
+    }
+
+    EphemerisTableHeader header = {EPHEMERIS_TABLE_MAGIC, 1, 0};
+    for(const auto& body : table)
+        header.nbSamples += body.second.size();
+    bool success = fwrite(&header, sizeof(header), 1, file) == 1;
+    for(const auto& body : table)
+    {
+        for(const EphemerisSample& sample : body.second)
+        {
+            EphemerisTableRecord record = {body.first, 0, sample.time, {sample.position.x, sample.position.y, sample.position.z}};
+            success = success && fwrite(&record, sizeof(record), 1, file) == 1;
+        }
+    }
+    fclose(file);
+    if(!success)
+        ERROR("Could not write the ephemeris table %s\n", path);
+    return success;
+}
+
+/*----------------------------------------------------------------------------*/
+/* Fit */
+/*----------------------------------------------------------------------------*/
+
+/* \brief Fill t with the Chebyshev polynomials T0(x) .. Tn(x) */
+static void chebyshev(double x, uint32_t degree, double* t)
+{
+    t[0] = 1.0;
+    if(degree > 0)
+        t[1] = x;
+    for(uint32_t k = 2; k <= degree; k++)
+        t[k] = 2.0 * x * t[k - 1] - t[k - 2];
+}
+
+/* \brief Least squares fit of the samples [first, last) on one segment, by the normal equations (the Chebyshev basis keeps them well conditioned)
+ * \param coefficients receives (degree + 1) x 3 coefficients
+ * \return false if the samples are too few */
+static bool fitSegment(const EphemerisSample* first, const EphemerisSample* last, double start, double length, uint32_t degree, double* coefficients)
+{
+    uint32_t n = degree + 1;
+    if((uint32_t)(last - first) < n)
+        return false;
+
+    std::vector<double> a(n * n, 0.0);
+    std::vector<double> b(n * 3, 0.0);
+    std::vector<double> t(n);
+    for(const EphemerisSample* sample = first; sample < last; sample++)
+    {
+        chebyshev(2.0 * (sample->time - start) / length - 1.0, degree, t.data());
+        for(uint32_t i = 0; i < n; i++)
+        {
+            for(uint32_t j = 0; j <= i; j++)
+                a[i * n + j] += t[i] * t[j];
+            for(uint32_t axis = 0; axis < 3; axis++)
+                b[i * 3 + axis] += t[i] * sample->position[axis];
+        }
+    }
+
+    /* Cholesky : a = L L^T, in the lower triangle */
+    for(uint32_t j = 0; j < n; j++)
+    {
+        double diagonal = a[j * n + j];
+        for(uint32_t k = 0; k < j; k++)
+            diagonal -= a[j * n + k] * a[j * n + k];
+        if(diagonal <= 0.0)
+            return false;
+        a[j * n + j] = std::sqrt(diagonal);
+        for(uint32_t i = j + 1; i < n; i++)
+        {
+            double sum = a[i * n + j];
+            for(uint32_t k = 0; k < j; k++)
+                sum -= a[i * n + k] * a[j * n + k];
+            a[i * n + j] = sum / a[j * n + j];
+        }
+    }
+    for(uint32_t axis = 0; axis < 3; axis++)
+    {
+        for(uint32_t i = 0; i < n; i++)
+        {
+            double sum = b[i * 3 + axis];
+            for(uint32_t k = 0; k < i; k++)
+                sum -= a[i * n + k] * b[k * 3 + axis];
+            b[i * 3 + axis] = sum / a[i * n + i];
+        }
+        for(uint32_t i = n; i-- > 0;)
+        {
+            double sum = b[i * 3 + axis];
+            for(uint32_t k = i + 1; k < n; k++)
+                sum -= a[k * n + i] * b[k * 3 + axis];
+            b[i * 3 + axis] = sum / a[i * n + i];
+        }
+    }
+    memcpy(coefficients, b.data(), n * 3 * sizeof(double));
+    return true;
+}
+
+/* \brief Fit the segments of one body, of a given length
+ * \return false if a segment has too few samples */
+static bool fitBody(const std::vector<EphemerisSample>& samples, uint32_t degree, uint32_t nbSegments, double length,
+                    std::vector<double>& coefficients, EphemerisFitStats& stats)
+{
+    uint32_t n = degree + 1;
+    double start = samples.front().time;
+    coefficients.assign((size_t)nbSegments * n * 3, 0.0);
+    stats.maxError = 0.0;
+    stats.rmsError = 0.0;
+
+    const EphemerisSample* first = samples.data();
+    const EphemerisSample* end   = samples.data() + samples.size();
+    std::vector<double> t(n);
+    for(uint32_t segment = 0; segment < nbSegments; segment++)
+    {
+        double segmentStart = start + segment * length;
+        const EphemerisSample* last = segment + 1 == nbSegments ? end :
+            std::lower_bound(first, end, segmentStart + length, [](const EphemerisSample& s, double time) {return s.time < time;});
+        const EphemerisSample* fitFirst = first - std::min<ptrdiff_t>(first - samples.data(), EPHEMERIS_FIT_OVERLAP);
+        const EphemerisSample* fitLast  = last + std::min<ptrdiff_t>(end - last, EPHEMERIS_FIT_OVERLAP);
+        double* c = &coefficients[(size_t)segment * n * 3];
+        if((uint32_t)(last - first) < n || !fitSegment(fitFirst, fitLast, segmentStart, length, degree, c))
+            return false;
+
+        for(const EphemerisSample* sample = first; sample < last; sample++)
+        {
+            chebyshev(2.0 * (sample->time - segmentStart) / length - 1.0, degree, t.data());
+            glm::dvec3 position(0.0);
+            for(uint32_t k = 0; k < n; k++)
+                position += t[k] * glm::dvec3(c[3 * k], c[3 * k + 1], c[3 * k + 2]);
+            double error = glm::length(position - sample->position);
+            stats.maxError  = std::max(stats.maxError, error);
+            stats.rmsError += error * error;
+        }
+        first = last;
+    }
+    stats.rmsError = std::sqrt(stats.rmsError / samples.size());
+    return true;
+}
+
+bool Ephemeris::fit(const char* path, const EphemerisTable& table, uint32_t degree, double tolerance, std::vector<EphemerisFitStats>* stats)
+{
+    std::vector<EphemerisBodyHeader> headers;
+    std::vector<std::vector<double>> coefficients;
+    for(const auto& body : table)
+    {
+        const std::vector<EphemerisSample>& samples = body.second;
+        if(samples.size() < degree + 1)
+        {
+            WARNING("Body %d has %u samples, too few for polynomials of degree %u. It is skipped\n", body.first, (uint32_t)samples.size(), degree);
+            continue;
+        }
+
+        /* Halve the segments until the tolerance is met. The last fit that worked is kept if they run out of samples first */
+        double span = std::max(samples.back().time - samples.front().time, 1e-9);
+        std::vector<double> best;
+        EphemerisFitStats bestStats = {body.first, 0, 0.0, INFINITY, INFINITY};
+        for(uint32_t nbSegments = 1; span / nbSegments >= EPHEMERIS_MIN_SEGMENT_LENGTH || nbSegments == 1; nbSegments *= 2)
+        {
+            std::vector<double> c;
+            EphemerisFitStats bodyStats = {body.first, nbSegments, span / nbSegments, 0.0, 0.0};
+            if(!fitBody(samples, degree, nbSegments, span / nbSegments, c, bodyStats))
+                break;
+            best.swap(c);
+            bestStats = bodyStats;
+            if(bodyStats.maxError <= tolerance)
+                break;
+        }
+        if(best.empty())
+        {
+            WARNING("The samples of body %d are too uneven to fit. It is skipped\n", body.first);
+            continue;
+        }
+        if(bestStats.maxError > tolerance)
+            WARNING("Body %d is fitted within %g only, above the tolerance %g\n", body.first, bestStats.maxError, tolerance);
+
+        EphemerisBodyHeader header = {body.first, degree, bestStats.nbSegments, 0, samples.front().time, bestStats.segmentLength, 0};
+        headers.push_back(header);
+        coefficients.push_back(std::move(best));
+        if(stats != nullptr)
+            stats->push_back(bestStats);
+    }
+
+    uint64_t offset = sizeof(EphemerisFileHeader) + headers.size() * sizeof(EphemerisBodyHeader);
+    for(uint32_t i = 0; i < headers.size(); i++)
+    {
+        headers[i].offset = offset;
+        offset += coefficients[i].size() * sizeof(double);
+    }
+
+    FILE* file = fopen(path, "wb");
+    if(file == nullptr)
+    {
+        ERROR("Could not create the ephemeris %s\n", path);
+        return false;
+    }
+    EphemerisFileHeader fileHeader = {EPHEMERIS_FILE_MAGIC, EPHEMERIS_FILE_VERSION, (uint32_t)headers.size(), 0};
+    bool success = fwrite(&fileHeader, sizeof(fileHeader), 1, file) == 1;
+    success = success && fwrite(headers.data(), sizeof(EphemerisBodyHeader), headers.size(), file) == headers.size();
+    for(const std::vector<double>& c : coefficients)
+        success = success && fwrite(c.data(), sizeof(double), c.size(), file) == c.size();
+    /* getPosition loads the z coefficients by pairs : one more double after the last one */
+    double padding = 0.0;
+    success = success && fwrite(&padding, sizeof(padding), 1, file) == 1;
+    fclose(file);
+    if(!success)
+        ERROR("Could not write the ephemeris %s\n", path);
+    return success;
+}
+
+/*----------------------------------------------------------------------------*/
+/* Lookup */
+/*----------------------------------------------------------------------------*/
+
+Ephemeris* Ephemeris::open(const char* path)
+{
+    Ephemeris* ephemeris = new Ephemeris();
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    LARGE_INTEGER size;
+    if(file == INVALID_HANDLE_VALUE || !GetFileSizeEx(file, &size))
+    {
+        ERROR("Could not open the ephemeris %s\n", path);
+        if(file != INVALID_HANDLE_VALUE)
+            CloseHandle(file);
+        delete ephemeris;
+        return nullptr;
+    }
+    ephemeris->m_fileHandle    = file;
+    ephemeris->m_size          = size.QuadPart;
+    ephemeris->m_mappingHandle = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if(ephemeris->m_mappingHandle != NULL)
+        ephemeris->m_mapping = MapViewOfFile(ephemeris->m_mappingHandle, FILE_MAP_READ, 0, 0, 0);
+#else
+    int file = ::open(path, O_RDONLY);
+    struct stat status;
+    if(file < 0 || fstat(file, &status) != 0)
+    {
+        ERROR("Could not open the ephemeris %s\n", path);
+        if(file >= 0)
+            close(file);
+        delete ephemeris;
+        return nullptr;
+    }
+    ephemeris->m_size = status.st_size;
+    void* mapping = ephemeris->m_size > 0 ? mmap(nullptr, ephemeris->m_size, PROT_READ, MAP_SHARED, file, 0) : MAP_FAILED;
+    ephemeris->m_mapping = mapping == MAP_FAILED ? nullptr : mapping;
+    close(file);
+#endif
+    if(ephemeris->m_mapping == nullptr)
+    {
+        ERROR("Could not map the ephemeris %s\n", path);
+        delete ephemeris;
+        return nullptr;
+    }
+
+    /* Check everything getPosition relies on, once */
+    const EphemerisFileHeader* header = (const EphemerisFileHeader*)ephemeris->m_mapping;
+    bool valid = ephemeris->m_size >= sizeof(EphemerisFileHeader) && header->magic == EPHEMERIS_FILE_MAGIC && header->version == EPHEMERIS_FILE_VERSION &&
+                 ephemeris->m_size >= sizeof(EphemerisFileHeader) + (uint64_t)header->nbBodies * sizeof(EphemerisBodyHeader);
+    if(valid)
+    {
+        ephemeris->m_nbBodies = header->nbBodies;
+        ephemeris->m_bodies   = (const EphemerisBodyHeader*)(header + 1);
+        for(uint32_t i = 0; i < ephemeris->m_nbBodies && valid; i++)
+        {
+            const EphemerisBodyHeader& body = ephemeris->m_bodies[i];
+            uint64_t size = (uint64_t)body.nbSegments * (body.degree + 1) * 3 * sizeof(double);
+            valid = body.nbSegments > 0 && body.segmentLength > 0.0 && body.offset % sizeof(double) == 0 &&
+                    body.offset + size + sizeof(double) <= ephemeris->m_size;
+        }
+    }
+    if(!valid)
+    {
+        ERROR("%s is not a valid ephemeris\n", path);
+        delete ephemeris;
+        return nullptr;
+    }
+    return ephemeris;
+}
+
+Ephemeris::~Ephemeris()
+{
+#ifdef _WIN32
+    if(m_mapping != nullptr)
+        UnmapViewOfFile(m_mapping);
+    if(m_mappingHandle != nullptr)
+        CloseHandle(m_mappingHandle);
+    if(m_fileHandle != nullptr)
+        CloseHandle(m_fileHandle);
+#else
+    if(m_mapping != nullptr)
+        munmap(m_mapping, m_size);
+#endif
+}
+
+int32_t Ephemeris::findBody(int32_t bodyID) const
+{
+    for(uint32_t i = 0; i < m_nbBodies; i++)
+        if(m_bodies[i].bodyID == bodyID)
+            return (int32_t)i;
+    return -1;
+}
+
+double Ephemeris::getStartTime(uint32_t index) const
+{
+    return m_bodies[index].startTime;
+}
+
+double Ephemeris::getEndTime(uint32_t index) const
+{
+    return m_bodies[index].startTime + m_bodies[index].nbSegments * m_bodies[index].segmentLength;
+}
+
+glm::dvec3 Ephemeris::getPosition(uint32_t index, double time) const
+{
+    const EphemerisBodyHeader& body = m_bodies[index];
+    double s = glm::clamp((time - body.startTime) / body.segmentLength, 0.0, (double)body.nbSegments);
+    uint32_t segment = std::min((uint32_t)s, body.nbSegments - 1);
+    double x = 2.0 * (s - segment) - 1.0;
+
+    /* Clenshaw, on (x, y) and (z, unused) at once */
+    const double* c = (const double*)((const uint8_t*)m_mapping + body.offset) + (size_t)segment * (body.degree + 1) * 3;
+    Double2 twoX(2.0 * x);
+    Double2 xy1, xy2, zw1, zw2;
+    for(uint32_t k = body.degree; k > 0; k--)
+    {
+        Double2 xy = twoX * xy1 - xy2 + Double2::load(c + 3 * k);
+        Double2 zw = twoX * zw1 - zw2 + Double2::load(c + 3 * k + 2);
+        xy2 = xy1;
+        xy1 = xy;
+        zw2 = zw1;
+        zw1 = zw;
+    }
+    Double2 xy = Double2(x) * xy1 - xy2 + Double2::load(c);
+    Double2 zw = Double2(x) * zw1 - zw2 + Double2::load(c + 2);
+    return glm::dvec3(xy[0], xy[1], zw[0]);
+}
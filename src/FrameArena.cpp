@@ -0,0 +1,156 @@
+#include "FrameArena.h"
+
+#include <new>
+#include <mutex>
+#include <atomic>
+#include <cstdlib>
+#include <algorithm>
+
+#ifdef FRAME_ARENA_COUNT_ALLOCATIONS
+static std::atomic<uint64_t> s_nbAllocations{0};
+
+/* The array and nothrow forms call this one */
+void* operator new(size_t size)
+{
+    s_nbAllocations.fetch_add(1, std::memory_order_relaxed);
+    void* pointer = std::malloc(size > 0 ? size : 1);
+    if(pointer == nullptr)
+        throw std::bad_alloc();
+    return pointer;
+}
+
+void operator delete(void* pointer) noexcept
+{
+    std::free(pointer);
+}
+
+void operator delete(void* pointer, size_t) noexcept
+{
+    std::free(pointer);
+}
+#endif
+
+/* \brief The arenas of the threads, for resetAll */
+static std::mutex& arenasMutex()
+{
+    static std::mutex mutex;
+    return mutex;
+}
+
+static std::vector<FrameArena*>& arenas()
+{
+    static std::vector<FrameArena*> threadArenas;
+    return threadArenas;
+}
+
+/* \brief The arena of a thread, known by resetAll while the thread lives */
+struct ThreadArena
+{
+    FrameArena arena;
+
+    ThreadArena()
+    {
+        std::lock_guard<std::mutex> lock(arenasMutex());
+        arenas().push_back(&arena);
+    }
+
+    ~ThreadArena()
+    {
+        std::lock_guard<std::mutex> lock(arenasMutex());
+        arenas().erase(std::find(arenas().begin(), arenas().end(), &arena));
+    }
+};
+
+FrameArena::~FrameArena()
+{
+    for(Block& block : m_blocks)
+        ::operator delete(block.data);
+}
+
+void* FrameArena::allocate(size_t size, size_t alignment)
+{
+    if(!m_blocks.empty())
+    {
+        Block& block = m_blocks.back();
+        uintptr_t start   = (uintptr_t)block.data + m_offset;
+        size_t    padding = (alignment - start % alignment) % alignment;
+        if(m_offset + padding + size <= block.size)
+        {
+            m_offset += padding + size;
+            return (void*)(start + padding);
+        }
+        m_used += m_offset;
+    }
+
+    /* A new block, at least as large as the allocation. The blocks come from operator new, aligned for any type */
+    Block block;
+    block.size = std::max((size_t)FRAME_ARENA_BLOCK_SIZE, size + alignment);
+    block.data = (uint8_t*)::operator new(block.size);
+    m_blocks.push_back(block);
+    uintptr_t start = (uintptr_t)block.data;
+    size_t padding  = (alignment - start % alignment) % alignment;
+    m_offset = padding + size;
+    return (void*)(start + padding);
+}
+
+void FrameArena::deallocate(void* pointer, size_t size)
+{
+    if(m_blocks.empty())
+        return;
+    uint8_t* data = m_blocks.back().data;
+    if((uint8_t*)pointer + size == data + m_offset && (uint8_t*)pointer >= data)
+        m_offset = (uint8_t*)pointer - data;
+}
+
+void FrameArena::reset()
+{
+    if(m_blocks.size() > 1)
+    {
+        size_t capacity = getCapacity();
+        for(Block& block : m_blocks)
+            ::operator delete(block.data);
+        m_blocks.clear();
+        m_blocks.push_back(Block{(uint8_t*)::operator new(capacity), capacity});
+    }
+    m_offset = 0;
+    m_used   = 0;
+}
+
+size_t FrameArena::getCapacity() const
+{
+    size_t capacity = 0;
+    for(const Block& block : m_blocks)
+        capacity += block.size;
+    return capacity;
+}
+
+FrameArena& FrameArena::local()
+{
+    thread_local ThreadArena threadArena;
+    return threadArena.arena;
+}
+
+void FrameArena::resetAll()
+{
+    std::lock_guard<std::mutex> lock(arenasMutex());
+    for(FrameArena* arena : arenas())
+        arena->reset();
+}
+
+bool FrameArena::countsAllocations()
+{
+#ifdef FRAME_ARENA_COUNT_ALLOCATIONS
+    return true;
+#else
+    return false;
+#endif
+}
+
+uint64_t FrameArena::getNbAllocations()
+{
+#ifdef FRAME_ARENA_COUNT_ALLOCATIONS
+    return s_nbAllocations.load(std::memory_order_relaxed);
+#else
+    return 0;
+#endif
+}
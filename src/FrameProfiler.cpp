@@ -0,0 +1,71 @@
+#include "FrameProfiler.h"
+#include "logger.h"
+
+void FrameProfiler::beginFrame()
+{
+    for(Stage& stage : m_stages)
+        stage.frameTime = 0.0;
+    m_open.clear();
+    m_openTimes.clear();
+    m_frameBegin = Clock::now();
+}
+
+bool FrameProfiler::endFrame()
+{
+    double frameTime = std::chrono::duration<double, std::milli>(Clock::now() - m_frameBegin).count();
+    m_frameTotal += frameTime;
+    m_frameWorst  = frameTime > m_frameWorst ? frameTime : m_frameWorst;
+    for(Stage& stage : m_stages)
+    {
+        stage.total += stage.frameTime;
+        stage.worst  = stage.frameTime > stage.worst ? stage.frameTime : stage.worst;
+    }
+    if(++m_nbFrames < FRAME_PROFILER_WINDOW)
+        return false;
+
+    bool logged = m_enabled;
+    if(m_enabled)
+    {
+        INFO("Frame : %7.3f ms average, %7.3f ms worst over %u frames\n", m_frameTotal / m_nbFrames, m_frameWorst, m_nbFrames);
+        for(const Stage& stage : m_stages)
+            INFO("%*s%-24s %7.3f ms average, %7.3f ms worst\n", 2 * (stage.depth + 1), "", stage.name, stage.total / m_nbFrames, stage.worst);
+    }
+    for(Stage& stage : m_stages)
+    {
+        stage.total = 0.0;
+        stage.worst = 0.0;
+    }
+    m_frameTotal = 0.0;
+    m_frameWorst = 0.0;
+    m_nbFrames   = 0;
+    return logged;
+}
+
+void FrameProfiler::begin(const char* name)
+{
+    m_open.push_back(findStage(name));
+    m_openTimes.push_back(Clock::now());
+}
+
+void FrameProfiler::end()
+{
+    if(m_open.empty())
+        return;
+    m_stages[m_open.back()].frameTime += std::chrono::duration<double, std::milli>(Clock::now() - m_openTimes.back()).count();
+    m_open.pop_back();
+    m_openTimes.pop_back();
+}
+
+void FrameProfiler::add(const char* name, double milliseconds)
+{
+    m_stages[findStage(name)].frameTime += milliseconds;
+}
+
+uint32_t FrameProfiler::findStage(const char* name)
+{
+    for(uint32_t i = 0; i < m_stages.size(); i++)
+        if(m_stages[i].name == name)
+            return i;
+    m_stages.push_back(Stage{name, (uint32_t)m_open.size(), 0.0, 0.0, 0.0});
+    return (uint32_t)m_stages.size() - 1;
+}
@@ -1,5 +1,35 @@
 #include "Geometry.h"
+#include "logger.h"
 #include <cstring>
+#include <new>
+#include <utility>
+
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+
+/* \brief Allocate GEOMETRY_ALIGNMENT aligned memory
+ * \return the memory, NULL if error */
+static void* alignedAlloc(size_t size)
+{
+#ifdef _WIN32
+    return _aligned_malloc(size, GEOMETRY_ALIGNMENT);
+#else
+    void* pointer = NULL;
+    if(posix_memalign(&pointer, GEOMETRY_ALIGNMENT, size) != 0)
+        return NULL;
+    return pointer;
+#endif
+}
+
+static void alignedFree(void* pointer)
+{
+#ifdef _WIN32
+    _aligned_free(pointer);
+#else
+    free(pointer);
+#endif
+}
 
 Geometry::Geometry(){}
 
@@ -10,34 +40,33 @@ Geometry::Geometry(const Geometry& copy)
 
 Geometry::Geometry(Geometry&& mvt) noexcept
 {
-    m_nbVertices = mvt.m_nbVertices;
-    m_vertices   = mvt.m_vertices;
-    m_normals    = mvt.m_normals;
-    m_uvs        = mvt.m_uvs;
-
-    mvt.m_vertices   = mvt.m_normals = mvt.m_uvs = nullptr;
-    mvt.m_nbVertices = 0;
+    *this = std::move(mvt);
 }
 
 Geometry& Geometry::operator=(const Geometry& copy)
 {
     if(this != &copy)
     {
+        if(copy.m_buffer != NULL)
+            copy.m_buffer->references++;
         clear();
-        if (copy.getNbVertices() == 0) return *this;
-
         m_nbVertices = copy.m_nbVertices;
-        m_vertices = (float*)malloc((uint64_t)getNbVertices()*3*sizeof(float));
-        if(m_vertices != nullptr)
-            memcpy(m_vertices, copy.m_vertices, (uint64_t)getNbVertices()*3*sizeof(float));
-        
-        m_normals = (float*)malloc((uint64_t)getNbVertices()*3*sizeof(float));
-        if(m_normals != nullptr)
-            memcpy(m_normals, copy.m_normals, (uint64_t)getNbVertices()*3*sizeof(float));
-        
-        m_uvs = (float*)malloc((uint64_t)getNbVertices()*2*sizeof(float));
-        if(m_uvs != nullptr)
-            memcpy(m_uvs, copy.m_uvs, (uint64_t)getNbVertices()*2*sizeof(float));
+        setBuffer(copy.m_buffer);
+    }
+
+    return *this;
+}
+
+Geometry& Geometry::operator=(Geometry&& mvt) noexcept
+{
+    if(this != &mvt)
+    {
+        clear();
+        m_nbVertices = mvt.m_nbVertices;
+        setBuffer(mvt.m_buffer);
+
+        mvt.m_nbVertices = 0;
+        mvt.setBuffer(NULL);
     }
 
     return *this;
@@ -48,14 +77,56 @@ Geometry::~Geometry()
     clear();
 }
 
+void Geometry::allocate(uint32_t nbVertices)
+{
+    clear();
+    if(nbVertices == 0)
+        return;
+
+    Buffer* buffer = (Buffer*)alignedAlloc(GEOMETRY_ALIGNMENT + (size_t)nbVertices * 8 * sizeof(float));
+    if(buffer == NULL)
+    {
+        ERROR("Could not allocate a geometry of %u vertices\n", nbVertices);
+        return;
+    }
+    new(&buffer->references) std::atomic<uint32_t>(1);
+    m_nbVertices = nbVertices;
+    setBuffer(buffer);
+}
+
+void Geometry::makeUnique()
+{
+    if(!isShared())
+        return;
+
+    /* Another geometry still reads the old data : it keeps it, this one moves to a copy */
+    Buffer* shared     = m_buffer;
+    uint32_t nbVertices = m_nbVertices;
+    m_buffer = NULL;
+    allocate(nbVertices);
+    if(m_buffer != NULL)
+        memcpy(m_vertices, (uint8_t*)shared + GEOMETRY_ALIGNMENT, getDataSize());
+    if(--shared->references == 0)
+        alignedFree(shared);
+}
+
+void Geometry::setBuffer(Buffer* buffer)
+{
+    m_buffer = buffer;
+    if(buffer == NULL)
+    {
+        m_vertices = m_normals = m_uvs = nullptr;
+        return;
+    }
+    m_vertices = (float*)((uint8_t*)buffer + GEOMETRY_ALIGNMENT);
+    m_normals  = m_vertices + 3 * (size_t)m_nbVertices;
+    m_uvs      = m_vertices + 6 * (size_t)m_nbVertices;
+}
+
 void Geometry::clear()
 {
-    if(m_vertices)
-        free(m_vertices);
-    if(m_normals)
-        free(m_normals);
-    if(m_uvs)
-        free(m_uvs);
-    m_vertices = m_normals = m_uvs = nullptr;
+    if(m_buffer != NULL && --m_buffer->references == 0)
+        alignedFree(m_buffer);
+    setBuffer(NULL);
     m_nbVertices = 0;
-}
\ No newline at end of file
+}
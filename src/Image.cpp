@@ -0,0 +1,54 @@
+#include "Image.h"
+#include "logger.h"
+
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_image.h>
+
+Image::Image(uint32_t width, uint32_t height) : m_width(width), m_height(height)
+{
+    m_pixels = (uint8_t*)malloc((uint64_t)width*height*4);
+}
+
+Image::Image(Image&& mvt) noexcept
+{
+    m_width  = mvt.m_width;
+    m_height = mvt.m_height;
+    m_pixels = mvt.m_pixels;
+
+    mvt.m_pixels = nullptr;
+    mvt.m_width  = mvt.m_height = 0;
+}
+
+Image::~Image()
+{
+    if(m_pixels)
+        free(m_pixels);
+}
+
+Image* Image::loadFromFile(const char* path)
+{
+    SDL_Surface* img = IMG_Load(path);
+    if(img == NULL)
+    {
+        ERROR("Could not load the image %s : %s\n", path, IMG_GetError());
+        return NULL;
+    }
+
+    SDL_Surface* rgbImg = SDL_ConvertSurfaceFormat(img, SDL_PIXELFORMAT_RGBA32, 0);
+    SDL_FreeSurface(img);
+    if(rgbImg == NULL)
+    {
+        ERROR("Could not convert the image %s to RGBA : %s\n", path, SDL_GetError());
+        return NULL;
+    }
+
+    /* The surface rows may be padded: copy them one by one */
+    Image* image = new Image(rgbImg->w, rgbImg->h);
+    SDL_LockSurface(rgbImg);
+    for(int y = 0; y < rgbImg->h; y++)
+        memcpy(image->m_pixels + (uint64_t)y*rgbImg->w*4, (uint8_t*)rgbImg->pixels + (uint64_t)y*rgbImg->pitch, rgbImg->w*4);
+    SDL_UnlockSurface(rgbImg);
+    SDL_FreeSurface(rgbImg);
+
+    return image;
+}
@@ -0,0 +1,335 @@
+#include "ImageProcessing.h"
+#include "JobSystem.h"
+#include "Simd.h"
+
+#include <cmath>
+#include <algorithm>
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+#define FILTER_LOBES        3
+#define KAISER_BETA         4.0
+#define LINEAR_TO_SRGB_SIZE 4096
+#define DOWNSAMPLE_BAND     16
+
+/* \brief Conversion tables between sRGB 8 bits and linear floats */
+struct SRGBTables
+{
+    float   toLinear[256];
+    uint8_t toSRGB[LINEAR_TO_SRGB_SIZE+1];
+
+    SRGBTables()
+    {
+        for(uint32_t i = 0; i < 256; i++)
+        {
+            double c = i / 255.0;
+            toLinear[i] = (float)((c <= 0.04045) ? c / 12.92 : pow((c + 0.055) / 1.055, 2.4));
+        }
+        for(uint32_t i = 0; i <= LINEAR_TO_SRGB_SIZE; i++)
+        {
+            double c = i / (double)LINEAR_TO_SRGB_SIZE;
+            c = (c <= 0.0031308) ? 12.92*c : 1.055*pow(c, 1.0/2.4) - 0.055;
+            toSRGB[i] = (uint8_t)std::min(255.0, c*255.0 + 0.5);
+        }
+    }
+
+    static const SRGBTables& get()
+    {
+        static SRGBTables tables;
+        return tables;
+    }
+};
+
+/* \brief The taps of one output pixel of a 1D resampling */
+struct FilterTaps
+{
+    int32_t  first;
+    uint32_t count;
+    uint32_t weightOffset;
+};
+
+/* \brief Precomputed 1D resampling from srcSize to dstSize*/
+struct Resampler
+{
+    std::vector<FilterTaps> taps;
+    std::vector<float>      weights;
+    std::vector<int32_t>    indices; /*!< Source index of every tap, after wrapping or clamping*/
+};
+
+static double sinc(double x)
+{
+    if(fabs(x) < 1e-8)
+        return 1.0;
+    x *= M_PI;
+    return sin(x) / x;
+}
+
+/* \brief Modified Bessel function of the first kind, order 0 */
+static double besselI0(double x)
+{
+    double sum = 1.0, term = 1.0;
+    for(uint32_t k = 1; k < 32; k++)
+    {
+        term *= (x / (2.0*k)) * (x / (2.0*k));
+        sum  += term;
+    }
+    return sum;
+}
+
+static double filterWeight(MipFilter filter, double x)
+{
+    if(fabs(x) >= FILTER_LOBES)
+        return 0.0;
+    if(filter == MIP_FILTER_LANCZOS3)
+        return sinc(x) * sinc(x / FILTER_LOBES);
+    double r = x / FILTER_LOBES;
+    return sinc(x) * besselI0(KAISER_BETA * sqrt(1.0 - r*r)) / besselI0(KAISER_BETA);
+}
+
+static Resampler makeResampler(uint32_t srcSize, uint32_t dstSize, MipFilter filter, bool wrap)
+{
+    Resampler r;
+    double scale  = srcSize / (double)dstSize;
+    double radius = FILTER_LOBES * std::max(1.0, scale);
+
+    for(uint32_t x = 0; x < dstSize; x++)
+    {
+        double center = (x + 0.5) * scale - 0.5;
+        int32_t first = (int32_t)ceil(center - radius);
+        int32_t last  = (int32_t)floor(center + radius);
+
+        FilterTaps t;
+        t.first        = first;
+        t.count        = (uint32_t)(last - first + 1);
+        t.weightOffset = (uint32_t)r.weights.size();
+
+        double total = 0.0;
+        for(int32_t i = first; i <= last; i++)
+        {
+            double w = filterWeight(filter, (i - center) / std::max(1.0, scale));
+            r.weights.push_back((float)w);
+            total += w;
+
+            int32_t index = i;
+            if(wrap)
+                index = ((index % (int32_t)srcSize) + (int32_t)srcSize) % (int32_t)srcSize;
+            else
+                index = std::min(std::max(index, 0), (int32_t)srcSize-1);
+            r.indices.push_back(index);
+        }
+        for(uint32_t i = 0; i < t.count; i++)
+            r.weights[t.weightOffset + i] /= (float)total;
+        r.taps.push_back(t);
+    }
+    return r;
+}
+
+/* \brief Load a pixel as linear RGBA floats */
+static inline Float4 loadLinear(const uint8_t* p, const SRGBTables& tables)
+{
+    return Float4(tables.toLinear[p[0]], tables.toLinear[p[1]], tables.toLinear[p[2]], p[3] * (1.0f/255.0f));
+}
+
+/* \brief Store a linear RGBA pixel as sRGB 8 bits */
+static inline void storeSRGB(Float4 c, uint8_t* p, const SRGBTables& tables)
+{
+    float v[4];
+    min(max(c, Float4(0.0f)), Float4(1.0f)).store(v);
+    for(uint32_t k = 0; k < 3; k++)
+        p[k] = tables.toSRGB[(uint32_t)(v[k]*LINEAR_TO_SRGB_SIZE + 0.5f)];
+    p[3] = (uint8_t)(v[3]*255.0f + 0.5f);
+}
+
+Image* ImageProcessing::downsample(const Image& src, MipFilter filter, bool wrapX)
+{
+    const uint32_t srcW = src.getWidth(), srcH = src.getHeight();
+    const uint32_t dstW = std::max(1u, srcW/2), dstH = std::max(1u, srcH/2);
+    const SRGBTables& tables = SRGBTables::get();
+
+    Resampler horizontal = makeResampler(srcW, dstW, filter, wrapX);
+    Resampler vertical   = makeResampler(srcH, dstH, filter, false);
+
+    Image* dst = new Image(dstW, dstH);
+    const uint8_t* srcPixels = src.getPixels();
+    uint8_t*       dstPixels = dst->getPixels();
+
+    /* Each job handles a band of output rows: it filters horizontally only the source rows the band needs, then vertically */
+    uint32_t nbBands = (dstH + DOWNSAMPLE_BAND - 1) / DOWNSAMPLE_BAND;
+    JobSystem::get().parallelFor(nbBands, 1, [&](uint32_t bandBegin, uint32_t bandEnd)
+    {
+        std::vector<float> rows;
+        for(uint32_t band = bandBegin; band < bandEnd; band++)
+        {
+            uint32_t y0 = band*DOWNSAMPLE_BAND;
+            uint32_t y1 = std::min(dstH, y0 + DOWNSAMPLE_BAND);
+
+            int32_t rowMin = (int32_t)srcH, rowMax = -1;
+            for(uint32_t y = y0; y < y1; y++)
+            {
+                const FilterTaps& t = vertical.taps[y];
+                for(uint32_t k = 0; k < t.count; k++)
+                {
+                    rowMin = std::min(rowMin, vertical.indices[t.weightOffset+k]);
+                    rowMax = std::max(rowMax, vertical.indices[t.weightOffset+k]);
+                }
+            }
+
+            /* Horizontal pass, RGBA as one Float4 */
+            rows.resize((size_t)(rowMax - rowMin + 1) * dstW * 4);
+            for(int32_t row = rowMin; row <= rowMax; row++)
+            {
+                const uint8_t* srcRow = srcPixels + (uint64_t)row*srcW*4;
+                float* out = &rows[(size_t)(row - rowMin)*dstW*4];
+                for(uint32_t x = 0; x < dstW; x++)
+                {
+                    const FilterTaps& t = horizontal.taps[x];
+                    const float*   w    = &horizontal.weights[t.weightOffset];
+                    const int32_t* idx  = &horizontal.indices[t.weightOffset];
+                    Float4 sum(0.0f);
+                    for(uint32_t k = 0; k < t.count; k++)
+                        sum = sum + Float4(w[k]) * loadLinear(srcRow + 4*idx[k], tables);
+                    sum.store(out + 4*x);
+                }
+            }
+
+            /* Vertical pass. With AVX2 two pixels are filtered at once */
+            for(uint32_t y = y0; y < y1; y++)
+            {
+                const FilterTaps& t = vertical.taps[y];
+                const float*   w    = &vertical.weights[t.weightOffset];
+                const int32_t* idx  = &vertical.indices[t.weightOffset];
+                uint8_t* dstRow = dstPixels + (uint64_t)y*dstW*4;
+                uint32_t x = 0;
+#ifdef __AVX2__
+                for(; x + 2 <= dstW; x += 2)
+                {
+                    __m256 sum = _mm256_setzero_ps();
+                    for(uint32_t k = 0; k < t.count; k++)
+                        sum = _mm256_fmadd_ps(_mm256_set1_ps(w[k]), _mm256_loadu_ps(&rows[((size_t)(idx[k] - rowMin)*dstW + x)*4]), sum);
+                    storeSRGB(Float4(_mm256_castps256_ps128(sum)),   dstRow + 4*x,     tables);
+                    storeSRGB(Float4(_mm256_extractf128_ps(sum, 1)), dstRow + 4*(x+1), tables);
+                }
+#endif
+                for(; x < dstW; x++)
+                {
+                    Float4 sum(0.0f);
+                    for(uint32_t k = 0; k < t.count; k++)
+                        sum = sum + Float4(w[k]) * Float4::load(&rows[((size_t)(idx[k] - rowMin)*dstW + x)*4]);
+                    storeSRGB(sum, dstRow + 4*x, tables);
+                }
+            }
+        }
+    });
+
+    return dst;
+}
+
+std::vector<Image*> ImageProcessing::buildMipChain(const Image& src, MipFilter filter, bool wrapX)
+{
+    std::vector<Image*> levels;
+    const Image* previous = &src;
+    while(previous->getWidth() > 1 || previous->getHeight() > 1)
+    {
+        Image* level = downsample(*previous, filter, wrapX);
+        levels.push_back(level);
+        previous = level;
+    }
+    return levels;
+}
+
+/* \brief atan2 on 4 lanes. Polynomial approximation, error below 1e-5 rad */
+static Float4 atan2Approx(Float4 y, Float4 x)
+{
+    const Float4 zero(0.0f), pi((float)M_PI), halfPi((float)M_PI_2);
+    Float4 ax = abs(x), ay = abs(y);
+    Float4 swap = ay > ax;
+    Float4 num  = select(swap, ax, ay);
+    Float4 den  = max(select(swap, ay, ax), Float4(1e-30f));
+    Float4 a    = num / den;
+    Float4 s    = a*a;
+    Float4 r    = ((((Float4(-0.0117212f)*s + Float4(0.05265332f))*s - Float4(0.11643287f))*s + Float4(0.19354346f))*s - Float4(0.33262347f))*s + Float4(0.99997726f);
+    r = r * a;
+    r = select(swap, halfPi - r, r);
+    r = select(x < zero, pi - r, r);
+    return select(y < zero, zero - r, r);
+}
+
+/* \brief acos on 4 lanes (Abramowitz and Stegun 4.4.45), error below 7e-5 rad */
+static Float4 acosApprox(Float4 x)
+{
+    Float4 ax = min(abs(x), Float4(1.0f));
+    Float4 r  = ((Float4(-0.0187293f)*ax + Float4(0.0742610f))*ax - Float4(0.2121144f))*ax + Float4(1.5707288f);
+    r = r * sqrt(Float4(1.0f) - ax);
+    return select(x < Float4(0.0f), Float4((float)M_PI) - r, r);
+}
+
+void ImageProcessing::equirectangularToCubeFace(const Image& equirectangular, uint32_t face, Image& faceImage)
+{
+    const uint32_t size = faceImage.getWidth();
+    const uint32_t srcW = equirectangular.getWidth(), srcH = equirectangular.getHeight();
+    const uint8_t* src  = equirectangular.getPixels();
+    uint8_t*       dst  = faceImage.getPixels();
+    const SRGBTables& tables = SRGBTables::get();
+
+    JobSystem::get().parallelFor(size, 16, [&](uint32_t rowBegin, uint32_t rowEnd)
+    {
+        const Float4 one(1.0f), minusOne(-1.0f);
+        const Float4 lane(0.5f, 1.5f, 2.5f, 3.5f);
+        for(uint32_t y = rowBegin; y < rowEnd; y++)
+        {
+            Float4 tc(2.0f*(y + 0.5f)/size - 1.0f);
+            for(uint32_t x = 0; x < size; x += 4)
+            {
+                /* Direction of 4 texels, following the OpenGL cubemap conventions */
+                Float4 sc = (Float4((float)x) + lane) * Float4(2.0f/size) - one;
+                Float4 dx, dy, dz;
+                switch(face)
+                {
+                    case 0:  dx = one;      dy = Float4(0.0f) - tc; dz = Float4(0.0f) - sc; break;
+                    case 1:  dx = minusOne; dy = Float4(0.0f) - tc; dz = sc;                break;
+                    case 2:  dx = sc;       dy = one;               dz = tc;                break;
+                    case 3:  dx = sc;       dy = minusOne;          dz = Float4(0.0f) - tc; break;
+                    case 4:  dx = sc;       dy = Float4(0.0f) - tc; dz = one;               break;
+                    default: dx = Float4(0.0f) - sc; dy = Float4(0.0f) - tc; dz = minusOne; break;
+                }
+                Float4 invLength = one / sqrt(dx*dx + dy*dy + dz*dz);
+                dx = dx*invLength; dy = dy*invLength; dz = dz*invLength;
+
+                /* Sphere mesh mapping */
+                Float4 theta = atan2Approx(dx, dz);
+                theta = select(theta < Float4(0.0f), theta + Float4(2.0f*(float)M_PI), theta);
+                Float4 phi = acosApprox(dy);
+                Float4 u = theta * Float4((float)(srcW / (2.0*M_PI))) - Float4(0.5f);
+                Float4 v = phi   * Float4((float)(srcH / M_PI))       - Float4(0.5f);
+                Float4 fu = floor(u), fv = floor(v);
+                float au[4], av[4];
+                (u - fu).store(au);
+                (v - fv).store(av);
+                int32_t iu[4], iv[4];
+                fu.storeInt(iu);
+                fv.storeInt(iv);
+
+                /* Bilinear taps in linear space, repeat horizontally and clamp vertically */
+                for(uint32_t l = 0; l < 4 && x + l < size; l++)
+                {
+                    int32_t x0 = ((iu[l] % (int32_t)srcW) + (int32_t)srcW) % (int32_t)srcW;
+                    int32_t x1 = (x0 + 1) % (int32_t)srcW;
+                    int32_t y0 = std::min(std::max(iv[l],   0), (int32_t)srcH-1);
+                    int32_t y1 = std::min(std::max(iv[l]+1, 0), (int32_t)srcH-1);
+                    const uint8_t* p00 = src + 4*((uint64_t)y0*srcW + x0);
+                    const uint8_t* p10 = src + 4*((uint64_t)y0*srcW + x1);
+                    const uint8_t* p01 = src + 4*((uint64_t)y1*srcW + x0);
+                    const uint8_t* p11 = src + 4*((uint64_t)y1*srcW + x1);
+                    Float4 c00 = loadLinear(p00, tables), c10 = loadLinear(p10, tables);
+                    Float4 c01 = loadLinear(p01, tables), c11 = loadLinear(p11, tables);
+                    Float4 a(au[l]), b(av[l]);
+                    Float4 top    = c00 + (c10 - c00)*a;
+                    Float4 bottom = c01 + (c11 - c01)*a;
+                    storeSRGB(top + (bottom - top)*b, dst + 4*((uint64_t)y*size + x + l), tables);
+                }
+            }
+        }
+    });
+}
@@ -0,0 +1,100 @@
+#include "JobSystem.h"
+
+JobSystem::JobSystem(uint32_t nbThreads)
+{
+    if(nbThreads == 0)
+        nbThreads = std::thread::hardware_concurrency();
+    if(nbThreads == 0)
+        nbThreads = 1;
+
+    for(uint32_t i = 1; i < nbThreads; i++)
+        m_workers.emplace_back(&JobSystem::workerLoop, this);
+}
+
+JobSystem::~JobSystem()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_quit = true;
+    }
+    m_wakeUp.notify_all();
+    for(std::thread& t : m_workers)
+        t.join();
+}
+
+JobSystem& JobSystem::get()
+{
+    static JobSystem jobSystem;
+    return jobSystem;
+}
+
+void JobSystem::run(uint32_t count, uint32_t grain, const void* context, RangeCall call)
+{
+    if(count == 0)
+        return;
+    if(grain == 0)
+        grain = 1;
+
+    /* Not worth waking up the workers */
+    if(m_workers.empty() || count <= grain)
+    {
+        call(context, 0, count);
+        return;
+    }
+
+    std::lock_guard<std::mutex> submitLock(m_submitMutex);
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_context = context;
+        m_call    = call;
+        m_count   = count;
+        m_grain   = grain;
+        m_next    = 0;
+        m_nbBusy  = (uint32_t)m_workers.size();
+        m_jobID++;
+    }
+    m_wakeUp.notify_all();
+
+    runBatches();
+
+    /* Wait for the workers to finish their last batch */
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_done.wait(lock, [this]{return m_nbBusy == 0;});
+    m_context = nullptr;
+    m_call    = nullptr;
+}
+
+void JobSystem::runBatches()
+{
+    while(true)
+    {
+        uint32_t begin = m_next.fetch_add(m_grain);
+        if(begin >= m_count)
+            break;
+        uint32_t end = (m_count - begin < m_grain) ? m_count : begin + m_grain;
+        m_call(m_context, begin, end);
+    }
+}
+
+void JobSystem::workerLoop()
+{
+    uint64_t lastJob = 0;
+    while(true)
+    {
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_wakeUp.wait(lock, [&]{return m_quit || m_jobID != lastJob;});
+            if(m_quit)
+                return;
+            lastJob = m_jobID;
+        }
+
+        runBatches();
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_nbBusy--;
+        }
+        m_done.notify_one();
+    }
+}
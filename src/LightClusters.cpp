@@ -0,0 +1,259 @@
+#include "LightClusters.h"
+#include "JobSystem.h"
+#include "FrameArena.h"
+#include "Simd.h"
+
+#include <chrono>
+#include <cmath>
+#include <algorithm>
+
+#define NB_CLUSTERS (LIGHT_CLUSTERS_X * LIGHT_CLUSTERS_Y * LIGHT_CLUSTERS_Z)
+
+LightClusters::LightClusters(uint32_t screenWidth, uint32_t screenHeight) : m_screenWidth(screenWidth), m_screenHeight(screenHeight),
+    m_clusterMin(NB_CLUSTERS * 3), m_clusterMax(NB_CLUSTERS * 3), m_grid(NB_CLUSTERS * 2, 0), m_sliceIndices(LIGHT_CLUSTERS_Z)
+{
+    GLuint textures[3];
+    glGenTextures(3, textures);
+    m_gridTexture  = textures[0];
+    m_indexTexture = textures[1];
+    m_lightTexture = textures[2];
+
+    /* Integer textures can only be fetched, never filtered */
+    for(GLuint texture : textures)
+    {
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    }
+
+    glBindTexture(GL_TEXTURE_2D, m_gridTexture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RG32UI, LIGHT_CLUSTERS_X * LIGHT_CLUSTERS_Y, LIGHT_CLUSTERS_Z, 0, GL_RG_INTEGER, GL_UNSIGNED_INT, m_grid.data());
+
+    m_indexTextureHeight = 1;
+    glBindTexture(GL_TEXTURE_2D, m_indexTexture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_R32UI, LIGHT_INDICES_TEXTURE_WIDTH, m_indexTextureHeight, 0, GL_RED_INTEGER, GL_UNSIGNED_INT, NULL);
+
+    m_lightTextureWidth = 2;
+    glBindTexture(GL_TEXTURE_2D, m_lightTexture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, m_lightTextureWidth, 1, 0, GL_RGBA, GL_FLOAT, NULL);
+
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+LightClusters::~LightClusters()
+{
+    GLuint textures[3] = {m_gridTexture, m_indexTexture, m_lightTexture};
+    glDeleteTextures(3, textures);
+}
+
+void LightClusters::buildClusterBounds(const glm::mat4& projection, float zNear, float zFar)
+{
+    m_boundsProjection = projection;
+    m_boundsNear       = zNear;
+    m_boundsFar        = zFar;
+
+    /* slice = floor(log(z) * scale + bias), z being the distance along the view direction */
+    float logRatio = logf(zFar / zNear);
+    m_sliceScale   = LIGHT_CLUSTERS_Z / logRatio;
+    m_sliceBias    = -LIGHT_CLUSTERS_Z * logf(zNear) / logRatio;
+
+    for(uint32_t k = 0; k < LIGHT_CLUSTERS_Z; k++)
+    {
+        float sliceNear = zNear * powf(zFar / zNear, k / (float)LIGHT_CLUSTERS_Z);
+        float sliceFar  = zNear * powf(zFar / zNear, (k+1) / (float)LIGHT_CLUSTERS_Z);
+        for(uint32_t j = 0; j < LIGHT_CLUSTERS_Y; j++)
+        {
+            for(uint32_t i = 0; i < LIGHT_CLUSTERS_X; i++)
+            {
+                /* ndc = (P00 * x - P20 * z) / z at the distance z, so x = (ndc + P20) * z / P00 */
+                float ndcX[2] = {-1.0f + 2.0f * i / LIGHT_CLUSTERS_X, -1.0f + 2.0f * (i+1) / LIGHT_CLUSTERS_X};
+                float ndcY[2] = {-1.0f + 2.0f * j / LIGHT_CLUSTERS_Y, -1.0f + 2.0f * (j+1) / LIGHT_CLUSTERS_Y};
+                float depths[2] = {sliceNear, sliceFar};
+
+                glm::vec3 bmin( INFINITY);
+                glm::vec3 bmax(-INFINITY);
+                for(float z : depths)
+                    for(float nx : ndcX)
+                        for(float ny : ndcY)
+                        {
+                            glm::vec3 p((nx + projection[2][0]) * z / projection[0][0], (ny + projection[2][1]) * z / projection[1][1], -z);
+                            bmin = glm::min(bmin, p);
+                            bmax = glm::max(bmax, p);
+                        }
+
+                uint32_t cluster = (k * LIGHT_CLUSTERS_Y + j) * LIGHT_CLUSTERS_X + i;
+                for(uint32_t c = 0; c < 3; c++)
+                {
+                    m_clusterMin[3*cluster+c] = bmin[c];
+                    m_clusterMax[3*cluster+c] = bmax[c];
+                }
+            }
+        }
+    }
+}
+
+void LightClusters::update(const std::vector<PointLight>& lights, const glm::mat4& view, const glm::mat4& projection, float zNear, float zFar)
+{
+    auto begin = std::chrono::high_resolution_clock::now();
+
+    if(projection != m_boundsProjection || zNear != m_boundsNear || zFar != m_boundsFar)
+        buildClusterBounds(projection, zNear, zFar);
+
+    if(lights.size() > LIGHT_CLUSTERS_MAX_LIGHTS && m_nbLights != LIGHT_CLUSTERS_MAX_LIGHTS)
+        WARNING("Only the first %u of the %u lights are used\n", LIGHT_CLUSTERS_MAX_LIGHTS, (uint32_t)lights.size());
+    m_nbLights = (uint32_t)std::min(lights.size(), (size_t)LIGHT_CLUSTERS_MAX_LIGHTS);
+
+    /* The lights in view space, SoA. The temporaries of the update come from the frame arenas */
+    FrameVector<float> lightX(m_nbLights), lightY(m_nbLights), lightZ(m_nbLights), lightRadius(m_nbLights);
+    for(uint32_t i = 0; i < m_nbLights; i++)
+    {
+        glm::vec3 p = glm::vec3(view * glm::vec4(lights[i].position, 1.0f));
+        lightX[i] = p.x;
+        lightY[i] = p.y;
+        lightZ[i] = p.z;
+        lightRadius[i] = lights[i].radius;
+    }
+
+    JobSystem::get().parallelFor(LIGHT_CLUSTERS_Z, 1, [&](uint32_t sliceBegin, uint32_t sliceEnd)
+    {
+        for(uint32_t k = sliceBegin; k < sliceEnd; k++)
+        {
+            std::vector<uint32_t>& indices = m_sliceIndices[k];
+            indices.clear();
+
+            /* Keep the lights overlapping the slice depth range, padded to a multiple of 4 with lights that touch nothing */
+            uint32_t firstCluster = k * LIGHT_CLUSTERS_X * LIGHT_CLUSTERS_Y;
+            float sliceMinZ = m_clusterMin[3*firstCluster+2];
+            float sliceMaxZ = m_clusterMax[3*firstCluster+2];
+            FrameVector<float>    cx, cy, cz, cr2;
+            FrameVector<uint32_t> candidates;
+            for(uint32_t i = 0; i < m_nbLights; i++)
+            {
+                if(lightZ[i] - lightRadius[i] <= sliceMaxZ && lightZ[i] + lightRadius[i] >= sliceMinZ)
+                {
+                    candidates.push_back(i);
+                    cx.push_back(lightX[i]);
+                    cy.push_back(lightY[i]);
+                    cz.push_back(lightZ[i]);
+                    cr2.push_back(lightRadius[i] * lightRadius[i]);
+                }
+            }
+            while(cx.size() % 4)
+            {
+                cx.push_back(0.0f); cy.push_back(0.0f); cz.push_back(0.0f); cr2.push_back(-1.0f);
+            }
+
+            /* Sphere against cluster box, 4 lights at a time */
+            for(uint32_t t = 0; t < LIGHT_CLUSTERS_X * LIGHT_CLUSTERS_Y; t++)
+            {
+                uint32_t cluster = firstCluster + t;
+                Float4 minX(m_clusterMin[3*cluster+0]), minY(m_clusterMin[3*cluster+1]), minZ(m_clusterMin[3*cluster+2]);
+                Float4 maxX(m_clusterMax[3*cluster+0]), maxY(m_clusterMax[3*cluster+1]), maxZ(m_clusterMax[3*cluster+2]);
+                uint32_t count = 0;
+                for(size_t l = 0; l < cx.size(); l += 4)
+                {
+                    Float4 x = Float4::load(&cx[l]);
+                    Float4 y = Float4::load(&cy[l]);
+                    Float4 z = Float4::load(&cz[l]);
+                    Float4 dx = max(max(minX - x, x - maxX), Float4(0.0f));
+                    Float4 dy = max(max(minY - y, y - maxY), Float4(0.0f));
+                    Float4 dz = max(max(minZ - z, z - maxZ), Float4(0.0f));
+                    int mask = movemask((dx*dx + dy*dy + dz*dz) <= Float4::load(&cr2[l]));
+                    while(mask)
+                    {
+                        int lane = 0;
+                        while(!(mask & (1 << lane)))
+                            lane++;
+                        mask &= ~(1 << lane);
+                        indices.push_back(candidates[l + lane]);
+                        count++;
+                    }
+                }
+                m_grid[2*cluster+1] = count;
+            }
+        }
+    });
+
+    /* Concatenate the slices and compute the offsets */
+    m_indices.clear();
+    for(uint32_t k = 0; k < LIGHT_CLUSTERS_Z; k++)
+    {
+        uint32_t offset = (uint32_t)m_indices.size();
+        for(uint32_t t = 0; t < LIGHT_CLUSTERS_X * LIGHT_CLUSTERS_Y; t++)
+        {
+            uint32_t cluster = k * LIGHT_CLUSTERS_X * LIGHT_CLUSTERS_Y + t;
+            m_grid[2*cluster] = offset;
+            offset += m_grid[2*cluster+1];
+        }
+        m_indices.insert(m_indices.end(), m_sliceIndices[k].begin(), m_sliceIndices[k].end());
+    }
+
+    m_nbIndices = (uint32_t)m_indices.size();
+
+    m_lightData.resize(8 * std::max(m_nbLights, 1u));
+    for(uint32_t i = 0; i < m_nbLights; i++)
+    {
+        float* texels = &m_lightData[8*i];
+        texels[0] = lights[i].position.x;
+        texels[1] = lights[i].position.y;
+        texels[2] = lights[i].position.z;
+        texels[3] = lights[i].radius;
+        texels[4] = lights[i].color.r;
+        texels[5] = lights[i].color.g;
+        texels[6] = lights[i].color.b;
+        texels[7] = 0.0f;
+    }
+
+    m_lastAssignTime = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - begin).count();
+
+    /* Upload. The textures grow, they never shrink */
+    glBindTexture(GL_TEXTURE_2D, m_gridTexture);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, LIGHT_CLUSTERS_X * LIGHT_CLUSTERS_Y, LIGHT_CLUSTERS_Z, GL_RG_INTEGER, GL_UNSIGNED_INT, m_grid.data());
+
+    uint32_t indexRows = ((uint32_t)m_indices.size() + LIGHT_INDICES_TEXTURE_WIDTH - 1) / LIGHT_INDICES_TEXTURE_WIDTH;
+    glBindTexture(GL_TEXTURE_2D, m_indexTexture);
+    if(indexRows > m_indexTextureHeight)
+    {
+        m_indexTextureHeight = indexRows;
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_R32UI, LIGHT_INDICES_TEXTURE_WIDTH, m_indexTextureHeight, 0, GL_RED_INTEGER, GL_UNSIGNED_INT, NULL);
+    }
+    if(indexRows > 0)
+    {
+        m_indices.resize(indexRows * LIGHT_INDICES_TEXTURE_WIDTH, 0);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, LIGHT_INDICES_TEXTURE_WIDTH, indexRows, GL_RED_INTEGER, GL_UNSIGNED_INT, m_indices.data());
+    }
+
+    glBindTexture(GL_TEXTURE_2D, m_lightTexture);
+    if(2 * m_nbLights > m_lightTextureWidth)
+    {
+        m_lightTextureWidth = 2 * m_nbLights;
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, m_lightTextureWidth, 1, 0, GL_RGBA, GL_FLOAT, NULL);
+    }
+    if(m_nbLights > 0)
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, 2 * m_nbLights, 1, GL_RGBA, GL_FLOAT, m_lightData.data());
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+void LightClusters::bind(const Shader* shader) const
+{
+    GLuint textures[3] = {m_gridTexture, m_indexTexture, m_lightTexture};
+    for(uint32_t i = 0; i < 3; i++)
+    {
+        glActiveTexture(GL_TEXTURE0 + LIGHT_CLUSTERS_TEXTURE_UNIT + i);
+        glBindTexture(GL_TEXTURE_2D, textures[i]);
+    }
+    glActiveTexture(GL_TEXTURE0);
+
+    GLint uClusterGrid   = glGetUniformLocation(shader->getProgramID(), "uClusterGrid");
+    GLint uLightIndices  = glGetUniformLocation(shader->getProgramID(), "uLightIndices");
+    GLint uLights        = glGetUniformLocation(shader->getProgramID(), "uLights");
+    GLint uClusterParams = glGetUniformLocation(shader->getProgramID(), "uClusterParams");
+    GLint uClusterCount  = glGetUniformLocation(shader->getProgramID(), "uClusterCount");
+    glUniform1i(uClusterGrid,  LIGHT_CLUSTERS_TEXTURE_UNIT);
+    glUniform1i(uLightIndices, LIGHT_CLUSTERS_TEXTURE_UNIT + 1);
+    glUniform1i(uLights,       LIGHT_CLUSTERS_TEXTURE_UNIT + 2);
+    glUniform4f(uClusterParams, m_screenWidth / (float)LIGHT_CLUSTERS_X, m_screenHeight / (float)LIGHT_CLUSTERS_Y, m_sliceScale, m_sliceBias);
+    glUniform3i(uClusterCount, LIGHT_CLUSTERS_X, LIGHT_CLUSTERS_Y, LIGHT_CLUSTERS_Z);
+}
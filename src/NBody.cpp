@@ -0,0 +1,268 @@
+#include "NBody.h"
+#include "JobSystem.h"
+
+#include <chrono>
+#include <cmath>
+#include <atomic>
+#include <algorithm>
+
+/* Bodies per job of the force walk */
+#define NBODY_GRAIN 256
+
+/* \brief Spread the 21 low bits of x so that there are two zero bits between each of them */
+static uint64_t spreadBits(uint64_t x)
+{
+    x &= 0x1fffff;
+    x = (x | x << 32) & 0x1f00000000ffffull;
+    x = (x | x << 16) & 0x1f0000ff0000ffull;
+    x = (x | x << 8)  & 0x100f00f00f00f00full;
+    x = (x | x << 4)  & 0x10c30c30c30c30c3ull;
+    x = (x | x << 2)  & 0x1249249249249249ull;
+    return x;
+}
+
+NBody::NBody(const NBodyParameters& params) : m_params(params)
+{
+    setOpeningAngle(params.openingAngle);
+}
+
+uint32_t NBody::add(const glm::dvec3& position, const glm::dvec3& velocity, double mass)
+{
+    m_position.push_back(position);
+    m_velocity.push_back(velocity);
+    m_acceleration.push_back(glm::dvec3(0.0));
+    m_potential.push_back(0.0);
+    m_mass.push_back(mass);
+    m_forcesValid = false;
+    return (uint32_t)m_mass.size() - 1;
+}
+
+void NBody::clear()
+{
+    m_position.clear();
+    m_velocity.clear();
+    m_acceleration.clear();
+    m_potential.clear();
+    m_mass.clear();
+    m_remainingTime = 0.0;
+    m_forcesValid   = false;
+}
+
+void NBody::setOpeningAngle(double theta)
+{
+    m_params.openingAngle = glm::clamp(theta, 0.0, 1.0);
+    m_forcesValid = false;
+}
+
+uint32_t NBody::advance(double dt)
+{
+    m_remainingTime += dt;
+    uint32_t nbSteps = 0;
+    while(m_remainingTime >= m_params.timeStep)
+    {
+        step();
+        m_remainingTime -= m_params.timeStep;
+        nbSteps++;
+    }
+    return nbSteps;
+}
+
+void NBody::step()
+{
+    if(!m_forcesValid)
+        computeForces();
+
+    /* Kick, drift, and kick again with the forces at the new positions. They are kept for the first kick of the next step */
+    double dt = m_params.timeStep;
+    uint32_t nbBodies = getNbBodies();
+    JobSystem::get().parallelFor(nbBodies, 4096, [&](uint32_t first, uint32_t last)
+    {
+        for(uint32_t i = first; i < last; i++)
+        {
+            m_velocity[i] += 0.5 * dt * m_acceleration[i];
+            m_position[i] += dt * m_velocity[i];
+        }
+    });
+    computeForces();
+    JobSystem::get().parallelFor(nbBodies, 4096, [&](uint32_t first, uint32_t last)
+    {
+        for(uint32_t i = first; i < last; i++)
+            m_velocity[i] += 0.5 * dt * m_acceleration[i];
+    });
+}
+
+double NBody::getEnergy()
+{
+    if(!m_forcesValid)
+        computeForces();
+    double kinetic   = 0.0;
+    double potential = 0.0;
+    for(uint32_t i = 0; i < getNbBodies(); i++)
+    {
+        kinetic   += 0.5 * m_mass[i] * glm::dot(m_velocity[i], m_velocity[i]);
+        potential += 0.5 * m_mass[i] * m_potential[i]; /* Each pair is counted twice */
+    }
+    return kinetic + potential;
+}
+
+void NBody::buildTree()
+{
+    uint32_t nbBodies = getNbBodies();
+    glm::dvec3 boxMin(INFINITY);
+    glm::dvec3 boxMax(-INFINITY);
+    for(const glm::dvec3& p : m_position)
+    {
+        boxMin = glm::min(boxMin, p);
+        boxMax = glm::max(boxMax, p);
+    }
+    /* A cube, slightly larger so that the largest coordinates stay inside the last cell */
+    double size = glm::max(glm::max(boxMax.x - boxMin.x, boxMax.y - boxMin.y), glm::max(boxMax.z - boxMin.z, 1e-9)) * 1.0001;
+    double scale = (1 << NBODY_MAX_DEPTH) / size;
+
+    m_codes.resize(nbBodies);
+    JobSystem::get().parallelFor(nbBodies, 4096, [&](uint32_t first, uint32_t last)
+    {
+        for(uint32_t i = first; i < last; i++)
+        {
+            glm::dvec3 cell = (m_position[i] - boxMin) * scale;
+            m_codes[i] = spreadBits((uint64_t)cell.x) << 2 | spreadBits((uint64_t)cell.y) << 1 | spreadBits((uint64_t)cell.z);
+        }
+    });
+
+    /* Equal codes are ordered by index, so that the order does not depend on the sort */
+    m_sortKeys.resize(nbBodies);
+    for(uint32_t i = 0; i < nbBodies; i++)
+        m_sortKeys[i] = std::make_pair(m_codes[i], i);
+    std::sort(m_sortKeys.begin(), m_sortKeys.end());
+
+    m_sortedPosition.resize(nbBodies);
+    m_sortedMass.resize(nbBodies);
+    m_order.resize(nbBodies);
+    for(uint32_t i = 0; i < nbBodies; i++)
+    {
+        m_codes[i]          = m_sortKeys[i].first;
+        m_order[i]          = m_sortKeys[i].second;
+        m_sortedPosition[i] = m_position[m_sortKeys[i].second];
+        m_sortedMass[i]     = m_mass[m_sortKeys[i].second];
+    }
+
+    m_nodes.clear();
+    if(nbBodies > 0)
+        buildNode(0, nbBodies, 0, boxMin, size);
+}
+
+uint32_t NBody::buildNode(uint32_t first, uint32_t last, uint32_t level, const glm::dvec3& cellMin, double cellSize)
+{
+    uint32_t nodeID = (uint32_t)m_nodes.size();
+    m_nodes.push_back(NBodyNode());
+
+    glm::dvec3 weightedSum(0.0);
+    double mass = 0.0;
+    uint32_t count = 0;
+    if(last - first <= NBODY_LEAF_SIZE || level == NBODY_MAX_DEPTH)
+    {
+        for(uint32_t i = first; i < last; i++)
+        {
+            weightedSum += m_sortedMass[i] * m_sortedPosition[i];
+            mass        += m_sortedMass[i];
+        }
+        count = last - first;
+    }
+    else
+    {
+        /* The 8 children are consecutive ranges of the sorted codes : split on the 3 bits of this level */
+        uint32_t shift = 3 * (NBODY_MAX_DEPTH - 1 - level);
+        double childSize = 0.5 * cellSize;
+        uint32_t childFirst = first;
+        for(uint64_t octant = 0; octant < 8 && childFirst < last; octant++)
+        {
+            uint32_t childLast = (uint32_t)(std::partition_point(m_codes.begin() + childFirst, m_codes.begin() + last,
+                                            [&](uint64_t code) {return ((code >> shift) & 7) <= octant;}) - m_codes.begin());
+            if(childLast == childFirst)
+                continue;
+            glm::dvec3 childMin = cellMin + childSize * glm::dvec3((octant >> 2) & 1, (octant >> 1) & 1, octant & 1);
+            uint32_t childID = buildNode(childFirst, childLast, level + 1, childMin, childSize);
+            weightedSum += m_nodes[childID].mass * m_nodes[childID].centerOfMass;
+            mass        += m_nodes[childID].mass;
+            childFirst = childLast;
+        }
+    }
+
+    /* Opened when closer than size / theta, plus the distance between the center of mass and the cell center (Barnes 1994) :
+     * a body inside the cell always opens it, even at theta = 1 */
+    NBodyNode& node = m_nodes[nodeID];
+    node.mass         = mass;
+    node.centerOfMass = mass > 0.0 ? weightedSum / mass : cellMin + 0.5 * cellSize;
+    double offset     = glm::length(node.centerOfMass - (cellMin + 0.5 * cellSize));
+    double openRadius = m_params.openingAngle > 0.0 ? cellSize / m_params.openingAngle + offset : INFINITY;
+    node.openRadius2  = openRadius * openRadius;
+    node.first        = first;
+    node.count        = count;
+    node.next         = (uint32_t)m_nodes.size();
+    return nodeID;
+}
+
+void NBody::computeForces()
+{
+    auto begin = std::chrono::high_resolution_clock::now();
+    buildTree();
+
+    double G    = m_params.gravity;
+    double eps2 = m_params.softening * m_params.softening;
+    uint32_t nbNodes = (uint32_t)m_nodes.size();
+    std::atomic<uint64_t> nbInteractions(0);
+
+    /* Walked in the Morton order : neighbor bodies open the same nodes, which stay in the cache */
+    JobSystem::get().parallelFor(getNbBodies(), NBODY_GRAIN, [&](uint32_t first, uint32_t last)
+    {
+        uint64_t interactions = 0;
+        for(uint32_t s = first; s < last; s++)
+        {
+            glm::dvec3 p = m_sortedPosition[s];
+            glm::dvec3 acceleration(0.0);
+            double potential = 0.0;
+            uint32_t nodeID = 0;
+            while(nodeID < nbNodes)
+            {
+                const NBodyNode& node = m_nodes[nodeID];
+                glm::dvec3 d = node.centerOfMass - p;
+                double d2 = glm::dot(d, d);
+                if(d2 < node.openRadius2)
+                {
+                    if(node.count == 0)
+                    {
+                        nodeID++;
+                        continue;
+                    }
+                    /* Leaf too close : every body of it */
+                    for(uint32_t j = node.first; j < node.first + node.count; j++)
+                    {
+                        if(j == s)
+                            continue;
+                        glm::dvec3 dj = m_sortedPosition[j] - p;
+                        double invR = 1.0 / std::sqrt(glm::dot(dj, dj) + eps2);
+                        acceleration += (m_sortedMass[j] * invR * invR * invR) * dj;
+                        potential    -= m_sortedMass[j] * invR;
+                    }
+                    interactions += node.count - (s >= node.first && s < node.first + node.count);
+                }
+                else
+                {
+                    double invR = 1.0 / std::sqrt(d2 + eps2);
+                    acceleration += (node.mass * invR * invR * invR) * d;
+                    potential    -= node.mass * invR;
+                    interactions++;
+                }
+                nodeID = node.next;
+            }
+            uint32_t i = m_order[s];
+            m_acceleration[i] = G * acceleration;
+            m_potential[i]    = G * potential;
+        }
+        nbInteractions += interactions;
+    });
+
+    m_forcesValid        = true;
+    m_lastNbInteractions = nbInteractions;
+    m_lastForceTime      = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - begin).count();
+}
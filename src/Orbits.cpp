@@ -0,0 +1,170 @@
+#include "Orbits.h"
+#include "JobSystem.h"
+#include "Simd.h"
+#include "logger.h"
+
+#include <chrono>
+#include <cmath>
+#include <algorithm>
+
+/* Orbits per job. A few thousands keep the threads busy without fighting over the batches */
+#define ORBITS_GRAIN 4096
+
+/* 1.5 * 2^52 : adding then subtracting it rounds a double to an integer */
+static const double ROUNDING_MAGIC = 6755399441055744.0;
+
+/* \brief Get the perifocal axes of an orbit in the scene frame : P towards the periapsis, Q 90 degrees ahead.
+ * The usual formulas give them in a Z-up frame, (x, y, z) is then (x, z, -y) in the scene */
+static void perifocalAxes(const KeplerElements& elements, glm::dvec3& p, glm::dvec3& q)
+{
+    double cosO = std::cos((double)elements.longitudeOfNode), sinO = std::sin((double)elements.longitudeOfNode);
+    double cosW = std::cos((double)elements.argumentOfPeriapsis), sinW = std::sin((double)elements.argumentOfPeriapsis);
+    double cosI = std::cos((double)elements.inclination), sinI = std::sin((double)elements.inclination);
+
+    glm::dvec3 pz(cosW * cosO - sinW * cosI * sinO, cosW * sinO + sinW * cosI * cosO, sinW * sinI);
+    glm::dvec3 qz(-sinW * cosO - cosW * cosI * sinO, -sinW * sinO + cosW * cosI * cosO, cosW * sinI);
+    p = glm::dvec3(pz.x, pz.z, -pz.y);
+    q = glm::dvec3(qz.x, qz.z, -qz.y);
+}
+
+uint32_t Orbits::add(const KeplerElements& elements)
+{
+    float e = elements.eccentricity;
+    if(e < 0.0f || e > KEPLER_MAX_ECCENTRICITY)
+    {
+        WARNING("Eccentricity %f is out of [0, %f], it is clamped\n", e, KEPLER_MAX_ECCENTRICITY);
+        e = glm::clamp(e, 0.0f, KEPLER_MAX_ECCENTRICITY);
+    }
+
+    /* Pad to a multiple of 4 with null orbits (zero axes) so that propagate never needs a scalar tail */
+    uint32_t orbitID = m_nbOrbits++;
+    if(orbitID % 4 == 0)
+    {
+        uint32_t size = orbitID + 4;
+        m_meanAnomaly.resize(size, 0.0f);
+        m_meanMotion.resize(size, 0.0f);
+        m_eccentricity.resize(size, 0.0f);
+        m_semiMajorAxis.resize(size, 0.0f);
+        m_semiMinorAxis.resize(size, 0.0f);
+        for(uint32_t i = 0; i < 3; i++)
+        {
+            m_axisP[i].resize(size, 0.0f);
+            m_axisQ[i].resize(size, 0.0f);
+        }
+        m_x.resize(size, 0.0f);
+        m_y.resize(size, 0.0f);
+        m_z.resize(size, 0.0f);
+    }
+
+    glm::dvec3 p, q;
+    perifocalAxes(elements, p, q);
+    m_meanAnomaly[orbitID]   = elements.meanAnomaly;
+    m_meanMotion[orbitID]    = elements.meanMotion;
+    m_eccentricity[orbitID]  = e;
+    m_semiMajorAxis[orbitID] = elements.semiMajorAxis;
+    m_semiMinorAxis[orbitID] = elements.semiMajorAxis * std::sqrt(1.0f - e * e);
+    for(uint32_t i = 0; i < 3; i++)
+    {
+        m_axisP[i][orbitID] = (float)p[i];
+        m_axisQ[i][orbitID] = (float)q[i];
+    }
+    return orbitID;
+}
+
+void Orbits::clear()
+{
+    m_nbOrbits = 0;
+    m_meanAnomaly.clear();
+    m_meanMotion.clear();
+    m_eccentricity.clear();
+    m_semiMajorAxis.clear();
+    m_semiMinorAxis.clear();
+    for(uint32_t i = 0; i < 3; i++)
+    {
+        m_axisP[i].clear();
+        m_axisQ[i].clear();
+    }
+    m_x.clear();
+    m_y.clear();
+    m_z.clear();
+}
+
+void Orbits::propagate(double t)
+{
+    auto begin = std::chrono::high_resolution_clock::now();
+
+    uint32_t nbGroups = (m_nbOrbits + 3) / 4;
+    JobSystem::get().parallelFor(nbGroups, ORBITS_GRAIN / 4, [&](uint32_t first, uint32_t last)
+    {
+        for(uint32_t group = first; group < last; group++)
+        {
+            uint32_t i = 4 * group;
+
+            /* Mean anomalies in [-pi, pi]. Reduced in double : n * t is far too large for a float after a while */
+            float meanAnomaly[4];
+            for(uint32_t lane = 0; lane < 4; lane++)
+            {
+                double m = m_meanAnomaly[i + lane] + m_meanMotion[i + lane] * t;
+                double turns = (m * (0.5 / M_PI) + ROUNDING_MAGIC) - ROUNDING_MAGIC; /* Rounded to the nearest integer, without a float to int conversion */
+                meanAnomaly[lane] = (float)(m - turns * (2.0 * M_PI));
+            }
+            Float4 m = Float4::load(meanAnomaly);
+            Float4 e = Float4::load(&m_eccentricity[i]);
+
+            /* Halley on E - e sin(E) = M, from the guess of Danby : E0 = M + 0.85 e sign(sin M). Converges for every eccentricity.
+             * The 4 lanes stop together, when the slowest one is done */
+            Float4 sinE, cosE;
+            Float4 eccentricAnomaly = m + select(m < Float4(0.0f), Float4(-0.85f), Float4(0.85f)) * e;
+            for(uint32_t iteration = 0; iteration < KEPLER_MAX_ITERATIONS; iteration++)
+            {
+                sinCos(eccentricAnomaly, sinE, cosE);
+                Float4 f     = eccentricAnomaly - e * sinE - m;
+                Float4 slope = Float4(1.0f) - e * cosE;
+                Float4 step  = f * slope / (slope * slope - Float4(0.5f) * f * e * sinE);
+                eccentricAnomaly = eccentricAnomaly - step;
+                /* The last step is tiny : first order update of the sine and cosine instead of a new sinCos */
+                Float4 previousSin = sinE;
+                sinE = sinE - step * cosE;
+                cosE = cosE + step * previousSin;
+                if(movemask(abs(step) > Float4(KEPLER_TOLERANCE)) == 0)
+                    break;
+            }
+
+            /* Position in the orbit plane, then rotated by the perifocal axes */
+            Float4 u = Float4::load(&m_semiMajorAxis[i]) * (cosE - e);
+            Float4 v = Float4::load(&m_semiMinorAxis[i]) * sinE;
+            (u * Float4::load(&m_axisP[0][i]) + v * Float4::load(&m_axisQ[0][i])).store(&m_x[i]);
+            (u * Float4::load(&m_axisP[1][i]) + v * Float4::load(&m_axisQ[1][i])).store(&m_y[i]);
+            (u * Float4::load(&m_axisP[2][i]) + v * Float4::load(&m_axisQ[2][i])).store(&m_z[i]);
+        }
+    });
+
+    m_lastUpdateTime = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - begin).count();
+}
+
+glm::dvec3 Orbits::solve(const KeplerElements& elements, double t)
+{
+    double e = glm::clamp((double)elements.eccentricity, 0.0, (double)KEPLER_MAX_ECCENTRICITY);
+    double m = std::fmod(elements.meanAnomaly + elements.meanMotion * t, 2.0 * M_PI);
+    if(m < 0.0)
+        m += 2.0 * M_PI;
+
+    double eccentricAnomaly = e > 0.8 ? M_PI : m;
+    for(uint32_t iteration = 0; iteration < 100; iteration++)
+    {
+        double step = (eccentricAnomaly - e * std::sin(eccentricAnomaly) - m) / (1.0 - e * std::cos(eccentricAnomaly));
+        eccentricAnomaly -= step;
+        if(std::abs(step) < 1e-14)
+            break;
+    }
+
+    glm::dvec3 p, q;
+    perifocalAxes(elements, p, q);
+    double a = elements.semiMajorAxis;
+    return a * (std::cos(eccentricAnomaly) - e) * p + a * std::sqrt(1.0 - e * e) * std::sin(eccentricAnomaly) * q;
+}
+
+void Orbits::getAxes(const KeplerElements& elements, glm::dvec3& p, glm::dvec3& q)
+{
+    perifocalAxes(elements, p, q);
+}
@@ -0,0 +1,573 @@
+#include "PathTracer.h"
+#include "JobSystem.h"
+#include "logger.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+#define PT_TILE_SIZE     16
+#define PT_EPSILON       1e-4f
+#define PT_BVH_LEAF_SIZE 2
+#define PT_STACK_SIZE    64
+
+/* \brief Small per lane random generator (xorshift32) */
+struct PTRandom
+{
+    uint32_t state;
+
+    PTRandom(uint32_t seed)
+    {
+        /* Wang hash so that neighbouring seeds give unrelated sequences */
+        seed = (seed ^ 61) ^ (seed >> 16);
+        seed *= 9;
+        seed = seed ^ (seed >> 4);
+        seed *= 0x27d4eb2d;
+        seed = seed ^ (seed >> 15);
+        state = seed ? seed : 1;
+    }
+
+    float next()
+    {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        return (state >> 8) * (1.0f / 16777216.0f);
+    }
+};
+
+/* \brief Build an orthonormal basis around n */
+static void makeBasis(const glm::vec3& n, glm::vec3& t, glm::vec3& b)
+{
+    if(fabs(n.x) > 0.9f)
+        t = glm::normalize(glm::cross(glm::vec3(0.0f, 1.0f, 0.0f), n));
+    else
+        t = glm::normalize(glm::cross(glm::vec3(1.0f, 0.0f, 0.0f), n));
+    b = glm::cross(n, t);
+}
+
+PathTracer::PathTracer(uint32_t width, uint32_t height) : m_width(width), m_height(height)
+{
+    m_accumulation.resize((size_t)width*height, glm::vec3(0.0f));
+    for(uint32_t i = 0; i < 256; i++)
+    {
+        float c = i / 255.0f;
+        m_srgbToLinear[i] = (c <= 0.04045f) ? c / 12.92f : powf((c + 0.055f) / 1.055f, 2.4f);
+    }
+}
+
+void PathTracer::reset()
+{
+    std::fill(m_accumulation.begin(), m_accumulation.end(), glm::vec3(0.0f));
+    m_nbPasses = 0;
+}
+
+void PathTracer::setCamera(const glm::mat4& invViewProjection, const glm::vec3& position)
+{
+    m_invViewProjection = invViewProjection;
+    m_cameraPosition    = position;
+    reset();
+}
+
+void PathTracer::setScene(const std::vector<PTSphere>& spheres, const Image* environment, float environmentScale)
+{
+    m_spheres          = spheres;
+    m_environment      = environment;
+    m_environmentScale = environmentScale;
+
+    m_nodes.clear();
+    m_lights.clear();
+    m_bvhDepth = 0;
+    if(!m_spheres.empty())
+    {
+        m_nodes.reserve(2*m_spheres.size());
+        m_nodes.push_back(BVHNode());
+        buildNode(0, 0, (uint32_t)m_spheres.size(), 0);
+    }
+
+    /* The median split keeps the depth near log2(count), so this only happens with a broken build */
+    if(m_bvhDepth + 1 > PT_STACK_SIZE)
+        WARNING("The path tracer BVH is %u deep, its traversal stack of %u entries will skip some spheres\n", m_bvhDepth, PT_STACK_SIZE);
+
+    /* The BVH reordered the spheres: find the lights and pack the intersection data afterward */
+    m_sphereData.resize(4*m_spheres.size());
+    for(uint32_t i = 0; i < m_spheres.size(); i++)
+    {
+        const PTSphere& s = m_spheres[i];
+        m_sphereData[4*i+0] = s.center.x;
+        m_sphereData[4*i+1] = s.center.y;
+        m_sphereData[4*i+2] = s.center.z;
+        m_sphereData[4*i+3] = s.radius*s.radius;
+        if(s.emission.x > 0.0f || s.emission.y > 0.0f || s.emission.z > 0.0f)
+            m_lights.push_back(i);
+    }
+
+    reset();
+}
+
+void PathTracer::buildNode(uint32_t nodeID, uint32_t first, uint32_t count, uint32_t depth)
+{
+    m_bvhDepth = std::max(m_bvhDepth, depth);
+
+    glm::vec3 bmin(INFINITY), bmax(-INFINITY);
+    glm::vec3 cmin(INFINITY), cmax(-INFINITY);
+    for(uint32_t i = first; i < first+count; i++)
+    {
+        const PTSphere& s = m_spheres[i];
+        bmin = glm::min(bmin, s.center - glm::vec3(s.radius));
+        bmax = glm::max(bmax, s.center + glm::vec3(s.radius));
+        cmin = glm::min(cmin, s.center);
+        cmax = glm::max(cmax, s.center);
+    }
+
+    for(uint32_t k = 0; k < 3; k++)
+    {
+        m_nodes[nodeID].bmin[k] = bmin[k];
+        m_nodes[nodeID].bmax[k] = bmax[k];
+    }
+
+    if(count <= PT_BVH_LEAF_SIZE)
+    {
+        m_nodes[nodeID].leftOrFirst = first;
+        m_nodes[nodeID].count       = (uint16_t)count;
+        m_nodes[nodeID].axis        = 0;
+        return;
+    }
+
+    /* Median split along the largest extent of the centers */
+    glm::vec3 extent = cmax - cmin;
+    uint32_t axis = 0;
+    if(extent.y > extent[axis]) axis = 1;
+    if(extent.z > extent[axis]) axis = 2;
+
+    uint32_t half = count/2;
+    std::nth_element(m_spheres.begin()+first, m_spheres.begin()+first+half, m_spheres.begin()+first+count,
+                     [axis](const PTSphere& a, const PTSphere& b){return a.center[axis] < b.center[axis];});
+
+    uint32_t left = (uint32_t)m_nodes.size();
+    m_nodes.push_back(BVHNode());
+    m_nodes.push_back(BVHNode());
+    m_nodes[nodeID].leftOrFirst = left;
+    m_nodes[nodeID].count       = 0;
+    m_nodes[nodeID].axis        = (uint16_t)axis;
+
+    buildNode(left,   first,      half,       depth+1);
+    buildNode(left+1, first+half, count-half, depth+1);
+}
+
+void PathTracer::intersect(RayPacket& packet, int hitID[4]) const
+{
+    Float4 hit(-1.0f);
+    if(m_nodes.empty())
+    {
+        for(int i = 0; i < 4; i++) hitID[i] = -1;
+        return;
+    }
+
+    const Float4 one(1.0f);
+    Float4 idx = one / packet.dx, idy = one / packet.dy, idz = one / packet.dz;
+
+    uint32_t stack[PT_STACK_SIZE];
+    uint32_t stackSize = 0;
+    stack[stackSize++] = 0;
+
+    while(stackSize > 0)
+    {
+        const BVHNode& node = m_nodes[stack[--stackSize]];
+
+        /* Slab test of the 4 rays against the node box */
+        Float4 tx0 = (Float4(node.bmin[0]) - packet.ox) * idx, tx1 = (Float4(node.bmax[0]) - packet.ox) * idx;
+        Float4 ty0 = (Float4(node.bmin[1]) - packet.oy) * idy, ty1 = (Float4(node.bmax[1]) - packet.oy) * idy;
+        Float4 tz0 = (Float4(node.bmin[2]) - packet.oz) * idz, tz1 = (Float4(node.bmax[2]) - packet.oz) * idz;
+        Float4 tEnter = max(max(min(tx0, tx1), min(ty0, ty1)), max(min(tz0, tz1), Float4(0.0f)));
+        Float4 tExit  = min(min(max(tx0, tx1), max(ty0, ty1)), min(max(tz0, tz1), packet.tMax));
+        int hitBits = movemask((tEnter <= tExit) & packet.active);
+        if(hitBits == 0)
+            continue;
+
+        if(node.count == 0)
+        {
+            /* Visit first the child on the side the rays come from, seen from the first ray entering the node */
+            int lane = 0;
+            while((hitBits & (1 << lane)) == 0)
+                lane++;
+            float dir = packet.dx[lane];
+            if(node.axis == 1) dir = packet.dy[lane];
+            else if(node.axis == 2) dir = packet.dz[lane];
+            if(stackSize + 2 > PT_STACK_SIZE)
+                continue; /* Only with m_bvhDepth+1 > PT_STACK_SIZE, reported by setScene */
+            if(dir > 0.0f)
+            {
+                stack[stackSize++] = node.leftOrFirst+1;
+                stack[stackSize++] = node.leftOrFirst;
+            }
+            else
+            {
+                stack[stackSize++] = node.leftOrFirst;
+                stack[stackSize++] = node.leftOrFirst+1;
+            }
+            continue;
+        }
+
+        for(uint32_t i = node.leftOrFirst; i < node.leftOrFirst + node.count; i++)
+        {
+            const float* s = &m_sphereData[4*i];
+            Float4 ocx = packet.ox - Float4(s[0]);
+            Float4 ocy = packet.oy - Float4(s[1]);
+            Float4 ocz = packet.oz - Float4(s[2]);
+            Float4 b   = ocx*packet.dx + ocy*packet.dy + ocz*packet.dz;
+            Float4 c   = ocx*ocx + ocy*ocy + ocz*ocz - Float4(s[3]);
+            Float4 disc = b*b - c;
+            Float4 valid = (disc > Float4(0.0f)) & packet.active;
+            if(movemask(valid) == 0)
+                continue;
+            Float4 sq = sqrt(max(disc, Float4(0.0f)));
+            Float4 t0 = Float4(0.0f) - b - sq;
+            Float4 t1 = Float4(0.0f) - b + sq;
+            Float4 t  = select(t0 > Float4(PT_EPSILON), t0, t1);
+            valid = valid & (t > Float4(PT_EPSILON)) & (t < packet.tMax);
+            packet.tMax = select(valid, t, packet.tMax);
+            hit = select(valid, Float4((float)i), hit);
+        }
+    }
+
+    for(int i = 0; i < 4; i++)
+        hitID[i] = (int)hit[i];
+}
+
+Float4 PathTracer::occluded(const RayPacket& packet) const
+{
+    Float4 result(0.0f);
+    if(m_nodes.empty())
+        return result;
+
+    const Float4 one(1.0f);
+    Float4 idx = one / packet.dx, idy = one / packet.dy, idz = one / packet.dz;
+    int activeBits = movemask(packet.active);
+
+    uint32_t stack[PT_STACK_SIZE];
+    uint32_t stackSize = 0;
+    stack[stackSize++] = 0;
+
+    while(stackSize > 0)
+    {
+        const BVHNode& node = m_nodes[stack[--stackSize]];
+        Float4 pending = andNot(result, packet.active);
+
+        Float4 tx0 = (Float4(node.bmin[0]) - packet.ox) * idx, tx1 = (Float4(node.bmax[0]) - packet.ox) * idx;
+        Float4 ty0 = (Float4(node.bmin[1]) - packet.oy) * idy, ty1 = (Float4(node.bmax[1]) - packet.oy) * idy;
+        Float4 tz0 = (Float4(node.bmin[2]) - packet.oz) * idz, tz1 = (Float4(node.bmax[2]) - packet.oz) * idz;
+        Float4 tEnter = max(max(min(tx0, tx1), min(ty0, ty1)), max(min(tz0, tz1), Float4(0.0f)));
+        Float4 tExit  = min(min(max(tx0, tx1), max(ty0, ty1)), min(max(tz0, tz1), packet.tMax));
+        if(movemask((tEnter <= tExit) & pending) == 0)
+            continue;
+
+        if(node.count == 0)
+        {
+            if(stackSize + 2 > PT_STACK_SIZE)
+                continue; /* Only with m_bvhDepth+1 > PT_STACK_SIZE, reported by setScene */
+            stack[stackSize++] = node.leftOrFirst+1;
+            stack[stackSize++] = node.leftOrFirst;
+            continue;
+        }
+
+        for(uint32_t i = node.leftOrFirst; i < node.leftOrFirst + node.count; i++)
+        {
+            const float* s = &m_sphereData[4*i];
+            Float4 ocx = packet.ox - Float4(s[0]);
+            Float4 ocy = packet.oy - Float4(s[1]);
+            Float4 ocz = packet.oz - Float4(s[2]);
+            Float4 b   = ocx*packet.dx + ocy*packet.dy + ocz*packet.dz;
+            Float4 c   = ocx*ocx + ocy*ocy + ocz*ocz - Float4(s[3]);
+            Float4 disc = b*b - c;
+            Float4 sq = sqrt(max(disc, Float4(0.0f)));
+            Float4 t0 = Float4(0.0f) - b - sq;
+            Float4 t1 = Float4(0.0f) - b + sq;
+            Float4 t  = select(t0 > Float4(PT_EPSILON), t0, t1);
+            result = result | ((disc > Float4(0.0f)) & (t > Float4(PT_EPSILON)) & (t < packet.tMax) & pending);
+        }
+
+        /* Every ray of the packet is blocked: done */
+        if((movemask(result) & activeBits) == activeBits)
+            break;
+    }
+
+    return result;
+}
+
+glm::vec3 PathTracer::sampleTexture(const Image* texture, const glm::vec3& localDir) const
+{
+    /* Same parametrization as Sphere: pos = (sin(phi)sin(theta), cos(phi), cos(theta)sin(phi)), uv = (theta/2pi, phi/pi) */
+    glm::vec3 d = glm::normalize(localDir);
+    float theta = atan2f(d.x, d.z);
+    if(theta < 0.0f)
+        theta += 2.0f*(float)M_PI;
+    float phi = acosf(glm::clamp(d.y, -1.0f, 1.0f));
+    float u = theta / (2.0f*(float)M_PI);
+    float v = phi / (float)M_PI;
+
+    /* Bilinear filtering, repeat in u and clamp in v */
+    uint32_t w = texture->getWidth(), h = texture->getHeight();
+    float x = u*w - 0.5f, y = v*h - 0.5f;
+    float fx = floorf(x), fy = floorf(y);
+    float ax = x - fx, ay = y - fy;
+    int x0 = ((int)fx % (int)w + (int)w) % (int)w;
+    int x1 = (x0 + 1) % (int)w;
+    int y0 = glm::clamp((int)fy, 0, (int)h-1);
+    int y1 = glm::clamp((int)fy+1, 0, (int)h-1);
+
+    const uint8_t* p = texture->getPixels();
+    const uint8_t* p00 = p + 4*((uint64_t)y0*w + x0);
+    const uint8_t* p10 = p + 4*((uint64_t)y0*w + x1);
+    const uint8_t* p01 = p + 4*((uint64_t)y1*w + x0);
+    const uint8_t* p11 = p + 4*((uint64_t)y1*w + x1);
+
+    glm::vec3 result;
+    for(uint32_t k = 0; k < 3; k++)
+    {
+        float top    = m_srgbToLinear[p00[k]]*(1.0f-ax) + m_srgbToLinear[p10[k]]*ax;
+        float bottom = m_srgbToLinear[p01[k]]*(1.0f-ax) + m_srgbToLinear[p11[k]]*ax;
+        result[k] = top*(1.0f-ay) + bottom*ay;
+    }
+    return result;
+}
+
+void PathTracer::renderPass()
+{
+    uint32_t nbTilesX = (m_width  + PT_TILE_SIZE - 1) / PT_TILE_SIZE;
+    uint32_t nbTilesY = (m_height + PT_TILE_SIZE - 1) / PT_TILE_SIZE;
+    std::atomic<uint64_t> nbRays(0);
+
+    auto begin = std::chrono::high_resolution_clock::now();
+    JobSystem::get().parallelFor(nbTilesX*nbTilesY, 1, [&](uint32_t first, uint32_t last)
+    {
+        uint64_t rays = 0;
+        for(uint32_t tile = first; tile < last; tile++)
+            rays += renderTile(tile);
+        nbRays += rays;
+    });
+    auto end = std::chrono::high_resolution_clock::now();
+
+    m_nbPasses++;
+    m_lastNbRays = nbRays;
+    double seconds = std::chrono::duration<double>(end - begin).count();
+    m_lastRaysPerSecond = (seconds > 0.0) ? m_lastNbRays / seconds : 0.0;
+}
+
+uint64_t PathTracer::renderTile(uint32_t tileID)
+{
+    uint32_t nbTilesX = (m_width + PT_TILE_SIZE - 1) / PT_TILE_SIZE;
+    uint32_t x0 = (tileID % nbTilesX) * PT_TILE_SIZE;
+    uint32_t y0 = (tileID / nbTilesX) * PT_TILE_SIZE;
+    uint64_t nbRays = 0;
+
+    const float invNbLights = m_lights.empty() ? 0.0f : 1.0f / m_lights.size();
+
+    /* Each packet is a 2x2 block of pixels, one path per lane */
+    for(uint32_t py = y0; py < y0 + PT_TILE_SIZE && py < m_height; py += 2)
+    for(uint32_t px = x0; px < x0 + PT_TILE_SIZE && px < m_width;  px += 2)
+    {
+        glm::vec3 throughput[4], radiance[4], origin[4], dir[4];
+        bool      alive[4];
+        uint32_t  pixel[4];
+        PTRandom  rng[4] = {PTRandom(0), PTRandom(0), PTRandom(0), PTRandom(0)};
+
+        for(int l = 0; l < 4; l++)
+        {
+            uint32_t x = px + (l & 1), y = py + (l >> 1);
+            alive[l] = (x < m_width && y < m_height);
+            pixel[l] = alive[l] ? y*m_width + x : 0;
+            rng[l]   = PTRandom(pixel[l]*9781u + m_nbPasses*6271u + 1u);
+            throughput[l] = glm::vec3(1.0f);
+            radiance[l]   = glm::vec3(0.0f);
+
+            /* Jittered camera ray through the pixel */
+            float ndcX = 2.0f*(x + rng[l].next())/m_width - 1.0f;
+            float ndcY = 1.0f - 2.0f*(y + rng[l].next())/m_height;
+            glm::vec4 nearP = m_invViewProjection * glm::vec4(ndcX, ndcY, -1.0f, 1.0f);
+            glm::vec4 farP  = m_invViewProjection * glm::vec4(ndcX, ndcY,  1.0f, 1.0f);
+            origin[l] = m_cameraPosition;
+            dir[l]    = glm::normalize(glm::vec3(farP)/farP.w - glm::vec3(nearP)/nearP.w);
+        }
+
+        for(uint32_t depth = 0; depth <= m_maxDepth; depth++)
+        {
+            if(!(alive[0] || alive[1] || alive[2] || alive[3]))
+                break;
+
+            RayPacket packet;
+            float ox[4], oy[4], oz[4], dx[4], dy[4], dz[4], act[4];
+            for(int l = 0; l < 4; l++)
+            {
+                ox[l] = origin[l].x; oy[l] = origin[l].y; oz[l] = origin[l].z;
+                dx[l] = dir[l].x;    dy[l] = dir[l].y;    dz[l] = dir[l].z;
+                act[l] = alive[l] ? 1.0f : 0.0f;
+                if(alive[l])
+                    nbRays++;
+            }
+            packet.ox = Float4::load(ox); packet.oy = Float4::load(oy); packet.oz = Float4::load(oz);
+            packet.dx = Float4::load(dx); packet.dy = Float4::load(dy); packet.dz = Float4::load(dz);
+            packet.tMax   = Float4(INFINITY);
+            packet.active = Float4::load(act) > Float4(0.5f);
+
+            int hitID[4];
+            intersect(packet, hitID);
+            float tHit[4];
+            packet.tMax.store(tHit);
+
+            /* Shade each lane and prepare the shadow rays of next event estimation */
+            glm::vec3 shadowContribution[4];
+            float     sox[4] = {0}, soy[4] = {0}, soz[4] = {0}, sdx[4] = {0}, sdy[4] = {0}, sdz[4] = {1, 1, 1, 1}, stMax[4] = {0}, sact[4] = {0};
+            for(int l = 0; l < 4; l++)
+            {
+                shadowContribution[l] = glm::vec3(0.0f);
+                if(!alive[l])
+                    continue;
+
+                if(hitID[l] < 0)
+                {
+                    if(m_environment)
+                        radiance[l] += throughput[l] * m_environmentScale * sampleTexture(m_environment, dir[l]);
+                    alive[l] = false;
+                    continue;
+                }
+
+                const PTSphere& sphere = m_spheres[hitID[l]];
+                glm::vec3 p = origin[l] + tHit[l]*dir[l];
+                glm::vec3 n = (p - sphere.center) / sphere.radius;
+                glm::vec3 texColor = sphere.texture ? sampleTexture(sphere.texture, sphere.worldToLocal*(p - sphere.center)) : glm::vec3(1.0f);
+
+                /* Lights are only visible directly: their contribution after a bounce is handled by next event estimation */
+                if(sphere.emission != glm::vec3(0.0f))
+                {
+                    if(depth == 0)
+                        radiance[l] += throughput[l] * sphere.emission * texColor;
+                    alive[l] = false;
+                    continue;
+                }
+
+                glm::vec3 albedo = sphere.albedo * texColor;
+
+                /* Next event estimation: uniformly pick a star and sample the cone it subtends */
+                if(!m_lights.empty())
+                {
+                    uint32_t lightID = m_lights[std::min((uint32_t)(rng[l].next()*m_lights.size()), (uint32_t)m_lights.size()-1)];
+                    const PTSphere& light = m_spheres[lightID];
+                    glm::vec3 toLight = light.center - p;
+                    float dist2 = glm::dot(toLight, toLight);
+                    if(dist2 > light.radius*light.radius)
+                    {
+                        float dist = sqrtf(dist2);
+                        glm::vec3 w = toLight / dist;
+                        float cosMax = sqrtf(std::max(0.0f, 1.0f - light.radius*light.radius/dist2));
+                        float cosT = 1.0f - rng[l].next()*(1.0f - cosMax);
+                        float sinT = sqrtf(std::max(0.0f, 1.0f - cosT*cosT));
+                        float angle = 2.0f*(float)M_PI*rng[l].next();
+                        glm::vec3 t, b;
+                        makeBasis(w, t, b);
+                        glm::vec3 wi = glm::normalize(cosf(angle)*sinT*t + sinf(angle)*sinT*b + cosT*w);
+                        float cosSurface = glm::dot(n, wi);
+                        if(cosSurface > 0.0f)
+                        {
+                            /* Distance to the light surface along wi */
+                            glm::vec3 oc = p - light.center;
+                            float bq = glm::dot(oc, wi);
+                            float cq = glm::dot(oc, oc) - light.radius*light.radius;
+                            float tl = -bq - sqrtf(std::max(0.0f, bq*bq - cq));
+                            glm::vec3 lightPoint = p + tl*wi;
+                            glm::vec3 le = light.emission * (light.texture ? sampleTexture(light.texture, light.worldToLocal*(lightPoint - light.center)) : glm::vec3(1.0f));
+                            float pdf = 1.0f / (2.0f*(float)M_PI*(1.0f - cosMax));
+
+                            shadowContribution[l] = throughput[l] * albedo * (float)M_1_PI * le * cosSurface / (pdf * invNbLights);
+                            glm::vec3 so = p + n*PT_EPSILON*10.0f;
+                            sox[l] = so.x; soy[l] = so.y; soz[l] = so.z;
+                            sdx[l] = wi.x; sdy[l] = wi.y; sdz[l] = wi.z;
+                            stMax[l] = tl*(1.0f - 1e-3f);
+                            sact[l]  = 1.0f;
+                        }
+                    }
+                }
+
+                /* Cosine weighted bounce: the cosine and pdf cancel with the 1/pi of the Lambertian BRDF */
+                throughput[l] *= albedo;
+                if(depth >= 2)
+                {
+                    float survive = glm::clamp(std::max(throughput[l].x, std::max(throughput[l].y, throughput[l].z)), 0.05f, 0.95f);
+                    if(rng[l].next() > survive)
+                    {
+                        alive[l] = false;
+                        continue;
+                    }
+                    throughput[l] /= survive;
+                }
+                float r1 = rng[l].next(), r2 = rng[l].next();
+                float sr = sqrtf(r1), angle = 2.0f*(float)M_PI*r2;
+                glm::vec3 t, b;
+                makeBasis(n, t, b);
+                origin[l] = p + n*PT_EPSILON*10.0f;
+                dir[l]    = glm::normalize(sr*cosf(angle)*t + sr*sinf(angle)*b + sqrtf(std::max(0.0f, 1.0f - r1))*n);
+            }
+
+            /* Trace the 4 shadow rays together */
+            if(sact[0] + sact[1] + sact[2] + sact[3] > 0.0f)
+            {
+                RayPacket shadow;
+                shadow.ox = Float4::load(sox); shadow.oy = Float4::load(soy); shadow.oz = Float4::load(soz);
+                shadow.dx = Float4::load(sdx); shadow.dy = Float4::load(sdy); shadow.dz = Float4::load(sdz);
+                shadow.tMax   = Float4::load(stMax);
+                shadow.active = Float4::load(sact) > Float4(0.5f);
+                int blocked = movemask(occluded(shadow));
+                for(int l = 0; l < 4; l++)
+                {
+                    if(sact[l] > 0.5f)
+                    {
+                        nbRays++;
+                        if(!(blocked & (1 << l)))
+                            radiance[l] += shadowContribution[l];
+                    }
+                }
+            }
+        }
+
+        for(int l = 0; l < 4; l++)
+        {
+            uint32_t x = px + (l & 1), y = py + (l >> 1);
+            if(x < m_width && y < m_height)
+                m_accumulation[pixel[l]] += radiance[l];
+        }
+    }
+
+    return nbRays;
+}
+
+bool PathTracer::saveToPPM(const char* path) const
+{
+    FILE* file = fopen(path, "wb");
+    if(file == NULL)
+    {
+        ERROR("Could not open %s for writing\n", path);
+        return false;
+    }
+
+    fprintf(file, "P6\n%u %u\n255\n", m_width, m_height);
+    std::vector<uint8_t> row(3*m_width);
+    float invNbPasses = m_nbPasses ? 1.0f / m_nbPasses : 0.0f;
+    for(uint32_t y = 0; y < m_height; y++)
+    {
+        for(uint32_t x = 0; x < m_width; x++)
+        {
+            glm::vec3 c = m_accumulation[(size_t)y*m_width + x] * invNbPasses;
+            for(uint32_t k = 0; k < 3; k++)
+            {
+                /* Exponential tone mapping then sRGB encoding */
+                float v = 1.0f - expf(-c[k]);
+                v = (v <= 0.0031308f) ? 12.92f*v : 1.055f*powf(v, 1.0f/2.4f) - 0.055f;
+                row[3*x+k] = (uint8_t)glm::clamp(v*255.0f + 0.5f, 0.0f, 255.0f);
+            }
+        }
+        fwrite(row.data(), 1, row.size(), file);
+    }
+
+    fclose(file);
+    return true;
+}
@@ -0,0 +1,267 @@
+#include "PlanetRings.h"
+#include "logger.h"
+#include "JobSystem.h"
+#include "Hash.h"
+#include "FrameArena.h"
+
+#include <chrono>
+#include <cmath>
+#include <algorithm>
+#include <glm/gtc/type_ptr.hpp>
+
+/* Draws of the random generator per particle */
+#define RINGS_RANDOM_DRAWS 16
+/* Cells per job of the particle generation */
+#define RINGS_CELLS_PER_JOB 64
+
+/* \brief Random number of a particle. The same cell gives back the same particles at every frame
+ * \param cellHash the hash of the cell of the particle and of the ring seed
+ * \param particle the particle in the cell
+ * \param draw which number of this particle, below RINGS_RANDOM_DRAWS
+ * \return a number in [0, 1) */
+static float random01(uint32_t cellHash, uint32_t particle, uint32_t draw)
+{
+    return (hashInteger(cellHash ^ (particle * RINGS_RANDOM_DRAWS + draw)) >> 8) * (1.0f / 16777216.0f);
+}
+
+PlanetRings::~PlanetRings()
+{
+    glDeleteTextures(1, &m_opacityID);
+    delete m_shader;
+}
+
+PlanetRings* PlanetRings::create(const RingParameters& params, const Image& opacity)
+{
+    FILE* vert = fopen("Shaders/rings.vert", "r");
+    FILE* frag = fopen("Shaders/rings.frag", "r");
+    if(vert == NULL || frag == NULL)
+    {
+        ERROR("Could not open the ring shaders\n");
+        if(vert) fclose(vert);
+        if(frag) fclose(frag);
+        return NULL;
+    }
+    Shader* shader = Shader::loadFromFiles(vert, frag);
+    fclose(vert);
+    fclose(frag);
+    if(shader == NULL)
+        return NULL;
+
+    PlanetRings* rings = new PlanetRings();
+    rings->m_params = params;
+    rings->m_shader = shader;
+
+    /* The image only varies along the radius : one row, the average of its rows */
+    uint32_t width = opacity.getWidth();
+    rings->m_opacity.assign(width, 0.0f);
+    const uint8_t* pixels = opacity.getPixels();
+    for(uint32_t y = 0; y < opacity.getHeight(); y++)
+        for(uint32_t x = 0; x < width; x++)
+            rings->m_opacity[x] += pixels[(y * width + x) * 4 + 3];
+    for(float& alpha : rings->m_opacity)
+        alpha /= 255.0f * opacity.getHeight();
+
+    /* Single channel texture, its mips averaged two texels at a time */
+    std::vector<uint8_t> level(width);
+    for(uint32_t x = 0; x < width; x++)
+        level[x] = (uint8_t)(rings->m_opacity[x] * 255.0f + 0.5f);
+
+    glGenTextures(1, &rings->m_opacityID);
+    glBindTexture(GL_TEXTURE_2D, rings->m_opacityID);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    /* The rings are mostly seen at grazing angles, where only the radius varies quickly on screen */
+    if(GLEW_EXT_texture_filter_anisotropic)
+    {
+        GLfloat maxAnisotropy = 1.0f;
+        glGetFloatv(GL_MAX_TEXTURE_MAX_ANISOTROPY_EXT, &maxAnisotropy);
+        glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAX_ANISOTROPY_EXT, maxAnisotropy);
+    }
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    for(GLint mip = 0; ; mip++)
+    {
+        glTexImage2D(GL_TEXTURE_2D, mip, GL_R8, (GLsizei)level.size(), 1, 0, GL_RED, GL_UNSIGNED_BYTE, level.data());
+        if(level.size() == 1)
+            break;
+        /* An odd width keeps its last texel, averaged with itself, so that the outer edge stays in place */
+        size_t size = (level.size() + 1) / 2;
+        for(size_t x = 0; x < size; x++)
+            level[x] = (uint8_t)((level[2 * x] + level[std::min(2 * x + 1, level.size() - 1)] + 1) / 2);
+        level.resize(size);
+    }
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    return rings;
+}
+
+float PlanetRings::getOpacity(float radius) const
+{
+    float u = (radius - m_params.innerRadius) / (m_params.outerRadius - m_params.innerRadius);
+    if(u < 0.0f || u >= 1.0f)
+        return 0.0f;
+    return m_opacity[(size_t)(u * m_opacity.size())];
+}
+
+void PlanetRings::generateParticles(const glm::vec2& center, float lod, double t)
+{
+    auto begin = std::chrono::high_resolution_clock::now();
+    m_particles.clear();
+
+    const RingParameters& p = m_params;
+    float range     = p.particleRange;
+    float footRho   = glm::length(center);
+    float angle     = std::atan2(center.y, center.x);
+    int32_t nbBands = (int32_t)std::ceil((p.outerRadius - p.innerRadius) / p.cellSize);
+    int32_t firstBand = std::max((int32_t)std::floor((footRho - range - p.innerRadius) / p.cellSize), 0);
+    int32_t lastBand  = std::min((int32_t)std::floor((footRho + range - p.innerRadius) / p.cellSize), nbBands - 1);
+
+    /* The cells in reach, with their band and the angle the band has turned by. Then the fraction of the particles kept :
+     * the square of the level of detail, less if the opacity of these cells would give more than maxParticles */
+    struct Cell {uint32_t hash; float radius; float angle; float cellAngle; float opacity;};
+    FrameVector<Cell> cells;
+    float expected = 0.0f;
+    for(int32_t band = firstBand; band <= lastBand; band++)
+    {
+        float radius     = p.innerRadius + (band + 0.5f) * p.cellSize;
+        uint32_t nbCells = std::max((uint32_t)(2.0f * (float)M_PI * radius / p.cellSize), 3u);
+        float cellAngle  = 2.0f * (float)M_PI / nbCells;
+        double turned    = std::fmod(p.angularSpeed * std::pow(radius, -1.5) * t, 2.0 * M_PI);
+        float relative   = angle - (float)turned;
+        float halfSpan   = std::min((range + p.cellSize) / radius, (float)M_PI);
+        int32_t first    = (int32_t)std::floor((relative - halfSpan) / cellAngle);
+        int32_t last     = std::min((int32_t)std::floor((relative + halfSpan) / cellAngle), first + (int32_t)nbCells - 1);
+        float opacity    = getOpacity(radius);
+        if(opacity <= 0.0f)
+            continue;
+        for(int32_t c = first; c <= last; c++)
+        {
+            uint32_t wrapped = (uint32_t)(((c % (int32_t)nbCells) + (int32_t)nbCells) % (int32_t)nbCells);
+            cells.push_back({hashInteger(p.seed ^ hashInteger((uint32_t)band * 65536u + wrapped)), radius, (float)turned + wrapped * cellAngle, cellAngle, opacity});
+            expected += opacity;
+        }
+    }
+    expected *= RINGS_PARTICLES_PER_CELL;
+    float keep = std::min(lod * lod, expected > 0.0f ? p.maxParticles / expected : 0.0f);
+
+    /* The cells are split between the job threads, each group written in its own list */
+    float sizeRatio = std::pow(p.minParticleSize / p.maxParticleSize, 2.5f);
+    uint32_t nbGroups = (uint32_t)(cells.size() + RINGS_CELLS_PER_JOB - 1) / RINGS_CELLS_PER_JOB;
+    if(m_groups.size() < nbGroups)
+        m_groups.resize(nbGroups);
+    JobSystem::get().parallelFor(nbGroups, 1, [&](uint32_t firstGroup, uint32_t lastGroup)
+    {
+        for(uint32_t group = firstGroup; group < lastGroup; group++)
+        {
+            std::vector<AsteroidInstance>& particles = m_groups[group];
+            particles.clear();
+            uint32_t lastCell = std::min((group + 1) * RINGS_CELLS_PER_JOB, (uint32_t)cells.size());
+            for(uint32_t c = group * RINGS_CELLS_PER_JOB; c < lastCell; c++)
+            {
+                const Cell& cell = cells[c];
+                for(uint32_t i = 0; i < RINGS_PARTICLES_PER_CELL; i++)
+                {
+                    /* Same particles at every frame, more of them as keep grows */
+                    if(random01(cell.hash, i, 0) >= cell.opacity * keep)
+                        continue;
+                    float u[RINGS_RANDOM_DRAWS];
+                    u[1] = random01(cell.hash, i, 1);
+                    u[2] = random01(cell.hash, i, 2);
+                    float radius = cell.radius + (u[1] - 0.5f) * p.cellSize;
+                    float theta  = cell.angle + u[2] * cell.cellAngle;
+                    glm::vec2 planar(radius * std::cos(theta), radius * std::sin(theta));
+
+                    /* The particles shrink to nothing at the edge of the disk instead of popping */
+                    float distance = glm::length(planar - center);
+                    if(distance > range)
+                        continue;
+                    for(uint32_t k = 3; k < RINGS_RANDOM_DRAWS; k++)
+                        u[k] = random01(cell.hash, i, k);
+                    glm::vec3 position(planar.x, (u[3] + u[4] - 1.0f) * p.thickness, planar.y);
+                    float edge = glm::clamp((range - distance) / (0.2f * range), 0.0f, 1.0f);
+                    float size = p.minParticleSize * std::pow(1.0f - u[5] * (1.0f - sizeRatio), -1.0f / 2.5f);
+
+                    float z = 2.0f * u[6] - 1.0f;
+                    float phi = 2.0f * (float)M_PI * u[7];
+                    float axisRadius = std::sqrt(1.0f - z * z);
+                    double spin = (u[8] - 0.5) * 4.0;
+
+                    AsteroidInstance particle;
+                    particle.positionSize = glm::vec4(position, size * edge);
+                    particle.rotation = glm::vec4(axisRadius * std::cos(phi), z, axisRadius * std::sin(phi), (float)std::fmod(2.0 * M_PI * u[9] + spin * t, 2.0 * M_PI));
+                    particle.shape = glm::vec4(0.7f + 0.6f * u[10], 0.6f + 0.4f * u[11], 0.7f + 0.6f * u[12], 0.8f + 0.2f * u[13]);
+                    particles.push_back(particle);
+                }
+            }
+        }
+    });
+
+    for(uint32_t group = 0; group < nbGroups; group++)
+        m_particles.insert(m_particles.end(), m_groups[group].begin(), m_groups[group].begin() + std::min(m_groups[group].size(), p.maxParticles - m_particles.size()));
+
+    m_lastParticleTime = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - begin).count();
+}
+
+void PlanetRings::draw(const glm::vec3& center, float planetRadius, const glm::mat3& orientation, const glm::vec3& sunPosition, double t,
+                       const glm::mat4& view, const glm::mat4& projection, const DepthBuffer* depthBuffer)
+{
+    /* Distance from the camera to the annulus, in planet radii. The particles are around the point of the rings closest to the camera */
+    glm::vec3 camera = glm::transpose(orientation) * (-center) / planetRadius;
+    float rho = std::max(std::sqrt(camera.x * camera.x + camera.z * camera.z), 1e-6f);
+    float footRho = glm::clamp(rho, m_params.innerRadius, m_params.outerRadius);
+    glm::vec2 foot = glm::vec2(camera.x, camera.z) * (footRho / rho);
+    float lod = 1.0f - glm::length(glm::vec2(rho - footRho, camera.y)) / m_params.particleDistance;
+
+    /* Close : opaque particles first, the annulus is then blended over them */
+    m_instances.clear();
+    if(lod > 0.0f && m_particleRenderer != nullptr)
+    {
+        generateParticles(foot, lod, t);
+        glm::mat3 toCamera = glm::mat3(view);
+        for(const AsteroidInstance& particle : m_particles)
+        {
+            AsteroidInstance instance;
+            glm::vec3 position = center + orientation * glm::vec3(particle.positionSize) * planetRadius;
+            float size = particle.positionSize.w * planetRadius;
+            if((toCamera * position).z > size)
+                continue;
+            instance.positionSize = glm::vec4(position, size);
+            instance.rotation = glm::vec4(orientation * glm::vec3(particle.rotation), particle.rotation.w);
+            instance.shape = particle.shape;
+            m_instances.push_back(instance);
+        }
+        m_particleRenderer->draw(m_instances, std::vector<glm::vec4>(), m_particleTexture, sunPosition, view, projection, depthBuffer);
+    }
+    else
+        m_particles.clear();
+
+    GLuint programID = m_shader->getProgramID();
+    glUseProgram(programID);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, m_opacityID);
+    glUniform1i(glGetUniformLocation(programID, "uOpacity"), 0);
+    glUniform4f(glGetUniformLocation(programID, "uPlanet"), center.x, center.y, center.z, planetRadius);
+    glUniformMatrix3fv(glGetUniformLocation(programID, "uOrientation"), 1, GL_FALSE, glm::value_ptr(orientation));
+    glUniform2f(glGetUniformLocation(programID, "uRadii"), m_params.innerRadius, m_params.outerRadius);
+    glUniform1i(glGetUniformLocation(programID, "uNbSegments"), (GLint)m_params.nbSegments);
+    glUniform3fv(glGetUniformLocation(programID, "uColor"), 1, glm::value_ptr(m_params.color));
+    glUniform3fv(glGetUniformLocation(programID, "uSunPosition"), 1, glm::value_ptr(sunPosition));
+    glUniform2fv(glGetUniformLocation(programID, "uParticleCenter"), 1, glm::value_ptr(foot));
+    glUniform2f(glGetUniformLocation(programID, "uParticleFade"), m_instances.empty() ? 0.0f : lod, m_params.particleRange);
+    glUniformMatrix4fv(glGetUniformLocation(programID, "uView"), 1, GL_FALSE, glm::value_ptr(view));
+    glUniformMatrix4fv(glGetUniformLocation(programID, "uProjection"), 1, GL_FALSE, glm::value_ptr(projection));
+    glUniform1f(glGetUniformLocation(programID, "uLogDepthScale"), 0.0f);
+    if(depthBuffer != nullptr)
+        depthBuffer->bind(m_shader);
+
+    /* Seen from both sides. The depth is tested, not written. The strip has no vertex array : the ones of the bodies are off after their draw */
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    glDepthMask(GL_FALSE);
+    glDrawArrays(GL_TRIANGLE_STRIP, 0, 2 * (m_params.nbSegments + 1));
+    glDepthMask(GL_TRUE);
+    glDisable(GL_BLEND);
+    glUseProgram(0);
+}
@@ -0,0 +1,83 @@
+#include "Rock.h"
+#include <cmath>
+#include <cstdlib>
+#include <vector>
+
+/* Random bumps dented in the sphere */
+#define ROCK_NB_BUMPS 12
+
+/* \brief Radius of the rock in a direction. A function of the direction only, so that the faces sharing a vertex agree on it */
+static float rockRadius(const glm::vec3& direction, const glm::vec3* bumps, const float* depths)
+{
+    float radius = 0.5f;
+    for(uint32_t i = 0; i < ROCK_NB_BUMPS; i++)
+    {
+        float d = glm::max(glm::dot(direction, bumps[i]), 0.0f);
+        radius -= depths[i] * d * d * d * d;
+    }
+    return radius;
+}
+
+Rock::Rock(uint32_t seed, uint32_t nbSubdivisions)
+{
+    /* Icosahedron */
+    const float g = 0.5f * (1.0f + std::sqrt(5.0f));
+    std::vector<glm::vec3> triangles;
+    const glm::vec3 corners[12] = {{-1, g, 0}, {1, g, 0}, {-1, -g, 0}, {1, -g, 0}, {0, -1, g}, {0, 1, g},
+                                   {0, -1, -g}, {0, 1, -g}, {g, 0, -1}, {g, 0, 1}, {-g, 0, -1}, {-g, 0, 1}};
+    const uint32_t faces[20][3] = {{0, 11, 5}, {0, 5, 1}, {0, 1, 7}, {0, 7, 10}, {0, 10, 11}, {1, 5, 9}, {5, 11, 4}, {11, 10, 2}, {10, 7, 6}, {7, 1, 8},
+                                   {3, 9, 4}, {3, 4, 2}, {3, 2, 6}, {3, 6, 8}, {3, 8, 9}, {4, 9, 5}, {2, 4, 11}, {6, 2, 10}, {8, 6, 7}, {9, 8, 1}};
+    for(uint32_t f = 0; f < 20; f++)
+        for(uint32_t k = 0; k < 3; k++)
+            triangles.push_back(glm::normalize(corners[faces[f][k]]));
+
+    /* Each subdivision splits a triangle in 4 at the middle of its edges, pushed back on the sphere */
+    for(uint32_t s = 0; s < nbSubdivisions; s++)
+    {
+        std::vector<glm::vec3> split;
+        for(size_t t = 0; t < triangles.size(); t += 3)
+        {
+            glm::vec3 a = triangles[t], b = triangles[t+1], c = triangles[t+2];
+            glm::vec3 ab = glm::normalize(a + b), bc = glm::normalize(b + c), ca = glm::normalize(c + a);
+            const glm::vec3 children[12] = {a, ab, ca, ab, b, bc, ca, bc, c, ab, bc, ca};
+            split.insert(split.end(), children, children + 12);
+        }
+        triangles.swap(split);
+    }
+
+    srand(seed);
+    glm::vec3 bumps[ROCK_NB_BUMPS];
+    float depths[ROCK_NB_BUMPS];
+    for(uint32_t i = 0; i < ROCK_NB_BUMPS; i++)
+    {
+        float z = rand() / (float)RAND_MAX * 2.0f - 1.0f;
+        float angle = rand() / (float)RAND_MAX * 2.0f * (float)M_PI;
+        bumps[i] = glm::vec3(std::sqrt(1.0f - z * z) * std::cos(angle), z, std::sqrt(1.0f - z * z) * std::sin(angle));
+        depths[i] = 0.03f + rand() / (float)RAND_MAX * 0.07f;
+    }
+
+    allocate((uint32_t)triangles.size());
+    float* vertices = editVertices();
+    float* normals  = editNormals();
+    float* uvs      = editUVs();
+    for(uint32_t t = 0; t < m_nbVertices; t += 3)
+    {
+        glm::vec3 positions[3];
+        for(uint32_t k = 0; k < 3; k++)
+            positions[k] = triangles[t+k] * rockRadius(triangles[t+k], bumps, depths);
+        glm::vec3 normal = glm::normalize(glm::cross(positions[1] - positions[0], positions[2] - positions[0]));
+        for(uint32_t k = 0; k < 3; k++)
+        {
+            uint32_t v = t + k;
+            const glm::vec3& direction = triangles[v];
+            for(uint32_t i = 0; i < 3; i++)
+            {
+                vertices[3*v+i] = positions[k][i];
+                normals [3*v+i] = normal[i];
+            }
+            /* Same mapping as Sphere : theta from +Z towards +X, phi from +Y */
+            uvs[2*v]   = (float)(std::atan2(direction.x, direction.z) / (2.0 * M_PI) + 0.5);
+            uvs[2*v+1] = (float)(std::acos(glm::clamp(direction.y, -1.0f, 1.0f)) / M_PI);
+        }
+    }
+}
@@ -0,0 +1,532 @@
+#include "Scene.h"
+#include "logger.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <unordered_map>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#define SCENE_FILE_MAGIC   0x4E435347 /* "GSCN" */
+#define SCENE_FILE_VERSION 1
+
+/* \brief Header of the binary scenes. The textures, the bodies and the strings follow it */
+struct SceneFileHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t nbTextures;
+    uint32_t nbBodies;
+    uint32_t stringsSize;
+    uint32_t padding;
+};
+
+static const float POWERS_OF_TEN[] = {1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f, 1e6f, 1e7f, 1e8f, 1e9f, 1e10f};
+
+/* \brief Parse a decimal number, "-1.5" or "2e-3". The digits are gathered in an integer, then scaled once
+ * \return the character after the number, NULL if there is none */
+static const char* parseNumber(const char* p, const char* end, float& value)
+{
+    bool negative = false;
+    if(p < end && (*p == '-' || *p == '+'))
+        negative = *p++ == '-';
+
+    uint64_t mantissa = 0;
+    int32_t  exponent = 0;
+    uint32_t nbDigits = 0;
+    for(; p < end && *p >= '0' && *p <= '9'; p++, nbDigits++)
+    {
+        if(mantissa < 100000000000000000ull)
+            mantissa = mantissa * 10 + (*p - '0');
+        else
+            exponent++;
+    }
+    if(p < end && *p == '.')
+    {
+        for(p++; p < end && *p >= '0' && *p <= '9'; p++, nbDigits++)
+        {
+            if(mantissa < 100000000000000000ull)
+            {
+                mantissa = mantissa * 10 + (*p - '0');
+                exponent--;
+            }
+        }
+    }
+    if(nbDigits == 0)
+        return nullptr;
+    if(p < end && (*p == 'e' || *p == 'E'))
+    {
+        const char* q = p + 1;
+        bool negativeExponent = false;
+        if(q < end && (*q == '-' || *q == '+'))
+            negativeExponent = *q++ == '-';
+        int32_t e = 0;
+        const char* digits = q;
+        for(; q < end && *q >= '0' && *q <= '9'; q++)
+            e = std::min(e * 10 + (*q - '0'), 100);
+        if(q > digits)
+        {
+            exponent += negativeExponent ? -e : e;
+            p = q;
+        }
+    }
+
+    double result = (double)mantissa;
+    for(; exponent < -10; exponent += 10)
+        result /= 1e10;
+    for(; exponent > 10; exponent -= 10)
+        result *= 1e10;
+    result = exponent < 0 ? result / POWERS_OF_TEN[-exponent] : result * POWERS_OF_TEN[exponent];
+    value  = (float)(negative ? -result : result);
+    return p;
+}
+
+/* \brief Parse "count" numbers separated by commas, filling the whole value. A single number is repeated : size=0.3 is size=0.3,0.3,0.3
+ * \return true if the value is made of 1 or "count" numbers */
+static bool parseNumbers(const char* p, const char* end, float* values, uint32_t count)
+{
+    uint32_t nbParsed = 0;
+    while(nbParsed < count)
+    {
+        p = parseNumber(p, end, values[nbParsed++]);
+        if(p == nullptr)
+            return false;
+        if(p == end)
+            break;
+        if(*p != ',')
+            return false;
+        p++;
+    }
+    if(p != end)
+        return false;
+    if(nbParsed == 1)
+        for(uint32_t i = 1; i < count; i++)
+            values[i] = values[0];
+    return nbParsed == 1 || nbParsed == count;
+}
+
+/* \brief Cut the next token of a line, up to a blank
+ * \return false at the end of the line */
+static bool nextToken(const char*& p, const char* end, const char*& tokenBegin, const char*& tokenEnd)
+{
+    while(p < end && (*p == ' ' || *p == '\t' || *p == '\r'))
+        p++;
+    if(p == end)
+        return false;
+    tokenBegin = p;
+    while(p < end && *p != ' ' && *p != '\t' && *p != '\r')
+        p++;
+    tokenEnd = p;
+    return true;
+}
+
+static bool tokenIs(const char* begin, const char* end, const char* word)
+{
+    size_t length = strlen(word);
+    return (size_t)(end - begin) == length && memcmp(begin, word, length) == 0;
+}
+
+/* \brief The state of a text scene being parsed */
+struct SceneParser
+{
+    const char*                              path;
+    uint32_t                                 lineNumber = 0;
+    std::vector<SceneTexture>&               textures;
+    std::vector<SceneBody>&                  bodies;
+    std::vector<char>&                       strings;
+    std::unordered_map<std::string, int32_t> textureIDs;
+    std::unordered_map<std::string, int32_t> bodyIDs;
+    std::string                              key; /*!< Kept between the lookups, so that they do not allocate*/
+
+    SceneParser(const char* path, std::vector<SceneTexture>& textures, std::vector<SceneBody>& bodies, std::vector<char>& strings) :
+        path(path), textures(textures), bodies(bodies), strings(strings) {}
+
+    /* \brief Append a string to the string table
+     * \return its offset */
+    uint32_t addString(const char* begin, const char* end)
+    {
+        uint32_t offset = (uint32_t)strings.size();
+        strings.insert(strings.end(), begin, end);
+        strings.push_back('\0');
+        return offset;
+    }
+
+    /* \brief Find a name in a map
+     * \return its index, -1 if absent */
+    int32_t find(const std::unordered_map<std::string, int32_t>& ids, const char* begin, const char* end)
+    {
+        key.assign(begin, end);
+        auto found = ids.find(key);
+        return found == ids.end() ? -1 : found->second;
+    }
+
+    bool parseTexture(const char* p, const char* end);
+    bool parseBody(const char* p, const char* end);
+    bool parseKey(SceneBody& body, const char* key, const char* keyEnd, const char* value, const char* valueEnd);
+};
+
+bool SceneParser::parseTexture(const char* p, const char* end)
+{
+    const char* name;
+    const char* nameEnd;
+    const char* texturePath;
+    const char* texturePathEnd;
+    if(!nextToken(p, end, name, nameEnd) || !nextToken(p, end, texturePath, texturePathEnd))
+    {
+        ERROR("Line %u of %s : a texture needs a name and a path\n", lineNumber, path);
+        return false;
+    }
+    SceneTexture texture;
+    texture.name = addString(name, nameEnd);
+    texture.path = addString(texturePath, texturePathEnd);
+    textureIDs[std::string(name, nameEnd)] = (int32_t)textures.size();
+    textures.push_back(texture);
+    return true;
+}
+
+bool SceneParser::parseBody(const char* p, const char* end)
+{
+    const char* name;
+    const char* nameEnd;
+    const char* parent;
+    const char* parentEnd;
+    if(!nextToken(p, end, name, nameEnd) || !nextToken(p, end, parent, parentEnd))
+    {
+        ERROR("Line %u of %s : a body needs a name and a parent\n", lineNumber, path);
+        return false;
+    }
+
+    SceneBody body;
+    body.name        = addString(name, nameEnd);
+    body.parent      = tokenIs(parent, parentEnd, "-") ? -1 : find(bodyIDs, parent, parentEnd);
+    body.texture     = -1;
+    body.color       = glm::vec3(0.0f);
+    body.ka          = 0.2f;
+    body.kd          = 0.8f;
+    body.ks          = 0.0f;
+    body.alpha       = 1.0f;
+    body.sky         = 0;
+    body.light       = 0;
+    body.lit         = 0;
+    body.hasOrbit    = 0;
+    body.orbit       = KeplerElements();
+    body.spin        = 0.0f;
+    body.tilt        = 0.0f;
+    body.size        = glm::vec3(1.0f);
+    body.atmosphere  = SCENE_ATMOSPHERE_NONE;
+    body.rings       = 0;
+    body.ephemerisID = -1;
+    if(bodies.empty() != (body.parent < 0))
+    {
+        if(bodies.empty())
+            ERROR("Line %u of %s : the first body is the root, its parent is -\n", lineNumber, path);
+        else
+            ERROR("Line %u of %s : the parent of %.*s is not a body declared before\n", lineNumber, path, (int)(nameEnd - name), name);
+        return false;
+    }
+
+    const char* token;
+    const char* tokenEnd;
+    while(nextToken(p, end, token, tokenEnd))
+    {
+        const char* equal = (const char*)memchr(token, '=', tokenEnd - token);
+        const char* keyEnd = equal != nullptr ? equal : tokenEnd;
+        const char* value  = equal != nullptr ? equal + 1 : tokenEnd;
+        if(!parseKey(body, token, keyEnd, value, tokenEnd))
+            WARNING("Line %u of %s : %.*s is not understood, skipped\n", lineNumber, path, (int)(tokenEnd - token), token);
+    }
+    bodyIDs[std::string(name, nameEnd)] = (int32_t)bodies.size();
+    bodies.push_back(body);
+    return true;
+}
+
+bool SceneParser::parseKey(SceneBody& body, const char* key, const char* keyEnd, const char* value, const char* valueEnd)
+{
+    if(tokenIs(key, keyEnd, "sky"))
+    {
+        body.sky = 1;
+        return value == valueEnd;
+    }
+    if(tokenIs(key, keyEnd, "texture"))
+    {
+        body.texture = find(textureIDs, value, valueEnd);
+        if(body.texture < 0)
+            WARNING("Line %u of %s : the texture %.*s is not declared before\n", lineNumber, path, (int)(valueEnd - value), value);
+        return true;
+    }
+    if(tokenIs(key, keyEnd, "rings"))
+    {
+        body.rings = addString(value, valueEnd);
+        return value != valueEnd;
+    }
+    if(tokenIs(key, keyEnd, "atmosphere"))
+    {
+        if(tokenIs(value, valueEnd, "earth"))
+            body.atmosphere = SCENE_ATMOSPHERE_EARTH;
+        else if(tokenIs(value, valueEnd, "haze"))
+            body.atmosphere = SCENE_ATMOSPHERE_HAZE;
+        else
+            return false;
+        return true;
+    }
+    if(tokenIs(key, keyEnd, "orbit"))
+    {
+        float elements[7];
+        if(!parseNumbers(value, valueEnd, elements, 7) || std::count(value, valueEnd, ',') != 6)
+            return false;
+        body.orbit    = KeplerElements{elements[0], elements[1], elements[2], elements[3], elements[4], elements[5], elements[6]};
+        body.hasOrbit = 1;
+        return true;
+    }
+    if(tokenIs(key, keyEnd, "color"))
+        return parseNumbers(value, valueEnd, &body.color.x, 3);
+    if(tokenIs(key, keyEnd, "size"))
+        return parseNumbers(value, valueEnd, &body.size.x, 3);
+
+    float number;
+    if(parseNumber(value, valueEnd, number) != valueEnd)
+        return false;
+    if(tokenIs(key, keyEnd, "ka"))
+        body.ka = number;
+    else if(tokenIs(key, keyEnd, "kd"))
+        body.kd = number;
+    else if(tokenIs(key, keyEnd, "ks"))
+        body.ks = number;
+    else if(tokenIs(key, keyEnd, "alpha"))
+        body.alpha = number;
+    else if(tokenIs(key, keyEnd, "spin"))
+        body.spin = number;
+    else if(tokenIs(key, keyEnd, "tilt"))
+        body.tilt = number;
+    else if(tokenIs(key, keyEnd, "light"))
+        body.light = (int32_t)number;
+    else if(tokenIs(key, keyEnd, "lit"))
+        body.lit = (int32_t)number;
+    else if(tokenIs(key, keyEnd, "ephemeris"))
+        body.ephemerisID = (int32_t)number;
+    else
+        return false;
+    return true;
+}
+
+bool Scene::parse(const char* path)
+{
+    FILE* file = fopen(path, "rb");
+    if(file == nullptr)
+    {
+        ERROR("Could not open the scene %s\n", path);
+        return false;
+    }
+
+    m_ownedStrings.assign(1, '\0'); //Offset 0 is the empty string
+    SceneParser parser(path, m_ownedTextures, m_ownedBodies, m_ownedStrings);
+
+    /* The lines cut by the end of a chunk are moved to the start of the buffer and completed by the next read */
+    std::vector<char> buffer(SCENE_READ_BUFFER_SIZE);
+    size_t kept  = 0;
+    bool   valid = true;
+    while(valid)
+    {
+        size_t nbRead = fread(buffer.data() + kept, 1, buffer.size() - kept, file);
+        size_t size   = kept + nbRead;
+        bool   last   = nbRead == 0;
+        if(size == 0)
+            break;
+
+        const char* begin = buffer.data();
+        const char* end   = begin + size;
+        while(begin < end && valid)
+        {
+            const char* lineEnd = (const char*)memchr(begin, '\n', end - begin);
+            if(lineEnd == nullptr)
+            {
+                if(!last)
+                    break;
+                lineEnd = end;
+            }
+            parser.lineNumber++;
+            const char* comment = (const char*)memchr(begin, '#', lineEnd - begin);
+            const char* p       = begin;
+            const char* statementEnd = comment != nullptr ? comment : lineEnd;
+            const char* statement;
+            const char* statementNameEnd;
+            if(nextToken(p, statementEnd, statement, statementNameEnd))
+            {
+                if(tokenIs(statement, statementNameEnd, "body"))
+                    valid = parser.parseBody(p, statementEnd);
+                else if(tokenIs(statement, statementNameEnd, "texture"))
+                    valid = parser.parseTexture(p, statementEnd);
+                else
+                    WARNING("Line %u of %s : unknown statement %.*s, skipped\n", parser.lineNumber, path, (int)(statementNameEnd - statement), statement);
+            }
+            begin = lineEnd + 1;
+        }
+        if(last)
+            break;
+
+        kept = end > begin ? end - begin : 0;
+        if(kept == buffer.size())
+        {
+            ERROR("A line of the scene %s is longer than %d bytes\n", path, SCENE_READ_BUFFER_SIZE);
+            valid = false;
+        }
+        memmove(buffer.data(), begin, kept);
+    }
+    fclose(file);
+
+    if(valid && m_ownedBodies.empty())
+    {
+        ERROR("No body in the scene %s\n", path);
+        valid = false;
+    }
+    m_textures    = m_ownedTextures.data();
+    m_bodies      = m_ownedBodies.data();
+    m_strings     = m_ownedStrings.data();
+    m_nbTextures  = (uint32_t)m_ownedTextures.size();
+    m_nbBodies    = (uint32_t)m_ownedBodies.size();
+    m_stringsSize = (uint32_t)m_ownedStrings.size();
+    return valid;
+}
+
+bool Scene::map(const char* path)
+{
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    LARGE_INTEGER size;
+    if(file == INVALID_HANDLE_VALUE || !GetFileSizeEx(file, &size))
+    {
+        ERROR("Could not open the scene %s\n", path);
+        if(file != INVALID_HANDLE_VALUE)
+            CloseHandle(file);
+        return false;
+    }
+    m_fileHandle    = file;
+    m_size          = size.QuadPart;
+    m_mappingHandle = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if(m_mappingHandle != NULL)
+        m_mapping = MapViewOfFile(m_mappingHandle, FILE_MAP_READ, 0, 0, 0);
+#else
+    int file = ::open(path, O_RDONLY);
+    struct stat status;
+    if(file < 0 || fstat(file, &status) != 0)
+    {
+        ERROR("Could not open the scene %s\n", path);
+        if(file >= 0)
+            close(file);
+        return false;
+    }
+    m_size = status.st_size;
+    void* mapping = m_size > 0 ? mmap(nullptr, m_size, PROT_READ, MAP_SHARED, file, 0) : MAP_FAILED;
+    m_mapping = mapping == MAP_FAILED ? nullptr : mapping;
+    close(file);
+#endif
+    if(m_mapping == nullptr)
+    {
+        ERROR("Could not map the scene %s\n", path);
+        return false;
+    }
+
+    /* Check every index once, so that the bodies can be used as they are */
+    const SceneFileHeader* header = (const SceneFileHeader*)m_mapping;
+    bool valid = m_size >= sizeof(SceneFileHeader) && header->magic == SCENE_FILE_MAGIC && header->version == SCENE_FILE_VERSION && header->nbBodies > 0 && header->stringsSize > 0 &&
+                 m_size == sizeof(SceneFileHeader) + (uint64_t)header->nbTextures * sizeof(SceneTexture) +
+                           (uint64_t)header->nbBodies * sizeof(SceneBody) + header->stringsSize;
+    if(valid)
+    {
+        m_nbTextures  = header->nbTextures;
+        m_nbBodies    = header->nbBodies;
+        m_stringsSize = header->stringsSize;
+        m_textures    = (const SceneTexture*)(header + 1);
+        m_bodies      = (const SceneBody*)(m_textures + m_nbTextures);
+        m_strings     = (const char*)(m_bodies + m_nbBodies);
+        valid         = m_strings[m_stringsSize - 1] == '\0';
+        for(uint32_t i = 0; i < m_nbTextures && valid; i++)
+            valid = m_textures[i].name < m_stringsSize && m_textures[i].path < m_stringsSize;
+        for(uint32_t i = 0; i < m_nbBodies && valid; i++)
+        {
+            const SceneBody& body = m_bodies[i];
+            valid = body.name < m_stringsSize && body.rings < m_stringsSize && body.parent < (int32_t)i && (body.parent >= 0) == (i > 0) &&
+                    body.texture >= -1 && body.texture < (int32_t)m_nbTextures &&
+                    body.atmosphere >= SCENE_ATMOSPHERE_NONE && body.atmosphere <= SCENE_ATMOSPHERE_HAZE;
+        }
+    }
+    if(!valid)
+        ERROR("%s is not a valid scene\n", path);
+    return valid;
+}
+
+Scene* Scene::load(const char* path)
+{
+    auto begin = std::chrono::high_resolution_clock::now();
+    FILE* file = fopen(path, "rb");
+    if(file == nullptr)
+    {
+        ERROR("Could not open the scene %s\n", path);
+        return nullptr;
+    }
+    uint32_t magic = 0;
+    bool binary = fread(&magic, sizeof(magic), 1, file) == 1 && magic == SCENE_FILE_MAGIC;
+    fclose(file);
+
+    Scene* scene = new Scene();
+    if(!(binary ? scene->map(path) : scene->parse(path)))
+    {
+        delete scene;
+        return nullptr;
+    }
+    scene->m_loadTime = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - begin).count();
+    return scene;
+}
+
+bool Scene::save(const char* path) const
+{
+    FILE* file = fopen(path, "wb");
+    if(file == nullptr)
+    {
+        ERROR("Could not create the scene %s\n", path);
+        return false;
+    }
+
+    SceneFileHeader header = {SCENE_FILE_MAGIC, SCENE_FILE_VERSION, m_nbTextures, m_nbBodies, m_stringsSize, 0};
+    bool written = fwrite(&header, sizeof(header), 1, file) == 1 &&
+                   fwrite(m_textures, sizeof(SceneTexture), m_nbTextures, file) == m_nbTextures &&
+                   fwrite(m_bodies, sizeof(SceneBody), m_nbBodies, file) == m_nbBodies &&
+                   fwrite(m_strings, 1, m_stringsSize, file) == m_stringsSize;
+    written = fclose(file) == 0 && written;
+    if(!written)
+        ERROR("Could not write the scene %s\n", path);
+    return written;
+}
+
+int32_t Scene::findTexture(const char* name) const
+{
+    for(uint32_t i = 0; i < m_nbTextures; i++)
+        if(strcmp(m_strings + m_textures[i].name, name) == 0)
+            return (int32_t)i;
+    return -1;
+}
+
+Scene::~Scene()
+{
+#ifdef _WIN32
+    if(m_mapping != nullptr)
+        UnmapViewOfFile(m_mapping);
+    if(m_mappingHandle != nullptr)
+        CloseHandle(m_mappingHandle);
+    if(m_fileHandle != nullptr)
+        CloseHandle(m_fileHandle);
+#else
+    if(m_mapping != nullptr)
+        munmap(m_mapping, m_size);
+#endif
+}
@@ -1,6 +1,7 @@
 #include "Shader.h"
+#include "ShaderCache.h"
 
-Shader::Shader() : m_programID(0), m_vertexID(0), m_fragID(0)
+Shader::Shader() : m_programID(0), m_vertexID(0), m_fragID(0), m_status(SHADER_COMPILING), m_cacheKey(0)
 {}
 
 Shader::~Shader()
@@ -12,44 +13,77 @@ Shader::~Shader()
 
 Shader* Shader::loadFromFiles(FILE* vertexFile, FILE* fragFile)
 {
-    uint32_t vertexFileSize = 0;
-    uint32_t fragFileSize   = 0;
-    char* vertexCodeC;
-    char* fragCodeC;
-
-    /* Determine the vertex and fragment shader sizes */
-    fseek(vertexFile, 0, SEEK_END);
-    vertexFileSize = ftell(vertexFile);
-    fseek(vertexFile, 0, SEEK_SET);
-
-    fseek(fragFile, 0, SEEK_END);
-    fragFileSize = ftell(fragFile);
-    fseek(fragFile, 0, SEEK_SET);
-
-    /* Read the files */
-    vertexCodeC = (char*)malloc(vertexFileSize+1);
-    fragCodeC   = (char*)malloc(fragFileSize+1);
+    return loadFromStrings(readFile(vertexFile), readFile(fragFile));
+}
 
-    fread(vertexCodeC, 1, vertexFileSize, vertexFile);
-    vertexCodeC[vertexFileSize] = '\0';
-    fread(fragCodeC, 1, fragFileSize, fragFile);
-    fragCodeC[fragFileSize] = '\0';
+std::string Shader::readFile(FILE* file)
+{
+    /* Determine the file size */
+    fseek(file, 0, SEEK_END);
+    uint32_t fileSize = ftell(file);
+    fseek(file, 0, SEEK_SET);
+
+    /* Read the file */
+    char* codeC = (char*)malloc(fileSize+1);
+    size_t nbRead = fread(codeC, 1, fileSize, file);
+    codeC[nbRead] = '\0';
+
+    std::string code(codeC);
+    free(codeC);
+    return code;
+}
 
-    /* Return the shader and free everything*/
-    Shader* s = loadFromStrings(std::string(vertexCodeC), std::string(fragCodeC));
+Shader* Shader::loadVariantFromStrings(const std::string& vertexString, const std::string& fragString, uint32_t variantKey)
+{
+    return loadFromStrings(injectDefines(vertexString, variantKey), injectDefines(fragString, variantKey));
+}
 
-    free(vertexCodeC);
-    free(fragCodeC);
+std::string Shader::injectDefines(const std::string& code, uint32_t variantKey)
+{
+    std::string defines;
+    for(uint32_t i = 0; i < SHADER_FEATURE_COUNT; i++)
+        defines += "#define " + std::string(SHADER_FEATURE_TABLE[i].define) + " " + std::to_string(shaderFeatureValue(variantKey, (ShaderFeature)i)) + "\n";
+
+    /* #version must stay the first statement */
+    size_t insertAt = 0;
+    size_t version  = code.find("#version");
+    if(version != std::string::npos)
+    {
+        size_t endOfLine = code.find('\n', version);
+        insertAt = (endOfLine == std::string::npos) ? code.size() : endOfLine+1;
+    }
 
-    return s;
+    std::string variant = code;
+    variant.insert(insertAt, defines);
+    return variant;
 }
 
 Shader* Shader::loadFromStrings(const std::string& vertexString, const std::string& fragString)
+{
+    Shader* shader = beginLoadFromStrings(vertexString, fragString);
+    if(!shader->finish())
+    {
+        delete shader;
+        return NULL;
+    }
+    return shader;
+}
+
+Shader* Shader::beginLoadFromStrings(const std::string& vertexString, const std::string& fragString)
 {
     Shader* shader = new Shader();
 
-    /* Create a program and compile each shader component (vertex, fragment) */
+    /* Reuse the binary of a previous run if the driver accepts it */
     shader->m_programID = glCreateProgram();
+    shader->m_cacheKey  = ShaderCache::computeKey(vertexString, fragString);
+    if(ShaderCache::loadProgram(shader->m_cacheKey, shader->m_programID))
+    {
+        shader->m_status = SHADER_LINKED;
+        return shader;
+    }
+
+    /* Compile each shader component (vertex, fragment). Nothing is queried here so that the driver can compile in the background */
+    shader->m_compileBegin = std::chrono::high_resolution_clock::now();
     shader->m_vertexID = loadShader(vertexString, GL_VERTEX_SHADER);
     shader->m_fragID = loadShader(fragString, GL_FRAGMENT_SHADER);
 
@@ -61,33 +95,73 @@ Shader* Shader::loadFromStrings(const std::string& vertexString, const std::stri
     shader->bindAttributes();
 
     /* Link the program. */
+    if(ShaderCache::isSupported())
+        glProgramParameteri(shader->m_programID, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
     glLinkProgram(shader->m_programID);
 
-    /* Check for errors and print error message */
+    return shader;
+}
+
+void Shader::enableParallelCompile()
+{
+    if(GLEW_KHR_parallel_shader_compile)
+    {
+        glMaxShaderCompilerThreadsKHR(0xFFFFFFFF);
+        INFO("Shaders are compiled in parallel (GL_KHR_parallel_shader_compile)\n");
+    }
+}
+
+bool Shader::isReady() const
+{
+    if(m_status != SHADER_COMPILING || !GLEW_KHR_parallel_shader_compile)
+        return true;
+
+    int completed = GL_FALSE;
+    glGetProgramiv(m_programID, GL_COMPLETION_STATUS_KHR, &completed);
+    return completed == GL_TRUE;
+}
+
+bool Shader::finish()
+{
+    if(m_status != SHADER_COMPILING)
+        return m_status == SHADER_LINKED;
+
+    /* Check for errors and print error message. Blocks until the driver is done */
     int linkStatus;
-    glGetProgramiv(shader->m_programID, GL_LINK_STATUS, &linkStatus);
+    glGetProgramiv(m_programID, GL_LINK_STATUS, &linkStatus);
     if(linkStatus == GL_FALSE)
     {
+        checkCompileStatus(m_vertexID, GL_VERTEX_SHADER);
+        checkCompileStatus(m_fragID, GL_FRAGMENT_SHADER);
+
         char* error = (char*) malloc(ERROR_MAX_LENGTH * sizeof(char));
         int length=0;
-        glGetProgramInfoLog(shader->m_programID, ERROR_MAX_LENGTH, &length, error);
+        glGetProgramInfoLog(m_programID, ERROR_MAX_LENGTH, &length, error);
         ERROR("Could not link shader-> : \n %s", error);
+        free(error);
 
-        delete shader;
-        return NULL;
+        m_status = SHADER_FAILED;
+        return false;
     }
 
-    return shader;
+    ShaderCache::addCompileTime(std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - m_compileBegin).count());
+    ShaderCache::storeProgram(m_cacheKey, m_programID);
+    m_status = SHADER_LINKED;
+    return true;
 }
 
 int Shader::loadShader(const std::string& code, int type)
 {
-    /* Create a shader component and compile it */
+    /* Create a shader component and compile it. Errors are checked once the program is linked */
     int shader = glCreateShader(type);
     const GLchar* s = code.c_str();
     glShaderSource(shader, 1, &s, 0);
     glCompileShader(shader);
+    return shader;
+}
 
+void Shader::checkCompileStatus(GLuint shader, int type)
+{
     /* Check for errors and print error message */
     int compiled = 0;
     glGetShaderiv(shader, GL_COMPILE_STATUS, &compiled);
@@ -99,11 +173,8 @@ int Shader::loadShader(const std::string& code, int type)
         glGetShaderInfoLog(shader, ERROR_MAX_LENGTH, &length, error);
 
         ERROR("Could not compile shader %d : \n %s", type, error);
-        glDeleteShader(shader);
-        return 0;
+        free(error);
     }
-
-    return shader;
 }
 
 int Shader::getProgramID() const
@@ -124,3 +195,8 @@ int Shader::getFragID() const
 void Shader::bindAttributes()
 {
 }
+
+ShaderStatus Shader::getStatus() const
+{
+    return m_status;
+}
@@ -0,0 +1,174 @@
+#include "ShaderCache.h"
+#include "logger.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#include <chrono>
+
+#ifdef _WIN32
+#include <direct.h>
+#define MAKE_DIRECTORY(path) _mkdir(path)
+#else
+#include <sys/stat.h>
+#define MAKE_DIRECTORY(path) mkdir(path, 0755)
+#endif
+
+#define SHADER_CACHE_MAGIC   0x42505347 /* "GSPB" */
+#define SHADER_CACHE_VERSION 1
+
+uint32_t ShaderCache::s_nbHits      = 0;
+uint32_t ShaderCache::s_nbMisses    = 0;
+double   ShaderCache::s_compileTime = 0.0;
+double   ShaderCache::s_loadTime    = 0.0;
+
+/* \brief Header written before the binary blob */
+struct ShaderCacheHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint64_t key;
+    uint32_t binaryFormat;
+    uint32_t length;
+};
+
+/* \brief FNV-1a, 64 bits */
+static uint64_t hashString(uint64_t hash, const char* str, size_t length)
+{
+    for(size_t i = 0; i < length; i++)
+    {
+        hash ^= (uint8_t)str[i];
+        hash *= 0x100000001b3ULL;
+    }
+    /* Separator, so that ("ab", "c") and ("a", "bc") differ */
+    hash ^= 0xff;
+    hash *= 0x100000001b3ULL;
+    return hash;
+}
+
+static std::string cachePath(uint64_t key)
+{
+    char name[64];
+    snprintf(name, sizeof(name), SHADER_CACHE_DIRECTORY "/%016llx.bin", (unsigned long long)key);
+    return name;
+}
+
+uint64_t ShaderCache::computeKey(const std::string& vertexString, const std::string& fragString)
+{
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    hash = hashString(hash, vertexString.c_str(), vertexString.size());
+    hash = hashString(hash, fragString.c_str(), fragString.size());
+
+    const GLenum driverStrings[] = {GL_VENDOR, GL_RENDERER, GL_VERSION, GL_SHADING_LANGUAGE_VERSION};
+    for(GLenum name : driverStrings)
+    {
+        const char* str = (const char*)glGetString(name);
+        if(str)
+            hash = hashString(hash, str, strlen(str));
+    }
+    return hash;
+}
+
+bool ShaderCache::isSupported()
+{
+    if(!(GLEW_VERSION_4_1 || GLEW_ARB_get_program_binary))
+        return false;
+    GLint nbFormats = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &nbFormats);
+    return nbFormats > 0;
+}
+
+bool ShaderCache::loadProgram(uint64_t key, GLuint programID)
+{
+    if(!isSupported())
+        return false;
+
+    auto begin = std::chrono::high_resolution_clock::now();
+    std::string path = cachePath(key);
+    FILE* file = fopen(path.c_str(), "rb");
+    if(file == NULL)
+    {
+        s_nbMisses++;
+        return false;
+    }
+
+    ShaderCacheHeader header;
+    std::vector<uint8_t> binary;
+    bool valid = fread(&header, sizeof(header), 1, file) == 1 &&
+                 header.magic == SHADER_CACHE_MAGIC && header.version == SHADER_CACHE_VERSION && header.key == key;
+    if(valid)
+    {
+        binary.resize(header.length);
+        valid = fread(binary.data(), 1, header.length, file) == header.length;
+    }
+    fclose(file);
+
+    GLint linkStatus = GL_FALSE;
+    if(valid)
+    {
+        glProgramBinary(programID, header.binaryFormat, binary.data(), header.length);
+        glGetProgramiv(programID, GL_LINK_STATUS, &linkStatus);
+    }
+
+    if(linkStatus == GL_FALSE)
+    {
+        WARNING("The program binary %s was rejected, compiling from source\n", path.c_str());
+        remove(path.c_str());
+        s_nbMisses++;
+        return false;
+    }
+
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - begin).count();
+    s_loadTime += ms;
+    s_nbHits++;
+    INFO("Program %016llx loaded from the cache in %.2f ms\n", (unsigned long long)key, ms);
+    return true;
+}
+
+void ShaderCache::storeProgram(uint64_t key, GLuint programID)
+{
+    if(!isSupported())
+        return;
+
+    GLint length = 0;
+    glGetProgramiv(programID, GL_PROGRAM_BINARY_LENGTH, &length);
+    if(length <= 0)
+        return;
+
+    ShaderCacheHeader header;
+    header.magic   = SHADER_CACHE_MAGIC;
+    header.version = SHADER_CACHE_VERSION;
+    header.key     = key;
+    header.length  = 0;
+    std::vector<uint8_t> binary(length);
+    GLenum binaryFormat = 0;
+    GLsizei written = 0;
+    glGetProgramBinary(programID, length, &written, &binaryFormat, binary.data());
+    if(written <= 0)
+        return;
+    header.binaryFormat = binaryFormat;
+    header.length       = (uint32_t)written;
+
+    MAKE_DIRECTORY(SHADER_CACHE_DIRECTORY);
+    std::string path = cachePath(key);
+    FILE* file = fopen(path.c_str(), "wb");
+    if(file == NULL)
+    {
+        WARNING("Could not write the program binary %s\n", path.c_str());
+        return;
+    }
+    fwrite(&header, sizeof(header), 1, file);
+    fwrite(binary.data(), 1, header.length, file);
+    fclose(file);
+}
+
+void ShaderCache::addCompileTime(double milliseconds)
+{
+    s_compileTime += milliseconds;
+}
+
+void ShaderCache::logStats()
+{
+    INFO("Shader cache : %u hit(s), %u miss(es), %.2f ms loading binaries, %.2f ms compiling from source\n",
+         s_nbHits, s_nbMisses, s_loadTime, s_compileTime);
+}
@@ -0,0 +1,76 @@
+#include "ShaderVariants.h"
+
+ShaderVariants::ShaderVariants(const std::string& vertexString, const std::string& fragString) : m_vertexString(vertexString), m_fragString(fragString)
+{
+    for(uint32_t i = 0; i < SHADER_VARIANT_COUNT; i++)
+    {
+        m_variants[i] = NULL;
+        m_failed[i]   = false;
+    }
+}
+
+ShaderVariants::~ShaderVariants()
+{
+    for(uint32_t i = 0; i < SHADER_VARIANT_COUNT; i++)
+        delete m_variants[i];
+}
+
+ShaderVariants* ShaderVariants::loadFromFiles(FILE* vertexFile, FILE* fragFile)
+{
+    if(vertexFile == NULL || fragFile == NULL)
+        return NULL;
+    return new ShaderVariants(Shader::readFile(vertexFile), Shader::readFile(fragFile));
+}
+
+Shader* ShaderVariants::get(uint32_t variantKey)
+{
+    if(!submit(variantKey))
+        return NULL;
+    return finish(variantKey);
+}
+
+Shader* ShaderVariants::tryGet(uint32_t variantKey)
+{
+    if(!submit(variantKey))
+        return NULL;
+
+    Shader* variant = m_variants[variantKey];
+    if(variant->getStatus() == SHADER_LINKED)
+        return variant;
+    if(!variant->isReady())
+        return NULL;
+    return finish(variantKey);
+}
+
+bool ShaderVariants::submit(uint32_t variantKey)
+{
+    if(variantKey >= SHADER_VARIANT_COUNT || m_failed[variantKey])
+        return false;
+
+    if(m_variants[variantKey] == NULL)
+    {
+        m_submitTime[variantKey] = std::chrono::high_resolution_clock::now();
+        m_variants[variantKey]   = Shader::beginLoadFromStrings(Shader::injectDefines(m_vertexString, variantKey), Shader::injectDefines(m_fragString, variantKey));
+    }
+    return true;
+}
+
+Shader* ShaderVariants::finish(uint32_t variantKey)
+{
+    Shader* variant = m_variants[variantKey];
+    if(variant->getStatus() == SHADER_LINKED)
+        return variant;
+
+    if(!variant->finish())
+    {
+        ERROR("Could not compile the shader variant %u\n", variantKey);
+        delete variant;
+        m_variants[variantKey] = NULL;
+        m_failed[variantKey]   = true;
+        return NULL;
+    }
+
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - m_submitTime[variantKey]).count();
+    INFO("Shader variant %u ready %.2f ms after its submission\n", variantKey, ms);
+    return variant;
+}
@@ -0,0 +1,89 @@
+#include "Skybox.h"
+#include "ImageProcessing.h"
+#include "logger.h"
+
+#include <glm/gtc/type_ptr.hpp>
+
+Skybox::~Skybox()
+{
+    glDeleteTextures(1, &m_cubemapID);
+    delete m_shader;
+}
+
+Skybox* Skybox::loadFromEquirectangular(const Image& equirectangular, uint32_t faceSize)
+{
+    FILE* vert = fopen("Shaders/skybox.vert", "r");
+    FILE* frag = fopen("Shaders/skybox.frag", "r");
+    if(vert == NULL || frag == NULL)
+    {
+        ERROR("Could not open the skybox shaders\n");
+        if(vert) fclose(vert);
+        if(frag) fclose(frag);
+        return NULL;
+    }
+    Shader* shader = Shader::loadFromFiles(vert, frag);
+    fclose(vert);
+    fclose(frag);
+    if(shader == NULL)
+        return NULL;
+
+    Skybox* skybox = new Skybox();
+    skybox->m_shader = shader;
+
+    glGenTextures(1, &skybox->m_cubemapID);
+    glBindTexture(GL_TEXTURE_CUBE_MAP, skybox->m_cubemapID);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+
+    Image face(faceSize, faceSize);
+    for(uint32_t i = 0; i < 6; i++)
+    {
+        ImageProcessing::equirectangularToCubeFace(equirectangular, i, face);
+        glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGBA8, faceSize, faceSize, 0, GL_RGBA, GL_UNSIGNED_BYTE, face.getPixels());
+
+        std::vector<Image*> mips = ImageProcessing::buildMipChain(face, MIP_FILTER_LANCZOS3, false);
+        for(uint32_t level = 0; level < mips.size(); level++)
+        {
+            glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, level+1, GL_RGBA8, mips[level]->getWidth(), mips[level]->getHeight(), 0, GL_RGBA, GL_UNSIGNED_BYTE, mips[level]->getPixels());
+            delete mips[level];
+        }
+    }
+    glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+
+    if(GLEW_VERSION_3_2 || GLEW_ARB_seamless_cube_map)
+        glEnable(GL_TEXTURE_CUBE_MAP_SEAMLESS);
+
+    return skybox;
+}
+
+void Skybox::draw(const glm::mat4& view, const glm::mat4& projection, const DepthBuffer* depthBuffer) const
+{
+    /* Only the rotation of the camera matters for a sky at infinity */
+    glm::mat4 rotation = glm::mat4(glm::mat3(view));
+    glm::mat4 invViewProjection = glm::inverse(projection * rotation);
+
+    glUseProgram(m_shader->getProgramID());
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_CUBE_MAP, m_cubemapID);
+    GLint uInvViewProjection = glGetUniformLocation(m_shader->getProgramID(), "uInvViewProjection");
+    GLint uSkybox = glGetUniformLocation(m_shader->getProgramID(), "uSkybox");
+    glUniformMatrix4fv(uInvViewProjection, 1, GL_FALSE, glm::value_ptr(invViewProjection));
+    glUniform1i(uSkybox, 0);
+    GLint uFarDepth = glGetUniformLocation(m_shader->getProgramID(), "uFarDepth");
+    glUniform1f(uFarDepth, 1.0f);
+    if(depthBuffer != nullptr)
+        depthBuffer->bind(m_shader);
+
+    /* Far plane triangle: passes only where nothing was drawn. No need to write the depth */
+    glDepthFunc(depthBuffer != nullptr ? depthBuffer->getFarDepthFunc() : GL_LEQUAL);
+    glDepthMask(GL_FALSE);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+    glDepthMask(GL_TRUE);
+    glDepthFunc(depthBuffer != nullptr ? depthBuffer->getDepthFunc() : GL_LESS);
+
+    glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+    glUseProgram(0);
+}
@@ -1,60 +1,53 @@
 #include "Sphere.h"
 
+/* Corners of the two triangles of the quad (i, j) -> (i+1, j+1) */
+static const uint32_t QUAD_CORNERS[6][2] = {{0, 0}, {1, 1}, {1, 0},
+                                            {0, 0}, {0, 1}, {1, 1}};
+
 Sphere::Sphere(uint32_t nbLatitude, uint32_t nbLongitude)
 {
-    float radius = 0.5;
-    //Determine position
-	glm::vec3* vertexCoord = (glm::vec3*)malloc(nbLongitude*nbLatitude*sizeof(glm::vec3));
-    glm::vec2* uvCoord     = (glm::vec2*)malloc(nbLongitude*nbLatitude*sizeof(glm::vec2));
-	for(unsigned int i=0; i < nbLongitude; i++)
-	{
-		double theta = 2*M_PI/(nbLongitude-1) * i;
-		for(unsigned int j=0; j < nbLatitude; j++)
-		{
-			double phi = M_PI/(nbLatitude-1) * j;
-			double pos[] = {sin(phi)*sin(theta), cos(phi), cos(theta)*sin(phi)};
-            double uvs[] = {i/(double)(nbLongitude), j/(double)(nbLatitude)};
-			for(unsigned int k=0; k < 3; k++)
-				vertexCoord[i*nbLatitude + j][k] = radius*(float)pos[k];
-            for(unsigned int k=0; k < 2; k++)
-                uvCoord[i*nbLatitude+j][k] = (float)uvs[k];
-		}
-	}
-
-    //Determine draw orders
-	unsigned int* order = (unsigned int*)malloc(nbLongitude*(nbLatitude-1)*sizeof(unsigned int)*6);
-	for(unsigned int i=0; i < nbLongitude; i++)
-	{
-		for(unsigned int j=0; j < nbLatitude-1; j++)
-		{
-			unsigned int o[] = {i*(nbLatitude) + j, (i+1)*(nbLatitude)%(nbLatitude*nbLongitude) + (j+1)%nbLatitude, (i+1)*(nbLatitude)%(nbLatitude*nbLongitude)+j,
-								i*(nbLatitude) + j, i*(nbLatitude) + (j+1)%nbLatitude, (i+1)*(nbLatitude)%(nbLatitude*nbLongitude) + (j+1)%nbLatitude
-						        
-			};
-
-			for(unsigned int k=0; k < 6; k++)
-				order[(nbLatitude-1)*i*6 + j*6 + k] = o[k];
-		}
-	}
-
-    //Merge everything
-    m_nbVertices = nbLongitude*(nbLatitude-1)*6;
-    m_vertices = (float*)malloc(sizeof(float)*m_nbVertices*3);
-    m_uvs      = (float*)malloc(sizeof(float)*m_nbVertices*2);
-    m_normals  = (float*)malloc(sizeof(float)*m_nbVertices*3);
-    for(uint32_t i = 0; i < nbLatitude*(nbLongitude-1)*6; i++)
+    allocate(countVertices(nbLatitude, nbLongitude));
+    float* vertices = editVertices();
+    float* normals  = editNormals();
+    float* uvs      = editUVs();
+    for(uint32_t v = 0; v < m_nbVertices; v++)
     {
-        uint32_t indice   = order[i];
-        for(uint32_t j = 0; j < 3; j++)
+        uint32_t i, j;
+        getGridPoint(v, nbLatitude, nbLongitude, i, j);
+
+        glm::vec3 pos    = getGridPosition(i, j, nbLatitude, nbLongitude);
+        glm::vec3 normal = glm::normalize(pos);
+        glm::vec2 uv     = getGridUV(i, j, nbLatitude, nbLongitude);
+        for(uint32_t k = 0; k < 3; k++)
         {
-            m_vertices[3*i+j] = vertexCoord[indice][j];
-            m_normals [3*i+j] = glm::normalize(vertexCoord[indice])[j];
+            vertices[3*v+k] = pos[k];
+            normals [3*v+k] = normal[k];
         }
-        for(uint32_t j = 0; j < 2; j++)
-            m_uvs[2*i+j] = uvCoord[indice][j];
+        for(uint32_t k = 0; k < 2; k++)
+            uvs[2*v+k] = uv[k];
     }
+}
 
-    free(order);
-    free(vertexCoord);
-    free(uvCoord);
+void Sphere::getGridPoint(uint32_t vertexID, uint32_t nbLatitude, uint32_t nbLongitude, uint32_t& i, uint32_t& j)
+{
+    uint32_t quad   = vertexID / 6;
+    uint32_t corner = vertexID % 6;
+    uint32_t quadI  = quad / (nbLatitude-1);
+    uint32_t quadJ  = quad % (nbLatitude-1);
+    i = (quadI + QUAD_CORNERS[corner][0]) % nbLongitude;
+    j = (quadJ + QUAD_CORNERS[corner][1]) % nbLatitude;
+}
+
+glm::vec3 Sphere::getGridPosition(uint32_t i, uint32_t j, uint32_t nbLatitude, uint32_t nbLongitude)
+{
+    float radius = 0.5;
+    double theta = 2*M_PI/(nbLongitude-1) * i;
+    double phi   = M_PI/(nbLatitude-1) * j;
+    double pos[] = {sin(phi)*sin(theta), cos(phi), cos(theta)*sin(phi)};
+    return glm::vec3(radius*(float)pos[0], radius*(float)pos[1], radius*(float)pos[2]);
+}
+
+glm::vec2 Sphere::getGridUV(uint32_t i, uint32_t j, uint32_t nbLatitude, uint32_t nbLongitude)
+{
+    return glm::vec2((float)(i/(double)(nbLongitude)), (float)(j/(double)(nbLatitude)));
 }
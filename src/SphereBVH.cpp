@@ -0,0 +1,426 @@
+#include "SphereBVH.h"
+#include "JobSystem.h"
+
+#include <chrono>
+#include <cmath>
+#include <algorithm>
+
+/* Spheres per job of the refit */
+#define SPHERE_BVH_REFIT_GRAIN 16384
+/* Depth where the build goes on in parallel, one job per subtree, and the smallest subtree worth a job */
+#define SPHERE_BVH_PARALLEL_DEPTH 6
+#define SPHERE_BVH_PARALLEL_MIN   4096
+/* Cost of visiting an inner node, relative to testing a sphere */
+#define SPHERE_BVH_TRAVERSAL_COST 1.0f
+
+static float surfaceArea(const glm::vec3& bmin, const glm::vec3& bmax)
+{
+    glm::vec3 e = glm::max(bmax - bmin, glm::vec3(0.0f));
+    return 2.0f * (e.x * e.y + e.y * e.z + e.z * e.x);
+}
+
+/* \brief Distance from a point to a box, 0 inside */
+static float boxDistance(const glm::vec3& p, const glm::vec3& bmin, const glm::vec3& bmax)
+{
+    glm::vec3 d = glm::max(glm::max(bmin - p, p - bmax), glm::vec3(0.0f));
+    return glm::length(d);
+}
+
+/* \brief Slab test of a ray against a box
+ * \return the distance where the ray enters the box, INFINITY if it misses it before maxDistance */
+static float boxEntry(const glm::vec3& origin, const glm::vec3& invDirection, float maxDistance, const glm::vec3& bmin, const glm::vec3& bmax)
+{
+    glm::vec3 t0 = (bmin - origin) * invDirection;
+    glm::vec3 t1 = (bmax - origin) * invDirection;
+    glm::vec3 tmin = glm::min(t0, t1);
+    glm::vec3 tmax = glm::max(t0, t1);
+    float enter = std::max(std::max(tmin.x, tmin.y), std::max(tmin.z, 0.0f));
+    float exit  = std::min(std::min(tmax.x, tmax.y), std::min(tmax.z, maxDistance));
+    return enter <= exit ? enter : INFINITY;
+}
+
+void SphereBVH::build(const std::vector<glm::vec3>& centers, const std::vector<float>& radii)
+{
+    auto begin = std::chrono::high_resolution_clock::now();
+    uint32_t count = (uint32_t)centers.size();
+    m_items.resize(count);
+    m_spheres.resize(count);
+    for(uint32_t i = 0; i < count; i++)
+    {
+        m_items[i]   = i;
+        m_spheres[i] = glm::vec4(centers[i], radii[i]);
+    }
+
+    m_nodes.clear();
+    if(count > 0)
+    {
+        m_nodes.reserve(2 * count / SPHERE_BVH_LEAF_SIZE + 1);
+        m_nodes.push_back({glm::vec3(0.0f), 0, glm::vec3(0.0f), count});
+        std::vector<uint32_t> subtrees;
+        split(m_nodes, 0, 0, &subtrees);
+
+        /* The subtrees touch disjoint ranges of the spheres : each job builds one in its own nodes, then they are appended.
+         * The root of a subtree replaces its node, the other nodes are shifted by where they land */
+        std::vector<std::vector<SphereBVHNode>> built(subtrees.size());
+        JobSystem::get().parallelFor((uint32_t)subtrees.size(), 1, [&](uint32_t first, uint32_t last)
+        {
+            for(uint32_t i = first; i < last; i++)
+            {
+                built[i].push_back(m_nodes[subtrees[i]]);
+                split(built[i], 0, SPHERE_BVH_PARALLEL_DEPTH, nullptr);
+            }
+        });
+        for(uint32_t i = 0; i < subtrees.size(); i++)
+        {
+            uint32_t offset = (uint32_t)m_nodes.size() - 1;
+            for(size_t n = 0; n < built[i].size(); n++)
+            {
+                SphereBVHNode node = built[i][n];
+                if(node.count == 0)
+                    node.first += offset;
+                if(n == 0)
+                    m_nodes[subtrees[i]] = node;
+                else
+                    m_nodes.push_back(node);
+            }
+        }
+    }
+    m_buildCost = m_cost = computeCost();
+    m_lastBuildTime = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - begin).count();
+}
+
+void SphereBVH::split(std::vector<SphereBVHNode>& nodes, uint32_t nodeID, uint32_t depth, std::vector<uint32_t>* subtrees)
+{
+    uint32_t first = nodes[nodeID].first;
+    uint32_t count = nodes[nodeID].count;
+    glm::vec3 bmin( INFINITY), bmax(-INFINITY);
+    glm::vec3 cmin( INFINITY), cmax(-INFINITY);
+    for(uint32_t i = first; i < first + count; i++)
+    {
+        glm::vec3 c(m_spheres[i]);
+        bmin = glm::min(bmin, c - m_spheres[i].w);
+        bmax = glm::max(bmax, c + m_spheres[i].w);
+        cmin = glm::min(cmin, c);
+        cmax = glm::max(cmax, c);
+    }
+    nodes[nodeID].bmin = bmin;
+    nodes[nodeID].bmax = bmax;
+    if(count <= SPHERE_BVH_LEAF_SIZE || depth + 1 >= SPHERE_BVH_MAX_DEPTH)
+        return;
+    if(subtrees != nullptr && depth == SPHERE_BVH_PARALLEL_DEPTH && count >= SPHERE_BVH_PARALLEL_MIN)
+    {
+        subtrees->push_back(nodeID);
+        return;
+    }
+
+    /* Bin the centers along the longest axis of their box, then take the bin boundary of the lowest surface area heuristic cost */
+    glm::vec3 extent = cmax - cmin;
+    int axis = extent.x > extent.y ? (extent.x > extent.z ? 0 : 2) : (extent.y > extent.z ? 1 : 2);
+    uint32_t middle = first + count / 2;
+    if(extent[axis] > 0.0f)
+    {
+        struct Bin {glm::vec3 bmin = glm::vec3(INFINITY); glm::vec3 bmax = glm::vec3(-INFINITY); uint32_t count = 0;};
+        Bin bins[SPHERE_BVH_BINS];
+        float scale = SPHERE_BVH_BINS / extent[axis] * 0.9999f;
+        for(uint32_t i = first; i < first + count; i++)
+        {
+            uint32_t b = std::min((uint32_t)((m_spheres[i][axis] - cmin[axis]) * scale), (uint32_t)SPHERE_BVH_BINS - 1);
+            glm::vec3 c(m_spheres[i]);
+            bins[b].bmin = glm::min(bins[b].bmin, c - m_spheres[i].w);
+            bins[b].bmax = glm::max(bins[b].bmax, c + m_spheres[i].w);
+            bins[b].count++;
+        }
+
+        /* Costs of the right sides, then sweep from the left */
+        float rightCost[SPHERE_BVH_BINS];
+        glm::vec3 rmin(INFINITY), rmax(-INFINITY);
+        uint32_t rightCount = 0;
+        for(int b = SPHERE_BVH_BINS - 1; b > 0; b--)
+        {
+            rmin = glm::min(rmin, bins[b].bmin);
+            rmax = glm::max(rmax, bins[b].bmax);
+            rightCount += bins[b].count;
+            rightCost[b] = rightCount * surfaceArea(rmin, rmax);
+        }
+        glm::vec3 lmin(INFINITY), lmax(-INFINITY);
+        uint32_t leftCount = 0;
+        float bestCost = INFINITY;
+        int bestBin = -1;
+        for(int b = 0; b < SPHERE_BVH_BINS - 1; b++)
+        {
+            lmin = glm::min(lmin, bins[b].bmin);
+            lmax = glm::max(lmax, bins[b].bmax);
+            leftCount += bins[b].count;
+            float cost = leftCount * surfaceArea(lmin, lmax) + rightCost[b + 1];
+            if(leftCount > 0 && leftCount < count && cost < bestCost)
+            {
+                bestCost = cost;
+                bestBin = b;
+            }
+        }
+
+        if(bestBin >= 0)
+        {
+            /* Partition the spheres and their indices together */
+            uint32_t i = first;
+            uint32_t j = first + count;
+            while(i < j)
+            {
+                uint32_t b = std::min((uint32_t)((m_spheres[i][axis] - cmin[axis]) * scale), (uint32_t)SPHERE_BVH_BINS - 1);
+                if((int)b <= bestBin)
+                    i++;
+                else
+                {
+                    j--;
+                    std::swap(m_spheres[i], m_spheres[j]);
+                    std::swap(m_items[i], m_items[j]);
+                }
+            }
+            middle = i;
+        }
+    }
+    /* Spheres all at the same place (or no useful split) : halves in the current order */
+
+    uint32_t left = (uint32_t)nodes.size();
+    nodes.push_back({glm::vec3(0.0f), first, glm::vec3(0.0f), middle - first});
+    nodes.push_back({glm::vec3(0.0f), middle, glm::vec3(0.0f), first + count - middle});
+    nodes[nodeID].first = left;
+    nodes[nodeID].count = 0;
+    split(nodes, left, depth + 1, subtrees);
+    split(nodes, left + 1, depth + 1, subtrees);
+}
+
+float SphereBVH::computeCost() const
+{
+    if(m_nodes.empty())
+        return 0.0f;
+    double cost = 0.0;
+    for(const SphereBVHNode& node : m_nodes)
+        cost += surfaceArea(node.bmin, node.bmax) * (node.count > 0 ? node.count : SPHERE_BVH_TRAVERSAL_COST);
+    float rootArea = surfaceArea(m_nodes[0].bmin, m_nodes[0].bmax);
+    return rootArea > 0.0f ? (float)(cost / rootArea) : 0.0f;
+}
+
+void SphereBVH::refit(const std::vector<glm::vec3>& centers, const std::vector<float>& radii)
+{
+    auto begin = std::chrono::high_resolution_clock::now();
+    uint32_t count = (uint32_t)m_items.size();
+    JobSystem::get().parallelFor(count, SPHERE_BVH_REFIT_GRAIN, [&](uint32_t first, uint32_t last)
+    {
+        for(uint32_t i = first; i < last; i++)
+            m_spheres[i] = glm::vec4(centers[m_items[i]], radii[m_items[i]]);
+    });
+
+    /* The children always come after their parent : in reverse order, every node sees the new boxes of its children */
+    for(size_t n = m_nodes.size(); n-- > 0;)
+    {
+        SphereBVHNode& node = m_nodes[n];
+        glm::vec3 bmin( INFINITY), bmax(-INFINITY);
+        if(node.count > 0)
+        {
+            for(uint32_t i = node.first; i < node.first + node.count; i++)
+            {
+                glm::vec3 c(m_spheres[i]);
+                bmin = glm::min(bmin, c - m_spheres[i].w);
+                bmax = glm::max(bmax, c + m_spheres[i].w);
+            }
+        }
+        else
+        {
+            bmin = glm::min(m_nodes[node.first].bmin, m_nodes[node.first + 1].bmin);
+            bmax = glm::max(m_nodes[node.first].bmax, m_nodes[node.first + 1].bmax);
+        }
+        node.bmin = bmin;
+        node.bmax = bmax;
+    }
+    m_cost = computeCost();
+    m_lastRefitTime = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - begin).count();
+}
+
+void SphereBVH::queryPlanes(const glm::vec4* planes, uint32_t nbPlanes, std::vector<uint32_t>& out) const
+{
+    if(m_nodes.empty())
+        return;
+    float lengths[32];
+    for(uint32_t p = 0; p < nbPlanes; p++)
+        lengths[p] = glm::length(glm::vec3(planes[p]));
+
+    /* Each node carries the planes its parent was not completely inside of */
+    struct Entry {uint32_t node; uint32_t mask;};
+    Entry stack[2 * SPHERE_BVH_MAX_DEPTH];
+    uint32_t top = 0;
+    stack[top++] = {0, nbPlanes >= 32 ? 0xffffffffu : (1u << nbPlanes) - 1};
+    while(top > 0)
+    {
+        Entry entry = stack[--top];
+        const SphereBVHNode& node = m_nodes[entry.node];
+        uint32_t mask = entry.mask;
+        bool outside = false;
+        for(uint32_t p = 0; p < nbPlanes && !outside; p++)
+        {
+            if(!(mask & (1u << p)))
+                continue;
+            glm::vec3 n(planes[p]);
+            glm::vec3 farthest(n.x >= 0.0f ? node.bmax.x : node.bmin.x, n.y >= 0.0f ? node.bmax.y : node.bmin.y, n.z >= 0.0f ? node.bmax.z : node.bmin.z);
+            glm::vec3 nearest(n.x >= 0.0f ? node.bmin.x : node.bmax.x, n.y >= 0.0f ? node.bmin.y : node.bmax.y, n.z >= 0.0f ? node.bmin.z : node.bmax.z);
+            if(glm::dot(n, farthest) + planes[p].w < 0.0f)
+                outside = true;
+            else if(glm::dot(n, nearest) + planes[p].w >= 0.0f)
+                mask &= ~(1u << p);
+        }
+        if(outside)
+            continue;
+
+        if(node.count == 0)
+        {
+            stack[top++] = {node.first, mask};
+            stack[top++] = {node.first + 1, mask};
+            continue;
+        }
+        for(uint32_t i = node.first; i < node.first + node.count; i++)
+        {
+            bool inside = true;
+            for(uint32_t p = 0; p < nbPlanes && inside; p++)
+                if(mask & (1u << p))
+                    inside = glm::dot(glm::vec3(planes[p]), glm::vec3(m_spheres[i])) + planes[p].w >= -m_spheres[i].w * lengths[p];
+            if(inside)
+                out.push_back(m_items[i]);
+        }
+    }
+}
+
+void SphereBVH::queryRadius(const glm::vec3& center, float radius, std::vector<uint32_t>& out) const
+{
+    if(m_nodes.empty())
+        return;
+    uint32_t stack[2 * SPHERE_BVH_MAX_DEPTH];
+    uint32_t top = 0;
+    stack[top++] = 0;
+    while(top > 0)
+    {
+        const SphereBVHNode& node = m_nodes[stack[--top]];
+        if(boxDistance(center, node.bmin, node.bmax) > radius)
+            continue;
+        if(node.count == 0)
+        {
+            stack[top++] = node.first;
+            stack[top++] = node.first + 1;
+            continue;
+        }
+        for(uint32_t i = node.first; i < node.first + node.count; i++)
+        {
+            float reach = radius + m_spheres[i].w;
+            glm::vec3 d = glm::vec3(m_spheres[i]) - center;
+            if(glm::dot(d, d) <= reach * reach)
+                out.push_back(m_items[i]);
+        }
+    }
+}
+
+int32_t SphereBVH::raycast(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, float* distance) const
+{
+    if(m_nodes.empty())
+        return -1;
+    glm::vec3 invDirection = 1.0f / direction;
+    float closest = maxDistance;
+    int32_t hit = -1;
+
+    struct Entry {uint32_t node; float entry;};
+    Entry stack[2 * SPHERE_BVH_MAX_DEPTH];
+    uint32_t top = 0;
+    float rootEntry = boxEntry(origin, invDirection, closest, m_nodes[0].bmin, m_nodes[0].bmax);
+    if(rootEntry != INFINITY)
+        stack[top++] = {0, rootEntry};
+    while(top > 0)
+    {
+        /* Skip the boxes a closer hit was found in front of since they were pushed */
+        Entry entry = stack[--top];
+        if(entry.entry >= closest)
+            continue;
+        const SphereBVHNode& node = m_nodes[entry.node];
+        if(node.count == 0)
+        {
+            /* The nearest child is visited first, so that its hits cut the other one short */
+            float ta = boxEntry(origin, invDirection, closest, m_nodes[node.first].bmin, m_nodes[node.first].bmax);
+            float tb = boxEntry(origin, invDirection, closest, m_nodes[node.first + 1].bmin, m_nodes[node.first + 1].bmax);
+            Entry nearChild = ta <= tb ? Entry{node.first, ta} : Entry{node.first + 1, tb};
+            Entry farChild  = ta <= tb ? Entry{node.first + 1, tb} : Entry{node.first, ta};
+            if(farChild.entry != INFINITY)
+                stack[top++] = farChild;
+            if(nearChild.entry != INFINITY)
+                stack[top++] = nearChild;
+            continue;
+        }
+        for(uint32_t i = node.first; i < node.first + node.count; i++)
+        {
+            glm::vec3 oc = origin - glm::vec3(m_spheres[i]);
+            float b = glm::dot(oc, direction);
+            /* r^2 - (distance from the center to the line)^2 : no cancellation between two large numbers far from the origin */
+            glm::vec3 h = oc - b * direction;
+            float discriminant = m_spheres[i].w * m_spheres[i].w - glm::dot(h, h);
+            if(discriminant < 0.0f)
+                continue;
+            float root = std::sqrt(discriminant);
+            float t = -b - root;
+            if(t < 0.0f)
+                t = -b + root; /* From inside */
+            if(t >= 0.0f && t < closest)
+            {
+                closest = t;
+                hit = (int32_t)m_items[i];
+            }
+        }
+    }
+    if(distance != nullptr && hit >= 0)
+        *distance = closest;
+    return hit;
+}
+
+int32_t SphereBVH::nearest(const glm::vec3& point, float* distance) const
+{
+    if(m_nodes.empty())
+        return -1;
+    float best = INFINITY;
+    int32_t found = -1;
+
+    struct Entry {uint32_t node; float distance;};
+    Entry stack[2 * SPHERE_BVH_MAX_DEPTH];
+    uint32_t top = 0;
+    stack[top++] = {0, boxDistance(point, m_nodes[0].bmin, m_nodes[0].bmax)};
+    while(top > 0)
+    {
+        /* A surface is never closer than the box around the sphere. Inside a sphere (best < 0), only the boxes holding the point can do better */
+        Entry entry = stack[--top];
+        if(entry.distance > 0.0f && entry.distance >= best)
+            continue;
+        const SphereBVHNode& node = m_nodes[entry.node];
+        if(node.count == 0)
+        {
+            float da = boxDistance(point, m_nodes[node.first].bmin, m_nodes[node.first].bmax);
+            float db = boxDistance(point, m_nodes[node.first + 1].bmin, m_nodes[node.first + 1].bmax);
+            if(da <= db)
+            {
+                stack[top++] = {node.first + 1, db};
+                stack[top++] = {node.first, da};
+            }
+            else
+            {
+                stack[top++] = {node.first, da};
+                stack[top++] = {node.first + 1, db};
+            }
+            continue;
+        }
+        for(uint32_t i = node.first; i < node.first + node.count; i++)
+        {
+            float d = glm::length(glm::vec3(m_spheres[i]) - point) - m_spheres[i].w;
+            if(d < best)
+            {
+                best = d;
+                found = (int32_t)m_items[i];
+            }
+        }
+    }
+    if(distance != nullptr && found >= 0)
+        *distance = best;
+    return found;
+}
@@ -0,0 +1,140 @@
+#include "SphereGrid.h"
+
+#include <algorithm>
+#include <cmath>
+
+glm::ivec3 SphereGrid::cellOf(const glm::vec3& p) const
+{
+    glm::ivec3 cell = glm::ivec3(glm::floor((p - m_origin) * m_invCellSize));
+    return glm::clamp(cell, glm::ivec3(0), m_dims - 1);
+}
+
+void SphereGrid::build(const glm::vec3* centers, const float* radii, uint32_t count, float minCellSize)
+{
+    m_nbSpheres = count;
+    m_maxRadius = 0.0f;
+    m_cellStart.clear();
+    m_items.clear();
+    if(m_nbSpheres == 0)
+    {
+        m_dims = glm::ivec3(0);
+        return;
+    }
+
+    glm::vec3 bmin( INFINITY);
+    glm::vec3 bmax(-INFINITY);
+    for(uint32_t i = 0; i < m_nbSpheres; i++)
+    {
+        bmin = glm::min(bmin, centers[i] - radii[i]);
+        bmax = glm::max(bmax, centers[i] + radii[i]);
+    }
+
+    /* About one sphere per cell : shrink the cells from the whole extent until there would be more cells than spheres */
+    glm::vec3 extent = bmax - bmin;
+    float size       = std::max(std::max(extent.x, extent.y), std::max(extent.z, 1e-6f));
+    double maxCells  = std::min((double)m_nbSpheres, (double)SPHERE_GRID_MAX_CELLS);
+    while(size * 0.8f >= minCellSize &&
+          (double)std::ceil(extent.x / (size * 0.8f)) * std::ceil(extent.y / (size * 0.8f)) * std::ceil(extent.z / (size * 0.8f)) <= maxCells)
+        size *= 0.8f;
+    float cellSize   = size;
+    m_origin         = bmin;
+    m_invCellSize    = 1.0f / cellSize;
+    m_dims           = glm::max(glm::ivec3(glm::ceil(extent * m_invCellSize)), glm::ivec3(1));
+
+    /* Counting sort of the spheres by the cell of their center : count, prefix sum, fill.
+     * The queries are grown by the largest radius instead of referencing a sphere from every cell it overlaps, so no index is reported twice */
+    uint32_t nbCells = m_dims.x * m_dims.y * m_dims.z;
+    m_cellStart.assign(nbCells + 1, 0);
+    m_items.resize(m_nbSpheres);
+    FrameVector<uint32_t> sphereCell(m_nbSpheres);
+    for(uint32_t i = 0; i < m_nbSpheres; i++)
+    {
+        glm::ivec3 c   = cellOf(centers[i]);
+        sphereCell[i]  = (c.z * m_dims.y + c.y) * m_dims.x + c.x;
+        m_cellStart[sphereCell[i]+1]++;
+        m_maxRadius    = std::max(m_maxRadius, radii[i]);
+    }
+    for(uint32_t c = 0; c < nbCells; c++)
+        m_cellStart[c+1] += m_cellStart[c];
+    for(uint32_t i = 0; i < m_nbSpheres; i++)
+        m_items[m_cellStart[sphereCell[i]]++] = i;
+
+    /* The fill pass moved every start to the end of its cell, which is the start of the next one */
+    for(uint32_t c = nbCells; c > 0; c--)
+        m_cellStart[c] = m_cellStart[c-1];
+    m_cellStart[0] = 0;
+}
+
+void SphereGrid::query(const glm::vec3& bmin, const glm::vec3& bmax, FrameVector<uint32_t>& out) const
+{
+    if(m_nbSpheres == 0)
+        return;
+
+    glm::vec3 gridMax = m_origin + glm::vec3(m_dims) / m_invCellSize;
+    if(glm::any(glm::lessThan(bmax + m_maxRadius, m_origin)) || glm::any(glm::greaterThan(bmin - m_maxRadius, gridMax)))
+        return;
+
+    glm::ivec3 c0 = cellOf(bmin - m_maxRadius);
+    glm::ivec3 c1 = cellOf(bmax + m_maxRadius);
+    for(int z = c0.z; z <= c1.z; z++)
+        for(int y = c0.y; y <= c1.y; y++)
+            for(int x = c0.x; x <= c1.x; x++)
+            {
+                uint32_t cell = (z * m_dims.y + y) * m_dims.x + x;
+                out.insert(out.end(), m_items.begin() + m_cellStart[cell], m_items.begin() + m_cellStart[cell+1]);
+            }
+}
+
+void SphereGrid::queryCone(const glm::vec3& a, const glm::vec3& b, float radiusA, float radiusB, FrameVector<uint32_t>& out) const
+{
+    out.clear();
+    if(m_nbSpheres == 0)
+        return;
+
+    /* Walk the slabs of cells along the dominant axis of the cone. In each slab only the cells around the part of the cone it contains are read,
+     * so every cell, hence every sphere, is visited once */
+    glm::vec3 dir    = b - a;
+    int axis         = (fabsf(dir.x) >= fabsf(dir.y) && fabsf(dir.x) >= fabsf(dir.z)) ? 0 : (fabsf(dir.y) >= fabsf(dir.z) ? 1 : 2);
+    float maxRadius  = std::max(radiusA, radiusB) + m_maxRadius;
+    float cellSize   = 1.0f / m_invCellSize;
+    glm::vec3 gridMax = m_origin + glm::vec3(m_dims) * cellSize;
+
+    /* The spheres are binned by their center : the cells of the centers whose sphere can touch the cone */
+    glm::vec3 coneMin = glm::min(a - radiusA, b - radiusB) - m_maxRadius;
+    glm::vec3 coneMax = glm::max(a + radiusA, b + radiusB) + m_maxRadius;
+    if(glm::any(glm::lessThan(coneMax, m_origin)) || glm::any(glm::greaterThan(coneMin, gridMax)))
+        return;
+    int first = cellOf(coneMin)[axis];
+    int last  = cellOf(coneMax)[axis];
+
+    for(int slab = first; slab <= last; slab++)
+    {
+        /* The axis points whose sphere can reach the slab */
+        float slabMin = m_origin[axis] + slab * cellSize - maxRadius;
+        float slabMax = slabMin + cellSize + 2.0f * maxRadius;
+        float t0 = 0.0f;
+        float t1 = 1.0f;
+        if(fabsf(dir[axis]) > 1e-12f)
+        {
+            t0 = glm::clamp((slabMin - a[axis]) / dir[axis], 0.0f, 1.0f);
+            t1 = glm::clamp((slabMax - a[axis]) / dir[axis], 0.0f, 1.0f);
+            if(t0 > t1)
+                std::swap(t0, t1);
+        }
+        glm::vec3 p0 = a + dir * t0;
+        glm::vec3 p1 = a + dir * t1;
+        float radius = std::max(radiusA + (radiusB - radiusA) * t0, radiusA + (radiusB - radiusA) * t1) + m_maxRadius;
+
+        glm::ivec3 c0 = cellOf(glm::min(p0, p1) - radius);
+        glm::ivec3 c1 = cellOf(glm::max(p0, p1) + radius);
+        c0[axis] = c1[axis] = slab;
+        for(int z = c0.z; z <= c1.z; z++)
+            for(int y = c0.y; y <= c1.y; y++)
+                for(int x = c0.x; x <= c1.x; x++)
+                {
+                    uint32_t cell = (z * m_dims.y + y) * m_dims.x + x;
+                    for(uint32_t k = m_cellStart[cell]; k < m_cellStart[cell+1]; k++)
+                        out.push_back(m_items[k]);
+                }
+    }
+}
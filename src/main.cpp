@@ -14,34 +14,108 @@
 #include <cstdint>
 #include <vector>
 #include <stack>
+#include <map>
+#include <set>
+#include <algorithm>
+#include <random>
 
 #include "Shader.h"
+#include "ShaderVariants.h"
+#include "Material.h"
+#include "LightClusters.h"
+#include "Eclipses.h"
+#include "SphereBVH.h"
+#include "CameraCollider.h"
+#include "FrameProfiler.h"
+#include "Conjunctions.h"
+#include "Scene.h"
+#include "Entities.h"
+#include "Atmosphere.h"
+#include "Orbits.h"
+#include "NBody.h"
+#include "Ephemeris.h"
+#include "AsteroidField.h"
+#include "AsteroidRenderer.h"
+#include "Rock.h"
+#include "PlanetRings.h"
+#include "DepthBuffer.h"
 #include "logger.h"
 
 #include "Sphere.h"
+#include "Image.h"
+#include "PathTracer.h"
+#include "Skybox.h"
+#include "ShaderCache.h"
+#include "ImageProcessing.h"
+#include "JobSystem.h"
+#include "FrameArena.h"
 
 #define WIDTH     1600
 #define HEIGHT    900
 #define FRAMERATE 60
 #define TIME_PER_FRAME_MS  (1.0f/FRAMERATE * 1e3)
 #define INDICE_TO_PTR(x) ((void*)(x))
+#define PATH_TRACER_PASSES 64
+#define PATH_TRACER_STAR_RADIANCE 8.0f
+#define BENCHMARK_WARMUP_FRAMES 2
+#define PROCEDURAL_MIN_TESSELLATION 8
+#define PROCEDURAL_MAX_TESSELLATION 128
+#define BENCHMARK_FRAMES 5
+#define CAMERA_NEAR 0.01f
+#define CAMERA_FAR  1000.0f
+#define CAMERA_RADIUS 0.05f //The camera collides with the bodies as a sphere of this radius, larger than the near plane so that they are never clipped
+#define STAR_LIGHT_RADIUS 10.5f //Covers the planets of a star but not the other star system
+#define ATMOSPHERE_SUN_INTENSITY 30.0f
+#define DEPTH_TEST_GAP 1e-3f       //Relative radius gap between the two spheres of --test-depth
+#define DEPTH_TEST_MAX_ERROR 0.01f //Fraction of z-fighting pixels tolerated in the best depth mode
+#define DEBRIS_COUNT 500          //Bodies of the N-body debris field around the second star (key N)
+#define DEBRIS_STAR_MASS 31.25    //G * M of the second star : the circular speed at 5 units gives the mean motion 0.5 of the scripted planets
+#define DEBRIS_FIELD_MASS 0.1     //Total mass of the field : the debris pull on each other, without leaving the belt
+#define NBODY_DRIFT_STEPS 100     //Steps of the --bench-nbody energy drift runs
+#define EPHEMERIS_DEGREE 12             //Degree of the Chebyshev polynomials of --ephemeris-import and --bench-ephemeris
+#define EPHEMERIS_TOLERANCE 1.0         //Largest fit error of the imported tables, in their unit (km for the JPL Horizons tables)
+#define EPHEMERIS_DAYS_PER_TIME 58.13   //Days of the ephemeris per unit of scene time : a year takes as long as the scripted Earth orbit (2 pi)
+#define EPHEMERIS_BENCH_YEARS 100       //Span of the daily samples of --bench-ephemeris
+#define EPHEMERIS_BENCH_LOOKUPS 1000000 //Random lookups timed by --bench-ephemeris
+#define AU_KM 1.495978707e8
+#define ASTEROID_COUNT 1000000      //Asteroids of the belt between Mars and Jupiter (key B)
+#define ASTEROID_SEED 2024
+#define ASTEROID_SUBDIVISIONS 1     //Icosphere level of the rock mesh : 320 triangles
+#define ASTEROID_MAX_BUDGET 80000   //Key M doubles the mesh budget up to this, then goes back to 0 (sprites only)
+#define BVH_REBUILD_COST 1.5         //The index of the bodies is rebuilt when its refits made the queries this much more expensive
+#define BVH_BENCH_QUERIES 10000      //Queries of each kind timed by --bench-bvh
+#define CONJUNCTION_BENCH_THRESHOLD 0.0005 //Separation reported by --bench-conjunctions, in scene units
+#define CONJUNCTION_BENCH_CHECKED 1000     //Bodies up to which --bench-conjunctions checks every pair against a dense sampling
+#define CONJUNCTION_BENCH_CHECK_THRESHOLD 0.02 //Separation of that check, wide enough for some pairs to come under it
+#define CONJUNCTION_BENCH_SAMPLES 20000    //Samples of the window in that check
+#define CONJUNCTION_BENCH_BLOCK 512        //Samples whose positions are computed at once in that check
+#define SCENE_PATH "Assets/solar_system.scene" //Bodies of the demo, replaced by --scene
+#define SCENE_BENCH_BODIES 100000   //Bodies of the scene generated by --bench-scene
+#define ENTITY_BENCH_COUNT 1000000  //Entities of --bench-entities
+#define ALLOCATION_TEST_WARMUP_FRAMES 120 //Frames of each phase of --test-allocations left to the shader compilations and the growth of the arenas
+#define ALLOCATION_TEST_FRAMES 300        //Frames of each phase of --test-allocations that must not allocate
+#define ALLOCATION_TEST_PHASES 4          //--test-allocations draws the scene as it is, then with the asteroid belt, then from inside the particles of the rings, then with the debris field
 
-struct Material {
-    glm::vec3 color;
-    float ka;
-    float kd;
-    float ks;
-    float alpha;
-    GLuint texture = 0;
-};
 struct objet {
     GLuint vboID = 0;
     Geometry* geometry = nullptr;
-    glm::mat4 localMatrix = glm::mat4(1.0f);
-    glm::mat4 propagatedMatrix = glm::mat4(1.0f);
+    glm::dmat4 localMatrix = glm::dmat4(1.0); //Double precision, so that the hierarchy can span true-scale distances
+    glm::dmat4 propagatedMatrix = glm::dmat4(1.0);
     std::vector<objet*> children;
     Material material;
     int etoile = 0;
+    int32_t bodyID = -1; //Index in the eclipse bodies of the frame, -1 if not drawn
+    Entity entity; //Holds the transform, the draw data and the light of the bodies of the frame loop, which write the matrices from it. None for the ones drawn by draw()
+    Atmosphere* atmosphere = nullptr; //Drawn around the body, shared between bodies
+    int32_t orbitID = -1; //Index in the Orbits moving the body around its parent, -1 if it is animated by hand
+    double spin = 0.0; //Rotation of the body on itself around +Y, in radians per unit of time
+    double tilt = 0.0; //Obliquity : the spin axis leans by this angle around +X, in radians
+    PlanetRings* rings = nullptr; //Drawn in the equatorial plane of the body
+    glm::dvec3 size = glm::dvec3(1.0);
+    int32_t nbodyID = -1; //Index in the NBody simulation moving the body, -1 if none
+    int32_t ephemerisID = -1; //Index of the body in the Ephemeris placing it, -1 if none. Replaces its orbit
+    double ephemerisScale = 1.0; //Scene units per unit of the ephemeris
+    const char* name = nullptr; //Name in the Scene it comes from, NULL for the bodies made by code
 };
 
 
@@ -51,729 +125,1786 @@ struct Light {
     glm::vec3 color;
 };
 
-void draw(objet& go, Shader* shader, std::stack<glm::mat4>& matrices, glm::vec3& cameraPosition, glm::mat4& view, glm::mat4& projection, glm::vec3 lightposition[]) {
-    glm::mat4 model = matrices.top() * go.localMatrix;
-    glm::mat4 mvp = projection * view * model;
-    glUseProgram(shader->getProgramID());
-    {
-        Material sphereMtl;
-        sphereMtl = go.material;
-        Light light;
-        if (go.etoile == 1) {
-            light = { lightposition[0], {1.0f, 1.0f, 1.0f} };
-        }
-        else {
-            light = { lightposition[1], {1.0f, 1.0f, 1.0f} };
-        }
-        glBindBuffer(GL_ARRAY_BUFFER, go.vboID);
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, go.material.texture);
-        GLint vPosition = glGetAttribLocation(shader->getProgramID(), "vPosition");
-        glVertexAttribPointer(vPosition, 3, GL_FLOAT, GL_FALSE, 0, 0);
-        glEnableVertexAttribArray(vPosition);
-        GLint vNormal = glGetAttribLocation(shader->getProgramID(), "vNormal");
-        glVertexAttribPointer(vNormal, 3, GL_FLOAT, GL_FALSE, 0, INDICE_TO_PTR(go.geometry->getNbVertices() * 3 * sizeof(float)));
-        glEnableVertexAttribArray(vNormal);
-        GLint UV = glGetAttribLocation(shader->getProgramID(), "Vuv");
-        glVertexAttribPointer(UV, 2, GL_FLOAT, GL_FALSE, 0, INDICE_TO_PTR(go.geometry->getNbVertices() * 6 * sizeof(float)));
-        glEnableVertexAttribArray(UV);
-        GLint uTexture = glGetAttribLocation(shader->getProgramID(), "uTexture");
-        glVertexAttribPointer(uTexture, 2, GL_FLOAT, GL_FALSE, 0, INDICE_TO_PTR(go.geometry->getNbVertices() * 6 * sizeof(float)));
-        glEnableVertexAttribArray(uTexture);
-        GLint uMVP = glGetUniformLocation(shader->getProgramID(), "uMVP");
-        GLint uModel = glGetUniformLocation(shader->getProgramID(), "uModel");
-        GLint uInvModel3x3 = glGetUniformLocation(shader->getProgramID(), "uInvModel3x3");
-        glUniformMatrix4fv(uMVP, 1, GL_FALSE, glm::value_ptr(mvp));
-        glUniformMatrix4fv(uModel, 1, GL_FALSE, glm::value_ptr(model));
-        glUniformMatrix3fv(uInvModel3x3, 1, GL_FALSE, glm::value_ptr(glm::mat3(glm::inverse(model))));
-        GLint uMtlColor = glGetUniformLocation(shader->getProgramID(), "uMtlColor");
-        GLint uMtlCts = glGetUniformLocation(shader->getProgramID(), "uMtlCts");
-        GLint uLightPos = glGetUniformLocation(shader->getProgramID(), "uLightPos");
-        GLint uLightColor = glGetUniformLocation(shader->getProgramID(), "uLightColor");
-        GLint uCameraPosition = glGetUniformLocation(shader->getProgramID(), "uCameraPosition");
-        glUniform3fv(uMtlColor, 1, glm::value_ptr(sphereMtl.color));
-        glUniform4f(uMtlCts, sphereMtl.ka, sphereMtl.kd, sphereMtl.ks, sphereMtl.alpha);
-        glUniform3fv(uLightPos, 1, glm::value_ptr(light.position));
-        glUniform3fv(uLightColor, 1, glm::value_ptr(light.color));
-        glUniform3fv(uCameraPosition, 1, glm::value_ptr(cameraPosition));
+enum GeometryMode {
+    GEOMETRY_MESH,     //Tessellated Sphere stored in vboSphereID
+    GEOMETRY_IMPOSTOR, //One quad per body, ray-sphere intersection in the fragment shader
+    GEOMETRY_PROCEDURAL, //No vertex buffer, the vertex shader rebuilds the Sphere vertices from gl_VertexID
+    GEOMETRY_COUNT
+};
 
+//The variant every body of the scene can be drawn with : textured, lit by one star
+constexpr uint32_t DEFAULT_SHADER_VARIANT = shaderFeatureBits(SHADER_FEATURE_TEXTURED, 1) | shaderFeatureBits(SHADER_FEATURE_NUM_LIGHTS, 1);
+//The variant of the planets in the frame loop, lit by the light clusters
+constexpr uint32_t CLUSTERED_SHADER_VARIANT = shaderFeatureBits(SHADER_FEATURE_TEXTURED, 1) | shaderFeatureBits(SHADER_FEATURE_CLUSTERED, 1);
+//The cheap unlit variant drawn while the others are compiled in the background. Built before the first frame
+constexpr uint32_t FALLBACK_SHADER_VARIANT = shaderFeatureBits(SHADER_FEATURE_TEXTURED, 1) | shaderFeatureBits(SHADER_FEATURE_EMISSIVE, 1);
+
+//The matrices of the bodies down the hierarchy, in the frame arena
+typedef std::stack<glm::dmat4, FrameVector<glm::dmat4>> MatrixStack;
+
+struct RenderContext {
+    ShaderVariants* shaders = nullptr;
+    ShaderVariants* impostorShaders = nullptr;
+    ShaderVariants* proceduralShaders = nullptr;
+    GLuint vboQuadID = 0;
+    GeometryMode geometryMode = GEOMETRY_MESH;
+    LightClusters* lightClusters = nullptr; //When set, the lights come from the clusters instead of lightposition[]
+    Eclipses* eclipses = nullptr;
+    DepthBuffer* depthBuffer = nullptr; //The depth mode of the frame, NULL for the standard one
+};
 
-        glDrawArrays(GL_TRIANGLES, 0, go.geometry->getNbVertices());
+void drawMesh(const Geometry* geometry, GLuint vboID, Shader* shader, const glm::mat4& model, const glm::mat4& mvp) {
+    glBindBuffer(GL_ARRAY_BUFFER, vboID);
+    GLint vPosition = glGetAttribLocation(shader->getProgramID(), "vPosition");
+    glVertexAttribPointer(vPosition, 3, GL_FLOAT, GL_FALSE, 0, 0);
+    glEnableVertexAttribArray(vPosition);
+    GLint vNormal = glGetAttribLocation(shader->getProgramID(), "vNormal");
+    glVertexAttribPointer(vNormal, 3, GL_FLOAT, GL_FALSE, 0, INDICE_TO_PTR(geometry->getNbVertices() * 3 * sizeof(float)));
+    glEnableVertexAttribArray(vNormal);
+    GLint UV = glGetAttribLocation(shader->getProgramID(), "Vuv");
+    glVertexAttribPointer(UV, 2, GL_FLOAT, GL_FALSE, 0, INDICE_TO_PTR(geometry->getNbVertices() * 6 * sizeof(float)));
+    glEnableVertexAttribArray(UV);
+    GLint uMVP = glGetUniformLocation(shader->getProgramID(), "uMVP");
+    GLint uModel = glGetUniformLocation(shader->getProgramID(), "uModel");
+    GLint uInvModel3x3 = glGetUniformLocation(shader->getProgramID(), "uInvModel3x3");
+    glUniformMatrix4fv(uMVP, 1, GL_FALSE, glm::value_ptr(mvp));
+    glUniformMatrix4fv(uModel, 1, GL_FALSE, glm::value_ptr(model));
+    glUniformMatrix3fv(uInvModel3x3, 1, GL_FALSE, glm::value_ptr(glm::mat3(glm::inverse(model))));
+
+    glDrawArrays(GL_TRIANGLES, 0, geometry->getNbVertices());
+    //The procedural spheres and the rings draw without arrays : none may stay on, pointing in this buffer
+    glDisableVertexAttribArray(UV);
+    glDisableVertexAttribArray(vNormal);
+    glDisableVertexAttribArray(vPosition);
+}
+
+void drawImpostor(GLuint vboQuadID, Shader* shader, const glm::mat4& model, const glm::mat4& view, const glm::mat4& projection) {
+    glBindBuffer(GL_ARRAY_BUFFER, vboQuadID);
+    GLint vCorner = glGetAttribLocation(shader->getProgramID(), "vCorner");
+    glVertexAttribPointer(vCorner, 2, GL_FLOAT, GL_FALSE, 0, 0);
+    glEnableVertexAttribArray(vCorner);
+    GLint uModel = glGetUniformLocation(shader->getProgramID(), "uModel");
+    GLint uView = glGetUniformLocation(shader->getProgramID(), "uView");
+    GLint uInvView = glGetUniformLocation(shader->getProgramID(), "uInvView");
+    GLint uProjection = glGetUniformLocation(shader->getProgramID(), "uProjection");
+    GLint uInvModel3x3 = glGetUniformLocation(shader->getProgramID(), "uInvModel3x3");
+    glUniformMatrix4fv(uModel, 1, GL_FALSE, glm::value_ptr(model));
+    glUniformMatrix4fv(uView, 1, GL_FALSE, glm::value_ptr(view));
+    glUniformMatrix4fv(uInvView, 1, GL_FALSE, glm::value_ptr(glm::inverse(view)));
+    glUniformMatrix4fv(uProjection, 1, GL_FALSE, glm::value_ptr(projection));
+    glUniformMatrix3fv(uInvModel3x3, 1, GL_FALSE, glm::value_ptr(glm::mat3(glm::inverse(model))));
+
+    glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+    glDisableVertexAttribArray(vCorner);
+}
 
+/* Gather the bodies under "go" for the eclipses, with the same matrices as draw(). The stars (etoile lights) are lit by nothing and hide nothing.
+ * Their index is given to the draw data of their entity */
+void collectEclipseBodies(objet& go, const glm::dmat4& parent, EntityWorld& entities, std::vector<EclipseBody>& bodies, std::vector<objet*>& objets) {
+    go.bodyID = -1;
+    if (go.geometry != nullptr) {
+        glm::mat4 model = glm::mat4(parent * go.localMatrix);
+        EclipseBody body;
+        body.center = glm::vec3(model[3]);
+        body.radius = 0.5f * glm::max(glm::length(glm::vec3(model[0])), glm::max(glm::length(glm::vec3(model[1])), glm::length(glm::vec3(model[2]))));
+        body.occluder = !go.material.isEmissive();
+        body.light = go.material.isEmissive() ? -1 : (go.etoile == 1 ? 0 : 1);
+        go.bodyID = (int32_t)bodies.size();
+        bodies.push_back(body);
+        objets.push_back(&go);
     }
-    glUseProgram(0);
-    matrices.push(matrices.top() * go.propagatedMatrix);
-    for (int i = 0; i < go.children.size(); i++) {
-        draw(*(go.children[i]), shader, matrices, cameraPosition, view, projection, lightposition);
+    RenderableComponent* renderable = entities.isAlive(go.entity) ? entities.get<RenderableComponent>(go.entity) : nullptr;
+    if (renderable != nullptr)
+        renderable->bodyID = go.bodyID;
+    for (size_t i = 0; i < go.children.size(); i++) {
+        collectEclipseBodies(*(go.children[i]), parent * go.propagatedMatrix, entities, bodies, objets);
     }
-    matrices.pop();
-
-
 }
 
-int main(int argc, char* argv[])
-{
-    ////////////////////////////////////////
-    //SDL2 / OpenGL Context initialization : 
-    ////////////////////////////////////////
-
-    //Initialize SDL2
-    if (SDL_Init(SDL_INIT_VIDEO | SDL_INIT_JOYSTICK) < 0)
-    {
-        ERROR("The initialization of the SDL failed : %s\n", SDL_GetError());
-        return 0;
+/* Gather the spheres the camera collides with under "go", in world space with the same matrices as draw(), in the order of collectEclipseBodies
+ * so that they share the index of the bodies. The star background gets a radius of 0 : it bounds the camera instead */
+void collectCollisionBodies(const objet& go, const glm::dmat4& parent, std::vector<glm::dvec3>& centers, std::vector<float>& radii) {
+    if (go.geometry != nullptr) {
+        glm::dmat4 model = parent * go.localMatrix;
+        centers.push_back(glm::dvec3(model[3]));
+        radii.push_back(go.material.sky ? 0.0f : (float)(0.5 * glm::max(glm::length(glm::dvec3(model[0])), glm::max(glm::length(glm::dvec3(model[1])), glm::length(glm::dvec3(model[2]))))));
     }
-    if (!(IMG_Init(IMG_INIT_PNG) & IMG_INIT_PNG)) {
-        ERROR("The initialization of the SDL_image failed : %s\n", IMG_GetError());
-        return EXIT_FAILURE;
+    for (size_t i = 0; i < go.children.size(); i++) {
+        collectCollisionBodies(*(go.children[i]), parent * go.propagatedMatrix, centers, radii);
     }
+}
 
+/* Draw the atmospheres of the bodies under "go", with the same matrices as draw(). Each one is lit by the star of its body */
+void drawAtmospheres(objet& go, const glm::dmat4& parent, const glm::vec3& cameraPosition, const glm::mat4& view, const glm::mat4& projection, glm::vec3 lightposition[], const DepthBuffer* depthBuffer) {
+    if (go.geometry != nullptr && go.atmosphere != nullptr) {
+        glm::mat4 model = glm::mat4(parent * go.localMatrix);
+        float radius = 0.5f * glm::max(glm::length(glm::vec3(model[0])), glm::max(glm::length(glm::vec3(model[1])), glm::length(glm::vec3(model[2]))));
+        glm::vec3 sun = go.etoile == 1 ? lightposition[0] : lightposition[1];
+        go.atmosphere->draw(glm::vec3(model[3]), radius, sun, ATMOSPHERE_SUN_INTENSITY, cameraPosition, view, projection, depthBuffer);
+    }
+    for (size_t i = 0; i < go.children.size(); i++) {
+        drawAtmospheres(*(go.children[i]), parent * go.propagatedMatrix, cameraPosition, view, projection, lightposition, depthBuffer);
+    }
+}
 
+/* Draw the rings of the bodies under "go", with the same matrices as draw(). Each one is lit by the star of its body */
+void drawRings(objet& go, const glm::dmat4& parent, double t, const glm::mat4& view, const glm::mat4& projection, glm::vec3 lightposition[], const DepthBuffer* depthBuffer) {
+    if (go.geometry != nullptr && go.rings != nullptr) {
+        glm::mat4 model = glm::mat4(parent * go.localMatrix);
+        float radius = 0.5f * glm::max(glm::length(glm::vec3(model[0])), glm::max(glm::length(glm::vec3(model[1])), glm::length(glm::vec3(model[2]))));
+        //The equator of the body, without its spin
+        glm::mat3 orientation = glm::mat3(glm::rotate(glm::mat4(1.0f), (float)go.tilt, glm::vec3(1.0f, 0.0f, 0.0f)));
+        glm::vec3 sun = go.etoile == 1 ? lightposition[0] : lightposition[1];
+        go.rings->draw(glm::vec3(model[3]), radius, orientation, sun, t, view, projection, depthBuffer);
+    }
+    for (size_t i = 0; i < go.children.size(); i++) {
+        drawRings(*(go.children[i]), parent * go.propagatedMatrix, t, view, projection, lightposition, depthBuffer);
+    }
+}
 
-    //Create a Window
-    SDL_Window* window = SDL_CreateWindow("Diving Throught Space",                           //Titre
-        SDL_WINDOWPOS_UNDEFINED,               //X Position
-        SDL_WINDOWPOS_UNDEFINED,               //Y Position
-        WIDTH, HEIGHT,                         //Resolution
-        SDL_WINDOW_OPENGL | SDL_WINDOW_SHOWN); //Flags (OpenGL + Show)
-
-//Initialize OpenGL Version (version 3.0)
-    SDL_GL_SetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION, 3);
-    SDL_GL_SetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, 0);
+/* Find a point of the rings of the first ringed body under "go", just above their plane where they draw their particles, with the same matrices as draw()
+ * \return true if a body under "go" has rings */
+bool findRingViewpoint(const objet& go, const glm::dmat4& parent, glm::dvec3& position) {
+    if (go.geometry != nullptr && go.rings != nullptr) {
+        glm::dmat4 model = parent * go.localMatrix;
+        double radius = 0.5 * glm::max(glm::length(glm::dvec3(model[0])), glm::max(glm::length(glm::dvec3(model[1])), glm::length(glm::dvec3(model[2]))));
+        glm::dmat3 orientation = glm::dmat3(glm::rotate(glm::dmat4(1.0), go.tilt, glm::dvec3(1.0, 0.0, 0.0)));
+        const RingParameters& params = go.rings->getParameters();
+        glm::dvec3 local(0.5 * (params.innerRadius + params.outerRadius), 0.25 * params.particleDistance, 0.0);
+        position = glm::dvec3(model[3]) + orientation * local * radius;
+        return true;
+    }
+    for (size_t i = 0; i < go.children.size(); i++) {
+        if (findRingViewpoint(*(go.children[i]), parent * go.propagatedMatrix, position))
+            return true;
+    }
+    return false;
+}
 
-    //Initialize the OpenGL Context (where OpenGL resources (Graphics card resources) lives)
-    SDL_GLContext context = SDL_GL_CreateContext(window);
+/* Give an orbit to a body. Its matrices are then written by applyOrbits, or from its entity */
+void addOrbit(objet& go, Orbits& orbits, const KeplerElements& elements, double spin, const glm::dvec3& size) {
+    go.orbitID = (int32_t)orbits.add(elements);
+    go.spin = spin;
+    go.size = size;
+}
 
-    //Tells GLEW to initialize the OpenGL function with this version
-    glewExperimental = GL_TRUE;
-    glewInit();
+/* Create the bodies of a scene in "bodies", parents first, with their material and orbit, and their entities in "entities". "textures" holds the
+ * GL textures of the scene ones. The children are pointers into "bodies" : it must not be resized afterwards */
+void instantiateScene(const Scene& scene, std::vector<objet>& bodies, EntityWorld& entities, Orbits& orbits, const std::vector<GLuint>& textures, Geometry* geometry, GLuint vboID) {
+    const ComponentMask components = componentBit(COMPONENT_TRANSFORM) | componentBit(COMPONENT_RENDERABLE) | componentBit(COMPONENT_MATERIAL) |
+                                     componentBit(COMPONENT_ORBIT) | componentBit(COMPONENT_COLLIDER);
+    //A body without orbit stays at the center of its parent : a null orbit still applies its spin and size
+    KeplerElements still;
+    still.semiMajorAxis = 0.0f;
+    bodies.assign(scene.getNbBodies(), objet());
+    for (uint32_t i = 0; i < scene.getNbBodies(); i++) {
+        const SceneBody& body = scene.getBody(i);
+        objet& go = bodies[i];
+        go.name = scene.getString(body.name);
+        go.geometry = geometry;
+        go.vboID = vboID;
+        go.material = Material{ body.color, body.ka, body.kd, body.ks, body.alpha, body.texture >= 0 ? textures[body.texture] : 0, body.sky != 0 };
+        go.etoile = body.lit;
+        go.tilt = body.tilt;
+        addOrbit(go, orbits, body.hasOrbit ? body.orbit : still, body.spin, glm::dvec3(body.size));
+        if (body.parent >= 0)
+            bodies[body.parent].children.push_back(&go);
+
+        //The stars light the frame : lights[0] and lights[1] are the ones with light=1 and light=2
+        go.entity = entities.create(body.light != 0 ? components | componentBit(COMPONENT_LIGHT) : components);
+        EntitySystems::setParent(entities, go.entity, body.parent >= 0 ? bodies[body.parent].entity : Entity());
+        RenderableComponent* renderable = entities.get<RenderableComponent>(go.entity);
+        renderable->geometry = geometry;
+        renderable->vboID = vboID;
+        MaterialComponent* material = entities.get<MaterialComponent>(go.entity);
+        material->material = go.material;
+        material->lit = go.etoile;
+        OrbitComponent* orbit = entities.get<OrbitComponent>(go.entity);
+        orbit->orbitID = (uint32_t)go.orbitID;
+        orbit->spin = (float)go.spin;
+        orbit->tilt = (float)go.tilt;
+        orbit->size = glm::vec3(body.size);
+        entities.get<ColliderComponent>(go.entity)->radius = 0.5f * glm::max(body.size[0], glm::max(body.size[1], body.size[2]));
+        if (body.light != 0) {
+            LightComponent* light = entities.get<LightComponent>(go.entity);
+            light->radius = STAR_LIGHT_RADIUS;
+            light->index = body.light - 1;
+        }
+    }
+}
 
+/* Write the transforms of the entities in the matrices of the bodies under "go", for the passes that walk the objet tree. Only the position is passed to the children */
+void applyTransforms(objet& go, EntityWorld& entities) {
+    if (entities.isAlive(go.entity)) {
+        const TransformComponent* transform = entities.get<TransformComponent>(go.entity);
+        go.propagatedMatrix = glm::translate(glm::dmat4(1.0), transform->position);
+        go.localMatrix = go.propagatedMatrix * glm::dmat4(glm::dmat3(transform->basis));
+    }
+    for (size_t i = 0; i < go.children.size(); i++) {
+        applyTransforms(*(go.children[i]), entities);
+    }
+}
 
-    //Start using OpenGL to draw something on screen
-    glViewport(0, 0, WIDTH, HEIGHT); //Draw on ALL the screen
+/* Write the positions of the last Orbits::propagate in the matrices of the bodies under "go". Only the position is passed to the children */
+void applyOrbits(objet& go, const Orbits& orbits, double t) {
+    if (go.orbitID >= 0) {
+        glm::dmat4 position = glm::translate(glm::dmat4(1.0), glm::dvec3(orbits.getPosition(go.orbitID)));
+        go.localMatrix = position * glm::rotate(glm::dmat4(1.0), go.tilt, glm::dvec3(1.0, 0.0, 0.0)) * glm::rotate(glm::dmat4(1.0), go.spin * t, glm::dvec3(0.0, 1.0, 0.0))
+                       * glm::scale(glm::dmat4(1.0), go.size);
+        go.propagatedMatrix = position;
+    }
+    for (size_t i = 0; i < go.children.size(); i++) {
+        applyOrbits(*(go.children[i]), orbits, t);
+    }
+}
 
-    //The OpenGL background color (RGBA, each component between 0.0f and 1.0f)
-    glClearColor(0.0, 0.0, 0.0, 1.0); //Full Black  
+/* Write the positions of the NBody simulation in the transforms of the entities of the bodies under "go" */
+void applyNBody(objet& go, EntityWorld& entities, const NBody& nbody) {
+    if (go.nbodyID >= 0 && entities.isAlive(go.entity))
+        entities.get<TransformComponent>(go.entity)->position = nbody.getPosition(go.nbodyID);
+    for (size_t i = 0; i < go.children.size(); i++) {
+        applyNBody(*(go.children[i]), entities, nbody);
+    }
+}
 
-    glEnable(GL_DEPTH_TEST); //Active the depth test
+/* Place a body with an ephemeris instead of its Keplerian orbit. The scene is not to scale : the positions are scaled so that the mean
+ * distance of the body matches the semi-major axis of its scripted orbit. Its direction, and how far it swings from the mean, are the ephemeris ones */
+bool addEphemeris(objet& go, const Ephemeris& ephemeris, int32_t bodyID, double semiMajorAxis) {
+    go.ephemerisID = ephemeris.findBody(bodyID);
+    if (go.ephemerisID < 0) {
+        WARNING("The ephemeris has no body %d, it keeps its orbit\n", bodyID);
+        return false;
+    }
+    double start = ephemeris.getStartTime(go.ephemerisID);
+    double end = ephemeris.getEndTime(go.ephemerisID);
+    double meanDistance = 0.0;
+    for (uint32_t i = 0; i < 256; i++)
+        meanDistance += glm::length(ephemeris.getPosition(go.ephemerisID, start + (end - start) * (i + 0.5) / 256.0)) / 256.0;
+    go.ephemerisScale = meanDistance > 0.0 ? semiMajorAxis / meanDistance : 1.0;
+    return true;
+}
 
+/* Write the ephemeris positions at "date" in the transforms of the entities of the bodies under "go", after EntitySystems::updateOrbits : they keep its
+ * spin and tilt. The tables are Z-up (ecliptic), the scene Y-up */
+void applyEphemeris(objet& go, EntityWorld& entities, const Ephemeris& ephemeris, double date) {
+    if (go.ephemerisID >= 0 && entities.isAlive(go.entity)) {
+        glm::dvec3 p = go.ephemerisScale * ephemeris.getPosition(go.ephemerisID, date);
+        entities.get<TransformComponent>(go.entity)->position = glm::dvec3(p.x, p.z, -p.y);
+    }
+    for (size_t i = 0; i < go.children.size(); i++) {
+        applyEphemeris(*(go.children[i]), entities, ephemeris, date);
+    }
+}
 
+/* Load the variants of a vertex / fragment file pair. NULL if a file is missing */
+ShaderVariants* loadShaderVariants(const char* vertPath, const char* fragPath) {
+    FILE* vert = fopen(vertPath, "r");
+    FILE* frag = fopen(fragPath, "r");
+    ShaderVariants* variants = ShaderVariants::loadFromFiles(vert, frag);
+    if (vert != nullptr)
+        fclose(vert);
+    if (frag != nullptr)
+        fclose(frag);
+    return variants;
+}
 
+/* Tessellation of a procedural sphere from its size on screen */
+uint32_t proceduralTessellation(const glm::mat4& model, const glm::mat4& view, const glm::mat4& projection) {
+    glm::vec3 center = glm::vec3(view * model[3]);
+    float radius = 0.5f * glm::max(glm::length(glm::vec3(model[0])), glm::max(glm::length(glm::vec3(model[1])), glm::length(glm::vec3(model[2]))));
+    float pixels = radius * projection[1][1] * HEIGHT * 0.5f / glm::max(-center.z, 0.01f);
+    return (uint32_t)glm::clamp(pixels / 4.0f, (float)PROCEDURAL_MIN_TESSELLATION, (float)PROCEDURAL_MAX_TESSELLATION);
+}
 
+void drawProcedural(Shader* shader, const glm::mat4& model, const glm::mat4& mvp, uint32_t tessellation) {
+    GLint uNbLatitude = glGetUniformLocation(shader->getProgramID(), "uNbLatitude");
+    GLint uNbLongitude = glGetUniformLocation(shader->getProgramID(), "uNbLongitude");
+    GLint uMVP = glGetUniformLocation(shader->getProgramID(), "uMVP");
+    GLint uModel = glGetUniformLocation(shader->getProgramID(), "uModel");
+    GLint uInvModel3x3 = glGetUniformLocation(shader->getProgramID(), "uInvModel3x3");
+    glUniform1i(uNbLatitude, tessellation);
+    glUniform1i(uNbLongitude, tessellation);
+    glUniformMatrix4fv(uMVP, 1, GL_FALSE, glm::value_ptr(mvp));
+    glUniformMatrix4fv(uModel, 1, GL_FALSE, glm::value_ptr(model));
+    glUniformMatrix3fv(uInvModel3x3, 1, GL_FALSE, glm::value_ptr(glm::mat3(glm::inverse(model))));
+
+    //The vertices come from gl_VertexID alone. drawMesh and drawImpostor leave no array on, which would be fetched past its buffer
+    glDrawArrays(GL_TRIANGLES, 0, Sphere::countVertices(tessellation, tessellation));
+}
 
-    SDL_Surface* imgSun = IMG_Load("Assets/8k_sun.jpg");
-
-    SDL_Surface* imgMercury = IMG_Load("Assets/8k_mercury.jpg");
-    SDL_Surface* imgSertAr = IMG_Load("Assets/elcockpito.png");
-    SDL_Surface* ImgVenus = IMG_Load("Assets/8k_venus_surface.jpg");
-    SDL_Surface* ImgTerre = IMG_Load("Assets/myP.png");
-    SDL_Surface* ImgMars = IMG_Load("Assets/8k_mars.jpg");
-    SDL_Surface* ImgJupiter = IMG_Load("Assets/8k_jupiter.jpg");
-    SDL_Surface* ImgSaturne = IMG_Load("Assets/8k_saturn.jpg");
-    SDL_Surface* ImgUranus = IMG_Load("Assets/2k_uranus.jpg");
-    SDL_Surface* ImgNeptune = IMG_Load("Assets/2k_neptune.jpg");
-    SDL_Surface* ImgMoon = IMG_Load("Assets/8k_moon.jpg");
-    SDL_Surface* ImgStar = IMG_Load("Assets/8k_stars.jpg");
-
-    //sci fi part 
-    SDL_Surface* Imgpandora = IMG_Load("Assets/pandora.jpg");
-    SDL_Surface* Imgcoruscant = IMG_Load("Assets/coruscant.jpeg");
-    SDL_Surface* Imgdiana = IMG_Load("Assets/diana.jpg");
-    SDL_Surface* Imganubis = IMG_Load("Assets/anubis.jpg");
-
-    SDL_Surface* Imgloki = IMG_Load("Assets/loki.png");
-    SDL_Surface* ImgdeathStar = IMG_Load("Assets/death-star.png");
-    SDL_Surface* Imgnaruto = IMG_Load("Assets/naruto.jpg");
-    SDL_Surface* Imgisis = IMG_Load("Assets/isis.jpg");
-
-
-
-    SDL_Surface* rgbImgSun = SDL_ConvertSurfaceFormat(imgSun, SDL_PIXELFORMAT_RGBA32, 0);
-    SDL_Surface* rgbImgMercure = SDL_ConvertSurfaceFormat(imgMercury, SDL_PIXELFORMAT_RGBA32, 0);
-    SDL_Surface* rgbImg2 = SDL_ConvertSurfaceFormat(imgSertAr, SDL_PIXELFORMAT_RGBA32, 0);
-    SDL_Surface* rgbImgVenus = SDL_ConvertSurfaceFormat(ImgVenus, SDL_PIXELFORMAT_RGBA32, 0);
-    SDL_Surface* rgbImgTerre = SDL_ConvertSurfaceFormat(ImgTerre, SDL_PIXELFORMAT_RGBA32, 0);
-    SDL_Surface* rgbImgMars = SDL_ConvertSurfaceFormat(ImgMars, SDL_PIXELFORMAT_RGBA32, 0);
-    SDL_Surface* rgbImgJupiter = SDL_ConvertSurfaceFormat(ImgJupiter, SDL_PIXELFORMAT_RGBA32, 0);
-    SDL_Surface* rgbImgSaturne = SDL_ConvertSurfaceFormat(ImgSaturne, SDL_PIXELFORMAT_RGBA32, 0);
-    SDL_Surface* rgbImgUranus = SDL_ConvertSurfaceFormat(ImgUranus, SDL_PIXELFORMAT_RGBA32, 0);
-    SDL_Surface* rgbImgNeptune = SDL_ConvertSurfaceFormat(ImgNeptune, SDL_PIXELFORMAT_RGBA32, 0);
-    SDL_Surface* rgbImgMoon = SDL_ConvertSurfaceFormat(ImgMoon, SDL_PIXELFORMAT_RGBA32, 0);
-    SDL_Surface* rgbImgSTAR = SDL_ConvertSurfaceFormat(ImgStar, SDL_PIXELFORMAT_RGBA32, 0);
-
-    //scifi part 
-    SDL_Surface* rgbImgpandora = SDL_ConvertSurfaceFormat(Imgpandora, SDL_PIXELFORMAT_RGBA32, 0);
-    SDL_Surface* rgbImgcoruscant = SDL_ConvertSurfaceFormat(Imgcoruscant, SDL_PIXELFORMAT_RGBA32, 0);
-    SDL_Surface* rgbImgdiana = SDL_ConvertSurfaceFormat(Imgdiana, SDL_PIXELFORMAT_RGBA32, 0);
-    SDL_Surface* rgbImganubis = SDL_ConvertSurfaceFormat(Imganubis, SDL_PIXELFORMAT_RGBA32, 0);
-
-    SDL_Surface* rgbloki = SDL_ConvertSurfaceFormat(Imgloki, SDL_PIXELFORMAT_RGBA32, 0);
-    SDL_Surface* rgbImgdeathStar = SDL_ConvertSurfaceFormat(ImgdeathStar, SDL_PIXELFORMAT_RGBA32, 0);
-    SDL_Surface* rgbImgnaruto = SDL_ConvertSurfaceFormat(Imgnaruto, SDL_PIXELFORMAT_RGBA32, 0);
-    SDL_Surface* rgbImgisis = SDL_ConvertSurfaceFormat(Imgisis, SDL_PIXELFORMAT_RGBA32, 0);
-
-
-
-    SDL_FreeSurface(imgSun);
-    SDL_FreeSurface(imgSertAr);
-    SDL_FreeSurface(imgMercury);
-    SDL_FreeSurface(ImgVenus);
-    SDL_FreeSurface(ImgTerre);
-    SDL_FreeSurface(ImgMars);
-    SDL_FreeSurface(ImgJupiter);
-    SDL_FreeSurface(ImgSaturne);
-    SDL_FreeSurface(ImgUranus);
-    SDL_FreeSurface(ImgNeptune);
-    SDL_FreeSurface(ImgMoon);
-    SDL_FreeSurface(ImgStar);
-
-    //scifi part 
-    SDL_FreeSurface(Imgpandora);
-    SDL_FreeSurface(Imgcoruscant);
-    SDL_FreeSurface(Imgdiana);
-    SDL_FreeSurface(Imganubis);
-
-    SDL_FreeSurface(Imgloki);
-    SDL_FreeSurface(ImgdeathStar);
-    SDL_FreeSurface(Imgnaruto);
-    SDL_FreeSurface(Imgisis);
-
-    //sicfi part 
-    GLuint texturepandora;
-    glGenTextures(1, &texturepandora);
-    std::cout << glGetError() << std::endl;
-    glBindTexture(GL_TEXTURE_2D, texturepandora);
-    {
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, rgbImgpandora->w, rgbImgSun->h, 0, GL_RGBA, GL_UNSIGNED_BYTE, (GLvoid*)rgbImgpandora->pixels);
-        glGenerateMipmap(GL_TEXTURE_2D);
+/* Impostors only work when the camera is outside of the sphere (the star background is not) */
+bool useImpostor(const RenderContext& context, const glm::mat4& model, const glm::mat4& view) {
+    if (context.geometryMode != GEOMETRY_IMPOSTOR || context.impostorShaders == nullptr)
+        return false;
+    glm::vec3 eye = glm::vec3(glm::inverse(view)[3]);
+    float radius = 0.5f * glm::max(glm::length(glm::vec3(model[0])), glm::max(glm::length(glm::vec3(model[1])), glm::length(glm::vec3(model[2]))));
+    return glm::length(eye - glm::vec3(model[3])) > radius * 1.01f;
+}
 
+/* Draw a body with its material and lights. "bodyID" is its index in the eclipse bodies of the frame, -1 if it has none */
+void drawBody(RenderContext& context, const glm::mat4& model, Geometry* geometry, GLuint vboID, const Material& material, int etoile, int32_t bodyID,
+              glm::vec3& cameraPosition, glm::mat4& view, glm::mat4& projection, glm::vec3 lightposition[]) {
+    glm::mat4 mvp = projection * view * model;
+    bool eclipsed = context.eclipses != nullptr && bodyID >= 0 && context.eclipses->getShadow(bodyID).nbOccluders > 0;
+    uint32_t depthBits = context.depthBuffer != nullptr ? context.depthBuffer->getVariantBits() : 0;
+    uint32_t variantKey = material.getVariantKey(1, context.lightClusters != nullptr, eclipsed) | depthBits;
+    bool impostor = useImpostor(context, model, view);
+    bool procedural = !impostor && context.geometryMode == GEOMETRY_PROCEDURAL && context.proceduralShaders != nullptr;
+    Shader* shader = impostor ? context.impostorShaders->tryGet(variantKey) : (procedural ? context.proceduralShaders->tryGet(variantKey) : nullptr);
+    if (shader == nullptr) {
+        impostor = procedural = false;
+        shader = context.shaders->tryGet(variantKey);
     }
-    glBindTexture(GL_TEXTURE_2D, 0);
-    SDL_FreeSurface(rgbImgpandora);
-
-
-    GLuint texturecoruscant;
-    glGenTextures(1, &texturecoruscant);
-    std::cout << glGetError() << std::endl;
-    glBindTexture(GL_TEXTURE_2D, texturecoruscant);
+    if (shader == nullptr)
+        shader = context.shaders->get(FALLBACK_SHADER_VARIANT | depthBits);
+    if (geometry != nullptr && shader != nullptr)
     {
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, rgbImgcoruscant->w, rgbImgcoruscant->h, 0, GL_RGBA, GL_UNSIGNED_BYTE, (GLvoid*)rgbImgcoruscant->pixels);
-        glGenerateMipmap(GL_TEXTURE_2D);
+        glUseProgram(shader->getProgramID());
+        if (context.depthBuffer != nullptr)
+            context.depthBuffer->bind(shader);
+        Material sphereMtl;
+        sphereMtl = material;
+        Light light;
+        if (etoile == 1) {
+            light = { lightposition[0], {1.0f, 1.0f, 1.0f} };
+        }
+        else {
+            light = { lightposition[1], {1.0f, 1.0f, 1.0f} };
+        }
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, material.texture);
+        GLint uMtlColor = glGetUniformLocation(shader->getProgramID(), "uMtlColor");
+        GLint uMtlCts = glGetUniformLocation(shader->getProgramID(), "uMtlCts");
+        GLint uLightPos = glGetUniformLocation(shader->getProgramID(), "uLightPos");
+        GLint uLightColor = glGetUniformLocation(shader->getProgramID(), "uLightColor");
+        GLint uCameraPosition = glGetUniformLocation(shader->getProgramID(), "uCameraPosition");
+        glUniform3fv(uMtlColor, 1, glm::value_ptr(sphereMtl.color));
+        glUniform4f(uMtlCts, sphereMtl.ka, sphereMtl.kd, sphereMtl.ks, sphereMtl.alpha);
+        glUniform3fv(uLightPos, 1, glm::value_ptr(light.position));
+        glUniform3fv(uLightColor, 1, glm::value_ptr(light.color));
+        glUniform3fv(uCameraPosition, 1, glm::value_ptr(cameraPosition));
+        if (context.lightClusters != nullptr) {
+            context.lightClusters->bind(shader);
+            GLint uView = glGetUniformLocation(shader->getProgramID(), "uView");
+            glUniformMatrix4fv(uView, 1, GL_FALSE, glm::value_ptr(view));
+        }
+        if (eclipsed)
+            context.eclipses->bind(shader, bodyID);
+
+        if (impostor)
+            drawImpostor(context.vboQuadID, shader, model, view, projection);
+        else if (procedural)
+            drawProcedural(shader, model, mvp, proceduralTessellation(model, view, projection));
+        else
+            drawMesh(geometry, vboID, shader, model, mvp);
+        glUseProgram(0);
+    }
+}
 
+/* Draw the bodies under "go" from their matrices, for the passes without entities.
+ * The matrices are camera-relative : the stack starts with the translation by -camera, in double, and only the result is rounded to float.
+ * So view only holds the rotation of the camera and cameraPosition is the origin */
+void draw(objet& go, RenderContext& context, MatrixStack& matrices, glm::vec3& cameraPosition, glm::mat4& view, glm::mat4& projection, glm::vec3 lightposition[]) {
+    drawBody(context, glm::mat4(matrices.top() * go.localMatrix), go.geometry, go.vboID, go.material, go.etoile, go.bodyID, cameraPosition, view, projection, lightposition);
+    matrices.push(matrices.top() * go.propagatedMatrix);
+    for (int i = 0; i < go.children.size(); i++) {
+        draw(*(go.children[i]), context, matrices, cameraPosition, view, projection, lightposition);
     }
-    glBindTexture(GL_TEXTURE_2D, 0);
-    SDL_FreeSurface(rgbImgcoruscant);
+    matrices.pop();
 
 
+}
 
-    GLuint texturediana;
-    glGenTextures(1, &texturediana);
-    std::cout << glGetError() << std::endl;
-    glBindTexture(GL_TEXTURE_2D, texturediana);
+/* Load an equirectangular texture with its mip chain, filtered on the job threads by ImageProcessing */
+GLuint loadTexture(const char* path, std::map<GLuint, const char*>& textureAssets) {
+    GLuint texture;
+    glGenTextures(1, &texture);
+    textureAssets[texture] = path;
+    Image* image = Image::loadFromFile(path);
+    glBindTexture(GL_TEXTURE_2D, texture);
     {
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, rgbImgdiana->w, rgbImgdiana->h, 0, GL_RGBA, GL_UNSIGNED_BYTE, (GLvoid*)rgbImgdiana->pixels);
-        glGenerateMipmap(GL_TEXTURE_2D);
-
+        if (image != nullptr) {
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, image->getWidth(), image->getHeight(), 0, GL_RGBA, GL_UNSIGNED_BYTE, (GLvoid*)image->getPixels());
+
+            uint64_t begin = SDL_GetPerformanceCounter();
+            std::vector<Image*> mips = ImageProcessing::buildMipChain(*image, MIP_FILTER_LANCZOS3, true);
+            double seconds = (SDL_GetPerformanceCounter() - begin) / (double)SDL_GetPerformanceFrequency();
+
+            double megapixels = image->getWidth() * (double)image->getHeight() * 1e-6;
+            for (size_t i = 0; i < mips.size(); i++) {
+                glTexImage2D(GL_TEXTURE_2D, (GLint)i + 1, GL_RGBA8, mips[i]->getWidth(), mips[i]->getHeight(), 0, GL_RGBA, GL_UNSIGNED_BYTE, (GLvoid*)mips[i]->getPixels());
+                if (i + 1 < mips.size())
+                    megapixels += mips[i]->getWidth() * (double)mips[i]->getHeight() * 1e-6;
+                delete mips[i];
+            }
+            INFO("%s : %ux%u, %u mip levels in %.1f ms (%.1f MP/s per core)\n", path, image->getWidth(), image->getHeight(), (uint32_t)mips.size(),
+                 seconds * 1e3, megapixels / seconds / JobSystem::get().getNbThreads());
+            delete image;
+        }
     }
     glBindTexture(GL_TEXTURE_2D, 0);
-    SDL_FreeSurface(rgbImgdiana);
-
-
-    GLuint textureanubis;
-    glGenTextures(1, &textureanubis);
-    std::cout << glGetError() << std::endl;
-    glBindTexture(GL_TEXTURE_2D, textureanubis);
-    {
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, rgbImganubis->w, rgbImganubis->h, 0, GL_RGBA, GL_UNSIGNED_BYTE, (GLvoid*)rgbImganubis->pixels);
-        glGenerateMipmap(GL_TEXTURE_2D);
+    return texture;
+}
 
+/* Gather the bodies under "go" as analytic spheres, with the same matrices as draw() */
+void collectSpheres(objet& go, const glm::dmat4& parent, std::vector<PTSphere>& spheres, std::vector<objet*>& sources, std::set<objet*>& visited, std::map<GLuint, Image*>& images) {
+    if (!visited.insert(&go).second)
+        return;
+    if (go.geometry != nullptr) {
+        glm::mat4 model = glm::mat4(parent * go.localMatrix);
+        glm::mat3 linear(model);
+        PTSphere sphere;
+        sphere.center = glm::vec3(model[3]);
+        sphere.radius = 0.5f * glm::max(glm::length(linear[0]), glm::max(glm::length(linear[1]), glm::length(linear[2])));
+        sphere.worldToLocal = glm::inverse(linear);
+        sphere.albedo = glm::vec3(go.material.kd);
+        sphere.texture = images[go.material.texture];
+        spheres.push_back(sphere);
+        sources.push_back(&go);
     }
-    glBindTexture(GL_TEXTURE_2D, 0);
-    SDL_FreeSurface(rgbImganubis);
-
-
-    GLuint textureloki;
-    glGenTextures(1, &textureloki);
-    std::cout << glGetError() << std::endl;
-    glBindTexture(GL_TEXTURE_2D, textureloki);
-    {
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, rgbloki->w, rgbloki->h, 0, GL_RGBA, GL_UNSIGNED_BYTE, (GLvoid*)rgbloki->pixels);
-        glGenerateMipmap(GL_TEXTURE_2D);
-
+    for (size_t i = 0; i < go.children.size(); i++) {
+        collectSpheres(*(go.children[i]), parent * go.propagatedMatrix, spheres, sources, visited, images);
     }
-    glBindTexture(GL_TEXTURE_2D, 0);
-    SDL_FreeSurface(rgbloki);
-
-
-    GLuint texturedeathStar;
-    glGenTextures(1, &texturedeathStar);
-    std::cout << glGetError() << std::endl;
-    glBindTexture(GL_TEXTURE_2D, texturedeathStar);
-    {
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, rgbImgdeathStar->w, rgbImgdeathStar->h, 0, GL_RGBA, GL_UNSIGNED_BYTE, (GLvoid*)rgbImgdeathStar->pixels);
-        glGenerateMipmap(GL_TEXTURE_2D);
+}
 
+/* Offline render of the current frame with the path tracer. The stars are the area lights and the sky is the environment */
+void renderPathTraced(objet& sky, const std::vector<objet*>& stars, const std::map<GLuint, const char*>& textureAssets, std::map<GLuint, Image*>& images, const glm::dmat4& root, const glm::mat4& view, const glm::mat4& projection) {
+    /* The CPU copies of the textures are loaded from Assets/ on first use */
+    for (auto& asset : textureAssets) {
+        if (images.find(asset.first) == images.end())
+            images[asset.first] = Image::loadFromFile(asset.second);
     }
-    glBindTexture(GL_TEXTURE_2D, 0);
-    SDL_FreeSurface(rgbImgdeathStar);
 
+    std::vector<PTSphere> spheres;
+    std::vector<objet*> sources;
+    std::set<objet*> visited;
+    visited.insert(&sky);
+    for (size_t i = 0; i < sky.children.size(); i++) {
+        collectSpheres(*(sky.children[i]), root * sky.propagatedMatrix, spheres, sources, visited, images);
+    }
+    for (size_t i = 0; i < sources.size(); i++) {
+        for (objet* star : stars) {
+            if (sources[i] == star)
+                spheres[i].emission = glm::vec3(PATH_TRACER_STAR_RADIANCE * star->material.ka);
+        }
+    }
 
-    GLuint texturenaruto;
-    glGenTextures(1, &texturenaruto);
-    std::cout << glGetError() << std::endl;
-    glBindTexture(GL_TEXTURE_2D, texturenaruto);
-    {
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, rgbImgnaruto->w, rgbImgnaruto->h, 0, GL_RGBA, GL_UNSIGNED_BYTE, (GLvoid*)rgbImgnaruto->pixels);
-        glGenerateMipmap(GL_TEXTURE_2D);
+    PathTracer pathTracer(WIDTH, HEIGHT);
+    pathTracer.setScene(spheres, images[sky.material.texture], sky.material.ka);
+    pathTracer.setCamera(glm::inverse(projection * view), glm::vec3(glm::inverse(view)[3]));
 
+    INFO("Path tracing %u spheres, %u passes\n", (uint32_t)spheres.size(), PATH_TRACER_PASSES);
+    double totalRaysPerSecond = 0.0;
+    for (uint32_t i = 0; i < PATH_TRACER_PASSES; i++) {
+        pathTracer.renderPass();
+        totalRaysPerSecond += pathTracer.getLastRaysPerSecond();
+        INFO("Pass %u : %.2f Mrays/s\n", pathTracer.getNbPasses(), pathTracer.getLastRaysPerSecond() * 1e-6);
     }
-    glBindTexture(GL_TEXTURE_2D, 0);
-    SDL_FreeSurface(rgbImgnaruto);
+    INFO("Average : %.2f Mrays/s\n", totalRaysPerSecond / PATH_TRACER_PASSES * 1e-6);
 
+    if (pathTracer.saveToPPM("render.ppm"))
+        INFO("Render saved to render.ppm\n");
+}
 
-    GLuint textureisis;
-    glGenTextures(1, &textureisis);
-    std::cout << glGetError() << std::endl;
-    glBindTexture(GL_TEXTURE_2D, textureisis);
-    {
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, rgbImgisis->w, rgbImgisis->h, 0, GL_RGBA, GL_UNSIGNED_BYTE, (GLvoid*)rgbImgisis->pixels);
-        glGenerateMipmap(GL_TEXTURE_2D);
+/* Compare the mesh and impostor paths on many bodies. Run with --bench-spheres */
+void benchmarkSpheres(RenderContext& context, Geometry* sphere, GLuint vboSphereID, GLuint texture) {
+    const uint32_t counts[] = { 1000, 10000, 100000 };
+    const char* modeNames[] = { "mesh", "impostor" };
+    glm::mat4 view(1.0f);
+    glm::mat4 projection = glm::perspective(45.0f, WIDTH / (float)HEIGHT, CAMERA_NEAR, CAMERA_FAR);
+    glm::vec3 cameraPosition(0.0f);
+    glm::vec3 lights[2] = { glm::vec3(0.0f, 10.0f, 0.0f), glm::vec3(0.0f, 10.0f, 0.0f) };
+    srand(42);
+
+    //One light per body, no clusters nor eclipses : only the geometry paths are compared
+    LightClusters* lightClusters = context.lightClusters;
+    Eclipses* eclipses = context.eclipses;
+    context.lightClusters = nullptr;
+    context.eclipses = nullptr;
+
+    //Do not time the fallback shader
+    context.shaders->get(DEFAULT_SHADER_VARIANT);
+    if (context.impostorShaders != nullptr)
+        context.impostorShaders->get(DEFAULT_SHADER_VARIANT);
+
+    for (uint32_t count : counts) {
+        std::vector<objet> bodies(count);
+        objet root;
+        for (uint32_t i = 0; i < count; i++) {
+            double x = rand() / (double)RAND_MAX * 2.0 - 1.0;
+            double y = rand() / (double)RAND_MAX * 2.0 - 1.0;
+            double z = 5.0 + rand() / (double)RAND_MAX * 45.0;
+            bodies[i].geometry = sphere;
+            bodies[i].vboID = vboSphereID;
+            bodies[i].material = Material{ {0.0f, 0.0f, 0.0f}, 0.2f, 0.8f, 0.0f, 1, texture };
+            bodies[i].localMatrix = glm::translate(glm::dmat4(1.0), glm::dvec3(x * z * 0.4, y * z * 0.25, -z)) * glm::scale(glm::dmat4(1.0), glm::dvec3(0.05 * z / 10.0));
+            root.children.push_back(&bodies[i]);
+        }
 
+        for (uint32_t mode = 0; mode < 2; mode++) {
+            context.geometryMode = mode == 0 ? GEOMETRY_MESH : GEOMETRY_IMPOSTOR;
+            uint64_t elapsed = 0;
+            for (uint32_t frame = 0; frame < BENCHMARK_WARMUP_FRAMES + BENCHMARK_FRAMES; frame++) {
+                glFinish();
+                uint64_t begin = SDL_GetPerformanceCounter();
+                glClear(GL_DEPTH_BUFFER_BIT | GL_COLOR_BUFFER_BIT);
+                FrameArena::resetAll();
+                MatrixStack matrices;
+                matrices.push(glm::dmat4(1.0));
+                draw(root, context, matrices, cameraPosition, view, projection, lights);
+                glFinish();
+                if (frame >= BENCHMARK_WARMUP_FRAMES)
+                    elapsed += SDL_GetPerformanceCounter() - begin;
+            }
+            uint32_t verticesPerBody = mode == 0 ? sphere->getNbVertices() : 4;
+            INFO("%6u bodies, %-8s : %8.2f ms/frame, %10llu vertices/frame\n", count, modeNames[mode],
+                 elapsed * 1000.0 / SDL_GetPerformanceFrequency() / BENCHMARK_FRAMES, (unsigned long long)verticesPerBody * count);
+        }
     }
-    glBindTexture(GL_TEXTURE_2D, 0);
-    SDL_FreeSurface(rgbImgisis);
-
+    context.geometryMode = GEOMETRY_MESH;
+    context.lightClusters = lightClusters;
+    context.eclipses = eclipses;
+}
 
+/* Get the side planes of a camera frustum, (normal, d) with dot(normal, p) + d >= 0 inside. Without near and far planes :
+ * the four sides already keep what is in front of the camera, and stay valid with the infinite far plane of the reversed-Z mode */
+void frustumPlanes(const glm::mat4& viewProjection, glm::vec4 planes[4]) {
+    glm::vec4 row0(viewProjection[0][0], viewProjection[1][0], viewProjection[2][0], viewProjection[3][0]);
+    glm::vec4 row1(viewProjection[0][1], viewProjection[1][1], viewProjection[2][1], viewProjection[3][1]);
+    glm::vec4 row3(viewProjection[0][3], viewProjection[1][3], viewProjection[2][3], viewProjection[3][3]);
+    planes[0] = row3 + row0;
+    planes[1] = row3 - row0;
+    planes[2] = row3 + row1;
+    planes[3] = row3 - row1;
+}
 
+/* Time the bounding volume hierarchy on bodies orbiting in a disk, from 1k to 1M : build, refit after a step of the orbits,
+ * then frustum, ray, radius and nearest queries. Run with --bench-bvh */
+void benchmarkBVH() {
+    const uint32_t counts[] = { 1000, 10000, 100000, 1000000 };
+    glm::mat4 projection = glm::perspective(45.0f, WIDTH / (float)HEIGHT, CAMERA_NEAR, CAMERA_FAR);
+    glm::mat4 view = glm::lookAt(glm::vec3(0.0f, 20.0f, 120.0f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    glm::vec4 planes[4];
+    frustumPlanes(projection * view, planes);
+    srand(42);
+
+    for (uint32_t count : counts) {
+        std::vector<float> distances(count);
+        std::vector<float> angles(count);
+        std::vector<glm::vec3> centers(count);
+        std::vector<float> radii(count);
+        for (uint32_t i = 0; i < count; i++) {
+            distances[i] = 5.0f + rand() / (float)RAND_MAX * 95.0f;
+            angles[i] = rand() / (float)RAND_MAX * 2.0f * (float)M_PI;
+            centers[i] = glm::vec3(cosf(angles[i]) * distances[i], rand() / (float)RAND_MAX - 0.5f, sinf(angles[i]) * distances[i]);
+            radii[i] = 0.01f + rand() / (float)RAND_MAX * 0.05f;
+        }
+        SphereBVH bvh;
+        bvh.build(centers, radii);
+
+        //Frames of Keplerian motion, the inner bodies faster : the tree is refit, never rebuilt
+        double refit = 0.0;
+        for (uint32_t frame = 0; frame < BENCHMARK_WARMUP_FRAMES + BENCHMARK_FRAMES; frame++) {
+            for (uint32_t i = 0; i < count; i++) {
+                angles[i] += 0.5f / (distances[i] * sqrtf(distances[i]));
+                centers[i].x = cosf(angles[i]) * distances[i];
+                centers[i].z = sinf(angles[i]) * distances[i];
+            }
+            bvh.refit(centers, radii);
+            if (frame >= BENCHMARK_WARMUP_FRAMES)
+                refit += bvh.getLastRefitTime();
+        }
 
+        std::vector<uint32_t> found;
+        uint64_t begin = SDL_GetPerformanceCounter();
+        bvh.queryPlanes(planes, 4, found);
+        double frustum = (SDL_GetPerformanceCounter() - begin) * 1000.0 / SDL_GetPerformanceFrequency();
+        size_t nbVisible = found.size();
+
+        std::vector<glm::vec3> points(BVH_BENCH_QUERIES);
+        std::vector<glm::vec3> directions(BVH_BENCH_QUERIES);
+        for (uint32_t q = 0; q < BVH_BENCH_QUERIES; q++) {
+            points[q] = glm::vec3(rand() / (float)RAND_MAX * 200.0f - 100.0f, rand() / (float)RAND_MAX * 2.0f - 1.0f, rand() / (float)RAND_MAX * 200.0f - 100.0f);
+            directions[q] = glm::normalize(glm::vec3(rand() / (float)RAND_MAX - 0.5f, (rand() / (float)RAND_MAX - 0.5f) * 0.02f, rand() / (float)RAND_MAX - 0.5f));
+        }
+        uint32_t hits = 0;
+        begin = SDL_GetPerformanceCounter();
+        for (uint32_t q = 0; q < BVH_BENCH_QUERIES; q++)
+            hits += bvh.raycast(points[q], directions[q], CAMERA_FAR) >= 0;
+        double rays = (SDL_GetPerformanceCounter() - begin) * 1e6 / SDL_GetPerformanceFrequency() / BVH_BENCH_QUERIES;
+        found.clear();
+        begin = SDL_GetPerformanceCounter();
+        for (uint32_t q = 0; q < BVH_BENCH_QUERIES; q++)
+            bvh.queryRadius(points[q], 2.0f, found);
+        double radius = (SDL_GetPerformanceCounter() - begin) * 1e6 / SDL_GetPerformanceFrequency() / BVH_BENCH_QUERIES;
+        begin = SDL_GetPerformanceCounter();
+        for (uint32_t q = 0; q < BVH_BENCH_QUERIES; q++)
+            bvh.nearest(points[q]);
+        double nearest = (SDL_GetPerformanceCounter() - begin) * 1e6 / SDL_GetPerformanceFrequency() / BVH_BENCH_QUERIES;
+
+        INFO("%7u bodies : build %8.2f ms, refit %7.3f ms (cost x%.2f), frustum %7.3f ms (%7zu visible), ray %6.2f us (%4.1f%% hit), radius %6.2f us, nearest %6.2f us\n",
+             count, bvh.getLastBuildTime(), refit / BENCHMARK_FRAMES, bvh.getRefitCost(), frustum, nbVisible, rays, 100.0 * hits / BVH_BENCH_QUERIES, radius, nearest);
+    }
+}
 
+/* Time the eclipse occluder search on moons orbiting planets around a star, a hundred moons per planet. Run with --bench-eclipses */
+void benchmarkEclipses() {
+    const uint32_t counts[] = { 1000, 10000, 100000 };
+    std::vector<EclipseLight> lights = { { glm::vec3(0.0f), 1.0f } };
+    srand(42);
+
+    for (uint32_t count : counts) {
+        std::vector<EclipseBody> bodies(count);
+        glm::vec3 planet(0.0f);
+        for (uint32_t i = 0; i < count; i++) {
+            if (i % 100 == 0) {
+                float angle = rand() / (float)RAND_MAX * 2.0f * (float)M_PI;
+                float distance = 5.0f + rand() / (float)RAND_MAX * 95.0f;
+                planet = glm::vec3(cosf(angle) * distance, 0.0f, sinf(angle) * distance);
+            }
+            float angle = rand() / (float)RAND_MAX * 2.0f * (float)M_PI;
+            float distance = 0.3f + rand() / (float)RAND_MAX * 1.2f;
+            bodies[i].center = planet + glm::vec3(cosf(angle) * distance, rand() / (float)RAND_MAX * 0.1f - 0.05f, sinf(angle) * distance);
+            bodies[i].radius = 0.005f + rand() / (float)RAND_MAX * 0.02f;
+            bodies[i].light = 0;
+            bodies[i].occluder = true;
+        }
 
+        Eclipses eclipses;
+        double elapsed = 0.0;
+        for (uint32_t frame = 0; frame < BENCHMARK_WARMUP_FRAMES + BENCHMARK_FRAMES; frame++) {
+            FrameArena::resetAll();
+            eclipses.update(bodies, lights);
+            if (frame >= BENCHMARK_WARMUP_FRAMES)
+                elapsed += eclipses.getLastUpdateTime();
+        }
+        uint32_t eclipsed = 0;
+        for (uint32_t i = 0; i < count; i++)
+            eclipsed += eclipses.getShadow(i).nbOccluders > 0;
+        INFO("%6u moons : %8.3f ms per update, %6u eclipsed\n", count, elapsed / BENCHMARK_FRAMES, eclipsed);
+    }
+}
 
-    GLuint textureSun;
-    glGenTextures(1, &textureSun);
-    std::cout << glGetError() << std::endl;
-    glBindTexture(GL_TEXTURE_2D, textureSun);
-    {
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, rgbImgSun->w, rgbImgSun->h, 0, GL_RGBA, GL_UNSIGNED_BYTE, (GLvoid*)rgbImgSun->pixels);
-        glGenerateMipmap(GL_TEXTURE_2D);
+/* Time the propagation of random Keplerian orbits and compare a sample with the double precision solver. Run with --bench-orbits */
+void benchmarkOrbits() {
+    const uint32_t counts[] = { 1000, 100000, 1000000 };
+    srand(42);
+
+    for (uint32_t count : counts) {
+        Orbits orbits;
+        std::vector<KeplerElements> elements(count);
+        for (uint32_t i = 0; i < count; i++) {
+            elements[i].semiMajorAxis = 1.0f + rand() / (float)RAND_MAX * 99.0f;
+            elements[i].eccentricity = rand() / (float)RAND_MAX * 0.95f;
+            elements[i].inclination = rand() / (float)RAND_MAX * (float)M_PI;
+            elements[i].longitudeOfNode = rand() / (float)RAND_MAX * 2.0f * (float)M_PI;
+            elements[i].argumentOfPeriapsis = rand() / (float)RAND_MAX * 2.0f * (float)M_PI;
+            elements[i].meanAnomaly = rand() / (float)RAND_MAX * 2.0f * (float)M_PI;
+            elements[i].meanMotion = 0.01f + rand() / (float)RAND_MAX;
+            orbits.add(elements[i]);
+        }
 
+        double elapsed = 0.0;
+        double t = 1000.0;
+        for (uint32_t frame = 0; frame < BENCHMARK_WARMUP_FRAMES + BENCHMARK_FRAMES; frame++) {
+            t += 0.01;
+            orbits.propagate(t);
+            if (frame >= BENCHMARK_WARMUP_FRAMES)
+                elapsed += orbits.getLastUpdateTime();
+        }
+        double maxError = 0.0;
+        for (uint32_t i = 0; i < count; i += count / 1000) {
+            glm::dvec3 reference = Orbits::solve(elements[i], t);
+            maxError = glm::max(maxError, glm::length(reference - glm::dvec3(orbits.getPosition(i))) / elements[i].semiMajorAxis);
+        }
+        INFO("%7u orbits : %8.3f ms per update with %u threads, max error %.1e semi-major axis\n", count, elapsed / BENCHMARK_FRAMES,
+             JobSystem::get().getNbThreads(), maxError);
     }
-    glBindTexture(GL_TEXTURE_2D, 0);
-    SDL_FreeSurface(rgbImgSun);
-
-    GLuint textureSTAR;
-    glGenTextures(1, &textureSTAR);
-    std::cout << glGetError() << std::endl;
-    glBindTexture(GL_TEXTURE_2D, textureSTAR);
-    {
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, rgbImgSTAR->w, rgbImgSTAR->h, 0, GL_RGBA, GL_UNSIGNED_BYTE, (GLvoid*)rgbImgSTAR->pixels);
-        glGenerateMipmap(GL_TEXTURE_2D);
+}
 
+/* Add a Plummer sphere of total mass 1 and scale radius 1 in virial equilibrium (G = 1), the usual N-body test cluster (Aarseth 1974) */
+void addPlummerSphere(NBody& nbody, uint32_t count, uint32_t seed) {
+    srand(seed);
+    for (uint32_t i = 0; i < count; i++) {
+        double radius = 1.0 / sqrt(pow(0.001 + rand() / (double)RAND_MAX * 0.99, -2.0 / 3.0) - 1.0);
+        //Speed as a fraction of the escape speed, by rejection from its distribution q^2 (1 - q^2)^3.5
+        double q = 0.0;
+        double y = 0.1;
+        while (y > q * q * pow(1.0 - q * q, 3.5)) {
+            q = rand() / (double)RAND_MAX;
+            y = rand() / (double)RAND_MAX * 0.1;
+        }
+        double speed = q * sqrt(2.0) * pow(1.0 + radius * radius, -0.25);
+        glm::dvec3 directions[2];
+        for (glm::dvec3& direction : directions) {
+            double z = rand() / (double)RAND_MAX * 2.0 - 1.0;
+            double angle = rand() / (double)RAND_MAX * 2.0 * M_PI;
+            direction = glm::dvec3(sqrt(1.0 - z * z) * cos(angle), sqrt(1.0 - z * z) * sin(angle), z);
+        }
+        nbody.add(radius * directions[0], speed * directions[1], 1.0 / count);
     }
-    glBindTexture(GL_TEXTURE_2D, 0);
-    SDL_FreeSurface(rgbImgSTAR);
+}
 
+/* Time the Barnes-Hut forces on Plummer spheres of 10k to 1M bodies, then report the energy drift of the leapfrog for a few opening angles.
+ * Run with --bench-nbody */
+void benchmarkNBody() {
+    const uint32_t counts[] = { 10000, 100000, 1000000 };
+    NBodyParameters params;
+    params.timeStep = 0.001;
+    params.softening = 0.01;
+
+    for (uint32_t count : counts) {
+        NBody nbody(params);
+        addPlummerSphere(nbody, count, 42);
+        nbody.step(); //Warm up, also builds the first forces
+        double elapsed = 0.0;
+        uint64_t interactions = 0;
+        for (uint32_t frame = 0; frame < BENCHMARK_FRAMES; frame++) {
+            nbody.step();
+            elapsed += nbody.getLastForceTime();
+            interactions += nbody.getLastNbInteractions();
+        }
+        INFO("%7u bodies : %9.1f ms per step, %7.1f M interactions/s, %5.0f interactions per body, %u threads\n", count, elapsed / BENCHMARK_FRAMES,
+             interactions / (elapsed * 1e-3) * 1e-6, interactions / (double)BENCHMARK_FRAMES / count, JobSystem::get().getNbThreads());
+    }
 
-    GLuint TextureMercure;
-    glGenTextures(1, &TextureMercure);
-    std::cout << glGetError() << std::endl;
-    glBindTexture(GL_TEXTURE_2D, TextureMercure);
-    {
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, rgbImgMercure->w, rgbImgMercure->h, 0, GL_RGBA, GL_UNSIGNED_BYTE, (GLvoid*)rgbImgMercure->pixels);
-        glGenerateMipmap(GL_TEXTURE_2D);
+    const double angles[] = { 0.3, 0.5, 0.7 };
+    for (double angle : angles) {
+        params.openingAngle = angle;
+        NBody nbody(params);
+        addPlummerSphere(nbody, 10000, 42);
+        double initialEnergy = nbody.getEnergy();
+        double maxDrift = 0.0;
+        for (uint32_t i = 0; i < NBODY_DRIFT_STEPS; i++) {
+            nbody.step();
+            maxDrift = glm::max(maxDrift, fabs(nbody.getEnergy() - initialEnergy) / fabs(initialEnergy));
+        }
+        INFO("theta %.1f : energy drift %+.2e after %u steps, %.2e at most\n", angle, (nbody.getEnergy() - initialEnergy) / fabs(initialEnergy),
+             NBODY_DRIFT_STEPS, maxDrift);
+    }
+}
 
+/* Time the update and the culling of asteroid belts from 100k to 1M rocks, seen from inside the belt. Run with --bench-asteroids */
+void benchmarkAsteroids() {
+    const uint32_t counts[] = { 100000, 1000000 };
+    glm::mat4 projection = glm::perspective(45.0f, WIDTH / (float)HEIGHT, CAMERA_NEAR, CAMERA_FAR);
+    glm::mat4 view = glm::lookAt(glm::vec3(0.0f), glm::vec3(0.0f, 0.0f, -1.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+
+    for (uint32_t count : counts) {
+        AsteroidFieldParameters params;
+        params.count = count;
+        params.seed = ASTEROID_SEED;
+        uint64_t begin = SDL_GetPerformanceCounter();
+        AsteroidField belt(params);
+        double generation = (SDL_GetPerformanceCounter() - begin) * 1000.0 / SDL_GetPerformanceFrequency();
+
+        double update = 0.0;
+        double cull = 0.0;
+        double t = 100.0;
+        glm::dvec3 camera(4.55, 0.05, 0.0);
+        for (uint32_t frame = 0; frame < BENCHMARK_WARMUP_FRAMES + BENCHMARK_FRAMES; frame++) {
+            t += 0.01;
+            belt.update(t);
+            belt.cull(camera, view, projection, t);
+            if (frame >= BENCHMARK_WARMUP_FRAMES) {
+                update += belt.getLastUpdateTime();
+                cull += belt.getLastCullTime();
+            }
+        }
+        INFO("%7u asteroids : generation %7.1f ms, update %6.2f ms, cull %6.2f ms, %6zu meshes up to %.3f, %7zu sprites, %u threads\n", count, generation,
+             update / BENCHMARK_FRAMES, cull / BENCHMARK_FRAMES, belt.getMeshInstances().size(), belt.getLastMeshDistance(), belt.getSprites().size(),
+             JobSystem::get().getNbThreads());
     }
-    glBindTexture(GL_TEXTURE_2D, 0);
-    SDL_FreeSurface(rgbImgMercure);
+}
 
-    GLuint TextureVenus;
-    glGenTextures(1, &TextureVenus);
-    std::cout << glGetError() << std::endl;
-    glBindTexture(GL_TEXTURE_2D, TextureVenus);
-    {
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, rgbImgVenus->w, rgbImgVenus->h, 0, GL_RGBA, GL_UNSIGNED_BYTE, (GLvoid*)rgbImgVenus->pixels);
-        glGenerateMipmap(GL_TEXTURE_2D);
+/* Convert a table of positions (CSV or binary) into an ephemeris file. Run with --ephemeris-import <table> <file.eph> */
+int importEphemeris(const char* tablePath, const char* ephemerisPath) {
+    EphemerisTable table;
+    if (Ephemeris::loadTable(tablePath, table) == 0)
+        return EXIT_FAILURE;
+    std::vector<EphemerisFitStats> stats;
+    if (!Ephemeris::fit(ephemerisPath, table, EPHEMERIS_DEGREE, EPHEMERIS_TOLERANCE, &stats))
+        return EXIT_FAILURE;
+    for (const EphemerisFitStats& body : stats)
+        INFO("Body %4d : %6u segments of %8.3f, max error %.3e, rms %.3e\n", body.bodyID, body.nbSegments, body.segmentLength, body.maxError, body.rmsError);
+    return 0;
+}
 
+/* Find the close approaches of the bodies of a scene over a window starting at 0, and write them in a CSV report. The star background holds every
+ * other body : it is left out, and its children orbit the origin. Run with --conjunctions duration threshold report.csv, on the scene of --scene */
+int analyzeConjunctions(const Scene& scene, double duration, double threshold, const char* reportPath) {
+    Conjunctions conjunctions;
+    std::vector<std::string> names;
+    std::vector<int32_t> conjunctionIDs(scene.getNbBodies(), -1);
+    //A body without orbit stays at the center of its parent, as in instantiateScene
+    KeplerElements still;
+    still.semiMajorAxis = 0.0f;
+    for (uint32_t i = 0; i < scene.getNbBodies(); i++) {
+        const SceneBody& body = scene.getBody(i);
+        if (body.sky)
+            continue;
+        ConjunctionBody added;
+        added.elements = body.hasOrbit ? body.orbit : still;
+        added.parent = body.parent >= 0 ? conjunctionIDs[body.parent] : -1;
+        added.radius = 0.5f * glm::max(body.size.x, glm::max(body.size.y, body.size.z));
+        conjunctionIDs[i] = (int32_t)conjunctions.add(added);
+        names.push_back(scene.getString(body.name));
     }
-    glBindTexture(GL_TEXTURE_2D, 0);
-    SDL_FreeSurface(rgbImgVenus);
+    if (conjunctions.getNbBodies() == 0) {
+        ERROR("No body to analyze in the scene\n");
+        return EXIT_FAILURE;
+    }
+    std::vector<Conjunction> approaches;
+    conjunctions.analyze(0.0, duration, threshold, approaches);
+    INFO("%u bodies over %.3f : %u intervals, %llu pairs refined, %zu close approaches. Sweep and prune %.1f ms, refinement %.1f ms\n",
+         conjunctions.getNbBodies(), duration, conjunctions.getNbIntervals(), (unsigned long long)conjunctions.getNbCandidates(), approaches.size(),
+         conjunctions.getLastBroadphaseTime(), conjunctions.getLastRefineTime());
+    for (size_t i = 0; i < approaches.size() && i < 20; i++)
+        INFO("%s - %s at %.4f : %.6f\n", names[approaches[i].first].c_str(), names[approaches[i].second].c_str(), approaches[i].time, approaches[i].separation);
+    return Conjunctions::saveReport(reportPath, approaches, names) ? 0 : EXIT_FAILURE;
+}
 
+/* Find by brute force the pairs coming closer than "threshold" during [start, end], and count the ones missing from "approaches".
+ * Every pair is sampled CONJUNCTION_BENCH_SAMPLES times. Between two samples, the distance changes by at most the sum of the top speeds times
+ * the step : the steps where it may go under the threshold are refined by golden section */
+uint32_t countMissedConjunctions(const Conjunctions& conjunctions, double start, double end, double threshold, const std::vector<Conjunction>& approaches,
+                                 uint32_t& nbClose) {
+    const uint32_t count = conjunctions.getNbBodies();
+    const double step = (end - start) / CONJUNCTION_BENCH_SAMPLES;
+    const double golden = 0.5 * (sqrt(5.0) - 1.0);
+    //The pairs under the threshold, then the reported ones, indexed by first * count + second
+    std::vector<uint8_t> close((size_t)count * count, 0);
+    std::vector<uint8_t> reported((size_t)count * count, 0);
+    for (const Conjunction& approach : approaches)
+        reported[(size_t)approach.first * count + approach.second] = 1;
+
+    //Each block shares its last sample with the next one, so every step is in a block
+    const uint32_t blockSize = CONJUNCTION_BENCH_BLOCK + 1;
+    std::vector<glm::dvec3> positions((size_t)count * blockSize);
+    for (uint32_t blockStart = 0; blockStart < CONJUNCTION_BENCH_SAMPLES; blockStart += CONJUNCTION_BENCH_BLOCK) {
+        uint32_t nbSamples = glm::min(blockSize, CONJUNCTION_BENCH_SAMPLES + 1 - blockStart);
+        JobSystem::get().parallelFor(count, 16, [&](uint32_t begin, uint32_t last) {
+            for (uint32_t body = begin; body < last; body++)
+                for (uint32_t s = 0; s < nbSamples; s++)
+                    positions[(size_t)body * blockSize + s] = conjunctions.getPosition(body, start + (blockStart + s) * step);
+        });
+        JobSystem::get().parallelFor(count, 4, [&](uint32_t begin, uint32_t last) {
+            for (uint32_t first = begin; first < last; first++) {
+                const glm::dvec3* firstPositions = &positions[(size_t)first * blockSize];
+                for (uint32_t second = first + 1; second < count; second++) {
+                    if (close[(size_t)first * count + second])
+                        continue;
+                    const glm::dvec3* secondPositions = &positions[(size_t)second * blockSize];
+                    double limit = threshold + conjunctions.getRadius(first) + conjunctions.getRadius(second);
+                    double reach = limit + 0.5 * (conjunctions.getMaxSpeed(first) + conjunctions.getMaxSpeed(second)) * step;
+                    double previous = glm::dot(firstPositions[0] - secondPositions[0], firstPositions[0] - secondPositions[0]);
+                    for (uint32_t s = 1; s < nbSamples; s++) {
+                        glm::dvec3 offset = firstPositions[s] - secondPositions[s];
+                        double current = glm::dot(offset, offset);
+                        if (glm::min(previous, current) < reach * reach) {
+                            double a = start + (blockStart + s - 1) * step, b = a + step;
+                            for (uint32_t iteration = 0; iteration < 40; iteration++) {
+                                double m1 = b - golden * (b - a), m2 = a + golden * (b - a);
+                                if (glm::length(conjunctions.getPosition(first, m1) - conjunctions.getPosition(second, m1)) <
+                                    glm::length(conjunctions.getPosition(first, m2) - conjunctions.getPosition(second, m2)))
+                                    b = m2;
+                                else
+                                    a = m1;
+                            }
+                            double t = 0.5 * (a + b);
+                            if (glm::length(conjunctions.getPosition(first, t) - conjunctions.getPosition(second, t)) < limit) {
+                                close[(size_t)first * count + second] = 1;
+                                break;
+                            }
+                        }
+                        previous = current;
+                    }
+                }
+            }
+        });
+    }
 
+    uint32_t nbMissed = 0;
+    nbClose = 0;
+    for (size_t pair = 0; pair < close.size(); pair++) {
+        nbClose += close[pair];
+        nbMissed += close[pair] && !reported[pair];
+    }
+    return nbMissed;
+}
 
-    GLuint TextureTerre;
-    glGenTextures(1, &TextureTerre);
-    std::cout << glGetError() << std::endl;
-    glBindTexture(GL_TEXTURE_2D, TextureTerre);
-    {
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, rgbImgTerre->w, rgbImgTerre->h, 0, GL_RGBA, GL_UNSIGNED_BYTE, (GLvoid*)rgbImgTerre->pixels);
-        glGenerateMipmap(GL_TEXTURE_2D);
+/* Time the close approach analysis of 1k to 100k bodies in a belt, one in 50 with a moon, over one year (one orbit of the Earth, 2 pi).
+ * Up to CONJUNCTION_BENCH_CHECKED bodies, the analysis at a wider threshold is checked against every pair by brute force. Run with --bench-conjunctions */
+void benchmarkConjunctions() {
+    const uint32_t counts[] = { 1000, 10000, 100000 };
+    srand(42);
+    for (uint32_t count : counts) {
+        Conjunctions conjunctions;
+        for (uint32_t i = 0; i < count; i++) {
+            ConjunctionBody body;
+            float a = 2.0f + rand() / (float)RAND_MAX * 8.0f;
+            body.elements.semiMajorAxis = a;
+            body.elements.eccentricity = rand() / (float)RAND_MAX * 0.2f;
+            body.elements.inclination = rand() / (float)RAND_MAX * 0.1f;
+            body.elements.longitudeOfNode = rand() / (float)RAND_MAX * 2.0f * (float)M_PI;
+            body.elements.argumentOfPeriapsis = rand() / (float)RAND_MAX * 2.0f * (float)M_PI;
+            body.elements.meanAnomaly = rand() / (float)RAND_MAX * 2.0f * (float)M_PI;
+            body.elements.meanMotion = 1.0f / (a / 3.0f * sqrtf(a / 3.0f)); //Kepler's third law, the Earth at 3
+            body.radius = 0.001f;
+            if (i % 50 == 49) {
+                body.parent = (int32_t)i - 1;
+                body.elements.semiMajorAxis = 0.05f;
+                body.elements.meanMotion = 6.0f;
+                body.radius = 0.0005f;
+            }
+            conjunctions.add(body);
+        }
 
+        std::vector<Conjunction> approaches;
+        conjunctions.analyze(0.0, 2.0 * M_PI, CONJUNCTION_BENCH_THRESHOLD, approaches);
+
+        INFO("%6u bodies : %5u intervals, %9llu pairs refined, %5zu close approaches. Sweep and prune %9.1f ms, refinement %8.1f ms with %u threads\n",
+             count, conjunctions.getNbIntervals(), (unsigned long long)conjunctions.getNbCandidates(), approaches.size(), conjunctions.getLastBroadphaseTime(),
+             conjunctions.getLastRefineTime(), JobSystem::get().getNbThreads());
+        if (count <= CONJUNCTION_BENCH_CHECKED) {
+            conjunctions.analyze(0.0, 2.0 * M_PI, CONJUNCTION_BENCH_CHECK_THRESHOLD, approaches);
+            uint32_t nbClose = 0;
+            uint32_t nbMissed = countMissedConjunctions(conjunctions, 0.0, 2.0 * M_PI, CONJUNCTION_BENCH_CHECK_THRESHOLD, approaches, nbClose);
+            if (nbMissed > 0)
+                ERROR("%u of the %u pairs closer than %g found by brute force are missing from the analysis\n", nbMissed, nbClose, CONJUNCTION_BENCH_CHECK_THRESHOLD);
+            else
+                INFO("The %u pairs closer than %g found by brute force are all in the analysis\n", nbClose, CONJUNCTION_BENCH_CHECK_THRESHOLD);
+        }
     }
-    glBindTexture(GL_TEXTURE_2D, 0);
-    SDL_FreeSurface(rgbImgTerre);
+}
 
+/* Build a century of daily positions of the 8 planets from their J2000 elements, then time the table import, the fit and the lookups,
+ * and compare random lookups with the Kepler solver. Run with --bench-ephemeris */
+void benchmarkEphemeris() {
+    const double deg = M_PI / 180.0;
+    //Heliocentric ecliptic J2000 elements, in AU and radians per day, with the NAIF IDs of the planets
+    const int32_t bodyIDs[] = { 199, 299, 399, 499, 599, 699, 799, 899 };
+    const KeplerElements planets[] = {
+        { 0.38710f, 0.20563f, (float)(7.005 * deg), (float)(48.331 * deg), (float)(29.124 * deg), (float)(174.796 * deg), (float)(2.0 * M_PI / 87.969) },
+        { 0.72333f, 0.00677f, (float)(3.395 * deg), (float)(76.680 * deg), (float)(54.884 * deg), (float)(50.115 * deg), (float)(2.0 * M_PI / 224.701) },
+        { 1.00000f, 0.01671f, (float)(0.000 * deg), (float)(-11.26 * deg), (float)(114.21 * deg), (float)(358.617 * deg), (float)(2.0 * M_PI / 365.256) },
+        { 1.52368f, 0.09340f, (float)(1.850 * deg), (float)(49.558 * deg), (float)(286.502 * deg), (float)(19.412 * deg), (float)(2.0 * M_PI / 686.980) },
+        { 5.20260f, 0.04849f, (float)(1.303 * deg), (float)(100.464 * deg), (float)(273.867 * deg), (float)(20.020 * deg), (float)(2.0 * M_PI / 4332.59) },
+        { 9.55490f, 0.05551f, (float)(2.489 * deg), (float)(113.665 * deg), (float)(339.392 * deg), (float)(317.020 * deg), (float)(2.0 * M_PI / 10759.22) },
+        { 19.2184f, 0.04630f, (float)(0.773 * deg), (float)(74.006 * deg), (float)(96.999 * deg), (float)(142.239 * deg), (float)(2.0 * M_PI / 30688.5) },
+        { 30.1100f, 0.00899f, (float)(1.770 * deg), (float)(131.784 * deg), (float)(273.187 * deg), (float)(256.228 * deg), (float)(2.0 * M_PI / 60195.0) },
+    };
+    const double startDate = 2451545.0; //J2000
+    const uint32_t nbDays = (uint32_t)(EPHEMERIS_BENCH_YEARS * 365.25);
+    const char* csvPath = "ephemeris_bench.csv";
+    const char* binaryPath = "ephemeris_bench.bin";
+    const char* ephemerisPath = "ephemeris_bench.eph";
+
+    //Solve(...) works in the Y-up scene frame : (x, y, z) is (x, -z, y) in the ecliptic frame of the tables
+    auto reference = [&](uint32_t planet, double days) {
+        glm::dvec3 p = Orbits::solve(planets[planet], days) * AU_KM;
+        return glm::dvec3(p.x, -p.z, p.y);
+    };
+    FILE* csv = fopen(csvPath, "w");
+    if (csv == nullptr) {
+        ERROR("Could not create %s\n", csvPath);
+        return;
+    }
+    fprintf(csv, "# body,julian date,x (km),y (km),z (km)\n");
+    for (uint32_t planet = 0; planet < 8; planet++) {
+        for (uint32_t day = 0; day <= nbDays; day++) {
+            glm::dvec3 p = reference(planet, day);
+            fprintf(csv, "%d,%.6f,%.6f,%.6f,%.6f\n", bodyIDs[planet], startDate + day, p.x, p.y, p.z);
+        }
+    }
+    fclose(csv);
+
+    uint64_t begin = SDL_GetPerformanceCounter();
+    EphemerisTable table;
+    uint64_t nbSamples = Ephemeris::loadTable(csvPath, table);
+    double csvTime = (SDL_GetPerformanceCounter() - begin) / (double)SDL_GetPerformanceFrequency();
+    Ephemeris::saveTable(binaryPath, table);
+    begin = SDL_GetPerformanceCounter();
+    EphemerisTable binaryTable;
+    Ephemeris::loadTable(binaryPath, binaryTable);
+    double binaryTime = (SDL_GetPerformanceCounter() - begin) / (double)SDL_GetPerformanceFrequency();
+    FILE* file = fopen(csvPath, "rb");
+    fseek(file, 0, SEEK_END);
+    double csvSize = ftell(file) / 1048576.0;
+    fclose(file);
+    INFO("Import of %llu samples : CSV %.1f ms (%.0f MB/s), binary %.1f ms\n", (unsigned long long)nbSamples, csvTime * 1e3, csvSize / csvTime, binaryTime * 1e3);
+
+    begin = SDL_GetPerformanceCounter();
+    std::vector<EphemerisFitStats> stats;
+    Ephemeris::fit(ephemerisPath, table, EPHEMERIS_DEGREE, EPHEMERIS_TOLERANCE, &stats);
+    double fitTime = (SDL_GetPerformanceCounter() - begin) / (double)SDL_GetPerformanceFrequency();
+    for (const EphemerisFitStats& body : stats)
+        INFO("Body %d : %5u segments of %7.2f days, max error %.3f km, rms %.3f km\n", body.bodyID, body.nbSegments, body.segmentLength, body.maxError, body.rmsError);
+
+    begin = SDL_GetPerformanceCounter();
+    Ephemeris* ephemeris = Ephemeris::open(ephemerisPath);
+    double openTime = (SDL_GetPerformanceCounter() - begin) / (double)SDL_GetPerformanceFrequency();
+    if (ephemeris == nullptr)
+        return;
+    file = fopen(ephemerisPath, "rb");
+    fseek(file, 0, SEEK_END);
+    INFO("Fit in %.1f ms : %.1f MB of samples in %.2f MB of coefficients, mapped in %.3f ms\n", fitTime * 1e3, nbSamples * sizeof(EphemerisSample) / 1048576.0,
+         ftell(file) / 1048576.0, openTime * 1e3);
+    fclose(file);
+
+    //Random dates and bodies, so that each lookup touches a cold segment. The bodies of the file are sorted by ID : index i is planets[i]
+    srand(42);
+    std::vector<double> dates(EPHEMERIS_BENCH_LOOKUPS);
+    std::vector<glm::dvec3> positions(EPHEMERIS_BENCH_LOOKUPS);
+    for (double& date : dates)
+        date = startDate + rand() / (double)RAND_MAX * nbDays;
+    begin = SDL_GetPerformanceCounter();
+    for (uint32_t i = 0; i < EPHEMERIS_BENCH_LOOKUPS; i++)
+        positions[i] = ephemeris->getPosition(i % 8, dates[i]);
+    double lookupTime = (SDL_GetPerformanceCounter() - begin) / (double)SDL_GetPerformanceFrequency();
+
+    //The fit is checked on the samples, this is the error between them
+    double maxError = 0.0;
+    for (uint32_t i = 0; i < EPHEMERIS_BENCH_LOOKUPS; i++) {
+        uint32_t planet = i % 8;
+        maxError = glm::max(maxError, glm::length(positions[i] - reference(planet, dates[i] - startDate)));
+    }
+    INFO("%u lookups : %.1f M lookups/s (%.0f ns each), max error %.3f km\n", EPHEMERIS_BENCH_LOOKUPS, EPHEMERIS_BENCH_LOOKUPS / lookupTime * 1e-6,
+         lookupTime / EPHEMERIS_BENCH_LOOKUPS * 1e9, maxError);
 
+    delete ephemeris;
+    remove(csvPath);
+    remove(binaryPath);
+    remove(ephemerisPath);
+}
 
-    GLuint TextureMars;
-    glGenTextures(1, &TextureMars);
-    std::cout << glGetError() << std::endl;
-    glBindTexture(GL_TEXTURE_2D, TextureMars);
-    {
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, rgbImgMars->w, rgbImgMars->h, 0, GL_RGBA, GL_UNSIGNED_BYTE, (GLvoid*)rgbImgMars->pixels);
-        glGenerateMipmap(GL_TEXTURE_2D);
+/* Time the table build of an atmosphere, then its shading from close enough to cover the screen to a few pixels. Run with --bench-atmosphere */
+void benchmarkAtmosphere(const AtmosphereParameters& params) {
+    Atmosphere* atmosphere = nullptr;
+    double buildTime = 0.0;
+    for (uint32_t i = 0; i < BENCHMARK_FRAMES; i++) {
+        delete atmosphere;
+        atmosphere = Atmosphere::create(params, false);
+        if (atmosphere == nullptr)
+            return;
+        buildTime += atmosphere->getBuildTime();
+    }
+    INFO("Atmosphere tables : %.1f ms with %u threads\n", buildTime / BENCHMARK_FRAMES, JobSystem::get().getNbThreads());
+
+    const float distances[] = { 1.3f, 3.0f, 10.0f, 50.0f }; //In planet radii
+    glm::mat4 projection = glm::perspective(45.0f, WIDTH / (float)HEIGHT, CAMERA_NEAR, CAMERA_FAR);
+    glm::vec3 sun(20.0f, 5.0f, 0.0f);
+    for (float distance : distances) {
+        glm::vec3 cameraPosition(0.0f, 0.0f, distance);
+        glm::mat4 view = glm::lookAt(cameraPosition, glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+        uint64_t elapsed = 0;
+        for (uint32_t frame = 0; frame < BENCHMARK_WARMUP_FRAMES + BENCHMARK_FRAMES; frame++) {
+            glClear(GL_DEPTH_BUFFER_BIT | GL_COLOR_BUFFER_BIT);
+            glFinish();
+            uint64_t begin = SDL_GetPerformanceCounter();
+            atmosphere->draw(glm::vec3(0.0f), 1.0f, sun, ATMOSPHERE_SUN_INTENSITY, cameraPosition, view, projection);
+            glFinish();
+            if (frame >= BENCHMARK_WARMUP_FRAMES)
+                elapsed += SDL_GetPerformanceCounter() - begin;
+        }
+        INFO("Camera at %5.1f radii : %7.3f ms/frame\n", distance, elapsed * 1000.0 / SDL_GetPerformanceFrequency() / BENCHMARK_FRAMES);
+    }
+    delete atmosphere;
+}
 
+/* Draw a red sphere just inside a green one, DEPTH_TEST_GAP apart, at growing distances in every depth mode, and count the red pixels
+ * leaking through : the z-fighting. Run with --test-depth
+ * \return EXIT_FAILURE if the best mode the context supports exceeds DEPTH_TEST_MAX_ERROR */
+int testDepthModes(RenderContext& context, DepthBuffer& depthBuffer, Geometry* sphere, GLuint vboSphereID) {
+    const float distances[] = { 1.0f, 10.0f, 100.0f, 900.0f };
+    glm::mat4 view(1.0f);
+    glm::vec3 cameraPosition(0.0f);
+    glm::vec3 lights[2] = { glm::vec3(0.0f), glm::vec3(0.0f) };
+    std::vector<uint8_t> pixels(WIDTH * HEIGHT * 4);
+
+    //Unlit flat colors : only the depth decides which sphere is seen
+    LightClusters* lightClusters = context.lightClusters;
+    Eclipses* eclipses = context.eclipses;
+    GeometryMode geometryMode = context.geometryMode;
+    context.lightClusters = nullptr;
+    context.eclipses = nullptr;
+    context.geometryMode = GEOMETRY_MESH;
+    context.depthBuffer = &depthBuffer;
+
+    objet inner;
+    objet outer;
+    inner.geometry = outer.geometry = sphere;
+    inner.vboID = outer.vboID = vboSphereID;
+    inner.material = Material{ {1.0f, 0.0f, 0.0f}, 1.0f, 0.0f, 0.0f, 1 };
+    outer.material = Material{ {0.0f, 1.0f, 0.0f}, 1.0f, 0.0f, 0.0f, 1 };
+    objet root;
+    root.children = { &inner, &outer };
+
+    DepthMode best = DepthBuffer::isReversedZSupported() ? DEPTH_REVERSED_Z : DEPTH_LOGARITHMIC;
+    float bestError = 0.0f;
+    for (uint32_t mode = 0; mode < DEPTH_MODE_COUNT; mode++) {
+        if (!depthBuffer.setMode((DepthMode)mode)) {
+            INFO("%-12s : not supported\n", DepthBuffer::getModeName((DepthMode)mode));
+            continue;
+        }
+        //Do not measure the fallback shader
+        context.shaders->get(inner.material.getVariantKey(1) | depthBuffer.getVariantBits());
+        glm::mat4 projection = depthBuffer.getProjection(45.0f, WIDTH / (float)HEIGHT);
+        for (float distance : distances) {
+            glm::dmat4 center = glm::translate(glm::dmat4(1.0), glm::dvec3(0.0, 0.0, -distance));
+            outer.localMatrix = glm::scale(center, glm::dvec3(distance * 0.5));
+            inner.localMatrix = glm::scale(center, glm::dvec3(distance * 0.5 * (1.0 - DEPTH_TEST_GAP)));
+
+            depthBuffer.beginFrame();
+            FrameArena::resetAll();
+            MatrixStack matrices;
+            matrices.push(glm::dmat4(1.0));
+            draw(root, context, matrices, cameraPosition, view, projection, lights);
+            depthBuffer.endFrame();
+            glReadPixels(0, 0, WIDTH, HEIGHT, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+
+            uint32_t red = 0;
+            uint32_t green = 0;
+            for (uint32_t i = 0; i < WIDTH * HEIGHT; i++) {
+                red += pixels[4 * i] > 127;
+                green += pixels[4 * i + 1] > 127;
+            }
+            float error = red / (float)glm::max(red + green, 1u);
+            INFO("%-12s at %6.1f : %.2f%% of the pixels z-fight\n", DepthBuffer::getModeName((DepthMode)mode), distance, error * 100.0f);
+            if (mode == best)
+                bestError = glm::max(bestError, error);
+        }
     }
-    glBindTexture(GL_TEXTURE_2D, 0);
-    SDL_FreeSurface(rgbImgMars);
 
-    GLuint TextureJupiter;
-    glGenTextures(1, &TextureJupiter);
-    std::cout << glGetError() << std::endl;
+    depthBuffer.setMode(DEPTH_STANDARD);
+    context.lightClusters = lightClusters;
+    context.eclipses = eclipses;
+    context.geometryMode = geometryMode;
+    if (bestError > DEPTH_TEST_MAX_ERROR) {
+        ERROR("The %s depth z-fights on %.2f%% of the pixels\n", DepthBuffer::getModeName(best), bestError * 100.0f);
+        return EXIT_FAILURE;
+    }
+    INFO("The %s depth passes\n", DepthBuffer::getModeName(best));
+    return 0;
+}
 
-    glBindTexture(GL_TEXTURE_2D, TextureJupiter);
-    {
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, rgbImgJupiter->w, rgbImgJupiter->h, 0, GL_RGBA, GL_UNSIGNED_BYTE, (GLvoid*)rgbImgJupiter->pixels);
-        glGenerateMipmap(GL_TEXTURE_2D);
+/* Convert a text scene to its binary form. Run with --compile-scene scene.scene scene.bin */
+int compileScene(const char* textPath, const char* binaryPath) {
+    Scene* scene = Scene::load(textPath);
+    if (scene == nullptr)
+        return EXIT_FAILURE;
+    bool saved = scene->save(binaryPath);
+    if (saved)
+        INFO("%u bodies and %u textures compiled to %s\n", scene->getNbBodies(), scene->getNbTextures(), binaryPath);
+    delete scene;
+    return saved ? 0 : EXIT_FAILURE;
+}
 
+/* Write a scene of SCENE_BENCH_BODIES bodies, planets around a star with moons around them, then time its text parse, its compiled
+ * load and the creation of its bodies. The compiled bodies are compared with the parsed ones. Run with --bench-scene */
+void benchmarkScene() {
+    const char* textPath = "scene_bench.scene";
+    const char* binaryPath = "scene_bench.bin";
+    FILE* file = fopen(textPath, "w");
+    if (file == nullptr) {
+        ERROR("Could not create %s\n", textPath);
+        return;
     }
-    glBindTexture(GL_TEXTURE_2D, 0);
-    SDL_FreeSurface(rgbImgJupiter);
+    srand(42);
+    fprintf(file, "texture Stars Assets/8k_stars.jpg\ntexture Sun Assets/8k_sun.jpg\ntexture Moon Assets/8k_moon.jpg\n");
+    fprintf(file, "body Sky - texture=Stars sky ka=1 kd=0 lit=1 size=100\n");
+    fprintf(file, "body Star Sky texture=Sun ka=1 kd=0 color=1,1,1 light=1 spin=0.1 size=2\n");
+    uint32_t planet = 0;
+    for (uint32_t i = 2; i < SCENE_BENCH_BODIES; i++) {
+        float e = rand() / (float)RAND_MAX * 0.1f;
+        float inclination = rand() / (float)RAND_MAX * 0.2f;
+        float node = rand() / (float)RAND_MAX * 6.283f;
+        float anomaly = rand() / (float)RAND_MAX * 6.283f;
+        if (i % 10 == 2) {
+            //A planet every 10 bodies, the next 9 are its moons
+            planet = i;
+            float a = 2.0f + rand() / (float)RAND_MAX * 40.0f;
+            fprintf(file, "body Body%u Star texture=Moon ks=0.3 lit=1 orbit=%.4f,%.4f,%.4f,%.4f,0,%.4f,%.4f spin=1 size=%.4f atmosphere=haze\n",
+                    i, a, e, inclination, node, anomaly, 1.0f / (a * sqrtf(a)), 0.1f + rand() / (float)RAND_MAX * 0.2f);
+        }
+        else {
+            float a = 0.2f + rand() / (float)RAND_MAX * 0.5f;
+            fprintf(file, "body Body%u Body%u texture=Moon lit=1 orbit=%.4f,%.4f,%.4f,%.4f,0,%.4f,%.4f spin=2 size=%.4f\n",
+                    i, planet, a, e, inclination, node, anomaly, 4.0f / a, 0.01f + rand() / (float)RAND_MAX * 0.05f);
+        }
+    }
+    double textSize = ftell(file) / 1048576.0;
+    fclose(file);
+
+    Scene* text = Scene::load(textPath);
+    if (text == nullptr || !text->save(binaryPath)) {
+        delete text;
+        remove(textPath);
+        return;
+    }
+    Scene* binary = Scene::load(binaryPath);
+    if (binary == nullptr) {
+        delete text;
+        remove(textPath);
+        remove(binaryPath);
+        return;
+    }
+    INFO("Scene of %u bodies : text %.1f ms (%.0f MB/s), compiled %.3f ms\n", binary->getNbBodies(), text->getLoadTime(),
+         textSize / (text->getLoadTime() * 1e-3), binary->getLoadTime());
+
+    uint32_t nbDifferences = 0;
+    for (uint32_t i = 0; i < binary->getNbBodies(); i++) {
+        if (memcmp(&text->getBody(i), &binary->getBody(i), sizeof(SceneBody)) != 0 ||
+            strcmp(text->getString(text->getBody(i).name), binary->getString(binary->getBody(i).name)) != 0)
+            nbDifferences++;
+    }
+    if (text->getNbBodies() != binary->getNbBodies() || nbDifferences > 0)
+        ERROR("The compiled scene differs from the text one on %u bodies\n", nbDifferences);
+
+    //The bodies themselves, without the GPU resources
+    uint64_t begin = SDL_GetPerformanceCounter();
+    std::vector<GLuint> textures(binary->getNbTextures(), 0);
+    std::vector<objet> bodies;
+    EntityWorld entities;
+    Orbits orbits;
+    instantiateScene(*binary, bodies, entities, orbits, textures, nullptr, 0);
+    double instantiateTime = (SDL_GetPerformanceCounter() - begin) / (double)SDL_GetPerformanceFrequency();
+    INFO("%u bodies created in %.1f ms\n", (uint32_t)bodies.size(), instantiateTime * 1e3);
+
+    delete text;
+    delete binary;
+    remove(textPath);
+    remove(binaryPath);
+}
 
-    GLuint TextureSaturne;
-    glGenTextures(1, &TextureSaturne);
-    std::cout << glGetError() << std::endl;
+/* Count the bodies under "go" whose sphere touches the frustum, with the same matrices as draw(). The objet counterpart of EntitySystems::cull */
+uint32_t countVisibleObjets(const objet& go, const glm::dmat4& parent, const glm::vec4 planes[4]) {
+    glm::dmat4 model = parent * go.localMatrix;
+    glm::vec3 center = glm::vec3(model[3]);
+    float radius = (float)(0.5 * glm::max(glm::length(glm::dvec3(model[0])), glm::max(glm::length(glm::dvec3(model[1])), glm::length(glm::dvec3(model[2])))));
+    bool inside = go.geometry != nullptr;
+    for (uint32_t p = 0; p < 4; p++)
+        inside = inside && glm::dot(glm::vec3(planes[p]), center) + planes[p].w >= -radius * glm::length(glm::vec3(planes[p]));
+    uint32_t nbVisible = inside;
+    for (size_t i = 0; i < go.children.size(); i++)
+        nbVisible += countVisibleObjets(*(go.children[i]), parent * go.propagatedMatrix, planes);
+    return nbVisible;
+}
 
-    glBindTexture(GL_TEXTURE_2D, TextureSaturne);
-    {
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, rgbImgSaturne->w, rgbImgSaturne->h, 0, GL_RGBA, GL_UNSIGNED_BYTE, (GLvoid*)rgbImgSaturne->pixels);
-        glGenerateMipmap(GL_TEXTURE_2D);
+/* Build the same star, planets and moons as entities and as objet, then time each system over both : orbits, transforms, culling,
+ * then the draw list and the archetype changes of the entities. A third of the moons only collide, without Renderable nor Material.
+ * Run with --bench-entities */
+void benchmarkEntities() {
+    const ComponentMask drawn = componentBit(COMPONENT_TRANSFORM) | componentBit(COMPONENT_ORBIT) | componentBit(COMPONENT_RENDERABLE) |
+                                componentBit(COMPONENT_MATERIAL) | componentBit(COMPONENT_COLLIDER);
+    const ComponentMask hidden = componentBit(COMPONENT_TRANSFORM) | componentBit(COMPONENT_ORBIT) | componentBit(COMPONENT_COLLIDER);
+    const ComponentMask star = componentBit(COMPONENT_TRANSFORM) | componentBit(COMPONENT_RENDERABLE) | componentBit(COMPONENT_MATERIAL) |
+                               componentBit(COMPONENT_LIGHT) | componentBit(COMPONENT_COLLIDER);
+    Sphere sphere(8, 8); //Only its address is used : nothing is drawn
+    Orbits orbits;
+    EntityWorld world;
+    std::vector<Entity> entities(ENTITY_BENCH_COUNT);
+    std::vector<objet> objets(ENTITY_BENCH_COUNT);
+    srand(42);
+
+    uint64_t begin = SDL_GetPerformanceCounter();
+    entities[0] = world.create(star);
+    world.get<ColliderComponent>(entities[0])->radius = 1.0f;
+    world.get<RenderableComponent>(entities[0])->geometry = &sphere;
+    uint32_t planet = 0;
+    for (uint32_t i = 1; i < ENTITY_BENCH_COUNT; i++) {
+        //A planet every 10 entities, the next 9 are its moons
+        bool isPlanet = i % 10 == 1;
+        planet = isPlanet ? i : planet;
+        KeplerElements elements;
+        elements.semiMajorAxis = isPlanet ? 2.0f + rand() / (float)RAND_MAX * 40.0f : 0.2f + rand() / (float)RAND_MAX * 0.5f;
+        elements.eccentricity = rand() / (float)RAND_MAX * 0.1f;
+        elements.inclination = rand() / (float)RAND_MAX * 0.2f;
+        elements.longitudeOfNode = rand() / (float)RAND_MAX * 6.283f;
+        elements.meanAnomaly = rand() / (float)RAND_MAX * 6.283f;
+        elements.meanMotion = (isPlanet ? 1.0f : 4.0f) / (elements.semiMajorAxis * sqrtf(elements.semiMajorAxis));
+        float size = isPlanet ? 0.1f + rand() / (float)RAND_MAX * 0.2f : 0.01f + rand() / (float)RAND_MAX * 0.05f;
+        bool isDrawn = isPlanet || i % 3 != 0;
+
+        entities[i] = world.create(isDrawn ? drawn : hidden);
+        EntitySystems::setParent(world, entities[i], entities[isPlanet ? 0 : planet]);
+        OrbitComponent* orbit = world.get<OrbitComponent>(entities[i]);
+        orbit->orbitID = orbits.add(elements);
+        orbit->spin = elements.meanMotion;
+        orbit->size = glm::vec3(size);
+        world.get<ColliderComponent>(entities[i])->radius = 0.5f * size;
+        if (isDrawn) {
+            world.get<RenderableComponent>(entities[i])->geometry = &sphere;
+            world.get<MaterialComponent>(entities[i])->lit = 1;
+        }
 
+        objets[i].orbitID = (int32_t)orbit->orbitID;
+        objets[i].spin = orbit->spin;
+        objets[i].size = glm::dvec3(size);
+        objets[i].geometry = isDrawn ? &sphere : nullptr;
+        objets[i].etoile = 1;
+        objets[isPlanet ? 0 : planet].children.push_back(&objets[i]);
     }
-    glBindTexture(GL_TEXTURE_2D, 0);
-    SDL_FreeSurface(rgbImgSaturne);
-
-    GLuint TextureUranus;
-    glGenTextures(1, &TextureUranus);
-    std::cout << glGetError() << std::endl;
+    objets[0].geometry = &sphere;
+    objets[0].localMatrix = glm::scale(glm::dmat4(1.0), glm::dvec3(2.0));
+    double createTime = (SDL_GetPerformanceCounter() - begin) * 1000.0 / SDL_GetPerformanceFrequency();
+    INFO("%u entities : %u archetypes, %u chunks of %d KB, built with the objets in %.1f ms\n", world.getNbEntities(), world.getNbArchetypes(),
+         world.getNbChunks(), ENTITY_CHUNK_SIZE / 1024, createTime);
+
+    //The planes are relative to the camera, like in the frame loop
+    glm::dvec3 camera(0.0, 20.0, 60.0);
+    glm::mat4 projection = glm::perspective(45.0f, WIDTH / (float)HEIGHT, CAMERA_NEAR, CAMERA_FAR);
+    glm::mat4 view = glm::lookAt(glm::vec3(0.0f), -glm::vec3(camera), glm::vec3(0.0f, 1.0f, 0.0f));
+    glm::vec4 planes[4];
+    frustumPlanes(projection * view, planes);
+
+    double entityOrbits = 0.0, entityTransforms = 0.0, entityCull = 0.0, entityDraws = 0.0, objetOrbits = 0.0, objetCull = 0.0;
+    uint32_t entityVisible = 0, objetVisible = 0;
+    std::vector<EntitySystems::Draw> draws;
+    auto elapsed = [](uint64_t from) {return (SDL_GetPerformanceCounter() - from) * 1000.0 / SDL_GetPerformanceFrequency();};
+    for (uint32_t frame = 0; frame < BENCHMARK_WARMUP_FRAMES + BENCHMARK_FRAMES; frame++) {
+        double t = frame * 0.01;
+        orbits.propagate(t);
+        double scale = frame >= BENCHMARK_WARMUP_FRAMES ? 1.0 / BENCHMARK_FRAMES : 0.0;
+        begin = SDL_GetPerformanceCounter();
+        EntitySystems::updateOrbits(world, orbits, t);
+        entityOrbits += elapsed(begin) * scale;
+        begin = SDL_GetPerformanceCounter();
+        EntitySystems::updateTransforms(world);
+        entityTransforms += elapsed(begin) * scale;
+        begin = SDL_GetPerformanceCounter();
+        entityVisible = EntitySystems::cull(world, camera, planes);
+        entityCull += elapsed(begin) * scale;
+        begin = SDL_GetPerformanceCounter();
+        EntitySystems::gatherDraws(world, camera, draws);
+        entityDraws += elapsed(begin) * scale;
+
+        begin = SDL_GetPerformanceCounter();
+        applyOrbits(objets[0], orbits, t);
+        objetOrbits += elapsed(begin) * scale;
+        begin = SDL_GetPerformanceCounter();
+        objetVisible = countVisibleObjets(objets[0], glm::translate(glm::dmat4(1.0), -camera), planes);
+        objetCull += elapsed(begin) * scale;
+    }
+    INFO("Orbits : entities %.2f ms, objet %.2f ms\n", entityOrbits, objetOrbits);
+    INFO("Transforms : entities %.2f ms, objet in the culling traversal\n", entityTransforms);
+    INFO("Culling : entities %.2f ms (%u visible), objet %.2f ms (%u visible)\n", entityCull, entityVisible, objetCull, objetVisible);
+    INFO("Draw list : %.2f ms for %u bodies\n", entityDraws, (uint32_t)draws.size());
+
+    //Hide a tenth of the drawn bodies then show them again : two archetype changes each
+    uint32_t nbChanges = 0;
+    begin = SDL_GetPerformanceCounter();
+    for (uint32_t i = 1; i < ENTITY_BENCH_COUNT; i += 10) {
+        world.setComponents(entities[i], hidden);
+        world.setComponents(entities[i], drawn);
+        nbChanges += 2;
+    }
+    INFO("Archetype changes : %.1f ns each\n", elapsed(begin) * 1e6 / nbChanges);
+}
 
-    glBindTexture(GL_TEXTURE_2D, TextureUranus);
-    {
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, rgbImgUranus->w, rgbImgUranus->h, 0, GL_RGBA, GL_UNSIGNED_BYTE, (GLvoid*)rgbImgUranus->pixels);
-        glGenerateMipmap(GL_TEXTURE_2D);
+/* A light of the clustered lighting demo, in world space */
+struct DemoLight {
+    glm::dvec3 world;
+    float radius;
+    glm::vec3 color;
+};
 
+/* Small colored lights spread over both star systems, used to stress the clustered lighting. Drawn once from a fixed seed, so they do not move between frames */
+std::vector<DemoLight> makeDemoLights(uint32_t count) {
+    std::mt19937 generator(1234);
+    std::uniform_real_distribution<double> unit(0.0, 1.0);
+    std::vector<DemoLight> demoLights(count);
+    for (DemoLight& light : demoLights) {
+        double x = unit(generator) * 24.0 - 12.0;
+        double y = unit(generator) * 2.0 - 1.0;
+        double z = unit(generator) * 24.0 - 12.0;
+        light.world = glm::dvec3(x, y, z);
+        light.radius = (float)(1.0 + unit(generator) * 2.0);
+        float r = (float)unit(generator);
+        float g = (float)unit(generator);
+        float b = (float)unit(generator);
+        light.color = 0.5f * glm::vec3(r, g, b);
     }
-    glBindTexture(GL_TEXTURE_2D, 0);
-    SDL_FreeSurface(rgbImgUranus);
-
-    GLuint TextureNeptune;
-    glGenTextures(1, &TextureNeptune);
-    std::cout << glGetError() << std::endl;
+    return demoLights;
+}
 
-    glBindTexture(GL_TEXTURE_2D, TextureNeptune);
-    {
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, rgbImgNeptune->w, rgbImgNeptune->h, 0, GL_RGBA, GL_UNSIGNED_BYTE, (GLvoid*)rgbImgNeptune->pixels);
-        glGenerateMipmap(GL_TEXTURE_2D);
+/* Add the first "count" demo lights, made relative to "cameraWorld" like the rest of the frame */
+void addDemoLights(std::vector<PointLight>& lights, const std::vector<DemoLight>& demoLights, uint32_t count, const glm::dvec3& cameraWorld) {
+    for (uint32_t i = 0; i < count && i < demoLights.size(); i++)
+        lights.push_back({ glm::vec3(demoLights[i].world - cameraWorld), demoLights[i].radius, demoLights[i].color });
+}
 
+int main(int argc, char* argv[])
+{
+    bool benchSpheres = false;
+    bool benchLights = false;
+    bool benchAtmosphere = false;
+    bool testDepth = false;
+    bool testAllocations = false;
+    const char* ephemerisPath = nullptr;
+    const char* scenePath = SCENE_PATH;
+    const char* conjunctionsReport = nullptr;
+    double conjunctionsDuration = 0.0;
+    double conjunctionsThreshold = 0.0;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--bench-spheres") == 0)
+            benchSpheres = true;
+        else if (strcmp(argv[i], "--bench-lights") == 0)
+            benchLights = true;
+        else if (strcmp(argv[i], "--bench-atmosphere") == 0)
+            benchAtmosphere = true;
+        else if (strcmp(argv[i], "--test-depth") == 0)
+            testDepth = true;
+        else if (strcmp(argv[i], "--test-allocations") == 0)
+            testAllocations = true;
+        else if (strcmp(argv[i], "--bench-eclipses") == 0) {
+            benchmarkEclipses();
+            return 0;
+        }
+        else if (strcmp(argv[i], "--bench-orbits") == 0) {
+            benchmarkOrbits();
+            return 0;
+        }
+        else if (strcmp(argv[i], "--bench-nbody") == 0) {
+            benchmarkNBody();
+            return 0;
+        }
+        else if (strcmp(argv[i], "--bench-ephemeris") == 0) {
+            benchmarkEphemeris();
+            return 0;
+        }
+        else if (strcmp(argv[i], "--bench-conjunctions") == 0) {
+            benchmarkConjunctions();
+            return 0;
+        }
+        else if (strcmp(argv[i], "--conjunctions") == 0 && i + 3 < argc) {
+            conjunctionsDuration = atof(argv[i + 1]);
+            conjunctionsThreshold = atof(argv[i + 2]);
+            conjunctionsReport = argv[i + 3];
+            i += 3;
+        }
+        else if (strcmp(argv[i], "--bench-bvh") == 0) {
+            benchmarkBVH();
+            return 0;
+        }
+        else if (strcmp(argv[i], "--bench-asteroids") == 0) {
+            benchmarkAsteroids();
+            return 0;
+        }
+        else if (strcmp(argv[i], "--ephemeris-import") == 0 && i + 2 < argc)
+            return importEphemeris(argv[i + 1], argv[i + 2]);
+        else if (strcmp(argv[i], "--ephemeris") == 0 && i + 1 < argc)
+            ephemerisPath = argv[++i];
+        else if (strcmp(argv[i], "--bench-entities") == 0) {
+            benchmarkEntities();
+            return 0;
+        }
+        else if (strcmp(argv[i], "--bench-scene") == 0) {
+            benchmarkScene();
+            return 0;
+        }
+        else if (strcmp(argv[i], "--compile-scene") == 0 && i + 2 < argc)
+            return compileScene(argv[i + 1], argv[i + 2]);
+        else if (strcmp(argv[i], "--scene") == 0 && i + 1 < argc)
+            scenePath = argv[++i];
     }
-    glBindTexture(GL_TEXTURE_2D, 0);
-    SDL_FreeSurface(rgbImgNeptune);
 
+    //The bodies, their materials and their orbits, text or compiled
+    Scene* scene = Scene::load(scenePath);
+    if (scene == nullptr)
+        return EXIT_FAILURE;
+    if (conjunctionsReport != nullptr) {
+        int result = analyzeConjunctions(*scene, conjunctionsDuration, conjunctionsThreshold, conjunctionsReport);
+        delete scene;
+        return result;
+    }
 
-    GLuint TextureMoon;
-    glGenTextures(1, &TextureMoon);
-    std::cout << glGetError() << std::endl;
+    ////////////////////////////////////////
+    //SDL2 / OpenGL Context initialization : 
+    ////////////////////////////////////////
 
-    glBindTexture(GL_TEXTURE_2D, TextureMoon);
+    //Initialize SDL2
+    if (SDL_Init(SDL_INIT_VIDEO | SDL_INIT_JOYSTICK) < 0)
     {
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, rgbImgMoon->w, rgbImgMoon->h, 0, GL_RGBA, GL_UNSIGNED_BYTE, (GLvoid*)rgbImgMoon->pixels);
-        glGenerateMipmap(GL_TEXTURE_2D);
-
+        ERROR("The initialization of the SDL failed : %s\n", SDL_GetError());
+        return 0;
+    }
+    if (!(IMG_Init(IMG_INIT_PNG) & IMG_INIT_PNG)) {
+        ERROR("The initialization of the SDL_image failed : %s\n", IMG_GetError());
+        return EXIT_FAILURE;
     }
-    glBindTexture(GL_TEXTURE_2D, 0);
-    SDL_FreeSurface(rgbImgMoon);
-
-
-    Sphere sphere(32, 32);
-
-
-
-
-
-    GLuint vboSphereID;
-    glGenBuffers(1, &vboSphereID);
-    glBindBuffer(GL_ARRAY_BUFFER, vboSphereID);
-    glBufferData(GL_ARRAY_BUFFER, sphere.getNbVertices() * (3 + 3 + 2) * sizeof(float), nullptr, GL_DYNAMIC_DRAW);
-    glBufferSubData(GL_ARRAY_BUFFER, 0, sphere.getNbVertices() * 3 * sizeof(float), sphere.getVertices());
-
-    glBufferSubData(GL_ARRAY_BUFFER, sphere.getNbVertices() * 3 * sizeof(float) + sphere.getNbVertices() * 3 * sizeof(float), sphere.getNbVertices() * 2 * sizeof(float), sphere.getUVs());
-    glBufferSubData(GL_ARRAY_BUFFER, sphere.getNbVertices() * 3 * sizeof(float), sphere.getNbVertices() * 3 * sizeof(float), sphere.getNormals());
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-
-
-
-    objet sunGO;
-    objet sunDeux;
-    objet etoileGO;
-    objet etoileinvi;
-    objet MercureGO;
-    objet VenusGO;
-    objet EarthGO;
-    objet MarsGO;
-    objet JupiterGO;
-    objet SaturneGO;
-    objet UranusGO;
-    objet NeptuneGO;
-    objet MoonGO;
-
-    objet pandoraGO;
-    objet coruscantGO;
-    objet dianaGO;
-    objet anubisGO;
-    objet lokiGO;
-    objet deathStarGO;
-    objet narutoGO;
-    objet isisGO;
-
-
-
-
-    Material sphereMtl{ { 0.0f, 0.0f, 0.0f }, 1.0f, 0.0f, 0.0f, 1 };
-    sunGO.material = Material{ {1.0f, 1.0f, 1.0f}, 1.0f, 0.0f, 0.0f, 1 ,textureSun };
-    sunDeux.material = Material{ {1.0f, 1.0f, 1.0f}, 1.0f, 0.0f, 0.0f, 1 ,texturedeathStar };
-    etoileinvi.material = Material{ {1.0f, 1.0f, 1.0f}, 1.0f, 0.0f, 0.0f, 1 ,textureSun };
-    MercureGO.material = Material{ {0.0f, 0.0f, 0.0f}, 0.2f, 0.8f, 0.0f, 1 ,TextureMercure };
-    MercureGO.etoile = 2;
-    VenusGO.material = Material{ {0.0f, 0.0f, 0.0f}, 0.2f, 0.8f, 0.0f, 1 ,TextureVenus };
-    VenusGO.etoile = 2;
-    EarthGO.material = Material{ {0.0f, 0.0f, 0.0f}, 0.2f, 0.9f, 0.0f, 1 ,TextureTerre };
-    EarthGO.etoile = 2;
-    MarsGO.material = Material{ {0.0f, 0.0f, 0.0f}, 0.2f, 0.8f, 0.0f, 1 ,TextureMars };
-    MarsGO.etoile = 2;
-    JupiterGO.material = Material{ {0.0f, 0.0f, 0.0f}, 0.2f, 0.8f, 0.4f, 1 ,TextureJupiter };
-    JupiterGO.etoile = 2;
-    SaturneGO.material = Material{ {0.0f, 0.0f, 0.0f}, 0.2f, 0.8f, 0.3f, 1 ,TextureSaturne };
-    SaturneGO.etoile = 2;
-    UranusGO.material = Material{ {0.0f, 0.0f, 0.0f}, 0.2f, 0.8f, 0.1f, 1 ,TextureUranus };
-    UranusGO.etoile = 2;
-    NeptuneGO.material = Material{ {0.0f, 0.0f, 0.0f}, 0.2f, 0.8f, 0.0f, 1 ,TextureNeptune };
-    NeptuneGO.etoile = 2;
-    MoonGO.material = Material{ {0.0f, 0.0f, 0.0f}, 0.2f, 0.8f, 0.50f, 1, TextureMoon };
-    MoonGO.etoile = 2;
-    etoileGO.material = Material{ {0.0f, 0.0f, 0.0f}, 1.0f, 0.0f, 0.0f, 1, textureSTAR };
-    etoileGO.etoile = 2;
-
-    pandoraGO.material = Material{ {0.0f, 0.0f, 0.0f},0.2f, 0.8f, 0.50f, 1, texturepandora };
-    pandoraGO.etoile = 1;
-    coruscantGO.material = Material{ {0.0f, 0.0f, 0.0f}, 0.2f, 0.8f, 0.50f, 1, texturecoruscant };
-    coruscantGO.etoile = 1;
-
-    dianaGO.material = Material{ {0.0f, 0.0f, 0.0f},0.2f, 0.8f, 0.50f, 1, texturediana };
-    dianaGO.etoile = 1;
-    anubisGO.material = Material{ {0.0f, 0.0f, 0.0f}, 0.2f, 0.8f, 0.50f, 1, textureanubis };
-    anubisGO.etoile = 1;
-
-    lokiGO.material = Material{ {0.0f, 0.0f, 0.0f}, 0.2f, 0.8f, 0.50f, 1, textureloki };
-    lokiGO.etoile = 1;
-
-
-    narutoGO.material = Material{ {0.0f, 0.0f, 0.0f},0.2f, 0.8f, 0.50f, 1, texturenaruto };
-    narutoGO.etoile = 1;
-    isisGO.material = Material{ {0.0f, 0.0f, 0.0f}, 0.2f, 0.8f, 0.50f, 1, textureisis };
-    isisGO.etoile = 1;
-
-
-
-
-    etoileGO.children.push_back(&etoileinvi);
-    etoileinvi.children.push_back(&sunGO);
-    etoileinvi.children.push_back(&sunDeux);
-    sunGO.children.push_back(&MercureGO);
-    sunGO.children.push_back(&VenusGO);
-    sunGO.children.push_back(&EarthGO);
-    sunGO.children.push_back(&MarsGO);
-    sunGO.children.push_back(&JupiterGO);
-    sunGO.children.push_back(&SaturneGO);
-    sunGO.children.push_back(&UranusGO);
-    sunGO.children.push_back(&NeptuneGO);
-
-    sunDeux.children.push_back(&pandoraGO);
-    sunDeux.children.push_back(&coruscantGO);
-
-    sunDeux.children.push_back(&dianaGO);
-    sunDeux.children.push_back(&anubisGO);
-
-    sunDeux.children.push_back(&lokiGO);
-    
-
-    /* sunGO.children.push_back(&narutoGO);
-     sunGO.children.push_back(&isisGO);*/
-
-
-    EarthGO.children.push_back(&MoonGO);
-    etoileGO.children.push_back(&etoileinvi);
-
-    dianaGO.geometry = &sphere;
-    dianaGO.vboID = vboSphereID;
-
-    anubisGO.geometry = &sphere;
-    anubisGO.vboID = vboSphereID;
 
-    lokiGO.geometry = &sphere;
-    lokiGO.vboID = vboSphereID;
 
 
-    narutoGO.geometry = &sphere;
-    isisGO.vboID = vboSphereID;
+    //Create a Window
+    SDL_Window* window = SDL_CreateWindow("Diving Throught Space",                           //Titre
+        SDL_WINDOWPOS_UNDEFINED,               //X Position
+        SDL_WINDOWPOS_UNDEFINED,               //Y Position
+        WIDTH, HEIGHT,                         //Resolution
+        SDL_WINDOW_OPENGL | SDL_WINDOW_SHOWN); //Flags (OpenGL + Show)
 
-    isisGO.geometry = &sphere;
-    isisGO.vboID = vboSphereID;
+//Initialize OpenGL Version (version 3.0)
+    SDL_GL_SetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION, 3);
+    SDL_GL_SetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, 0);
 
+    //Initialize the OpenGL Context (where OpenGL resources (Graphics card resources) lives)
+    SDL_GLContext context = SDL_GL_CreateContext(window);
 
-    etoileinvi.geometry = &sphere;
-    etoileinvi.vboID = vboSphereID;
-    sunDeux.geometry = &sphere;
-    sunDeux.vboID = vboSphereID;
-    pandoraGO.geometry = &sphere;
-    pandoraGO.vboID = vboSphereID;
+    //Tells GLEW to initialize the OpenGL function with this version
+    glewExperimental = GL_TRUE;
+    glewInit();
+    Shader::enableParallelCompile();
 
-    coruscantGO.geometry = &sphere;
-    coruscantGO.vboID = vboSphereID;
 
-    sunGO.geometry = &sphere;
-    sunGO.vboID = vboSphereID;
+    //Start using OpenGL to draw something on screen
+    glViewport(0, 0, WIDTH, HEIGHT); //Draw on ALL the screen
 
-    etoileGO.geometry = &sphere;
-    etoileGO.vboID = vboSphereID;
+    //The OpenGL background color (RGBA, each component between 0.0f and 1.0f)
+    glClearColor(0.0, 0.0, 0.0, 1.0); //Full Black  
 
-    MercureGO.geometry = &sphere;
-    MercureGO.vboID = vboSphereID;
+    glEnable(GL_DEPTH_TEST); //Active the depth test
 
-    VenusGO.geometry = &sphere;
-    VenusGO.vboID = vboSphereID;
 
-    EarthGO.geometry = &sphere;
-    EarthGO.vboID = vboSphereID;
 
-    MarsGO.geometry = &sphere;
-    MarsGO.vboID = vboSphereID;
 
-    JupiterGO.geometry = &sphere;
-    JupiterGO.vboID = vboSphereID;
 
-    SaturneGO.geometry = &sphere;
-    SaturneGO.vboID = vboSphereID;
+    //Textures of the scene, with the path of their CPU copy for the path tracer
+    std::map<GLuint, const char*> textureAssets;
+    std::vector<GLuint> sceneTextures(scene->getNbTextures());
+    for (uint32_t i = 0; i < scene->getNbTextures(); i++)
+        sceneTextures[i] = loadTexture(scene->getString(scene->getTexture(i).path), textureAssets);
+    //The debris, the asteroids and the ring particles are textured like the Moon, the sphere benchmark like Jupiter
+    int32_t moonTexture = scene->findTexture("Moon");
+    int32_t jupiterTexture = scene->findTexture("Jupiter");
+    GLuint TextureMoon = moonTexture >= 0 ? sceneTextures[moonTexture] : loadTexture("Assets/8k_moon.jpg", textureAssets);
+    GLuint TextureJupiter = jupiterTexture >= 0 ? sceneTextures[jupiterTexture] : loadTexture("Assets/8k_jupiter.jpg", textureAssets);
 
-    UranusGO.geometry = &sphere;
-    UranusGO.vboID = vboSphereID;
+    std::map<GLuint, Image*> textureImages;
 
-    NeptuneGO.geometry = &sphere;
-    NeptuneGO.vboID = vboSphereID;
+    Sphere sphere(32, 32);
 
-    MoonGO.geometry = &sphere;
-    MoonGO.vboID = vboSphereID;
 
 
 
 
+    GLuint vboSphereID;
+    glGenBuffers(1, &vboSphereID);
+    glBindBuffer(GL_ARRAY_BUFFER, vboSphereID);
+    //The geometry is already in the layout of the buffer : vertices, normals, then UVs
+    glBufferData(GL_ARRAY_BUFFER, sphere.getDataSize(), sphere.getData(), GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
 
+    //Screen-aligned quad of the sphere impostors (triangle strip)
+    float quadCorners[] = { -1.0f, -1.0f, 1.0f, -1.0f, -1.0f, 1.0f, 1.0f, 1.0f };
+    GLuint vboQuadID;
+    glGenBuffers(1, &vboQuadID);
+    glBindBuffer(GL_ARRAY_BUFFER, vboQuadID);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(quadCorners), quadCorners, GL_STATIC_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
 
 
-    const char* vertPath = "Shaders/color.vert";
-    const char* fragPath = "Shaders/color.frag";
 
-    FILE* vert = fopen(vertPath, "r");
-    FILE* frag = fopen(fragPath, "r");
+    //The first body is the root. The stars are the bodies with light=1 and light=2, lights[0] and lights[1] of the frame
+    //The bodies are moved, culled and drawn from their entities. Their objet tree is kept in sync for the passes walking it
+    Orbits orbits;
+    std::vector<objet> sceneBodies;
+    EntityWorld entities;
+    instantiateScene(*scene, sceneBodies, entities, orbits, sceneTextures, &sphere, vboSphereID);
+    objet& rootGO = sceneBodies[0];
+    objet* stars[2] = { nullptr, nullptr };
+    objet* skyGO = nullptr;
+    for (uint32_t i = 0; i < scene->getNbBodies(); i++) {
+        const SceneBody& body = scene->getBody(i);
+        if (body.light == 1 || body.light == 2)
+            stars[body.light - 1] = &sceneBodies[i];
+        if (body.sky && skyGO == nullptr)
+            skyGO = &sceneBodies[i];
+    }
+    if (stars[0] == nullptr || stars[1] == nullptr) {
+        ERROR("The scene %s needs a body with light=1 and one with light=2\n", scenePath);
+        return EXIT_FAILURE;
+    }
+    objet& sunDeux = *stars[0];
+    objet& sunGO = *stars[1];
+
+    //With --ephemeris, the bodies with an ephemeris ID follow the file (NAIF IDs for the planets, heliocentric). The others keep their orbit
+    Ephemeris* ephemeris = ephemerisPath != nullptr ? Ephemeris::open(ephemerisPath) : nullptr;
+    double ephemerisStart = 0.0;
+    double ephemerisSpan = 0.0;
+    if (ephemeris != nullptr) {
+        ephemerisStart = -INFINITY;
+        double ephemerisEnd = INFINITY;
+        for (uint32_t i = 0; i < scene->getNbBodies(); i++) {
+            const SceneBody& body = scene->getBody(i);
+            if (body.ephemerisID >= 0 && addEphemeris(sceneBodies[i], *ephemeris, body.ephemerisID, body.orbit.semiMajorAxis)) {
+                ephemerisStart = glm::max(ephemerisStart, ephemeris->getStartTime(sceneBodies[i].ephemerisID));
+                ephemerisEnd = glm::min(ephemerisEnd, ephemeris->getEndTime(sceneBodies[i].ephemerisID));
+            }
+        }
+        if (ephemerisStart == -INFINITY) {
+            WARNING("%s has none of the bodies of the scene\n", ephemerisPath);
+            delete ephemeris;
+            ephemeris = nullptr;
+        }
+        else
+            ephemerisSpan = glm::max(ephemerisEnd - ephemerisStart, 0.0);
+    }
 
-    Shader* shader = Shader::loadFromFiles(vert, frag);
+    //N-body debris field between coruscant and diana, in the frame of the second star. The star is the first body. Key N shows and simulates it.
+    //Their entities are drawn only while it is shown
+    const ComponentMask debrisComponents = componentBit(COMPONENT_TRANSFORM) | componentBit(COMPONENT_MATERIAL) | componentBit(COMPONENT_COLLIDER);
+    NBodyParameters debrisParams;
+    debrisParams.softening = 0.05;
+    NBody debris(debrisParams);
+    debris.add(glm::dvec3(0.0), glm::dvec3(0.0), DEBRIS_STAR_MASS);
+    std::vector<objet> debrisBodies(DEBRIS_COUNT);
+    objet debrisGO;
+    srand(7);
+    for (objet& body : debrisBodies) {
+        double radius = 4.0 + rand() / (double)RAND_MAX * 1.5;
+        double angle = rand() / (double)RAND_MAX * 2.0 * M_PI;
+        glm::dvec3 position(radius * cos(angle), (rand() / (double)RAND_MAX - 0.5) * 0.2, -radius * sin(angle));
+        glm::dvec3 velocity = sqrt(DEBRIS_STAR_MASS / radius) * glm::dvec3(-sin(angle), 0.0, -cos(angle));
+        body.nbodyID = (int32_t)debris.add(position, velocity, DEBRIS_FIELD_MASS / DEBRIS_COUNT);
+        body.size = glm::dvec3(0.02 + rand() / (double)RAND_MAX * 0.03);
+        body.geometry = &sphere;
+        body.vboID = vboSphereID;
+        body.material = Material{ {0.0f, 0.0f, 0.0f}, 0.2f, 0.8f, 0.0f, 1, TextureMoon };
+        body.etoile = 1;
+        body.entity = entities.create(debrisComponents);
+        EntitySystems::setParent(entities, body.entity, sunDeux.entity);
+        TransformComponent* transform = entities.get<TransformComponent>(body.entity);
+        transform->position = position;
+        transform->basis = glm::mat3(glm::scale(glm::dmat4(1.0), body.size));
+        MaterialComponent* material = entities.get<MaterialComponent>(body.entity);
+        material->material = body.material;
+        material->lit = body.etoile;
+        entities.get<ColliderComponent>(body.entity)->radius = (float)(0.5 * body.size.x);
+        debrisGO.children.push_back(&body);
+    }
+    bool debrisShown = false;
+    auto showDebris = [&](bool shown) {
+        debrisShown = shown;
+        if (shown)
+            sunDeux.children.push_back(&debrisGO);
+        else
+            sunDeux.children.erase(std::find(sunDeux.children.begin(), sunDeux.children.end(), &debrisGO));
+        for (objet& body : debrisBodies) {
+            entities.setComponents(body.entity, shown ? debrisComponents | componentBit(COMPONENT_RENDERABLE) : debrisComponents);
+            if (shown) {
+                RenderableComponent* renderable = entities.get<RenderableComponent>(body.entity);
+                renderable->geometry = body.geometry;
+                renderable->vboID = body.vboID;
+            }
+        }
+    };
 
-    fclose(vert);
-    fclose(frag);
+    //Asteroid belt between Mars and Jupiter, in the frame of the first star. Generated on the first press of B, which shows and hides it
+    AsteroidField* belt = nullptr;
+    bool beltShown = false;
 
-    if (shader == nullptr) {
+    //Only the fallback is waited for. The other variants are built by the driver while the first frames are drawn
+    ShaderVariants* shaders = loadShaderVariants("Shaders/color.vert", "Shaders/color.frag");
+    if (shaders == nullptr || shaders->get(FALLBACK_SHADER_VARIANT) == nullptr) {
         std::cerr << "The shader 'color' did not compile correctly. Exiting." << std::endl;
         return EXIT_FAILURE;
     }
+    shaders->tryGet(CLUSTERED_SHADER_VARIANT);
+
+    ShaderVariants* impostorShaders = loadShaderVariants("Shaders/impostor.vert", "Shaders/impostor.frag");
+    if (impostorShaders != nullptr)
+        impostorShaders->tryGet(CLUSTERED_SHADER_VARIANT);
+    else
+        WARNING("The shader 'impostor' is missing. The impostor geometry is not available.\n");
+
+    ShaderVariants* proceduralShaders = loadShaderVariants("Shaders/procedural_sphere.vert", "Shaders/color.frag");
+    if (proceduralShaders != nullptr)
+        proceduralShaders->tryGet(CLUSTERED_SHADER_VARIANT);
+    else
+        WARNING("The shader 'procedural_sphere' is missing. The procedural geometry is not available.\n");
+
+    //Star background : the texture of the sky body is converted once to a cubemap and drawn last. The background sphere is kept only if this fails
+    Skybox* skybox = nullptr;
+    Image* skyImage = skyGO != nullptr && textureAssets.count(skyGO->material.texture) ? Image::loadFromFile(textureAssets[skyGO->material.texture]) : nullptr;
+    if (skyImage != nullptr) {
+        skybox = Skybox::loadFromEquirectangular(*skyImage, skyImage->getWidth() / 4);
+        delete skyImage;
+    }
+    if (skybox != nullptr) {
+        skyGO->geometry = nullptr;
+        skyGO->vboID = 0;
+        entities.setComponents(skyGO->entity, entities.getComponents(skyGO->entity) & ~componentBit(COMPONENT_RENDERABLE));
+    }
+    else if (skyGO != nullptr)
+        WARNING("Could not create the skybox. The star background is drawn as a sphere.\n");
+    ShaderCache::logStats();
+
+    Rock rock(ASTEROID_SEED, ASTEROID_SUBDIVISIONS);
+    AsteroidRenderer* asteroidRenderer = AsteroidRenderer::create(rock);
+    if (asteroidRenderer == nullptr)
+        WARNING("Could not create the asteroid renderer. The asteroid belt is not available.\n");
+
+    //Atmospheres : the tables are computed on the first launch, then read from AtmosphereCache/
+    Atmosphere* earthAtmosphere = Atmosphere::create(AtmosphereParameters::earth());
+    Atmosphere* hazeAtmosphere = Atmosphere::create(AtmosphereParameters::haze());
+    //Rings, in the equator of their body. Their particles are drawn like the asteroids, when the renderer exists
+    std::vector<PlanetRings*> planetRings;
+    for (uint32_t i = 0; i < scene->getNbBodies(); i++) {
+        const SceneBody& body = scene->getBody(i);
+        if (body.atmosphere == SCENE_ATMOSPHERE_EARTH)
+            sceneBodies[i].atmosphere = earthAtmosphere;
+        else if (body.atmosphere == SCENE_ATMOSPHERE_HAZE)
+            sceneBodies[i].atmosphere = hazeAtmosphere;
+        if (body.rings == 0)
+            continue;
+        PlanetRings* rings = nullptr;
+        Image* ringImage = Image::loadFromFile(scene->getString(body.rings));
+        if (ringImage != nullptr) {
+            rings = PlanetRings::create(RingParameters(), *ringImage);
+            delete ringImage;
+        }
+        if (rings != nullptr) {
+            rings->setParticles(asteroidRenderer, TextureMoon);
+            sceneBodies[i].rings = rings;
+            planetRings.push_back(rings);
+        }
+        else
+            WARNING("Could not create the rings of %s\n", scene->getString(body.name));
+    }
 
-
-    float t = 0;
-
-    bool isOpened = true;
+    RenderContext renderContext;
+    renderContext.shaders = shaders;
+    renderContext.impostorShaders = impostorShaders;
+    renderContext.proceduralShaders = proceduralShaders;
+    renderContext.vboQuadID = vboQuadID;
+    LightClusters* lightClusters = new LightClusters(WIDTH, HEIGHT);
+    renderContext.lightClusters = lightClusters;
+    Eclipses* eclipses = new Eclipses();
+    renderContext.eclipses = eclipses;
+    DepthBuffer* depthBuffer = new DepthBuffer(WIDTH, HEIGHT, CAMERA_NEAR, CAMERA_FAR);
+    int exitCode = 0;
+
+    if (benchSpheres)
+        benchmarkSpheres(renderContext, &sphere, vboSphereID, TextureJupiter);
+    if (benchAtmosphere)
+        benchmarkAtmosphere(AtmosphereParameters::earth());
+    if (testDepth)
+        exitCode = testDepthModes(renderContext, *depthBuffer, &sphere, vboSphereID);
+    renderContext.depthBuffer = depthBuffer;
+
+
+    double t = 0;
+
+    bool isOpened = !benchSpheres && !benchAtmosphere && !testDepth;
+    if (testAllocations && !FrameArena::countsAllocations()) {
+        ERROR("--test-allocations needs a build with FRAME_ARENA_COUNT_ALLOCATIONS\n");
+        exitCode = EXIT_FAILURE;
+        isOpened = false;
+    }
     float keyZ = 0.0f;
     float keyQ = 0.0f;
     float keyS = 0.0f;
@@ -782,16 +1913,46 @@ int main(int argc, char* argv[])
     float keyLSHIFT = 0.0f;
     bool keyA = false;
     bool keyE = false;
-    float positionX = 0.5f;
-    float positionY = 4.0f;
-    float positionZ = 20.0f;
+    bool keyP = false;
+    int32_t pickX = -1; //Mouse position of a left click, to pick the body under it at the next frame
+    int32_t pickY = -1;
+    //Total number of lights, the two stars included. L doubles it up to 512. --bench-lights times each step
+    const uint32_t lightCounts[] = { 2, 8, 32, 128, 512 };
+    const uint32_t nbLightCounts = sizeof(lightCounts) / sizeof(lightCounts[0]);
+    const std::vector<DemoLight> demoLights = makeDemoLights(lightCounts[nbLightCounts - 1] - 2);
+    uint32_t lightStep = 0;
+    uint32_t benchFrame = 0;
+    uint32_t testFrame = 0;
+    uint64_t benchElapsed = 0;
+    double benchAssign = 0.0;
+    double positionX = 0.5;
+    double positionY = 4.0;
+    double positionZ = 20.0;
     float delta = 0.01f;
     float cameraAngle = 0.0f;
+    //The camera starts where the keys left it : its first move is a still one
+    CameraCollider collider(CAMERA_RADIUS);
+    std::vector<glm::dvec3> collisionCenters;
+    std::vector<float> collisionRadii;
+    glm::dvec3 cameraPrevious = glm::dvec3(glm::rotate(glm::dmat4(1.0), (double)cameraAngle, glm::dvec3(0.0, 1.0, 0.0)) * glm::dvec4(positionX, positionY, positionZ, 1.0));
+    FrameProfiler profiler;
+    SphereBVH bodyIndex;
+    std::vector<glm::vec3> bodyCenters;
+    std::vector<float> bodyRadii;
+    //The per-frame lists keep their capacity from one frame to the next, the other temporaries come from the frame arenas
+    std::vector<EntitySystems::Draw> bodyDraws;
+    std::vector<PointLight> pointLights;
+    std::vector<EclipseLight> eclipseLights;
+    std::vector<EclipseBody> eclipseBodies;
+    std::vector<objet*> bodyObjets;
     //Main application loop
     while (isOpened)
     {
         //Time in ms telling us when this frame started. Useful for keeping a fix framerate
         uint32_t timeBegin = SDL_GetTicks();
+        //Nothing of the previous frame is used anymore, and the jobs are done
+        FrameArena::resetAll();
+        uint64_t allocationsBegin = FrameArena::getNbAllocations();
 
         //Fetch the SDL events
         SDL_Event event;
@@ -809,6 +1970,12 @@ int main(int argc, char* argv[])
                     break;
                 }
                 break;
+            case SDL_MOUSEBUTTONDOWN:
+                if (event.button.button == SDL_BUTTON_LEFT) {
+                    pickX = event.button.x;
+                    pickY = event.button.y;
+                }
+                break;
             case SDL_KEYDOWN:
                 switch (event.key.keysym.sym) {
                 case SDLK_z:
@@ -835,6 +2002,44 @@ int main(int argc, char* argv[])
                 case SDLK_e:
                     keyE = true;
                     break;
+                case SDLK_p:
+                    keyP = true;
+                    break;
+                case SDLK_f:
+                    profiler.setEnabled(!profiler.isEnabled());
+                    break;
+                case SDLK_g:
+                    renderContext.geometryMode = (GeometryMode)((renderContext.geometryMode + 1) % GEOMETRY_COUNT);
+                    break;
+                case SDLK_l:
+                    lightStep = (lightStep + 1) % nbLightCounts;
+                    INFO("%u lights\n", lightCounts[lightStep]);
+                    break;
+                case SDLK_n:
+                    showDebris(!debrisShown);
+                    break;
+                case SDLK_b:
+                    if (asteroidRenderer == nullptr)
+                        break;
+                    beltShown = !beltShown;
+                    break;
+                case SDLK_m:
+                    if (belt != nullptr) {
+                        uint32_t budget = belt->getParameters().meshBudget;
+                        budget = budget == 0 ? 5000 : (budget * 2 > ASTEROID_MAX_BUDGET ? 0 : budget * 2);
+                        belt->setMeshBudget(budget);
+                        INFO("Asteroid mesh budget : %u\n", budget);
+                    }
+                    break;
+                case SDLK_r: {
+                    //Next depth mode the context supports
+                    DepthMode mode = depthBuffer->getMode();
+                    do {
+                        mode = (DepthMode)((mode + 1) % DEPTH_MODE_COUNT);
+                    } while (!depthBuffer->setMode(mode));
+                    INFO("%s depth\n", DepthBuffer::getModeName(mode));
+                    break;
+                }
                 default:break;
                 }
                 break;
@@ -876,6 +2081,24 @@ int main(int argc, char* argv[])
         positionY = positionY + keySPACE - keyLSHIFT;
 
 
+        //The phases of --test-allocations : the belt is shown from the second one on, the debris field in the last one
+        const uint32_t testPhaseFrames = ALLOCATION_TEST_WARMUP_FRAMES + ALLOCATION_TEST_FRAMES;
+        if (testAllocations && testFrame == testPhaseFrames) {
+            if (asteroidRenderer != nullptr)
+                beltShown = true;
+            else
+                WARNING("No asteroid renderer : --test-allocations goes on without the belt\n");
+        }
+        if (testAllocations && testFrame == 3 * testPhaseFrames && !debrisShown)
+            showDebris(true);
+        //The belt is generated the first time it is shown
+        if (beltShown && belt == nullptr) {
+            AsteroidFieldParameters beltParams;
+            beltParams.count = ASTEROID_COUNT;
+            beltParams.seed = ASTEROID_SEED;
+            belt = new AsteroidField(beltParams);
+        }
+
         if (keyA) {
             cameraAngle += delta;
 
@@ -885,85 +2108,179 @@ int main(int argc, char* argv[])
 
         }
 
-        //Clear the screen : the depth buffer and the color buffer
-        glClear(GL_DEPTH_BUFFER_BIT | GL_COLOR_BUFFER_BIT);
-
-
+        //Clear the screen : the depth buffer and the color buffer, in the framebuffer of the depth mode
+        depthBuffer->beginFrame();
+        profiler.beginFrame();
 
-        glm::mat4 camera(1.0f);
-        glm::vec3 cameraPosition(positionX, positionY, positionZ);
-        camera = glm::rotate(glm::mat4(1.0f), cameraAngle, glm::vec3(0.0f, 1.0f, 0.0f)) * glm::translate(camera, cameraPosition);
-
-       
+        profiler.begin("Animation");
+        t += 0.01;
 
+        //Every body of the scene follows its Keplerian orbit, the ones without an orbit only spin
+        orbits.propagate(t);
+        EntitySystems::updateOrbits(entities, orbits, t);
+        if (ephemeris != nullptr) {
+            //Loops over the span every planet covers
+            double date = ephemerisStart + (ephemerisSpan > 0.0 ? fmod(t * EPHEMERIS_DAYS_PER_TIME, ephemerisSpan) : 0.0);
+            applyEphemeris(rootGO, entities, *ephemeris, date);
+        }
+        if (debrisShown) {
+            debris.advance(0.01);
+            applyNBody(debrisGO, entities, debris);
+        }
+        EntitySystems::updateTransforms(entities);
+        applyTransforms(rootGO, entities);
+        profiler.end();
+
+        //The third phase of --test-allocations puts the camera in the rings as they move, without sweeping it there
+        if (testAllocations && testFrame >= 2 * testPhaseFrames && testFrame < 3 * testPhaseFrames) {
+            glm::dvec3 ringViewpoint;
+            if (findRingViewpoint(rootGO, glm::dmat4(1.0), ringViewpoint)) {
+                glm::dvec3 ringLocal = glm::dvec3(glm::transpose(glm::rotate(glm::dmat4(1.0), (double)cameraAngle, glm::dvec3(0.0, 1.0, 0.0))) * glm::dvec4(ringViewpoint, 1.0));
+                positionX = ringLocal.x;
+                positionY = ringLocal.y;
+                positionZ = ringLocal.z;
+                cameraPrevious = ringViewpoint;
+            }
+            else if (testFrame == 2 * testPhaseFrames)
+                WARNING("No body with rings : --test-allocations goes on outside of them\n");
+        }
 
-        glm::mat4 view = glm::inverse(camera);
-        glm::mat4 projection = glm::perspective(45.0f, WIDTH / (float)HEIGHT, 0.01f, 1000.0f);
+        //The bodies, relative to the camera of the previous frame : the camera is swept from there, then they are moved in the frame of the new camera.
+        //Their index is refit as they move, rebuilt when the bodies change or the refits degraded it too much
+        profiler.begin("Bodies");
+        eclipseBodies.clear();
+        bodyObjets.clear();
+        collectEclipseBodies(rootGO, glm::translate(glm::dmat4(1.0), -cameraPrevious), entities, eclipseBodies, bodyObjets);
+        bodyCenters.clear();
+        bodyRadii.clear();
+        for (const EclipseBody& body : eclipseBodies) {
+            bodyCenters.push_back(body.center);
+            bodyRadii.push_back(body.radius);
+        }
+        if (bodyCenters.size() != bodyIndex.getNbSpheres() || bodyIndex.getRefitCost() > BVH_REBUILD_COST)
+            bodyIndex.build(bodyCenters, bodyRadii);
+        else
+            bodyIndex.refit(bodyCenters, bodyRadii);
+        profiler.end();
+
+        //The camera is swept from where it was to where the keys move it, against the bodies where they are now, inside the star background.
+        //Its position is kept in the frame turning with cameraAngle, so the result is brought back in it
+        profiler.begin("Camera collision");
+        collisionCenters.clear();
+        collisionRadii.clear();
+        collectCollisionBodies(rootGO, glm::dmat4(1.0), collisionCenters, collisionRadii);
+        glm::dmat4 cameraRotation = glm::rotate(glm::dmat4(1.0), (double)cameraAngle, glm::dvec3(0.0, 1.0, 0.0));
+        glm::dvec3 cameraTarget = glm::dvec3(cameraRotation * glm::dvec4(positionX, positionY, positionZ, 1.0));
+        glm::dvec3 cameraWorld = collider.move(cameraPrevious, cameraTarget, bodyIndex, collisionCenters, collisionRadii,
+                                               skyGO != nullptr ? glm::dvec3(skyGO->propagatedMatrix[3]) : glm::dvec3(0.0),
+                                               skyGO != nullptr ? 0.5 * glm::length(glm::dvec3(skyGO->localMatrix[0])) : 0.0);
+        glm::dvec3 cameraLocal = glm::dvec3(glm::transpose(cameraRotation) * glm::dvec4(cameraWorld, 1.0));
+        positionX = cameraLocal.x;
+        positionY = cameraLocal.y;
+        positionZ = cameraLocal.z;
+        //Where the new camera is in the frame of the index
+        glm::vec3 cameraShift = glm::vec3(cameraWorld - cameraPrevious);
+        cameraPrevious = cameraWorld;
+        profiler.end();
+
+        glm::dmat4 camera = cameraRotation * glm::translate(glm::dmat4(1.0), cameraLocal);
+
+        //Camera-relative rendering : the world is moved by -cameraWorld in double precision, the GPU only gets the camera rotation
+        glm::dmat4 root = glm::translate(glm::dmat4(1.0), -cameraWorld);
+        glm::vec3 cameraPosition(0.0f);
+        glm::mat4 view = glm::mat4(glm::mat3(glm::inverse(camera)));
+        glm::mat4 projection = depthBuffer->getProjection(45.0f, WIDTH / (float)HEIGHT);
         glm::mat4 model(1.0f);
 
-        std::stack<glm::mat4> matrices;
         glm::vec3 lights[2]{};
         model = glm::translate(model, glm::vec3(0.0f, 0.0f, -5.0f)); //Warning: We passed from left-handed world coordinate to right-handed world coordinate due to glm::perspective
         model = glm::rotate(model, cameraAngle, glm::vec3(0.0f, 1.0f, 0.0f));
         glm::mat3 invModel3x3 = glm::inverse(glm::mat3(model));
-        matrices.push(glm::mat4(1.0f));
-
-        t += 0.01;
-         etoileGO.localMatrix = glm::scale(glm::mat4(1.0f), glm::vec3(100.0f, 100.0f, 100.0f));
-         sunGO.localMatrix = glm::rotate(glm::mat4(1.0f), t * 0.1f, glm::vec3(0.0f, 1.0f, 0.0f))*glm::translate(glm::mat4(1.0f), glm::vec3(-10.0f, 0.0f, 0.0f))*glm::scale(glm::mat4(1.0f), glm::vec3(2.0f, 2.0f, 2.0f));
-         sunGO.propagatedMatrix= glm::rotate(glm::mat4(1.0f), t * 0.1f, glm::vec3(0.0f, 1.0f, 0.0f)) * glm::translate(glm::mat4(1.0f), glm::vec3(-10.0f, 0.0f, 0.0f));
-         sunDeux.localMatrix = glm::rotate(glm::mat4(1.0f), t * 0.1f, glm::vec3(0.0f, 1.0f, 0.0f))* glm::translate(glm::mat4(1.0f), glm::vec3(10.0f, 0.0f, 0.0f))*glm::scale(glm::mat4(1.0f), glm::vec3( 2.0f, 2.0f, 2.0f));
-             sunDeux.propagatedMatrix = glm::rotate(glm::mat4(1.0f), t * 0.1f, glm::vec3(0.0f, 1.0f, 0.0f)) * glm::translate(glm::mat4(1.0f), glm::vec3(10.0f, 0.0f, 0.0f));
-
-         etoileinvi.localMatrix = glm::rotate(glm::mat4(1.0f), t, glm::vec3(0.0f, 1.0f, 0.0f))*glm::scale(glm::mat4(1.0f), glm::vec3(0.001f, 0.001f, 0.001f));
-        // etoileinvi.propagatedMatrix = glm::rotate(glm::mat4(1.0f), t, glm::vec3(0.0f, 1.0f, 0.0f));
-    
-       
-
-        MercureGO.localMatrix = glm::rotate(glm::mat4(1.0f), t * 2.0f, glm::vec3(0.0f, 1.0f, 0.0f)) * glm::translate(glm::mat4(1.0f), glm::vec3(-1.5f, 0.0f, 0.0f)) * glm::scale(glm::mat4(1.0f), glm::vec3(0.1f, 0.1f, 0.1f));;
 
-        VenusGO.localMatrix = glm::rotate(glm::mat4(1.0f), t, glm::vec3(0.0f, 1.0f, 0.0f)) * glm::translate(glm::mat4(1.0f), glm::vec3(-2.0f, 0.0f, 0.0f)) * glm::scale(glm::mat4(1.0f), glm::vec3(0.25f, 0.25f, 0.25f));
-        
-        EarthGO.localMatrix = glm::rotate(glm::mat4(1.0f), t * 0.9f, glm::vec3(0.0f, 1.0f, 0.0f)) * glm::translate(glm::mat4(1.0f), glm::vec3(-3.0f, 0.0f, 0.0f)) * glm::scale(glm::mat4(1.0f), glm::vec3(0.3f, 0.3f, 0.3f));
-
-        EarthGO.propagatedMatrix = glm::rotate(glm::mat4(1.0f), t * 0.9f, glm::vec3(0.0f, 1.0f, 0.0f)) * glm::translate(glm::mat4(1.0f), glm::vec3(-3.0f, 0.0f, 0.0f));
-        
-        MoonGO.localMatrix = glm::rotate(glm::mat4(1.0f), t * 3.0f, glm::vec3(0.0f, 1.0f, 0.0f)) * glm::translate(glm::mat4(1.0f), glm::vec3(-0.3f, 0.0f, 0.0f)) * glm::scale(glm::mat4(1.0f), glm::vec3(0.12f, 0.12f, 0.12f));
-
-        MarsGO.localMatrix = glm::rotate(glm::mat4(1.0f), t * 0.8f, glm::vec3(0.0f, 1.0f, 0.0f)) * glm::translate(glm::mat4(1.0f), glm::vec3(-4.0f, 0.0f, 0.0f)) * glm::scale(glm::mat4(1.0f), glm::vec3(0.27f, 0.27f, 0.27f));
-
-        JupiterGO.localMatrix = glm::rotate(glm::mat4(1.0f), t * 0.6f, glm::vec3(0.0f, 1.0f, 0.0f)) * glm::translate(glm::mat4(1.0f), glm::vec3(-5.0f, 0.0f, 0.0f)) * glm::scale(glm::mat4(1.0f), glm::vec3(0.4f, 0.4f, 0.4f));
-
-        SaturneGO.localMatrix = glm::rotate(glm::mat4(1.0f), t * 0.5f, glm::vec3(0.0f, 1.0f, 0.0f)) * glm::translate(glm::mat4(1.0f), glm::vec3(-6.0f, 0.0f, 0.0f)) * glm::scale(glm::mat4(1.0f), glm::vec3(0.38f, 0.38f, 0.38f));
-
-        UranusGO.localMatrix = glm::rotate(glm::mat4(1.0f), t * 0.4f, glm::vec3(0.0f, 1.0f, 0.0f)) * glm::translate(glm::mat4(1.0f), glm::vec3(-7.0f, 0.0f, 0.0f)) * glm::scale(glm::mat4(1.0f), glm::vec3(0.3f, 0.3f, 0.3f));
-
-        NeptuneGO.localMatrix = glm::rotate(glm::mat4(1.0f), t * 0.3f, glm::vec3(0.0f, 1.0f, 0.0f)) * glm::translate(glm::mat4(1.0f), glm::vec3(-8.0f, 0.0f, 0.0f)) * glm::scale(glm::mat4(1.0f), glm::vec3(0.3f, 0.3f, 0.3f));
-
-        pandoraGO.localMatrix = glm::rotate(glm::mat4(1.0f), t * 0.7f, glm::vec3(0.0f, 1.0f, 0.0f)) * glm::translate(glm::mat4(1.0f), glm::vec3(8.0f, 0.0f, 0.0f)) * glm::scale(glm::mat4(1.0f), glm::vec3(0.01f, 0.01f, 0.01f));
-
-
-        coruscantGO.localMatrix = glm::rotate(glm::mat4(1.0f), t * 0.3f, glm::vec3(0.0f, 1.0f, 0.0f)) * glm::translate(glm::mat4(1.0f), glm::vec3(3.0f, 0.0f, 0.0f)) * glm::scale(glm::mat4(1.0f), glm::vec3(0.4f, 0.4f, 0.42f));
-
-        dianaGO.localMatrix = glm::rotate(glm::mat4(1.0f), t * 0.4f, glm::vec3(0.2f, 1.0f, 0.0f)) * glm::translate(glm::mat4(1.0f), glm::vec3(6.0f, 0.0f, 0.0f)) * glm::scale(glm::mat4(1.0f), glm::vec3(0.2f, 0.2f, 0.2f));
-
-        anubisGO.localMatrix = glm::rotate(glm::mat4(1.0f), t * 0.6f, glm::vec3(0.4f, 1.0f, 0.0f)) * glm::translate(glm::mat4(1.0f), glm::vec3(9.0f, 0.0f, 0.0f)) * glm::scale(glm::mat4(1.0f), glm::vec3(0.39f, 0.39f, 0.39f));
-
-        lokiGO.localMatrix = glm::rotate(glm::mat4(1.0f), t * 0.3f, glm::vec3(0.0f, 1.0f, 0.0f)) * glm::translate(glm::mat4(1.0f), glm::vec3(7.0f, 0.0f, 0.0f)) * glm::scale(glm::mat4(1.0f), glm::vec3(0.42f, 0.42f, 0.42f));
-
-
-        narutoGO.localMatrix = glm::rotate(glm::mat4(1.0f), t * 0.3f, glm::vec3(0.0f, 1.0f, 0.0f)) * glm::translate(glm::mat4(1.0f), glm::vec3(0.3f, 0.0f, 0.0f)) * glm::scale(glm::mat4(1.0f), glm::vec3(0.68f, 0.68f, 0.68f));
-
-        isisGO.localMatrix = glm::rotate(glm::mat4(1.0f), t * 0.3f, glm::vec3(0.0f, 1.0f, 0.0f)) * glm::translate(glm::mat4(1.0f), glm::vec3(0.3f, 0.0f, 0.0f)) * glm::scale(glm::mat4(1.0f), glm::vec3(0.68f, 0.68f, 0.68f));
-
-
-
-        lights[0] = sunDeux.localMatrix[3];
-        lights[1] = sunGO.localMatrix[3];
+        //The stars first, numbered by their LightComponent as the shaders expect, then the demo lights
+        pointLights.clear();
+        EntitySystems::gatherLights(entities, cameraWorld, pointLights);
+        lights[0] = pointLights[0].position;
+        lights[1] = pointLights[1].position;
         ; //Warning: We passed from left-handed world coordinate to right-handed world coordinate due to glm::perspective
 
         glm::mat4 mvp = projection * view * model;
-        draw(etoileGO, shader, matrices, cameraPosition, view, projection, lights);
+        if (keyP) {
+            renderPathTraced(rootGO, { &sunGO, &sunDeux }, textureAssets, textureImages, root, view, glm::perspective(45.0f, WIDTH / (float)HEIGHT, CAMERA_NEAR, CAMERA_FAR));
+            keyP = false;
+        }
+        addDemoLights(pointLights, demoLights, lightCounts[lightStep] - 2, cameraWorld);
+
+        //Same order as pointLights, so that the eclipsed light index is valid in the clusters
+        eclipseLights.clear();
+        eclipseLights.push_back({ lights[0], (float)(0.5 * glm::length(glm::dvec3(sunDeux.localMatrix[0]))) });
+        eclipseLights.push_back({ lights[1], (float)(0.5 * glm::length(glm::dvec3(sunGO.localMatrix[0]))) });
+        profiler.begin("Bodies");
+        for (EclipseBody& body : eclipseBodies)
+            body.center -= cameraShift;
+        //The bodies to draw are culled by their collider against the camera-relative frustum
+        glm::vec4 planes[4];
+        frustumPlanes(projection * view, planes);
+        EntitySystems::cull(entities, cameraWorld, planes);
+        EntitySystems::gatherDraws(entities, cameraWorld, bodyDraws);
+        profiler.end();
+
+        //Picking : the ray from the camera through the clicked pixel. Any depth between the near and the far planes gives its direction
+        if (pickX >= 0) {
+            glm::vec4 ndc(2.0f * pickX / WIDTH - 1.0f, 1.0f - 2.0f * pickY / HEIGHT, 0.5f, 1.0f);
+            glm::vec4 point = glm::inverse(projection * view) * ndc;
+            float distance = 0.0f;
+            int32_t picked = bodyIndex.raycast(cameraShift, glm::normalize(glm::vec3(point) / point.w), CAMERA_FAR, &distance);
+            if (picked >= 0)
+                INFO("Picked %s at %.3f\n", bodyObjets[picked]->name != nullptr ? bodyObjets[picked]->name : "a body", distance);
+            pickX = pickY = -1;
+        }
+        eclipses->update(eclipseBodies, eclipseLights);
+        profiler.add("Eclipses", eclipses->getLastUpdateTime());
+
+        if (benchLights)
+            glFinish();
+        uint64_t frameBegin = SDL_GetPerformanceCounter();
+        lightClusters->update(pointLights, view, projection, CAMERA_NEAR, CAMERA_FAR);
+        profiler.add("Light clusters", lightClusters->getLastAssignTime());
+        profiler.begin("Bodies draw");
+        for (const EntitySystems::Draw& body : bodyDraws)
+            drawBody(renderContext, body.model, body.geometry, body.vboID, body.material, body.lit, body.bodyID, cameraPosition, view, projection, lights);
+        profiler.end();
+        if (beltShown) {
+            profiler.begin("Asteroid belt");
+            //The belt is centered on the first star : the camera position in its frame
+            belt->update(t);
+            belt->cull(cameraWorld - glm::dvec3(sunGO.propagatedMatrix[3]), view, projection, t);
+            asteroidRenderer->draw(*belt, TextureMoon, lights[1], view, projection, depthBuffer);
+            profiler.end();
+        }
+        profiler.begin("Sky, rings, atmospheres");
+        if (skybox != nullptr)
+            skybox->draw(view, projection, depthBuffer);
+        drawRings(rootGO, root, t, view, projection, lights, depthBuffer);
+        drawAtmospheres(rootGO, root, cameraPosition, view, projection, lights, depthBuffer);
+        profiler.end();
+        depthBuffer->endFrame();
+        if (profiler.endFrame())
+            INFO("Camera : %u bodies after the broadphase, %u contacts\n", collider.getNbCandidates(), collider.getNbContacts());
+
+        if (benchLights) {
+            glFinish();
+            if (benchFrame >= BENCHMARK_WARMUP_FRAMES) {
+                benchElapsed += SDL_GetPerformanceCounter() - frameBegin;
+                benchAssign += lightClusters->getLastAssignTime();
+            }
+            if (++benchFrame == BENCHMARK_WARMUP_FRAMES + BENCHMARK_FRAMES) {
+                INFO("%4u lights : %7.2f ms/frame, %6.3f ms light assignment, %6u light indices\n", lightCounts[lightStep],
+                     benchElapsed * 1000.0 / SDL_GetPerformanceFrequency() / BENCHMARK_FRAMES, benchAssign / BENCHMARK_FRAMES, lightClusters->getNbIndices());
+                benchFrame = 0;
+                benchElapsed = 0;
+                benchAssign = 0.0;
+                if (++lightStep == nbLightCounts)
+                    isOpened = false;
+            }
+        }
         // draw(sunGO, shader, matrices,cameraPosition, view, projection);
 
 
@@ -975,6 +2292,20 @@ int main(int argc, char* argv[])
           //Display on screen (swap the buffer on screen and the buffer you are drawing on)
         SDL_GL_SwapWindow(window);
 
+        //Once warm, a frame must not take anything from the heap
+        if (testAllocations) {
+            uint64_t frameAllocations = FrameArena::getNbAllocations() - allocationsBegin;
+            if (testFrame % testPhaseFrames >= ALLOCATION_TEST_WARMUP_FRAMES && frameAllocations > 0) {
+                ERROR("Frame %u allocated %llu times\n", testFrame, (unsigned long long)frameAllocations);
+                exitCode = EXIT_FAILURE;
+            }
+            if (++testFrame == ALLOCATION_TEST_PHASES * testPhaseFrames) {
+                if (exitCode == 0)
+                    INFO("No allocation in %u frames, %zu KB of frame arena on the main thread\n", ALLOCATION_TEST_PHASES * ALLOCATION_TEST_FRAMES, FrameArena::local().getCapacity() / 1024);
+                isOpened = false;
+            }
+        }
+
         //Time in ms telling us when this frame ended. Useful for keeping a fix framerate
         uint32_t timeEnd = SDL_GetTicks();
 
@@ -984,7 +2315,24 @@ int main(int argc, char* argv[])
     }
 
     glDeleteBuffers(1, &vboSphereID);
-    delete shader;
+    glDeleteBuffers(1, &vboQuadID);
+    delete shaders;
+    delete impostorShaders;
+    delete proceduralShaders;
+    delete skybox;
+    delete lightClusters;
+    delete eclipses;
+    delete earthAtmosphere;
+    delete hazeAtmosphere;
+    for (PlanetRings* rings : planetRings)
+        delete rings;
+    delete depthBuffer;
+    delete ephemeris;
+    delete belt;
+    delete asteroidRenderer;
+    for (auto& image : textureImages)
+        delete image.second;
+    delete scene;
 
     //Free everything
     if (context != NULL)
@@ -992,5 +2340,5 @@ int main(int argc, char* argv[])
     if (window != NULL)
         SDL_DestroyWindow(window);
 
-    return 0;
+    return exitCode;
 }
\ No newline at end of file